@@ -211,6 +211,17 @@
 #endif
 
 
+/**
+ * Macro PJ_SCANNER_USE_SIMD is defined and non-zero (by default yes) will
+ * enable the use of SSE2 instructions to search for the end of line in
+ * the scanner (see #pj_scan_find_newline()), when the compiler targets
+ * SSE2. Otherwise the characters are checked one at a time.
+ */
+#ifndef PJ_SCANNER_USE_SIMD
+#  define PJ_SCANNER_USE_SIMD			    1
+#endif
+
+
 
 /* **************************************************************************
  * STUN CLIENT CONFIGURATION
@@ -430,6 +430,30 @@ PJ_DECL(void) pj_scan_get_until_ch( pj_scanner *scanner,
 PJ_DECL(void) pj_scan_get_until_chr( pj_scanner *scanner,
 				     const char *until_spec, pj_str_t *out);
 
+/** 
+ * Get characters from the scanner and move the scanner position until the
+ * end of the current line, i.e. until CR, LF, NULL character, or the end
+ * of the input. Unlike #pj_scan_get(), this function never throws syntax
+ * error, and the result may be an empty string.
+ *
+ * @param scanner	The scanner.
+ * @param out		String to store the result.
+ */
+PJ_DECL(void) pj_scan_get_until_newline( pj_scanner *scanner, pj_str_t *out);
+
+/**
+ * Find the first CR, LF, or NULL character in the buffer. This uses SSE2
+ * instructions when #PJ_SCANNER_USE_SIMD is enabled, to check sixteen
+ * characters at a time. This function does not throw exception.
+ *
+ * @param start		Start of the buffer.
+ * @param end		End of the buffer.
+ *
+ * @return		Position of the character, or \a end if it is not
+ *			found in the buffer.
+ */
+PJ_DECL(char*) pj_scan_find_newline( const char *start, const char *end );
+
 /** 
  * Advance the scanner N characters, and skip whitespace
  * if necessary.
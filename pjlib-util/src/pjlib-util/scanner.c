@@ -37,6 +37,14 @@
 #  include "scanner_cis_uint.c"
 #endif
 
+#if defined(PJ_SCANNER_USE_SIMD) && PJ_SCANNER_USE_SIMD != 0 && \
+    defined(__SSE2__) && defined(__GNUC__)
+#  include <emmintrin.h>
+#  define SCAN_USE_SSE2		1
+#else
+#  define SCAN_USE_SSE2		0
+#endif
+
 
 static void pj_scan_syntax_err(pj_scanner *scanner)
 {
@@ -567,6 +575,64 @@ PJ_DEF(void) pj_scan_get_until_chr( pj_scanner *scanner,
     }
 }
 
+PJ_DEF(char*) pj_scan_find_newline( const char *start, const char *end )
+{
+#if SCAN_USE_SSE2
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i nul = _mm_setzero_si128();
+    const char *p;
+    unsigned mask;
+
+    if (start >= end)
+	return (char*)end;
+
+    /* Use aligned loads, which never cross a page boundary, so reading
+     * past the end of the buffer within the last block is safe. The
+     * bytes before the start in the first block are masked out.
+     */
+    p = (const char*)((pj_size_t)start & ~(pj_size_t)15);
+    for (;;) {
+	__m128i v = _mm_load_si128((const __m128i*)p);
+	__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+					      _mm_cmpeq_epi8(v, lf)),
+				 _mm_cmpeq_epi8(v, nul));
+
+	mask = (unsigned)_mm_movemask_epi8(m);
+	if (p < start)
+	    mask &= 0xFFFFU << (start - p);
+
+	if (mask) {
+	    p += __builtin_ctz(mask);
+	    return (char*)(p < end ? p : end);
+	}
+
+	p += 16;
+	if (p >= end)
+	    return (char*)end;
+    }
+#else
+    while (start < end && *start && !PJ_SCAN_IS_NEWLINE(*start))
+	++start;
+    return (char*)(start < end ? start : end);
+#endif
+}
+
+PJ_DEF(void) pj_scan_get_until_newline( pj_scanner *scanner, pj_str_t *out)
+{
+    register char *s;
+
+    s = pj_scan_find_newline(scanner->curptr, scanner->end);
+
+    pj_strset3(out, scanner->curptr, s);
+
+    scanner->curptr = s;
+
+    if (PJ_SCAN_IS_PROBABLY_SPACE(*s) && scanner->skip_ws) {
+	pj_scan_skip_whitespace(scanner);
+    }
+}
+
 PJ_DEF(void) pj_scan_advance_n( pj_scanner *scanner,
 				 unsigned N, pj_bool_t skip_ws)
 {
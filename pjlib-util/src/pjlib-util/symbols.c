@@ -52,6 +52,8 @@ PJ_EXPORT_SYMBOL(pj_scan_get_newline)
 PJ_EXPORT_SYMBOL(pj_scan_get_until)
 PJ_EXPORT_SYMBOL(pj_scan_get_until_ch)
 PJ_EXPORT_SYMBOL(pj_scan_get_until_chr)
+PJ_EXPORT_SYMBOL(pj_scan_get_until_newline)
+PJ_EXPORT_SYMBOL(pj_scan_find_newline)
 PJ_EXPORT_SYMBOL(pj_scan_advance_n)
 PJ_EXPORT_SYMBOL(pj_scan_strcmp)
 PJ_EXPORT_SYMBOL(pj_scan_stricmp)
@@ -189,6 +189,32 @@ typedef struct pj_activesock_cb
     pj_bool_t (*on_connect_complete)(pj_activesock_t *asock,
 				     pj_status_t status);
 
+    /**
+     * This callback is called when a batch of packets arrives as the
+     * result of pj_activesock_start_recvmmsg(). If this callback is not
+     * set, the packets will be reported one by one to \a on_data_recvfrom()
+     * instead.
+     *
+     * @param asock	The active socket.
+     * @param msgs	Array of received packets. Each descriptor contains
+     *			the packet buffer, the length of the packet and the
+     *			source address. The descriptors and the buffers are
+     *			owned by the active socket and are only valid for
+     *			the duration of the callback. If the status argument
+     *			is non-PJ_SUCCESS, this argument will be set to NULL.
+     * @param count	Number of packets in the array.
+     * @param status	The status of the read operation.
+     *
+     * @return		PJ_TRUE if further read is desired, and PJ_FALSE 
+     *			when application no longer wants to receive data.
+     *			Application may destroy the active socket in the
+     *			callback and return PJ_FALSE here.
+     */
+    pj_bool_t (*on_data_recvfrom_batch)(pj_activesock_t *asock,
+					pj_sock_msg msgs[],
+					unsigned count,
+					pj_status_t status);
+
 } pj_activesock_cb;
 
 
@@ -477,6 +503,32 @@ PJ_DECL(pj_status_t) pj_activesock_start_recvfrom2(pj_activesock_t *asock,
 						   void *readbuf[],
 						   pj_uint32_t flags);
 
+/**
+ * Same as #pj_activesock_start_recvfrom(), except that multiple packets
+ * may be read with a single system call (recvmmsg() where available),
+ * reducing the per-packet overhead on busy datagram sockets. Received
+ * packets are reported with \a on_data_recvfrom_batch() callback.
+ *
+ * @param asock	    The active socket.
+ * @param pool	    Pool used to allocate buffers for incoming data.
+ * @param buff_size The size of each buffer, in bytes.
+ * @param batch_cnt Maximum number of packets to be read at once, for
+ *		    each of the asynchronous operations of the socket.
+ *		    This is capped to PJ_SOCK_MAX_MMSG.
+ * @param flags	    Flags to be given to pj_ioqueue_recvmmsg().
+ *
+ * @return	    PJ_SUCCESS if the operation has been successful,
+ *		    PJ_ENOTSUP if the ioqueue backend does not support
+ *		    batched receive (application may then use
+ *		    #pj_activesock_start_recvfrom() instead), or the
+ *		    appropriate error code on failure.
+ */
+PJ_DECL(pj_status_t) pj_activesock_start_recvmmsg(pj_activesock_t *asock,
+						  pj_pool_t *pool,
+						  unsigned buff_size,
+						  unsigned batch_cnt,
+						  pj_uint32_t flags);
+
 /**
  * Send data using the socket.
  *
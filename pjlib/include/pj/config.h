@@ -466,6 +466,30 @@
 #endif
 
 
+/**
+ * Maximum number of free pools of each size that the caching pool keeps
+ * in a per-thread cache. Pools are created from and released to the
+ * calling thread's cache without taking the caching pool's mutex, and
+ * the mutex is only taken to move half of the cache from or to the shared
+ * free list when the thread cache is empty or full.
+ *
+ * Pools that go through the thread cache are not kept in the caching
+ * pool's list of used pools, so they are not shown in the detailed dump
+ * and they will not be released by pj_caching_pool_destroy() if the
+ * application forgets to release them. The memory held by the thread
+ * caches is not counted against the caching pool's maximum capacity.
+ *
+ * Set to zero to disable the thread cache. The thread cache is also
+ * disabled when PJ_SAFE_POOL is enabled, or when the compiler does not
+ * provide atomic builtins.
+ *
+ * Default: 4
+ */
+#ifndef PJ_CACHING_POOL_THREAD_CACHE_CNT
+#   define PJ_CACHING_POOL_THREAD_CACHE_CNT	4
+#endif
+
+
 /**
  * If pool debugging is used, then each memory allocation from the pool
  * will call malloc(), and pool will release all memory chunks when it
@@ -492,6 +516,18 @@
 #endif
 
 
+/**
+ * Default resolution of the timing wheel timer heap, in milliseconds.
+ * See #PJ_TIMER_HEAP_TYPE_WHEEL for more info. The value must divide
+ * 1000 evenly.
+ *
+ * Default: 10
+ */
+#ifndef PJ_TIMER_WHEEL_RESOLUTION
+#  define PJ_TIMER_WHEEL_RESOLUTION 10
+#endif
+
+
 /**
  * Set this to 1 to enable debugging on the group lock. Default: 0
  */
@@ -573,6 +609,40 @@
 #   define PJ_ACTIVESOCK_MAX_CONSECUTIVE_ACCEPT_ERROR 50
 #endif
 
+/**
+ * Maximum number of datagrams that can be exchanged with a single
+ * pj_sock_recvmmsg() or pj_sock_sendmmsg() call. This is also the upper
+ * bound of the batch size for pj_activesock_start_recvmmsg(). Note that
+ * the value here affects the stack usage of those functions.
+ *
+ * Default: 32
+ */
+#ifndef PJ_SOCK_MAX_MMSG
+#   define PJ_SOCK_MAX_MMSG	    32
+#endif
+
+/**
+ * Default number of objects in each magazine of the object pool (see
+ * pj_objpool_create()). Each thread keeps up to two magazines, so this
+ * also bounds the number of free objects that are cached by a thread.
+ *
+ * Default: 16
+ */
+#ifndef PJ_OBJPOOL_MAG_SIZE
+#   define PJ_OBJPOOL_MAG_SIZE	    16
+#endif
+
+/**
+ * Number of lock-free slots in the global depot of the object pool. The
+ * depot holds the magazines exchanged between threads; when the slots
+ * are exhausted, magazines are kept in a list protected by a mutex.
+ *
+ * Default: 64
+ */
+#ifndef PJ_OBJPOOL_DEPOT_SIZE
+#   define PJ_OBJPOOL_DEPOT_SIZE    64
+#endif
+
 /**
  * Constants for declaring the maximum handles that can be supported by
  * a single IOQ framework. This constant might not be relevant to the 
@@ -646,6 +716,43 @@
 #endif
 
 
+/**
+ * Number of submission queue entries of the io_uring instance created
+ * by the io_uring ioqueue backend. The completion queue is four times
+ * this size.
+ *
+ * Default: 256
+ */
+#ifndef PJ_IOQUEUE_URING_ENTRIES
+#   define PJ_IOQUEUE_URING_ENTRIES	256
+#endif
+
+
+/**
+ * Number of receive buffers registered to the kernel by the io_uring
+ * ioqueue backend. The buffers are shared by all sockets in the ioqueue.
+ * The value must be a power of two.
+ *
+ * Default: 256
+ */
+#ifndef PJ_IOQUEUE_URING_BUF_COUNT
+#   define PJ_IOQUEUE_URING_BUF_COUNT	256
+#endif
+
+
+/**
+ * Size of each receive buffer of the io_uring ioqueue backend. This
+ * includes some space for the source address of datagrams, and should
+ * be large enough to hold the largest datagram expected by application,
+ * since datagrams larger than this will be truncated.
+ *
+ * Default: 4096 + 64
+ */
+#ifndef PJ_IOQUEUE_URING_BUF_SIZE
+#   define PJ_IOQUEUE_URING_BUF_SIZE	(4096 + 64)
+#endif
+
+
 /**
  * Determine if FD_SETSIZE is changeable/set-able. If so, then we will
  * set it to PJ_IOQUEUE_MAX_HANDLES. Currently we detect this by checking
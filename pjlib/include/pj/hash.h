@@ -37,6 +37,13 @@ PJ_BEGIN_DECL
  * hash functions. Having the keys of more than one item map to the same 
  * position is called a collision. In this library, we will chain the nodes
  * that have the same key in a list.
+ *
+ * Alternatively, the hash table can be created with #pj_hash_create2() and
+ * #PJ_HASH_OPEN_ADDRESSING flag. Such table keeps the entries in an array
+ * (using Robin Hood open addressing) and grows incrementally as entries
+ * are added, so lookups don't degrade to long chains when the table holds
+ * many more entries than the size specified at creation. Both kinds of
+ * hash table are accessed with the same API.
  */
 
 /**
@@ -96,6 +103,47 @@ PJ_DECL(pj_uint32_t) pj_hash_calc_tolower(pj_uint32_t hval,
 PJ_DECL(pj_hash_table_t*) pj_hash_create(pj_pool_t *pool, unsigned size);
 
 
+/**
+ * Flags to be specified when creating the hash table with
+ * #pj_hash_create2().
+ */
+typedef enum pj_hash_flag
+{
+    /**
+     * Use open addressing instead of chaining. The hash value, the key
+     * pointer and the value of the entries are stored inline in an array,
+     * and when the load factor gets too high a new array twice as large
+     * is allocated and the entries are moved to it a few at a time on
+     * subsequent insertions. The arrays are allocated from the pool that
+     * was used to create the hash table, so that pool must remain valid
+     * for the lifetime of the hash table.
+     *
+     * The entry buffer passed to #pj_hash_set_np() is not used by this
+     * kind of hash table. As with the chained hash table, it is safe to
+     * delete the current entry while iterating the hash table, but adding
+     * new entries while iterating is not supported.
+     */
+    PJ_HASH_OPEN_ADDRESSING = 1
+
+} pj_hash_flag;
+
+
+/**
+ * Create a hash table with the specified size and flags.
+ *
+ * @param pool	the pool from which the hash table will be allocated from.
+ * @param size	the bucket size, or the initial capacity for open
+ *		addressing hash table, which will be round-up to the
+ *		nearest 2^n-1
+ * @param flags	bitmask combination of #pj_hash_flag. Zero creates the
+ *		same hash table as #pj_hash_create().
+ *
+ * @return the hash table.
+ */
+PJ_DECL(pj_hash_table_t*) pj_hash_create2(pj_pool_t *pool, unsigned size,
+					  unsigned flags);
+
+
 /**
  * Get the value associated with the specified key.
  *
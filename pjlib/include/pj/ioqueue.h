@@ -27,6 +27,7 @@
  */
 
 #include <pj/types.h>
+#include <pj/sock.h>
 
 PJ_BEGIN_DECL
 
@@ -288,8 +289,10 @@ typedef enum pj_ioqueue_operation_e
     PJ_IOQUEUE_OP_SEND_TO	= 32,	/**< sendto() operation.    */
 #if defined(PJ_HAS_TCP) && PJ_HAS_TCP != 0
     PJ_IOQUEUE_OP_ACCEPT	= 64,	/**< accept() operation.    */
-    PJ_IOQUEUE_OP_CONNECT	= 128	/**< connect() operation.   */
+    PJ_IOQUEUE_OP_CONNECT	= 128,	/**< connect() operation.   */
 #endif	/* PJ_HAS_TCP */
+    PJ_IOQUEUE_OP_RECVMMSG	= 256,	/**< recvmmsg() operation.  */
+    PJ_IOQUEUE_OP_SENDMMSG	= 512	/**< sendmmsg() operation.  */
 } pj_ioqueue_operation_e;
 
 
@@ -309,6 +312,82 @@ typedef enum pj_ioqueue_operation_e
  */
 #define PJ_IOQUEUE_ALWAYS_ASYNC	    ((pj_uint32_t)1 << (pj_uint32_t)31)
 
+/**
+ * Epoll flags, to control how the epoll based ioqueue registers sockets
+ * to the epoll set. These flags are only used by the epoll backend and
+ * are ignored by other ioqueue implementations.
+ */
+typedef enum pj_ioqueue_epoll_flag
+{
+    /**
+     * Use EPOLLEXCLUSIVE when registering sockets (Linux 4.5 and later).
+     * Note that the kernel only applies the exclusive wakeup between
+     * different epoll sets watching the same socket. The ioqueue uses a
+     * single epoll set that is shared by all polling threads, so this
+     * flag does not prevent several of them from being woken up for the
+     * same event, nor the same key from being dispatched concurrently.
+     * Use PJ_IOQUEUE_EPOLL_ONESHOT for that. If the kernel does not
+     * support it, the ioqueue will fall back to PJ_IOQUEUE_EPOLL_ONESHOT.
+     */
+    PJ_IOQUEUE_EPOLL_EXCLUSIVE	= 1,
+
+    /**
+     * Use EPOLLONESHOT when registering sockets. An event on a socket is
+     * reported to one polling thread only, and the socket is re-armed
+     * after the event has been dispatched. This guarantees that a single
+     * key is never dispatched by more than one thread at a time. When
+     * both flags are specified, this flag takes precedence.
+     */
+    PJ_IOQUEUE_EPOLL_ONESHOT	= 2
+
+} pj_ioqueue_epoll_flag;
+
+
+/**
+ * Default epoll flags to be used by the epoll ioqueue, which is a bitmask
+ * combination of #pj_ioqueue_epoll_flag. The default is zero, which means
+ * sockets are registered with plain level-triggered events and every
+ * polling thread may be woken up for the same event.
+ */
+#ifndef PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS
+#   define PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS	0
+#endif
+
+
+/**
+ * Additional settings that can be given when creating the ioqueue with
+ * #pj_ioqueue_create2(). Application must initialize this structure with
+ * #pj_ioqueue_cfg_default().
+ */
+typedef struct pj_ioqueue_cfg
+{
+    /**
+     * Bitmask combination of #pj_ioqueue_epoll_flag, only used by the
+     * epoll backend.
+     *
+     * Default: PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS
+     */
+    unsigned		epoll_flags;
+
+    /**
+     * Default concurrency setting for keys registered to this ioqueue.
+     * See #pj_ioqueue_set_default_concurrency() for more info.
+     *
+     * Default: PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY
+     */
+    pj_bool_t		default_concurrency;
+
+} pj_ioqueue_cfg;
+
+
+/**
+ * Initialize the ioqueue settings with the default values.
+ *
+ * @param cfg		The settings to be initialized.
+ */
+PJ_DECL(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg);
+
+
 /**
  * Return the name of the ioqueue implementation.
  *
@@ -331,6 +410,23 @@ PJ_DECL(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
 					pj_size_t max_fd,
 					pj_ioqueue_t **ioqueue);
 
+/**
+ * Create a new I/O Queue framework with the specified settings.
+ *
+ * @param pool		The pool to allocate the I/O queue structure. 
+ * @param max_fd	The maximum number of handles to be supported, which 
+ *			should not exceed PJ_IOQUEUE_MAX_HANDLES.
+ * @param cfg		Optional ioqueue settings, or NULL to use the
+ *			default settings.
+ * @param ioqueue	Pointer to hold the newly created I/O Queue.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool, 
+					pj_size_t max_fd,
+					const pj_ioqueue_cfg *cfg,
+					pj_ioqueue_t **ioqueue);
+
 /**
  * Destroy the I/O queue.
  *
@@ -808,6 +904,84 @@ PJ_DECL(pj_status_t) pj_ioqueue_sendto( pj_ioqueue_key_t *key,
 					int addrlen);
 
 
+/**
+ * Start batched receive of datagrams from the socket. This behaves like
+ * #pj_ioqueue_recvfrom(), except that multiple datagrams may be received
+ * with a single system call (recvmmsg() where available). When the
+ * operation completes asynchronously, the \a bytes_read argument of the
+ * \a on_read_complete() callback contains the number of datagrams
+ * received into \a msgs (or negative error code), rather than number of
+ * bytes.
+ *
+ * @param key	    The key that uniquely identifies the handle.
+ * @param op_key    An operation specific key to be associated with the
+ *                  pending operation, so that application can keep track of
+ *                  which operation has been completed when the callback is
+ *                  called.
+ * @param msgs	    Array of message descriptors, which buffers, buffer
+ *		    lengths and address lengths must be initialized by the
+ *		    caller. The caller MUST make sure that the array and the
+ *		    buffers remain valid until the operation completes. On
+ *		    completion, the length and the source address of each
+ *		    received datagram are filled into the descriptors.
+ * @param count	    On input, the number of descriptors in \a msgs (capped
+ *		    to PJ_SOCK_MAX_MMSG). If data is available immediately,
+ *		    the function returns PJ_SUCCESS and this will be filled
+ *		    with the number of datagrams received. This parameter
+ *		    can point to local variable in caller's stack.
+ * @param flags     Recv flag. If flags has PJ_IOQUEUE_ALWAYS_ASYNC then
+ *		    the function will never return PJ_SUCCESS.
+ *
+ * @return
+ *  - PJ_SUCCESS    If immediate data has been received. In this case, the
+ *		    callback WILL NOT be called.
+ *  - PJ_EPENDING   If the operation has been queued, and the callback will be
+ *                  called when data has been received.
+ *  - PJ_ENOTSUP    If the ioqueue backend does not support batched receive.
+ *  - non-zero      The return value indicates the error code.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_recvmmsg( pj_ioqueue_key_t *key,
+                                          pj_ioqueue_op_key_t *op_key,
+					  pj_sock_msg msgs[],
+					  unsigned *count,
+					  pj_uint32_t flags);
+
+/**
+ * Send multiple datagrams with a single system call (sendmmsg() where
+ * available). Datagrams that can not be sent immediately are queued, and
+ * the \a bytes_sent argument of the \a on_write_complete() callback will
+ * contain the total number of datagrams of the batch that have been sent
+ * (or negative error code), rather than number of bytes.
+ *
+ * @param key	    the key that identifies the handle.
+ * @param op_key    An operation specific key to be associated with the
+ *                  pending operation, so that application can keep track of
+ *                  which operation has been completed when the callback is
+ *                  called.
+ * @param msgs	    Array of datagrams to send. Each descriptor contains
+ *		    the destination address, or zero \a addr_len to send to
+ *		    the connected peer. Caller MUST make sure that the array
+ *		    and the buffers remain valid until the operation
+ *		    completes.
+ * @param count	    On input, the number of datagrams in \a msgs (capped to
+ *		    PJ_SOCK_MAX_MMSG). When all datagrams were sent
+ *		    immediately, this function returns PJ_SUCCESS and this
+ *		    parameter contains the number of datagrams sent.
+ * @param flags     send flags.
+ *
+ * @return
+ *  - PJ_SUCCESS    If all datagrams were immediately sent.
+ *  - PJ_EPENDING   If some datagrams have been queued.
+ *  - PJ_ENOTSUP    If the ioqueue backend does not support batched send.
+ *  - non-zero      The return value indicates the error code.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_sendmmsg( pj_ioqueue_key_t *key,
+                                          pj_ioqueue_op_key_t *op_key,
+					  pj_sock_msg msgs[],
+					  unsigned *count,
+					  pj_uint32_t flags);
+
+
 /**
  * !}
  */
@@ -0,0 +1,152 @@
+/* $Id$ */
+/* 
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
+ */
+#ifndef __PJ_OBJPOOL_H__
+#define __PJ_OBJPOOL_H__
+
+/**
+ * @file objpool.h
+ * @brief Fixed-size object pool.
+ */
+#include <pj/pool.h>
+
+PJ_BEGIN_DECL
+
+/**
+ * @defgroup PJ_OBJPOOL Fixed-Size Object Pool
+ * @ingroup PJ_POOL_GROUP
+ * @brief Recycle fixed-size objects without going through the pool factory.
+ *
+ * Memory pool (#pj_pool_t) can only be freed as a whole, so objects with
+ * short lifetime that are created and destroyed at high rate (such as
+ * transactions or transmit buffers) normally each need their own pool.
+ * The object pool provides individual allocation and deallocation of
+ * objects of one fixed size.
+ *
+ * Free objects are kept in per-thread magazines (small arrays of object
+ * pointers), so most allocations and deallocations do not need any
+ * synchronization at all. When a thread runs out of objects, or has
+ * too many of them, it exchanges a whole magazine with the global depot,
+ * which is lock-free when atomic operations are available. The memory
+ * for the objects is allocated from a memory pool owned by the object
+ * pool, in chunks of one magazine worth of objects, and is only returned
+ * to the pool factory when the object pool is destroyed.
+ *
+ * Note that objects cached by a thread that has exited are not reused
+ * until the object pool is destroyed; at most two magazines worth of
+ * objects per thread can be held this way.
+ *
+ * The object pool may be destroyed while some of its objects are still
+ * in use. The destruction is then deferred until the last of these
+ * objects is freed.
+ *
+ * @{
+ */
+
+/**
+ * Opaque declaration of object pool.
+ */
+typedef struct pj_objpool_t pj_objpool_t;
+
+
+/**
+ * Create the object pool.
+ *
+ * @param factory	The pool factory to allocate memory from.
+ * @param name		Optional name for the object pool, for logging.
+ * @param obj_size	The size of each object.
+ * @param mag_size	Number of objects in each magazine. If zero,
+ *			PJ_OBJPOOL_MAG_SIZE will be used.
+ * @param p_objpool	Pointer to receive the object pool.
+ *
+ * @return		PJ_SUCCESS on success, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_objpool_create(pj_pool_factory *factory,
+				       const char *name,
+				       pj_size_t obj_size,
+				       unsigned mag_size,
+				       pj_objpool_t **p_objpool);
+
+/**
+ * Destroy the object pool and release all memory. If some objects are
+ * still allocated, the destruction is deferred until all of them have
+ * been freed with #pj_objpool_free(), so that objects with longer
+ * lifetime than their owner can still be freed safely. The object pool
+ * must not be used to allocate objects after this function is called.
+ *
+ * @param objpool	The object pool.
+ */
+PJ_DECL(void) pj_objpool_destroy(pj_objpool_t *objpool);
+
+/**
+ * Allocate an object from the object pool. The content of the object is
+ * not initialized.
+ *
+ * @param objpool	The object pool.
+ *
+ * @return		The object, or NULL if memory is exhausted.
+ */
+PJ_DECL(void*) pj_objpool_alloc(pj_objpool_t *objpool);
+
+/**
+ * Allocate an object from the object pool and initialize its content to
+ * zero.
+ *
+ * @param objpool	The object pool.
+ *
+ * @return		The object, or NULL if memory is exhausted.
+ */
+PJ_DECL(void*) pj_objpool_zalloc(pj_objpool_t *objpool);
+
+/**
+ * Return an object to the object pool. The object must have been
+ * allocated from the same object pool, but it may be freed by any
+ * thread.
+ *
+ * @param objpool	The object pool.
+ * @param obj		The object.
+ */
+PJ_DECL(void) pj_objpool_free(pj_objpool_t *objpool, void *obj);
+
+/**
+ * Get the object size of the object pool.
+ *
+ * @param objpool	The object pool.
+ *
+ * @return		The object size, as specified on creation.
+ */
+PJ_DECL(pj_size_t) pj_objpool_get_obj_size(const pj_objpool_t *objpool);
+
+/**
+ * Get the total number of objects that have been created by the object
+ * pool, i.e. both the objects in use and the free ones.
+ *
+ * @param objpool	The object pool.
+ *
+ * @return		Number of objects.
+ */
+PJ_DECL(unsigned) pj_objpool_get_capacity(pj_objpool_t *objpool);
+
+/**
+ * @}
+ */
+
+PJ_END_DECL
+
+#endif	/* __PJ_OBJPOOL_H__ */
@@ -862,6 +862,17 @@ struct pj_caching_pool
      * Mutex.
      */
     pj_lock_t	   *lock;
+
+    /**
+     * Thread local storage index of the per-thread pool caches, or -1 if
+     * the thread cache is not used (see PJ_CACHING_POOL_THREAD_CACHE_CNT).
+     */
+    long	    tls_id;
+
+    /**
+     * List of the per-thread pool caches.
+     */
+    pj_list	    thread_cache_list;
 };
 
 
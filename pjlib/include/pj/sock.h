@@ -297,6 +297,12 @@ extern const pj_uint16_t PJ_TCP_NODELAY;
  *  @see pj_SO_REUSEADDR */
 extern const pj_uint16_t PJ_SO_REUSEADDR;
 
+/** Allows multiple sockets to be bound to the same address, with the
+ *  incoming packets distributed among them by the kernel. The value is
+ *  0xFFFF when the option is not supported by the platform.
+ *  @see pj_SO_REUSEPORT */
+extern const pj_uint16_t PJ_SO_REUSEPORT;
+
 /** Do not generate SIGPIPE. @see pj_SO_NOSIGPIPE */
 extern const pj_uint16_t PJ_SO_NOSIGPIPE;
 
@@ -336,6 +342,9 @@ extern const pj_uint16_t PJ_IP_DROP_MEMBERSHIP;
     /** Get #PJ_SO_REUSEADDR constant */
     PJ_DECL(pj_uint16_t) pj_SO_REUSEADDR(void);
 
+    /** Get #PJ_SO_REUSEPORT constant */
+    PJ_DECL(pj_uint16_t) pj_SO_REUSEPORT(void);
+
     /** Get #PJ_SO_NOSIGPIPE constant */
     PJ_DECL(pj_uint16_t) pj_SO_NOSIGPIPE(void);
 
@@ -372,6 +381,9 @@ extern const pj_uint16_t PJ_IP_DROP_MEMBERSHIP;
     /** Get #PJ_SO_REUSEADDR constant */
 #   define pj_SO_REUSEADDR() PJ_SO_REUSEADDR
 
+    /** Get #PJ_SO_REUSEPORT constant */
+#   define pj_SO_REUSEPORT() PJ_SO_REUSEPORT
+
     /** Get #PJ_SO_NOSIGPIPE constant */
 #   define pj_SO_NOSIGPIPE() PJ_SO_NOSIGPIPE
 
@@ -617,6 +629,32 @@ typedef struct pj_ip_mreq {
 } pj_ip_mreq;
 
 
+/**
+ * This structure describes one datagram in a batch for pj_sock_recvmmsg()
+ * and pj_sock_sendmmsg().
+ */
+typedef struct pj_sock_msg
+{
+    /** The buffer to receive the datagram into, or the datagram to send. */
+    void	   *buf;
+
+    /** On input, the size of the buffer (for receiving) or the length of
+     *  the datagram (for sending). On return, the number of bytes
+     *  received or sent. */
+    pj_ssize_t	    len;
+
+    /** The source address of received datagram, or the destination
+     *  address of the datagram to send. */
+    pj_sockaddr	    addr;
+
+    /** The length of the address. For receiving, this must be initialized
+     *  to the size of the address storage. For sending, zero means the
+     *  datagram is sent to the connected peer. */
+    int		    addr_len;
+
+} pj_sock_msg;
+
+
 /*****************************************************************************
  *
  * SOCKET ADDRESS MANIPULATION.
@@ -1404,6 +1442,51 @@ PJ_DECL(pj_status_t) pj_sock_sendto(pj_sock_t sockfd,
 				    const pj_sockaddr_t *to,
 				    int tolen);
 
+/**
+ * Receive multiple datagrams from the socket with a single call. On
+ * platforms that support it this maps to recvmmsg(), otherwise it falls
+ * back to calling pj_sock_recvfrom() repeatedly until the socket has no
+ * more data. On a blocking socket, the function only blocks until the
+ * first datagram arrives (MSG_WAITFORONE), then returns it together with
+ * the datagrams that are already queued.
+ *
+ * @param sockfd	The socket descriptor.
+ * @param msgs		Array of message descriptors. On return, the first
+ *			\a count entries are filled with the received
+ *			datagrams.
+ * @param count		On input, the number of entries in \a msgs (capped
+ *			to PJ_SOCK_MAX_MMSG). On return, the number of
+ *			datagrams received.
+ * @param flags		Flags (such as pj_MSG_PEEK()).
+ *
+ * @return		PJ_SUCCESS if at least one datagram was received,
+ *			or the error code.
+ */
+PJ_DECL(pj_status_t) pj_sock_recvmmsg(pj_sock_t sockfd,
+				      pj_sock_msg msgs[],
+				      unsigned *count,
+				      unsigned flags);
+
+/**
+ * Transmit multiple datagrams with a single call. On platforms that
+ * support it this maps to sendmmsg(), otherwise it falls back to calling
+ * pj_sock_sendto() for each datagram.
+ *
+ * @param sockfd	The socket descriptor.
+ * @param msgs		Array of datagrams to send.
+ * @param count		On input, the number of entries in \a msgs (capped
+ *			to PJ_SOCK_MAX_MMSG). On return, the number of
+ *			datagrams sent, which may be less than requested.
+ * @param flags		Flags (such as pj_MSG_DONTROUTE()).
+ *
+ * @return		PJ_SUCCESS if at least one datagram was sent,
+ *			or the error code.
+ */
+PJ_DECL(pj_status_t) pj_sock_sendmmsg(pj_sock_t sockfd,
+				      pj_sock_msg msgs[],
+				      unsigned *count,
+				      unsigned flags);
+
 #if PJ_HAS_TCP
 /**
  * The shutdown call causes all or part of a full-duplex connection on the
@@ -47,6 +47,11 @@ PJ_BEGIN_DECL
  *      dynamic memory allocation, which is important for real-time
  *      systems.
  *
+ * Alternatively, a hierarchical timing wheel implementation can be
+ * selected when the timer heap is created with #pj_timer_heap_create2().
+ * The timing wheel schedules and cancels timers in O(1), at the cost of
+ * rounding the expiration up to the wheel resolution.
+ *
  * You can find the fine ACE library at:
  *  http://www.cs.wustl.edu/~schmidt/ACE.html
  *
@@ -125,6 +130,12 @@ typedef struct pj_timer_entry
      */
     pj_grp_lock_t *_grp_lock;
 
+    /**
+     * Internal: the timer heap (or the shard of a sharded timer heap)
+     * where this entry was last scheduled.
+     */
+    pj_timer_heap_t *_timer_heap;
+
 #if PJ_TIMER_DEBUG
     const char	*src_file;
     int		 src_line;
@@ -132,6 +143,93 @@ typedef struct pj_timer_entry
 } pj_timer_entry;
 
 
+/**
+ * Timer heap implementation types. The type is specified in
+ * #pj_timer_heap_param when the timer heap is created with
+ * #pj_timer_heap_create2(), and all timer heap functions work the
+ * same way regardless of the type.
+ */
+typedef enum pj_timer_heap_type
+{
+    /**
+     * Binary heap of absolute times. Scheduling, canceling, and expiring
+     * timers is O(log N), and timers expire with full time precision.
+     * This is the type used by #pj_timer_heap_create().
+     */
+    PJ_TIMER_HEAP_TYPE_HEAP,
+
+    /**
+     * Hierarchical timing wheel. Scheduling and canceling timers is O(1),
+     * and expiring timers is O(1) amortized, which makes it suitable for
+     * applications with very large number of timers (such as SIP proxies
+     * with many active transactions). The expiration is rounded up to the
+     * wheel resolution, so a timer may fire up to one resolution later
+     * than requested, but never earlier.
+     */
+    PJ_TIMER_HEAP_TYPE_WHEEL
+
+} pj_timer_heap_type;
+
+
+/**
+ * Timer heap creation parameters, to be specified when calling
+ * #pj_timer_heap_create2(). Application must initialize this structure
+ * with #pj_timer_heap_param_default().
+ */
+typedef struct pj_timer_heap_param
+{
+    /**
+     * The timer heap implementation type.
+     *
+     * Default: PJ_TIMER_HEAP_TYPE_HEAP
+     */
+    pj_timer_heap_type type;
+
+    /**
+     * The duration of one tick of the timing wheel, in milliseconds. This
+     * is only used when the type is PJ_TIMER_HEAP_TYPE_WHEEL, and the value
+     * must divide 1000 evenly (for example 1, 5, 10, 20, 50, or 100).
+     *
+     * Default: PJ_TIMER_WHEEL_RESOLUTION
+     */
+    unsigned wheel_resolution;
+
+    /**
+     * Number of shards. When this is greater than one, the timer heap is
+     * split into this many sub-heaps, each with its own lock. Each thread
+     * using the timer heap is assigned a home shard. Entries with a group
+     * lock are assigned to a shard by their group lock, so that all timers
+     * of one object live in the same shard, and the other entries go to
+     * the home shard of the thread scheduling them. #pj_timer_heap_poll()
+     * polls the home shard of the calling thread, and only helps with the
+     * other shards when their entries are already late by 10 msec, e.g.
+     * because no thread polling the timer heap has them as home shard.
+     *
+     * Sharding only pays off when several threads on different CPU cores
+     * schedule and poll timers at the same time and contend for the timer
+     * heap lock. Otherwise it only adds overhead: the multithreaded
+     * benchmark in pjlib-test shows 10-20% lower throughput with 4 shards
+     * on a single core machine. Keep the default unless the timer heap
+     * lock is known to be contended.
+     *
+     * Each shard has its own lock created internally, so the lock set
+     * with #pj_timer_heap_set_lock() is not used by the shards.
+     *
+     * Default: 1
+     */
+    unsigned shard_cnt;
+
+} pj_timer_heap_param;
+
+
+/**
+ * Initialize timer heap creation parameters with default values.
+ *
+ * @param param	    The parameters to be initialized.
+ */
+PJ_DECL(void) pj_timer_heap_param_default(pj_timer_heap_param *param);
+
+
 /**
  * Calculate memory size required to create a timer heap.
  *
@@ -159,6 +257,26 @@ PJ_DECL(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
 					   pj_size_t count,
                                            pj_timer_heap_t **ht);
 
+/**
+ * Create a timer heap with the specified parameters, for example to
+ * select the timer heap implementation type.
+ *
+ * @param pool      The pool where allocations in the timer heap will be 
+ *                  allocated.
+ * @param count     The maximum number of timer entries to be supported 
+ *                  initially. If the application registers more entries 
+ *                  during runtime, then the timer heap will resize.
+ * @param param     The creation parameters, or NULL to use the default
+ *                  parameters.
+ * @param ht        Pointer to receive the created timer heap.
+ *
+ * @return          PJ_SUCCESS, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_timer_heap_create2(pj_pool_t *pool,
+					   pj_size_t count,
+					   const pj_timer_heap_param *param,
+					   pj_timer_heap_t **ht);
+
 /**
  * Destroy the timer heap.
  *
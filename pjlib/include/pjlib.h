@@ -44,6 +44,7 @@
 #include <pj/lock.h>
 #include <pj/log.h>
 #include <pj/math.h>
+#include <pj/objpool.h>
 #include <pj/os.h>
 #include <pj/pool.h>
 #include <pj/pool_buf.h>
@@ -40,7 +40,8 @@ enum read_type
 {
     TYPE_NONE,
     TYPE_RECV,
-    TYPE_RECV_FROM
+    TYPE_RECV_FROM,
+    TYPE_RECVMMSG
 };
 
 enum shutdown_dir
@@ -58,6 +59,8 @@ struct read_op
     pj_size_t		 size;
     pj_sockaddr		 src_addr;
     int			 src_addr_len;
+    pj_sock_msg		*msgs;		/* Only for TYPE_RECVMMSG   */
+    unsigned		 msg_cnt;
 };
 
 struct accept_op
@@ -113,6 +116,10 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
 static void ioqueue_on_write_complete(pj_ioqueue_key_t *key, 
 				      pj_ioqueue_op_key_t *op_key,
 				      pj_ssize_t bytes_sent);
+static void on_recvmmsg_complete(pj_activesock_t *asock,
+				 pj_ioqueue_key_t *key, 
+				 struct read_op *r,
+				 pj_ssize_t count);
 #if PJ_HAS_TCP
 static void ioqueue_on_accept_complete(pj_ioqueue_key_t *key, 
 				       pj_ioqueue_op_key_t *op_key,
@@ -446,6 +453,56 @@ PJ_DEF(pj_status_t) pj_activesock_start_recvfrom2( pj_activesock_t *asock,
 }
 
 
+PJ_DEF(pj_status_t) pj_activesock_start_recvmmsg(pj_activesock_t *asock,
+						 pj_pool_t *pool,
+						 unsigned buff_size,
+						 unsigned batch_cnt,
+						 pj_uint32_t flags)
+{
+    unsigned i, j;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(asock && pool && buff_size && batch_cnt, PJ_EINVAL);
+    PJ_ASSERT_RETURN(asock->read_type == TYPE_NONE, PJ_EINVALIDOP);
+    PJ_ASSERT_RETURN(!asock->stream_oriented, PJ_EINVALIDOP);
+
+    if (batch_cnt > PJ_SOCK_MAX_MMSG)
+	batch_cnt = PJ_SOCK_MAX_MMSG;
+
+    asock->read_op = (struct read_op*)
+		     pj_pool_calloc(pool, asock->async_count, 
+				    sizeof(struct read_op));
+    asock->read_type = TYPE_RECVMMSG;
+    asock->read_flags = flags;
+
+    for (i=0; i<asock->async_count; ++i) {
+	struct read_op *r = &asock->read_op[i];
+	unsigned count = batch_cnt;
+
+	r->max_size = buff_size;
+	r->msg_cnt = batch_cnt;
+	r->msgs = (pj_sock_msg*) pj_pool_calloc(pool, batch_cnt,
+						sizeof(pj_sock_msg));
+	for (j=0; j<batch_cnt; ++j) {
+	    r->msgs[j].buf = pj_pool_alloc(pool, buff_size);
+	    r->msgs[j].len = buff_size;
+	    r->msgs[j].addr_len = sizeof(r->msgs[j].addr);
+	}
+
+	status = pj_ioqueue_recvmmsg(asock->key, &r->op_key, r->msgs,
+				     &count, PJ_IOQUEUE_ALWAYS_ASYNC | flags);
+	PJ_ASSERT_RETURN(status != PJ_SUCCESS, PJ_EBUG);
+
+	if (status != PJ_EPENDING) {
+	    asock->read_type = TYPE_NONE;
+	    return status;
+	}
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 static void ioqueue_on_read_complete(pj_ioqueue_key_t *key, 
 				     pj_ioqueue_op_key_t *op_key, 
 				     pj_ssize_t bytes_read)
@@ -461,6 +518,11 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
     if (asock->shutdown & SHUT_RX)
 	return;
 
+    if (asock->read_type == TYPE_RECVMMSG) {
+	on_recvmmsg_complete(asock, key, r, bytes_read);
+	return;
+    }
+
     do {
 	unsigned flags;
 
@@ -628,6 +690,93 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
 }
 
 
+/* Completion of batched receive. Here the ioqueue reports the number of
+ * datagrams received in r->msgs rather than number of bytes.
+ */
+static void on_recvmmsg_complete(pj_activesock_t *asock,
+				 pj_ioqueue_key_t *key, 
+				 struct read_op *r,
+				 pj_ssize_t count)
+{
+    unsigned loop = 0;
+    pj_status_t status;
+
+    do {
+	unsigned i, flags, batch_cnt;
+	pj_bool_t ret = PJ_TRUE;
+
+	if (count > 0) {
+	    /* Notify callback. Deliver the datagrams one by one if the
+	     * application does not handle batches.
+	     */
+	    if (asock->cb.on_data_recvfrom_batch) {
+		ret = (*asock->cb.on_data_recvfrom_batch)(asock, r->msgs,
+							  (unsigned)count,
+							  PJ_SUCCESS);
+	    } else if (asock->cb.on_data_recvfrom) {
+		for (i=0; i<(unsigned)count && ret; ++i) {
+		    pj_sock_msg *m = &r->msgs[i];
+		    ret = (*asock->cb.on_data_recvfrom)(asock, m->buf, m->len,
+							&m->addr, m->addr_len,
+							PJ_SUCCESS);
+		}
+	    }
+
+	    /* If callback returns false, we have been destroyed! */
+	    if (!ret)
+		return;
+
+	} else if (count < 0 &&
+		   -count != PJ_STATUS_FROM_OS(OSERR_EWOULDBLOCK) &&
+		   -count != PJ_STATUS_FROM_OS(OSERR_EINPROGRESS) && 
+		   -count != PJ_STATUS_FROM_OS(OSERR_ECONNRESET)) 
+	{
+	    status = (pj_status_t)-count;
+
+	    if (asock->cb.on_data_recvfrom_batch) {
+		ret = (*asock->cb.on_data_recvfrom_batch)(asock, NULL, 0,
+							  status);
+	    } else if (asock->cb.on_data_recvfrom) {
+		ret = (*asock->cb.on_data_recvfrom)(asock, NULL, 0,
+						    NULL, 0, status);
+	    }
+
+	    /* If callback returns false, we have been destroyed! */
+	    if (!ret)
+		return;
+	}
+
+	/* Also stop further read if we've been shutdown */
+	if (asock->shutdown & SHUT_RX)
+	    return;
+
+	/* Read next batch. See ioqueue_on_read_complete() for the loop
+	 * limit.
+	 */
+	for (i=0; i<r->msg_cnt; ++i) {
+	    r->msgs[i].len = r->max_size;
+	    r->msgs[i].addr_len = sizeof(r->msgs[i].addr);
+	}
+	batch_cnt = r->msg_cnt;
+	flags = asock->read_flags;
+	if (++loop >= asock->max_loop)
+	    flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
+
+	status = pj_ioqueue_recvmmsg(key, &r->op_key, r->msgs, &batch_cnt,
+				     flags);
+	if (status == PJ_SUCCESS) {
+	    /* Immediate data */
+	    count = batch_cnt;
+	} else if (status != PJ_EPENDING && status != PJ_ECANCELLED) {
+	    /* Error */
+	    count = -status;
+	} else {
+	    break;
+	}
+    } while (1);
+}
+
+
 static pj_status_t send_remaining(pj_activesock_t *asock, 
 				  pj_ioqueue_op_key_t *send_key)
 {
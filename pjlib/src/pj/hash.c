@@ -41,11 +41,43 @@ struct pj_hash_entry
 };
 
 
+/**
+ * Number of slots of the old array to move to the new array on every
+ * insertion when an open addressing hash table is growing.
+ */
+#define OA_MIGRATE_STEP		4
+
+
+/* Slot of open addressing hash table. Empty slot has NULL value. */
+typedef struct oa_slot
+{
+    void	*key;
+    void	*value;
+    pj_uint32_t	 hash;
+    pj_uint32_t	 keylen;
+} oa_slot;
+
+/* Slot array of open addressing hash table. */
+typedef struct oa_array
+{
+    oa_slot	*slot;
+    unsigned	 mask;		/* Capacity - 1 */
+    unsigned	 count;
+} oa_array;
+
+
 struct pj_hash_table_t
 {
     pj_hash_entry     **table;
     unsigned		count, rows;
     pj_hash_iterator_t	iterator;
+
+    /* Open addressing (PJ_HASH_OPEN_ADDRESSING) */
+    unsigned		flags;
+    pj_pool_t	       *pool;		/* Pool to allocate slot arrays	    */
+    oa_array		cur;		/* Array for new entries	    */
+    oa_array		old;		/* Array being migrated, if any	    */
+    unsigned		migrate_idx;	/* Next old slot to migrate	    */
 };
 
 
@@ -102,6 +134,12 @@ PJ_DEF(pj_uint32_t) pj_hash_calc_tolower( pj_uint32_t hval,
 
 
 PJ_DEF(pj_hash_table_t*) pj_hash_create(pj_pool_t *pool, unsigned size)
+{
+    return pj_hash_create2(pool, size, 0);
+}
+
+PJ_DEF(pj_hash_table_t*) pj_hash_create2(pj_pool_t *pool, unsigned size,
+					 unsigned flags)
 {
     pj_hash_table_t *h;
     unsigned table_size;
@@ -109,8 +147,9 @@ PJ_DEF(pj_hash_table_t*) pj_hash_create(pj_pool_t *pool, unsigned size)
     /* Check that PJ_HASH_ENTRY_BUF_SIZE is correct. */
     PJ_ASSERT_RETURN(sizeof(pj_hash_entry)<=PJ_HASH_ENTRY_BUF_SIZE, NULL);
 
-    h = PJ_POOL_ALLOC_T(pool, pj_hash_table_t);
+    h = PJ_POOL_ZALLOC_T(pool, pj_hash_table_t);
     h->count = 0;
+    h->flags = flags;
 
     PJ_LOG( 6, ("hashtbl", "hash table %p created from pool %s", h, pj_pool_getobjname(pool)));
 
@@ -124,31 +163,37 @@ PJ_DEF(pj_hash_table_t*) pj_hash_create(pj_pool_t *pool, unsigned size)
     } while (table_size < size);
     table_size -= 1;
     
+    if (flags & PJ_HASH_OPEN_ADDRESSING) {
+	h->pool = pool;
+	h->cur.mask = table_size;
+	h->cur.slot = (oa_slot*)
+		      pj_pool_calloc(pool, table_size+1, sizeof(oa_slot));
+	return h;
+    }
+
     h->rows = table_size;
     h->table = (pj_hash_entry**)
     	       pj_pool_calloc(pool, table_size+1, sizeof(pj_hash_entry*));
     return h;
 }
 
-static pj_hash_entry **find_entry( pj_pool_t *pool, pj_hash_table_t *ht, 
-				   const void *key, unsigned keylen,
-				   void *val, pj_uint32_t *hval,
-				   void *entry_buf, pj_bool_t lower)
+/* Get the hash value and the length of the key. */
+static pj_uint32_t calc_hash( const void *key, unsigned *keylen,
+			      pj_uint32_t *hval, pj_bool_t lower )
 {
     pj_uint32_t hash;
-    pj_hash_entry **p_entry, *entry;
 
     if (hval && *hval != 0) {
 	hash = *hval;
-	if (keylen==PJ_HASH_KEY_STRING) {
-	    keylen = (unsigned)pj_ansi_strlen((const char*)key);
+	if (*keylen==PJ_HASH_KEY_STRING) {
+	    *keylen = (unsigned)pj_ansi_strlen((const char*)key);
 	}
     } else {
 	/* This slightly differs with pj_hash_calc() because we need 
 	 * to get the keylen when keylen is PJ_HASH_KEY_STRING.
 	 */
 	hash=0;
-	if (keylen==PJ_HASH_KEY_STRING) {
+	if (*keylen==PJ_HASH_KEY_STRING) {
 	    const pj_uint8_t *p = (const pj_uint8_t*)key;
 	    for ( ; *p; ++p ) {
                 if (lower)
@@ -156,10 +201,10 @@ static pj_hash_entry **find_entry( pj_pool_t *pool, pj_hash_table_t *ht,
                 else 
 		    hash = hash * PJ_HASH_MULTIPLIER + *p;
 	    }
-	    keylen = (unsigned)(p - (const unsigned char*)key);
+	    *keylen = (unsigned)(p - (const unsigned char*)key);
 	} else {
 	    const pj_uint8_t *p = (const pj_uint8_t*)key,
-				  *end = p + keylen;
+				  *end = p + *keylen;
 	    for ( ; p!=end; ++p) {
 		if (lower)
                     hash = hash * PJ_HASH_MULTIPLIER + pj_tolower(*p);
@@ -173,6 +218,19 @@ static pj_hash_entry **find_entry( pj_pool_t *pool, pj_hash_table_t *ht,
 	    *hval = hash;
     }
 
+    return hash;
+}
+
+static pj_hash_entry **find_entry( pj_pool_t *pool, pj_hash_table_t *ht, 
+				   const void *key, unsigned keylen,
+				   void *val, pj_uint32_t *hval,
+				   void *entry_buf, pj_bool_t lower)
+{
+    pj_uint32_t hash;
+    pj_hash_entry **p_entry, *entry;
+
+    hash = calc_hash(key, &keylen, hval, lower);
+
     /* scan the linked list */
     for (p_entry = &ht->table[hash & ht->rows], entry=*p_entry; 
 	 entry; 
@@ -222,11 +280,306 @@ static pj_hash_entry **find_entry( pj_pool_t *pool, pj_hash_table_t *ht,
     return p_entry;
 }
 
+/*
+ * Open addressing hash table (PJ_HASH_OPEN_ADDRESSING).
+ *
+ * Entries are kept in Robin Hood order: an entry being inserted takes
+ * the slot of an entry that is closer to its home slot, so lookups can
+ * stop as soon as they see an entry closer to its home than the key would
+ * be. When the table needs to grow, a new array twice as large is
+ * allocated and the entries of the old array are moved to it a few at a
+ * time on subsequent insertions. Lookups and deletions check both arrays
+ * in the mean time.
+ */
+
+/* Get the home slot of the hash value. The hash value is scrambled first,
+ * since the low bits of the hash of similar keys are not well distributed.
+ */
+static unsigned oa_home(const oa_array *arr, pj_uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash & arr->mask;
+}
+
+/* Get the distance of the entry in the slot from its home slot. */
+static unsigned oa_dist(const oa_array *arr, unsigned idx)
+{
+    return (idx - oa_home(arr, arr->slot[idx].hash)) & arr->mask;
+}
+
+static oa_slot *oa_find( const oa_array *arr, const void *key,
+			 unsigned keylen, pj_uint32_t hash, pj_bool_t lower )
+{
+    unsigned idx, dist;
+
+    if (arr->slot == NULL)
+	return NULL;
+
+    for (idx = oa_home(arr, hash), dist = 0; 
+	 dist <= arr->mask; 
+	 idx = (idx + 1) & arr->mask, ++dist) 
+    {
+	oa_slot *s = &arr->slot[idx];
+
+	/* The key would have taken this slot if it were in the table */
+	if (s->value == NULL || oa_dist(arr, idx) < dist)
+	    break;
+
+	if (s->hash==hash && s->keylen==keylen &&
+            ((lower && pj_ansi_strnicmp((const char*)s->key,
+        			        (const char*)key, keylen)==0) ||
+	     (!lower && pj_memcmp(s->key, key, keylen)==0)))
+	{
+	    return s;
+	}
+    }
+
+    return NULL;
+}
+
+/* Insert an entry which is not in the array yet. */
+static void oa_insert( oa_array *arr, const oa_slot *entry )
+{
+    oa_slot tmp = *entry;
+    unsigned idx, dist;
+
+    for (idx = oa_home(arr, tmp.hash), dist = 0; ; 
+	 idx = (idx + 1) & arr->mask, ++dist) 
+    {
+	oa_slot *s = &arr->slot[idx];
+	unsigned d;
+
+	if (s->value == NULL) {
+	    *s = tmp;
+	    break;
+	}
+
+	/* Take the slot if its entry is closer to its home, and continue
+	 * to find a slot for that entry.
+	 */
+	d = oa_dist(arr, idx);
+	if (d < dist) {
+	    oa_slot swap = *s;
+	    *s = tmp;
+	    tmp = swap;
+	    dist = d;
+	}
+    }
+
+    ++arr->count;
+}
+
+/* Remove an entry, shifting back the entries that follow it. */
+static void oa_erase( oa_array *arr, oa_slot *s )
+{
+    unsigned idx = (unsigned)(s - arr->slot);
+    unsigned next = (idx + 1) & arr->mask;
+
+    while (arr->slot[next].value && oa_dist(arr, next) != 0) {
+	arr->slot[idx] = arr->slot[next];
+	idx = next;
+	next = (next + 1) & arr->mask;
+    }
+
+    arr->slot[idx].key = NULL;
+    arr->slot[idx].value = NULL;
+    --arr->count;
+}
+
+/* Move some entries from the old array to the current array. */
+static void oa_migrate( pj_hash_table_t *ht, unsigned step )
+{
+    while (ht->old.slot && step--) {
+	oa_slot *s = &ht->old.slot[ht->migrate_idx];
+
+	if (s->value) {
+	    /* Erasing may shift the next entry to this slot, hence the
+	     * slot will be checked again in the next step.
+	     */
+	    oa_slot entry = *s;
+	    oa_erase(&ht->old, s);
+	    oa_insert(&ht->cur, &entry);
+
+	} else if (ht->migrate_idx++ == ht->old.mask) {
+	    /* All entries have been moved. The old array is left in
+	     * the pool.
+	     */
+	    PJ_LOG(6, ("hashtbl", "%p: resized to %u slots", ht,
+		       ht->cur.mask+1));
+	    pj_bzero(&ht->old, sizeof(ht->old));
+	}
+    }
+}
+
+/* Start moving the entries to a new array twice as large. */
+static void oa_grow( pj_hash_table_t *ht )
+{
+    oa_slot *slot;
+
+    /* Finish the previous resize first. */
+    while (ht->old.slot)
+	oa_migrate(ht, OA_MIGRATE_STEP);
+
+    slot = (oa_slot*) pj_pool_calloc(ht->pool, (ht->cur.mask+1) * 2,
+				     sizeof(oa_slot));
+    if (!slot) {
+	/* Keep using the current array, it still has some room. */
+	return;
+    }
+
+    PJ_LOG(6, ("hashtbl", "%p: resizing from %u to %u slots", ht,
+	       ht->cur.mask+1, (ht->cur.mask+1) * 2));
+
+    ht->old = ht->cur;
+    ht->migrate_idx = 0;
+    ht->cur.slot = slot;
+    ht->cur.mask = ht->cur.mask * 2 + 1;
+    ht->cur.count = 0;
+}
+
+static void *oa_get( pj_hash_table_t *ht, const void *key, unsigned keylen,
+		     pj_uint32_t *hval, pj_bool_t lower )
+{
+    pj_uint32_t hash;
+    oa_slot *s;
+
+    hash = calc_hash(key, &keylen, hval, lower);
+
+    s = oa_find(&ht->cur, key, keylen, hash, lower);
+    if (!s)
+	s = oa_find(&ht->old, key, keylen, hash, lower);
+
+    return s ? s->value : NULL;
+}
+
+static void oa_set( pj_pool_t *pool, pj_hash_table_t *ht,
+		    const void *key, unsigned keylen, pj_uint32_t hval,
+		    void *value, pj_bool_t lower )
+{
+    pj_uint32_t hash;
+    oa_array *arr = &ht->cur;
+    oa_slot *s, entry;
+
+    hash = calc_hash(key, &keylen, &hval, lower);
+
+    s = oa_find(arr, key, keylen, hash, lower);
+    if (!s) {
+	arr = &ht->old;
+	s = oa_find(arr, key, keylen, hash, lower);
+    }
+
+    if (s) {
+	if (value == NULL) {
+	    /* delete entry */
+	    PJ_LOG(6, ("hashtbl", "%p: entry %p deleted", ht, s->value));
+	    oa_erase(arr, s);
+	    --ht->count;
+	} else {
+	    /* overwrite */
+	    s->value = value;
+	    PJ_LOG(6, ("hashtbl", "%p: entry value set to %p", ht, value));
+	}
+	return;
+    }
+
+    if (value == NULL)
+	return;
+
+    /* Entry not found, create a new one. */
+    entry.hash = hash;
+    entry.keylen = keylen;
+    entry.value = value;
+    if (pool) {
+	entry.key = pj_pool_alloc(pool, keylen);
+	pj_memcpy(entry.key, key, keylen);
+    } else {
+	entry.key = (void*)key;
+    }
+
+    /* Keep the load factor under 3/4 */
+    if (ht->cur.count >= (ht->cur.mask+1) - ((ht->cur.mask+1) >> 2))
+	oa_grow(ht);
+
+    oa_insert(&ht->cur, &entry);
+    ++ht->count;
+
+    oa_migrate(ht, OA_MIGRATE_STEP);
+}
+
+/* Find the next entry, iterating the array backward. */
+static pj_hash_iterator_t *oa_scan( const oa_array *arr,
+				    pj_hash_iterator_t *it,
+				    unsigned idx )
+{
+    /* it->index is the number of slots that are still to be visited. */
+    while (it->index) {
+	--it->index;
+	if (arr->slot[idx].value) {
+	    it->entry = (pj_hash_entry*) &arr->slot[idx];
+	    return it;
+	}
+	idx = (idx - 1) & arr->mask;
+    }
+
+    return NULL;
+}
+
+/* Start iterating the array. The iteration goes backward starting from
+ * the end of a cluster, so that entries that are shifted back when the
+ * current entry is deleted have all been visited.
+ */
+static pj_hash_iterator_t *oa_first( const oa_array *arr,
+				     pj_hash_iterator_t *it )
+{
+    unsigned idx, next;
+
+    if (arr->slot == NULL || arr->count == 0)
+	return NULL;
+
+    /* There's always an empty slot, so this will stop. */
+    for (idx = arr->mask; ; --idx) {
+	next = (idx + 1) & arr->mask;
+	if (arr->slot[next].value == NULL || oa_dist(arr, next) == 0)
+	    break;
+    }
+
+    it->index = arr->mask + 1;
+    return oa_scan(arr, it, idx);
+}
+
+static pj_hash_iterator_t *oa_next( pj_hash_table_t *ht,
+				    pj_hash_iterator_t *it )
+{
+    oa_slot *s = (oa_slot*) it->entry;
+
+    if (s >= ht->cur.slot && s <= ht->cur.slot + ht->cur.mask) {
+	return oa_scan(&ht->cur, it, 
+		       ((unsigned)(s - ht->cur.slot) - 1) & ht->cur.mask);
+    }
+
+    /* Continue with the current array after the old array is done. */
+    if (oa_scan(&ht->old, it,
+		((unsigned)(s - ht->old.slot) - 1) & ht->old.mask))
+    {
+	return it;
+    }
+    return oa_first(&ht->cur, it);
+}
+
+
 PJ_DEF(void *) pj_hash_get( pj_hash_table_t *ht,
 			    const void *key, unsigned keylen,
 			    pj_uint32_t *hval)
 {
     pj_hash_entry *entry;
+
+    if (ht->flags & PJ_HASH_OPEN_ADDRESSING)
+	return oa_get(ht, key, keylen, hval, PJ_FALSE);
+
     entry = *find_entry( NULL, ht, key, keylen, NULL, hval, NULL, PJ_FALSE);
     return entry ? entry->value : NULL;
 }
@@ -236,6 +589,10 @@ PJ_DEF(void *) pj_hash_get_lower( pj_hash_table_t *ht,
 			          pj_uint32_t *hval)
 {
     pj_hash_entry *entry;
+
+    if (ht->flags & PJ_HASH_OPEN_ADDRESSING)
+	return oa_get(ht, key, keylen, hval, PJ_TRUE);
+
     entry = *find_entry( NULL, ht, key, keylen, NULL, hval, NULL, PJ_TRUE);
     return entry ? entry->value : NULL;
 }
@@ -246,6 +603,11 @@ static void hash_set( pj_pool_t *pool, pj_hash_table_t *ht,
 {
     pj_hash_entry **p_entry;
 
+    if (ht->flags & PJ_HASH_OPEN_ADDRESSING) {
+	oa_set(pool, ht, key, keylen, hval, value, lower);
+	return;
+    }
+
     p_entry = find_entry( pool, ht, key, keylen, value, &hval, entry_buf,
                           lower);
     if (*p_entry) {
@@ -306,6 +668,12 @@ PJ_DEF(pj_hash_iterator_t*) pj_hash_first( pj_hash_table_t *ht,
     it->index = 0;
     it->entry = NULL;
 
+    if (ht->flags & PJ_HASH_OPEN_ADDRESSING) {
+	if (oa_first(&ht->old, it))
+	    return it;
+	return oa_first(&ht->cur, it);
+    }
+
     for (; it->index <= ht->rows; ++it->index) {
 	it->entry = ht->table[it->index];
 	if (it->entry) {
@@ -319,6 +687,9 @@ PJ_DEF(pj_hash_iterator_t*) pj_hash_first( pj_hash_table_t *ht,
 PJ_DEF(pj_hash_iterator_t*) pj_hash_next( pj_hash_table_t *ht, 
 					  pj_hash_iterator_t *it )
 {
+    if (ht->flags & PJ_HASH_OPEN_ADDRESSING)
+	return oa_next(ht, it);
+
     it->entry = it->entry->next;
     if (it->entry) {
 	return it;
@@ -337,7 +708,8 @@ PJ_DEF(pj_hash_iterator_t*) pj_hash_next( pj_hash_table_t *ht,
 PJ_DEF(void*) pj_hash_this( pj_hash_table_t *ht, pj_hash_iterator_t *it )
 {
     PJ_CHECK_STACK();
-    PJ_UNUSED_ARG(ht);
+    if (ht->flags & PJ_HASH_OPEN_ADDRESSING)
+	return ((oa_slot*)it->entry)->value;
     return it->entry->value;
 }
 
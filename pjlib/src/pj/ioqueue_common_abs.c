@@ -313,7 +313,15 @@ void ioqueue_dispatch_write_event(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *h)
          * preventing parallel write on a single key.. :-((
          */
         sent = write_op->size - write_op->written;
-        if (write_op->op == PJ_IOQUEUE_OP_SEND) {
+        if (write_op->op == PJ_IOQUEUE_OP_SENDMMSG) {
+	    /* For batched send, size and written are counted in datagrams */
+	    unsigned cnt = (unsigned)sent;
+	    send_rc = pj_sock_sendmmsg(h->fd,
+				       (pj_sock_msg*)write_op->buf +
+				           write_op->written,
+				       &cnt, write_op->flags);
+	    sent = cnt;
+        } else if (write_op->op == PJ_IOQUEUE_OP_SEND) {
             send_rc = pj_sock_send(h->fd, write_op->buf+write_op->written,
                                    &sent, write_op->flags);
 	    /* Can't do this. We only clear "op" after we're finished sending
@@ -362,7 +370,19 @@ void ioqueue_dispatch_write_event(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *h)
         }
 
         /* Are we finished with this buffer? */
-        if (send_rc!=PJ_SUCCESS || 
+        if (send_rc==PJ_SUCCESS && write_op->op==PJ_IOQUEUE_OP_SENDMMSG &&
+            write_op->written < (pj_ssize_t)write_op->size)
+        {
+            /* Batch is partially sent, put it back to the front of the
+             * queue so that the order of the datagrams is preserved.
+             */
+            if (h->fd_type == pj_SOCK_DGRAM()) {
+                pj_list_insert_after(&h->write_list, write_op);
+                ioqueue_add_to_set(ioqueue, h, WRITEABLE_EVENT);
+            }
+            pj_ioqueue_unlock_key(h);
+
+        } else if (send_rc!=PJ_SUCCESS || 
             write_op->written == (pj_ssize_t)write_op->size ||
             h->fd_type == pj_SOCK_DGRAM()) 
         {
@@ -497,7 +517,16 @@ void ioqueue_dispatch_read_event( pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *h )
 
         bytes_read = read_op->size;
 
-	if ((read_op->op == PJ_IOQUEUE_OP_RECV_FROM)) {
+	if ((read_op->op == PJ_IOQUEUE_OP_RECVMMSG)) {
+	    /* For batched receive, size is the number of descriptors and
+	     * the result is the number of datagrams received.
+	     */
+	    unsigned cnt = (unsigned)read_op->size;
+	    read_op->op = PJ_IOQUEUE_OP_NONE;
+	    rc = pj_sock_recvmmsg(h->fd, (pj_sock_msg*)read_op->buf, &cnt,
+				  read_op->flags);
+	    bytes_read = cnt;
+	} else if ((read_op->op == PJ_IOQUEUE_OP_RECV_FROM)) {
 	    read_op->op = PJ_IOQUEUE_OP_NONE;
 	    rc = pj_sock_recvfrom(h->fd, read_op->buf, &bytes_read, 
 				  read_op->flags,
@@ -820,6 +849,78 @@ PJ_DEF(pj_status_t) pj_ioqueue_recvfrom( pj_ioqueue_key_t *key,
     return PJ_EPENDING;
 }
 
+/*
+ * pj_ioqueue_recvmmsg()
+ *
+ * Start asynchronous batched receive from the socket.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recvmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    struct read_operation *read_op;
+
+    PJ_ASSERT_RETURN(key && op_key && msgs && count && *count, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    read_op = (struct read_operation*)op_key;
+    read_op->op = PJ_IOQUEUE_OP_NONE;
+
+    /* Try to see if there's data immediately available. 
+     */
+    if ((flags & PJ_IOQUEUE_ALWAYS_ASYNC) == 0) {
+	pj_status_t status;
+	unsigned cnt = *count;
+
+	status = pj_sock_recvmmsg(key->fd, msgs, &cnt, flags);
+	if (status == PJ_SUCCESS) {
+	    /* Yes! Data is available! */
+	    *count = cnt;
+	    return PJ_SUCCESS;
+	} else {
+	    /* If error is not EWOULDBLOCK (or EAGAIN on Linux), report
+	     * the error to caller.
+	     */
+	    if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL))
+		return status;
+	}
+    }
+
+    flags &= ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+
+    /*
+     * No data is immediately available.
+     * Must schedule asynchronous operation to the ioqueue.
+     */
+    read_op->op = PJ_IOQUEUE_OP_RECVMMSG;
+    read_op->buf = msgs;
+    read_op->size = (*count < PJ_SOCK_MAX_MMSG) ? *count : PJ_SOCK_MAX_MMSG;
+    read_op->flags = flags;
+    read_op->rmt_addr = NULL;
+    read_op->rmt_addrlen = NULL;
+
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app. If we add bad handle to the set it will
+     * corrupt the ioqueue set. See #913
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+    pj_list_insert_before(&key->read_list, read_op);
+    ioqueue_add_to_set(key->ioqueue, key, READABLE_EVENT);
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
 /*
  * pj_ioqueue_send()
  *
@@ -1080,6 +1181,96 @@ retry_on_restart:
     return PJ_EPENDING;
 }
 
+/*
+ * pj_ioqueue_sendmmsg()
+ *
+ * Start asynchronous batched send to the socket.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_sendmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    struct write_operation *write_op;
+    unsigned retry, total, sent = 0;
+
+    PJ_ASSERT_RETURN(key && op_key && msgs && count && *count, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    /* We can not use PJ_IOQUEUE_ALWAYS_ASYNC for socket write */
+    flags &= ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+
+    total = (*count < PJ_SOCK_MAX_MMSG) ? *count : PJ_SOCK_MAX_MMSG;
+
+    /* Fast track:
+     *   Try to send data immediately, only if there's no pending write!
+     *   See pj_ioqueue_sendto() for the notes.
+     */
+    if (pj_list_empty(&key->write_list)) {
+	pj_status_t status;
+
+	sent = total;
+	status = pj_sock_sendmmsg(key->fd, msgs, &sent, flags);
+	if (status == PJ_SUCCESS) {
+	    if (sent == total) {
+		/* Success! */
+		*count = sent;
+		return PJ_SUCCESS;
+	    }
+	} else if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL)) {
+	    /* If error is not EWOULDBLOCK (or EAGAIN on Linux), report
+	     * the error to caller.
+	     */
+	    return status;
+	} else {
+	    sent = 0;
+	}
+    }
+
+    /*
+     * Schedule asynchronous send of the remaining datagrams.
+     */
+    write_op = (struct write_operation*)op_key;
+
+    /* Spin if write_op has pending operation */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	pj_thread_sleep(0);
+
+    /* Last chance */
+    if (write_op->op) {
+	/* See pj_ioqueue_sendto() */
+	*count = sent;
+	return PJ_EBUSY;
+    }
+
+    write_op->op = PJ_IOQUEUE_OP_SENDMMSG;
+    write_op->buf = (char*)msgs;
+    write_op->size = total;
+    write_op->written = sent;
+    write_op->flags = flags;
+    write_op->rmt_addrlen = 0;
+
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app. If we add bad handle to the set it will
+     * corrupt the ioqueue set. See #913
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+    pj_list_insert_before(&key->write_list, write_op);
+    ioqueue_add_to_set(key->ioqueue, key, WRITEABLE_EVENT);
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
 #if PJ_HAS_TCP
 /*
  * Initiate overlapped accept() operation.
@@ -1293,6 +1484,13 @@ PJ_DEF(pj_status_t) pj_ioqueue_post_completion( pj_ioqueue_key_t *key,
     return PJ_EINVALIDOP;
 }
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->epoll_flags = PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS;
+    cfg->default_concurrency = PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+}
+
 PJ_DEF(pj_status_t) pj_ioqueue_set_default_concurrency( pj_ioqueue_t *ioqueue,
 							pj_bool_t allow)
 {
@@ -70,6 +70,19 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     return PJ_ENOTSUP;
 }
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool, 
+				       pj_size_t max_fd,
+				       const pj_ioqueue_cfg *cfg,
+				       pj_ioqueue_t **ptr_ioqueue)
+{
+    return PJ_ENOTSUP;
+}
+
 PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioque)
 {
     return PJ_ENOTSUP;
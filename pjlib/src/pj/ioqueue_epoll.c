@@ -141,6 +141,14 @@
 #   define epoll_data_type	__u32
 #endif
 
+/* These may not be defined by older headers */
+#ifndef EPOLLONESHOT
+#   define EPOLLONESHOT		(1U << 30)
+#endif
+#ifndef EPOLLEXCLUSIVE
+#   define EPOLLEXCLUSIVE	(1U << 28)
+#endif
+
 #define THIS_FILE   "ioq_epoll"
 
 //#define TRACE_(expr) PJ_LOG(3,expr)
@@ -157,6 +165,11 @@
 struct pj_ioqueue_key_t
 {
     DECLARE_COMMON_KEY
+
+    /* In oneshot mode, set while the key has been reported by epoll and
+     * is waiting to be re-armed by rearm_key().
+     */
+    pj_bool_t		    disarmed;
 };
 
 struct queue
@@ -176,6 +189,7 @@ struct pj_ioqueue_t
     //pj_ioqueue_key_t	hlist;
     pj_ioqueue_key_t	active_list;    
     int			epfd;
+    unsigned		epoll_flags;
     //struct epoll_event *events;
     //struct queue       *queue;
 
@@ -211,11 +225,24 @@ PJ_DEF(const char*) pj_ioqueue_name(void)
 /*
  * pj_ioqueue_create()
  *
- * Create select ioqueue.
+ * Create epoll ioqueue.
  */
 PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool, 
                                        pj_size_t max_fd,
                                        pj_ioqueue_t **p_ioqueue)
+{
+    return pj_ioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * Create epoll ioqueue with the specified settings.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool, 
+                                       pj_size_t max_fd,
+                                       const pj_ioqueue_cfg *cfg,
+                                       pj_ioqueue_t **p_ioqueue)
 {
     pj_ioqueue_t *ioqueue;
     pj_status_t rc;
@@ -234,6 +261,19 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
 
     ioqueue_init(ioqueue);
 
+    if (cfg) {
+	ioqueue->default_concurrency = cfg->default_concurrency;
+	ioqueue->epoll_flags = cfg->epoll_flags;
+    } else {
+	ioqueue->epoll_flags = PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS;
+    }
+
+    /* EPOLLEXCLUSIVE can't be combined with EPOLLONESHOT, and oneshot
+     * takes precedence.
+     */
+    if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT)
+	ioqueue->epoll_flags = PJ_IOQUEUE_EPOLL_ONESHOT;
+
     ioqueue->max = max_fd;
     ioqueue->count = 0;
     pj_list_init(&ioqueue->active_list);
@@ -298,7 +338,8 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     ioqueue->queue = pj_pool_calloc(pool, max_fd, sizeof(struct queue));
     PJ_ASSERT_RETURN(ioqueue->queue != NULL, PJ_ENOMEM);
    */
-    PJ_LOG(4, ("pjlib", "epoll I/O Queue created (%p)", ioqueue));
+    PJ_LOG(4, ("pjlib", "epoll I/O Queue created (%p), flags=%d",
+	       ioqueue, ioqueue->epoll_flags));
 
     *p_ioqueue = ioqueue;
     return PJ_SUCCESS;
@@ -345,6 +386,43 @@ PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
     return ioqueue_destroy(ioqueue);
 }
 
+/* Get the additional epoll event flags for the registered sockets,
+ * according to the ioqueue's epoll flags.
+ */
+static pj_uint32_t get_epoll_extra_events(pj_ioqueue_t *ioqueue)
+{
+    if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT)
+	return EPOLLONESHOT;
+    else if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_EXCLUSIVE)
+	return EPOLLEXCLUSIVE;
+    return 0;
+}
+
+/* Update the events monitored for the key. */
+static int update_epoll_event_set(pj_ioqueue_t *ioqueue,
+				  pj_ioqueue_key_t *key,
+				  pj_uint32_t events)
+{
+    struct epoll_event ev;
+
+    ev.events = events | get_epoll_extra_events(ioqueue);
+    ev.epoll_data = (epoll_data_type)key;
+
+    if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_EXCLUSIVE) {
+	/* EPOLL_CTL_MOD is not allowed on a descriptor registered with
+	 * EPOLLEXCLUSIVE, so delete and re-add it.
+	 */
+	struct epoll_event ev_del;
+
+	ev_del.events = 0;
+	ev_del.epoll_data = (epoll_data_type)key;
+	os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_DEL, key->fd, &ev_del);
+	return os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_ADD, key->fd, &ev);
+    }
+
+    return os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+}
+
 /*
  * pj_ioqueue_register_sock()
  *
@@ -410,6 +488,7 @@ PJ_DEF(pj_status_t) pj_ioqueue_register_sock2(pj_pool_t *pool,
 	key = NULL;
 	goto on_return;
     }
+    key->disarmed = PJ_FALSE;
 
     /* Create key's mutex */
  /*   rc = pj_mutex_create_recursive(pool, NULL, &key->mutex);
@@ -419,9 +498,21 @@ PJ_DEF(pj_status_t) pj_ioqueue_register_sock2(pj_pool_t *pool,
     }
 */
     /* os_epoll_ctl. */
-    ev.events = EPOLLIN | EPOLLERR;
+    ev.events = EPOLLIN | EPOLLERR | get_epoll_extra_events(ioqueue);
     ev.epoll_data = (epoll_data_type)key;
     status = os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_ADD, sock, &ev);
+    if (status < 0 && errno == EINVAL &&
+	(ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_EXCLUSIVE))
+    {
+	/* Kernel doesn't support EPOLLEXCLUSIVE, fallback to oneshot.
+	 * No key can have been registered with EPOLLEXCLUSIVE yet.
+	 */
+	PJ_LOG(4,(THIS_FILE, "EPOLLEXCLUSIVE is not supported, using "
+			     "EPOLLONESHOT instead"));
+	ioqueue->epoll_flags = PJ_IOQUEUE_EPOLL_ONESHOT;
+	ev.events = EPOLLIN | EPOLLERR | get_epoll_extra_events(ioqueue);
+	status = os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_ADD, sock, &ev);
+    }
     if (status < 0) {
 	rc = pj_get_os_error();
 	pj_lock_destroy(key->lock);
@@ -590,12 +681,16 @@ static void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
                                      pj_ioqueue_key_t *key, 
                                      enum ioqueue_event_type event_type)
 {
-    if (event_type == WRITEABLE_EVENT) {
-	struct epoll_event ev;
+    /* In oneshot mode this is only called while the key is being
+     * dispatched and is disarmed, and the key will be re-armed with the
+     * up to date event set once the dispatching is done. Modifying it
+     * here would re-arm the key prematurely.
+     */
+    if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT)
+	return;
 
-	ev.events = EPOLLIN | EPOLLERR;
-	ev.epoll_data = (epoll_data_type)key;
-	os_epoll_ctl( ioqueue->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+    if (event_type == WRITEABLE_EVENT) {
+	update_epoll_event_set(ioqueue, key, EPOLLIN | EPOLLERR);
     }	
 }
 
@@ -609,15 +704,52 @@ static void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
                                 pj_ioqueue_key_t *key,
                                 enum ioqueue_event_type event_type )
 {
-    if (event_type == WRITEABLE_EVENT) {
-	struct epoll_event ev;
+    /* In oneshot mode, a key that is being dispatched will be re-armed
+     * with EPOLLOUT by rearm_key() once it's done. Modifying it here
+     * would re-arm the key prematurely.
+     */
+    if ((ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT) && key->disarmed)
+	return;
 
-	ev.events = EPOLLIN | EPOLLOUT | EPOLLERR;
-	ev.epoll_data = (epoll_data_type)key;
-	os_epoll_ctl( ioqueue->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+    if (event_type == WRITEABLE_EVENT) {
+	update_epoll_event_set(ioqueue, key, EPOLLIN | EPOLLOUT | EPOLLERR);
     }	
 }
 
+/*
+ * rearm_key()
+ * In oneshot mode, this is called after the event for the key has been
+ * dispatched to re-enable the key in the epoll set.
+ */
+static void rearm_key(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    pj_uint32_t events = EPOLLIN | EPOLLERR;
+
+    pj_ioqueue_lock_key(key);
+
+    /* Don't touch the epoll set if the key has been unregistered, as the
+     * descriptor may have been closed and reused by a new key.
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return;
+    }
+
+    if (key_has_pending_write(key)
+#if PJ_HAS_TCP
+	|| key->connecting
+#endif
+       )
+    {
+	events |= EPOLLOUT;
+    }
+
+    key->disarmed = PJ_FALSE;
+    update_epoll_event_set(ioqueue, key, events);
+
+    pj_ioqueue_unlock_key(key);
+}
+
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 /* Scan closing keys to be put to free list again */
 static void scan_closing_keys(pj_ioqueue_t *ioqueue)
@@ -651,7 +783,7 @@ static void scan_closing_keys(pj_ioqueue_t *ioqueue)
  */
 PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 {
-    int i, count, processed;
+    int i, count, processed, queue_cnt;
     int msec;
     //struct epoll_event *events = ioqueue->events;
     //struct queue *queue = ioqueue->queue;
@@ -694,7 +826,7 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
     /* Lock ioqueue. */
     pj_lock_acquire(ioqueue->lock);
 
-    for (processed=0, i=0; i<count; ++i) {
+    for (queue_cnt=0, i=0; i<count; ++i) {
 	pj_ioqueue_key_t *h = (pj_ioqueue_key_t*)(epoll_data_type)
 				events[i].epoll_data;
 
@@ -709,9 +841,9 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 	    increment_counter(h);
 #endif
-	    queue[processed].key = h;
-	    queue[processed].event_type = READABLE_EVENT;
-	    ++processed;
+	    queue[queue_cnt].key = h;
+	    queue[queue_cnt].event_type = READABLE_EVENT;
+	    ++queue_cnt;
 	    continue;
 	}
 
@@ -723,9 +855,9 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 	    increment_counter(h);
 #endif
-	    queue[processed].key = h;
-	    queue[processed].event_type = WRITEABLE_EVENT;
-	    ++processed;
+	    queue[queue_cnt].key = h;
+	    queue[queue_cnt].event_type = WRITEABLE_EVENT;
+	    ++queue_cnt;
 	    continue;
 	}
 
@@ -738,9 +870,9 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 	    increment_counter(h);
 #endif
-	    queue[processed].key = h;
-	    queue[processed].event_type = WRITEABLE_EVENT;
-	    ++processed;
+	    queue[queue_cnt].key = h;
+	    queue[queue_cnt].event_type = WRITEABLE_EVENT;
+	    ++queue_cnt;
 	    continue;
 	}
 #endif /* PJ_HAS_TCP */
@@ -758,21 +890,38 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 		increment_counter(h);
 #endif
-		queue[processed].key = h;
-		queue[processed].event_type = EXCEPTION_EVENT;
-		++processed;
+		queue[queue_cnt].key = h;
+		queue[queue_cnt].event_type = EXCEPTION_EVENT;
+		++queue_cnt;
+		continue;
 	    } else if (key_has_pending_read(h) || key_has_pending_accept(h)) {
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 		increment_counter(h);
 #endif
-		queue[processed].key = h;
-		queue[processed].event_type = READABLE_EVENT;
-		++processed;
+		queue[queue_cnt].key = h;
+		queue[queue_cnt].event_type = READABLE_EVENT;
+		++queue_cnt;
+		continue;
 	    }
-	    continue;
+	}
+
+	/* In oneshot mode the key is disarmed now, so it must be re-armed
+	 * even though there is nothing to dispatch.
+	 */
+	if ((ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT) &&
+	    !IS_CLOSING(h))
+	{
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+	    increment_counter(h);
+#endif
+	    queue[queue_cnt].key = h;
+	    queue[queue_cnt].event_type = NO_EVENT;
+	    ++queue_cnt;
 	}
     }
-    for (i=0; i<processed; ++i) {
+    for (i=0; i<queue_cnt; ++i) {
+	if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT)
+	    queue[i].key->disarmed = PJ_TRUE;
 	if (queue[i].key->grp_lock)
 	    pj_grp_lock_add_ref_dbg(queue[i].key->grp_lock, "ioqueue", 0);
     }
@@ -784,22 +933,29 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
     PJ_RACE_ME(5);
 
     /* Now process the events. */
-    for (i=0; i<processed; ++i) {
+    for (processed=0, i=0; i<queue_cnt; ++i) {
 	switch (queue[i].event_type) {
         case READABLE_EVENT:
             ioqueue_dispatch_read_event(ioqueue, queue[i].key);
+	    ++processed;
             break;
         case WRITEABLE_EVENT:
             ioqueue_dispatch_write_event(ioqueue, queue[i].key);
+	    ++processed;
             break;
         case EXCEPTION_EVENT:
             ioqueue_dispatch_exception_event(ioqueue, queue[i].key);
+	    ++processed;
             break;
         case NO_EVENT:
-            pj_assert(!"Invalid event!");
+	    /* Only queued for re-arming in oneshot mode */
+	    pj_assert(ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT);
             break;
         }
 
+	if (ioqueue->epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT)
+	    rearm_key(ioqueue, queue[i].key);
+
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
 	decrement_counter(queue[i].key);
 #endif
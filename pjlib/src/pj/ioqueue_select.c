@@ -183,6 +183,20 @@ static void rescan_fdset(pj_ioqueue_t *ioqueue)
 PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool, 
                                        pj_size_t max_fd,
                                        pj_ioqueue_t **p_ioqueue)
+{
+    return pj_ioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * Create select ioqueue with the specified settings. The epoll flags
+ * are not applicable to this backend and are ignored.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool, 
+                                       pj_size_t max_fd,
+                                       const pj_ioqueue_cfg *cfg,
+                                       pj_ioqueue_t **p_ioqueue)
 {
     pj_ioqueue_t *ioqueue;
     pj_lock_t *lock;
@@ -201,6 +215,8 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     /* Create and init common ioqueue stuffs */
     ioqueue = PJ_POOL_ALLOC_T(pool, pj_ioqueue_t);
     ioqueue_init(ioqueue);
+    if (cfg)
+	ioqueue->default_concurrency = cfg->default_concurrency;
 
     ioqueue->max = (unsigned)max_fd;
     ioqueue->count = 0;
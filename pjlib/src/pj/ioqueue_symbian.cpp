@@ -473,6 +473,31 @@ PJ_DEF(pj_status_t) pj_ioqueue_create(	pj_pool_t *pool,
 }
 
 
+/*
+ * Initialize ioqueue settings with default values.
+ */
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->epoll_flags = PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS;
+    cfg->default_concurrency = PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+}
+
+
+/*
+ * Create a new I/O Queue framework with the specified settings.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool, 
+				       pj_size_t max_fd,
+				       const pj_ioqueue_cfg *cfg,
+				       pj_ioqueue_t **p_ioqueue)
+{
+    /* Settings are not applicable to this implementation */
+    PJ_UNUSED_ARG(cfg);
+    return pj_ioqueue_create(pool, max_fd, p_ioqueue);
+}
+
+
 /*
  * Destroy the I/O queue.
  */
@@ -842,6 +867,37 @@ PJ_DEF(pj_status_t) pj_ioqueue_sendto( pj_ioqueue_key_t *key,
     return PJ_SUCCESS;
 }
 
+/*
+ * Batched receive and send are not supported on Symbian.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recvmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(op_key);
+    PJ_UNUSED_ARG(msgs);
+    PJ_UNUSED_ARG(count);
+    PJ_UNUSED_ARG(flags);
+    return PJ_ENOTSUP;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_sendmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(op_key);
+    PJ_UNUSED_ARG(msgs);
+    PJ_UNUSED_ARG(count);
+    PJ_UNUSED_ARG(flags);
+    return PJ_ENOTSUP;
+}
+
 PJ_DEF(pj_status_t) pj_ioqueue_set_concurrency(pj_ioqueue_key_t *key,
 											   pj_bool_t allow)
 {
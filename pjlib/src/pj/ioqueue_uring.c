@@ -0,0 +1,2639 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * ioqueue_uring.c
+ *
+ * This is the implementation of IOQueue framework using Linux io_uring.
+ *
+ * Unlike the select/epoll implementations, which are readiness based and
+ * perform one recv()/send() system call per packet, this implementation
+ * is completion based:
+ *
+ *  - reading is done with a multishot recv/recvmsg request per socket,
+ *    which stays armed in the kernel and picks buffers from a buffer ring
+ *    registered to the io_uring instance. Received data is copied from
+ *    these buffers to the application buffers when the pending read is
+ *    completed, so the kernel never writes to application memory.
+ *  - writing, accept() and connect() are submitted as io_uring requests.
+ *    Sockets are referred to by their slot in the file table registered
+ *    to the io_uring instance, saving the file lookup on each request.
+ *  - requests made while dispatching events are submitted in a batch when
+ *    the poll finishes, so a poll cycle costs the same number of system
+ *    calls regardless of the number of packets processed.
+ *
+ * Linux 6.0 or later is required (multishot recvmsg and buffer rings).
+ */
+
+#include <pj/ioqueue.h>
+#include <pj/os.h>
+#include <pj/lock.h>
+#include <pj/log.h>
+#include <pj/list.h>
+#include <pj/pool.h>
+#include <pj/string.h>
+#include <pj/assert.h>
+#include <pj/errno.h>
+#include <pj/sock.h>
+#include <pj/compat/socket.h>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define THIS_FILE   "ioq_uring"
+
+//#define TRACE_(expr) PJ_LOG(3,expr)
+#define TRACE_(expr)
+
+/*
+ * The uring ioqueue relies on socket functions (pj_sock_xxx()) to return
+ * the correct error code.
+ */
+#if PJ_RETURN_OS_ERROR(100) != PJ_STATUS_FROM_OS(100)
+#   error "Proper error reporting must be enabled for ioqueue to work!"
+#endif
+
+#define PENDING_RETRY	2
+
+/* Maximum number of write requests in flight for a datagram socket.
+ * Stream sockets only have one write in flight to preserve ordering.
+ */
+#define MAX_WRITE_SLOTS	8
+
+/* Maximum number of received buffers held by a key before its multishot
+ * recv is paused, so that a socket which is not being read can't starve
+ * the other sockets of receive buffers.
+ */
+#define MAX_RX_STASH	32
+
+/* Space reserved at the start of each buffer for recvmsg header and
+ * the source address of datagram sockets.
+ */
+#define RX_HDR_LEN	(sizeof(struct io_uring_recvmsg_out) + \
+			 sizeof(pj_sockaddr))
+
+/* Buffer group ID of the receive buffer ring */
+#define RX_BGID		0
+
+/*
+ * Request type, encoded in the user_data of io_uring requests together
+ * with the key index, key generation and write slot:
+ *
+ *   bits  0-3:  request type
+ *   bits  4-7:  write slot
+ *   bits  8-31: key index
+ *   bits 32-63: key generation
+ */
+enum request_type
+{
+    REQ_NONE,
+    REQ_RECV,
+    REQ_SEND,
+    REQ_ACCEPT,
+    REQ_CONNECT,
+    REQ_CANCEL,
+    REQ_DELIVER,
+    REQ_WAKE
+};
+
+#define UD_MAKE(key,type,slot)	(((pj_uint64_t)(key)->gen << 32) | \
+				 ((pj_uint64_t)(key)->index << 8) | \
+				 ((slot) << 4) | (type))
+#define UD_TYPE(ud)		((unsigned)((ud) & 0x0F))
+#define UD_SLOT(ud)		((unsigned)(((ud) >> 4) & 0x0F))
+#define UD_INDEX(ud)		((unsigned)(((ud) >> 8) & 0xFFFFFF))
+#define UD_GEN(ud)		((unsigned)((ud) >> 32))
+
+#define load_acquire(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+
+struct generic_operation
+{
+    PJ_DECL_LIST_MEMBER(struct generic_operation);
+    pj_ioqueue_operation_e  op;
+};
+
+struct read_operation
+{
+    PJ_DECL_LIST_MEMBER(struct read_operation);
+    pj_ioqueue_operation_e  op;
+
+    void		   *buf;
+    pj_size_t		    size;
+    unsigned                flags;
+    pj_sockaddr_t	   *rmt_addr;
+    int			   *rmt_addrlen;
+};
+
+struct write_operation
+{
+    PJ_DECL_LIST_MEMBER(struct write_operation);
+    pj_ioqueue_operation_e  op;
+
+    char		   *buf;
+    pj_size_t		    size;
+    pj_ssize_t              written;
+    unsigned                flags;
+    int			    slot;
+    pj_sockaddr		    rmt_addr;
+    int			    rmt_addrlen;
+    struct msghdr	    msg;
+    struct iovec	    iov;
+};
+
+struct accept_operation
+{
+    PJ_DECL_LIST_MEMBER(struct accept_operation);
+    pj_ioqueue_operation_e  op;
+
+    pj_sock_t              *accept_fd;
+    pj_sockaddr_t	   *local_addr;
+    pj_sockaddr_t	   *rmt_addr;
+    int			   *addrlen;
+};
+
+union operation_key
+{
+    struct generic_operation generic;
+    struct read_operation    read;
+    struct write_operation   write;
+#if PJ_HAS_TCP
+    struct accept_operation  accept;
+#endif
+};
+
+/*
+ * Descriptor of a received buffer which has not been consumed by the
+ * application yet. There is one descriptor for each buffer in the ring,
+ * indexed by the buffer ID.
+ */
+struct rx_node
+{
+    struct rx_node	   *next;
+    unsigned		    off;	/* Offset of unread data.	*/
+    unsigned		    len;	/* Length of unread data.	*/
+    unsigned		    name_off;	/* Offset of source address.	*/
+    unsigned		    namelen;	/* Length of source address.	*/
+};
+
+/*
+ * This describes each key.
+ */
+struct pj_ioqueue_key_t
+{
+    PJ_DECL_LIST_MEMBER(struct pj_ioqueue_key_t);
+    pj_ioqueue_t           *ioqueue;
+    unsigned		    index;
+    unsigned		    gen;
+    pj_grp_lock_t	   *grp_lock;
+    pj_lock_t              *lock;
+    pj_bool_t		    allow_concurrent;
+    pj_sock_t		    fd;
+    int                     fd_type;
+    void		   *user_data;
+    pj_ioqueue_callback	    cb;
+    int                     connecting;
+    struct read_operation   read_list;
+    struct write_operation  write_list;
+    struct accept_operation accept_list;
+    unsigned		    ref_count;
+    pj_bool_t		    closing;
+    pj_time_val		    free_time;
+
+    /* Requests in flight */
+    struct write_operation *wr_slot[MAX_WRITE_SLOTS];
+    struct accept_operation*accept_op;
+    pj_sockaddr		    connect_addr;
+
+    /* Receive state, protected by rx_lock */
+    pj_lock_t		   *rx_lock;
+    pj_bool_t		    rx_armed;	/* Multishot recv is active.	*/
+    pj_bool_t		    rx_paused;	/* Too many buffers held.	*/
+    pj_bool_t		    rx_starved;	/* Ran out of ring buffers.	*/
+    pj_bool_t		    rx_has_final;
+    pj_ssize_t		    rx_final;	/* 0 (EOF) or negative status.	*/
+    struct rx_node	   *rx_head;
+    struct rx_node	   *rx_tail;
+    unsigned		    rx_cnt;
+};
+
+/* Memory mapped submission queue */
+struct uring_sq
+{
+    unsigned		   *khead;
+    unsigned		   *ktail;
+    unsigned		   *kring_mask;
+    unsigned		   *kflags;
+    unsigned		   *array;
+    struct io_uring_sqe	   *sqes;
+    unsigned		    tail;
+    unsigned		    entries;
+    void		   *ring_ptr;
+    pj_size_t		    ring_sz;
+    pj_size_t		    sqes_sz;
+};
+
+/* Memory mapped completion queue */
+struct uring_cq
+{
+    unsigned		   *khead;
+    unsigned		   *ktail;
+    unsigned		   *kring_mask;
+    struct io_uring_cqe	   *cqes;
+};
+
+/*
+ * This describes the I/O queue.
+ */
+struct pj_ioqueue_t
+{
+    pj_lock_t          *lock;
+    pj_bool_t           auto_delete_lock;
+    pj_bool_t		default_concurrency;
+
+    unsigned		max, count;
+    pj_ioqueue_key_t   *keys;
+    pj_ioqueue_key_t	active_list;
+    pj_ioqueue_key_t	closing_list;
+    pj_ioqueue_key_t	free_list;
+    pj_mutex_t	       *ref_cnt_mutex;
+
+    int			ring_fd;
+    struct uring_sq	sq;
+    struct uring_cq	cq;
+    pj_lock_t	       *sq_lock;
+    pj_lock_t	       *cq_lock;
+    unsigned		sq_pending;
+
+    /* Requests made outside the polling threads, protected by sq_lock */
+    struct io_uring_sqe *backlog;
+    unsigned		backlog_cnt;
+    unsigned		backlog_max;
+    int			wake_fd;
+    pj_uint64_t		wake_val;
+    pj_bool_t		wake_armed;
+    pj_bool_t		wake_signaled;
+
+    /* Receive buffer ring */
+    struct io_uring_buf_ring *br;
+    pj_size_t		br_sz;
+    char	       *rx_buf;
+    pj_size_t		rx_buf_sz;
+    unsigned		rx_buf_cnt;
+    unsigned		rx_buf_len;
+    pj_uint16_t		br_tail;
+    pj_lock_t	       *br_lock;
+    struct rx_node     *rx_nodes;
+    struct msghdr	rx_msg;
+    unsigned		starved_cnt;
+    unsigned		buf_returned;
+};
+
+/* Completion copied out of the completion queue */
+struct completion
+{
+    pj_uint64_t		user_data;
+    pj_int32_t		res;
+    pj_uint32_t		flags;
+    pj_bool_t		valid;
+};
+
+/* Thread local to mark that the thread is dispatching events of an
+ * ioqueue, in which case requests are submitted when the poll finishes.
+ */
+static long tls_dispatch_id = -1;
+
+#define IS_CLOSING(key)  (key->closing)
+
+/* Scan closing keys to be put to free list again */
+static void scan_closing_keys(pj_ioqueue_t *ioqueue);
+
+
+/*
+ * System call wrappers.
+ */
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		       unsigned flags, void *arg, pj_size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, arg, argsz);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg,
+			  unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+/* Set the socket in the registered file table. */
+static pj_status_t set_file_slot(pj_ioqueue_t *ioqueue, unsigned index,
+				 int fd)
+{
+    struct io_uring_files_update up;
+
+    pj_bzero(&up, sizeof(up));
+    up.offset = index;
+    up.fds = (pj_uint64_t)(pj_size_t)&fd;
+    if (uring_register(ioqueue->ring_fd, IORING_REGISTER_FILES_UPDATE,
+		       &up, 1) != 1)
+    {
+	return PJ_RETURN_OS_ERROR(errno);
+    }
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_name()
+ */
+PJ_DEF(const char*) pj_ioqueue_name(void)
+{
+    return "io_uring";
+}
+
+/* Check if current thread is dispatching events for the ioqueue. */
+static pj_bool_t is_dispatching(pj_ioqueue_t *ioqueue)
+{
+    return pj_thread_local_get(tls_dispatch_id) == ioqueue;
+}
+
+/* Submit queued requests to the kernel. */
+static void flush_sq(pj_ioqueue_t *ioqueue)
+{
+    unsigned n;
+    int rc;
+
+    pj_lock_acquire(ioqueue->sq_lock);
+    n = ioqueue->sq_pending;
+    ioqueue->sq_pending = 0;
+    pj_lock_release(ioqueue->sq_lock);
+
+    if (n == 0)
+	return;
+
+    rc = uring_enter(ioqueue->ring_fd, n, 0, 0, NULL, 0);
+    if (rc < 0 || (unsigned)rc < n) {
+	/* Put back what has not been submitted, they will be submitted
+	 * on the next poll.
+	 */
+	pj_lock_acquire(ioqueue->sq_lock);
+	ioqueue->sq_pending += (rc < 0 ? n : n - rc);
+	pj_lock_release(ioqueue->sq_lock);
+    }
+}
+
+/* Get a free submission queue entry. Must be called with sq_lock held. */
+static struct io_uring_sqe *get_sqe(pj_ioqueue_t *ioqueue)
+{
+    struct uring_sq *sq = &ioqueue->sq;
+    struct io_uring_sqe *sqe;
+    unsigned head;
+
+    head = load_acquire(sq->khead);
+    while (sq->tail - head >= sq->entries) {
+	/* Queue is full, submit the pending entries now */
+	int rc = uring_enter(ioqueue->ring_fd, ioqueue->sq_pending, 0, 0,
+			     NULL, 0);
+	if (rc > 0)
+	    ioqueue->sq_pending -= rc;
+	else if (rc < 0 && errno != EAGAIN && errno != EBUSY &&
+		 errno != EINTR)
+	{
+	    return NULL;
+	}
+	head = load_acquire(sq->khead);
+    }
+
+    sqe = &sq->sqes[sq->tail & *sq->kring_mask];
+    pj_bzero(sqe, sizeof(*sqe));
+    return sqe;
+}
+
+/* Publish the entry obtained with get_sqe(). Must be called with sq_lock
+ * held.
+ */
+static void commit_sqe(pj_ioqueue_t *ioqueue)
+{
+    struct uring_sq *sq = &ioqueue->sq;
+
+    sq->array[sq->tail & *sq->kring_mask] = sq->tail & *sq->kring_mask;
+    ++sq->tail;
+    store_release(sq->ktail, sq->tail);
+    ++ioqueue->sq_pending;
+}
+
+/* Submit a request.
+ *
+ * io_uring completes socket requests in the context of the thread which
+ * submitted them, so requests are only submitted by threads which are
+ * polling the ioqueue, and the submission is done when the poll finishes
+ * so that several requests are submitted with one system call. Requests
+ * made by other threads are put in the backlog, and a polling thread is
+ * woken up to submit them.
+ */
+static pj_status_t submit_req(pj_ioqueue_t *ioqueue,
+			      const struct io_uring_sqe *req)
+{
+    struct io_uring_sqe *sqe;
+    pj_bool_t wake = PJ_FALSE;
+
+    pj_lock_acquire(ioqueue->sq_lock);
+    if (!is_dispatching(ioqueue) &&
+	ioqueue->backlog_cnt < ioqueue->backlog_max)
+    {
+	pj_memcpy(&ioqueue->backlog[ioqueue->backlog_cnt++], req,
+		  sizeof(*req));
+	if (!ioqueue->wake_signaled) {
+	    ioqueue->wake_signaled = PJ_TRUE;
+	    wake = PJ_TRUE;
+	}
+	pj_lock_release(ioqueue->sq_lock);
+
+	if (wake) {
+	    pj_uint64_t val = 1;
+	    if (write(ioqueue->wake_fd, &val, sizeof(val)) < 0) {
+		TRACE_((THIS_FILE, "Error signaling ioqueue: %d", errno));
+	    }
+	}
+	return PJ_SUCCESS;
+    }
+
+    sqe = get_sqe(ioqueue);
+    if (!sqe) {
+	pj_status_t status = PJ_RETURN_OS_ERROR(errno);
+	pj_lock_release(ioqueue->sq_lock);
+	return status;
+    }
+    pj_memcpy(sqe, req, sizeof(*sqe));
+    commit_sqe(ioqueue);
+    pj_lock_release(ioqueue->sq_lock);
+
+    /* Backlog is full, submit it now from this thread */
+    if (!is_dispatching(ioqueue))
+	flush_sq(ioqueue);
+
+    return PJ_SUCCESS;
+}
+
+/* Move requests in the backlog to the submission queue, and make sure
+ * that the polling thread will be woken up when there are new requests
+ * in the backlog. Must be called by the polling thread.
+ */
+static void drain_backlog(pj_ioqueue_t *ioqueue)
+{
+    unsigned i;
+
+    pj_lock_acquire(ioqueue->sq_lock);
+
+    for (i=0; i<ioqueue->backlog_cnt; ++i) {
+	struct io_uring_sqe *sqe = get_sqe(ioqueue);
+	if (!sqe)
+	    break;
+	pj_memcpy(sqe, &ioqueue->backlog[i], sizeof(*sqe));
+	commit_sqe(ioqueue);
+    }
+    if (i < ioqueue->backlog_cnt) {
+	pj_memmove(ioqueue->backlog, &ioqueue->backlog[i],
+		   (ioqueue->backlog_cnt - i) * sizeof(struct io_uring_sqe));
+    }
+    ioqueue->backlog_cnt -= i;
+
+    if (!ioqueue->wake_armed) {
+	struct io_uring_sqe *sqe = get_sqe(ioqueue);
+	if (sqe) {
+	    sqe->opcode = IORING_OP_READ;
+	    sqe->fd = ioqueue->wake_fd;
+	    sqe->addr = (pj_uint64_t)(pj_size_t)&ioqueue->wake_val;
+	    sqe->len = sizeof(ioqueue->wake_val);
+	    sqe->user_data = REQ_WAKE;
+	    commit_sqe(ioqueue);
+	    ioqueue->wake_armed = PJ_TRUE;
+	    ioqueue->wake_signaled = PJ_FALSE;
+	}
+    }
+
+    pj_lock_release(ioqueue->sq_lock);
+}
+
+/* Return a buffer to the buffer ring. */
+static void recycle_buf(pj_ioqueue_t *ioqueue, unsigned bid)
+{
+    struct io_uring_buf *buf;
+    unsigned mask = ioqueue->rx_buf_cnt - 1;
+
+    pj_lock_acquire(ioqueue->br_lock);
+    buf = &ioqueue->br->bufs[ioqueue->br_tail & mask];
+    buf->addr = (pj_uint64_t)(pj_size_t)
+		(ioqueue->rx_buf + (pj_size_t)bid * ioqueue->rx_buf_len);
+    buf->len = ioqueue->rx_buf_len;
+    buf->bid = (pj_uint16_t)bid;
+    ++ioqueue->br_tail;
+    store_release(&ioqueue->br->tail, ioqueue->br_tail);
+    ++ioqueue->buf_returned;
+    pj_lock_release(ioqueue->br_lock);
+}
+
+/* Arm the multishot recv of the key when there is a pending read and
+ * nothing prevents it. Must be called with rx_lock held.
+ */
+static void rx_update_arm(pj_ioqueue_key_t *key)
+{
+    struct io_uring_sqe req;
+
+    if (key->rx_armed || key->rx_paused || key->rx_starved ||
+	key->rx_has_final || IS_CLOSING(key) ||
+	pj_list_empty(&key->read_list))
+    {
+	return;
+    }
+
+    pj_bzero(&req, sizeof(req));
+    if (key->fd_type == pj_SOCK_DGRAM()) {
+	req.opcode = IORING_OP_RECVMSG;
+	req.addr = (pj_uint64_t)(pj_size_t)&key->ioqueue->rx_msg;
+	req.len = 1;
+    } else {
+	req.opcode = IORING_OP_RECV;
+    }
+    req.fd = key->index;
+    req.ioprio = IORING_RECV_MULTISHOT;
+    req.flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    req.buf_group = RX_BGID;
+    req.user_data = UD_MAKE(key, REQ_RECV, 0);
+
+    if (submit_req(key->ioqueue, &req) == PJ_SUCCESS)
+	key->rx_armed = PJ_TRUE;
+}
+
+/* Cancel a request of the key. */
+static void cancel_req(pj_ioqueue_key_t *key, unsigned type, unsigned slot)
+{
+    struct io_uring_sqe req;
+
+    pj_bzero(&req, sizeof(req));
+    req.opcode = IORING_OP_ASYNC_CANCEL;
+    req.fd = -1;
+    req.addr = UD_MAKE(key, type, slot);
+    req.user_data = UD_MAKE(key, REQ_CANCEL, 0);
+    submit_req(key->ioqueue, &req);
+}
+
+/* Post a request to deliver data already received for the key, from
+ * the polling thread.
+ */
+static void post_deliver(pj_ioqueue_key_t *key)
+{
+    struct io_uring_sqe req;
+
+    pj_bzero(&req, sizeof(req));
+    req.opcode = IORING_OP_NOP;
+    req.user_data = UD_MAKE(key, REQ_DELIVER, 0);
+    submit_req(key->ioqueue, &req);
+}
+
+/* Release all received buffers held by the key. Must be called with
+ * rx_lock held.
+ */
+static void rx_clear(pj_ioqueue_key_t *key)
+{
+    pj_ioqueue_t *ioqueue = key->ioqueue;
+
+    while (key->rx_head) {
+	struct rx_node *node = key->rx_head;
+	key->rx_head = node->next;
+	recycle_buf(ioqueue, (unsigned)(node - ioqueue->rx_nodes));
+    }
+    key->rx_tail = NULL;
+    key->rx_cnt = 0;
+    if (key->rx_starved) {
+	key->rx_starved = PJ_FALSE;
+	--ioqueue->starved_cnt;
+    }
+}
+
+/* Process a completion of the multishot recv. This is called by the
+ * polling thread in the order of the completion queue, with cq_lock held.
+ */
+static void on_recv_cqe(pj_ioqueue_t *ioqueue, const struct completion *c)
+{
+    pj_ioqueue_key_t *key = &ioqueue->keys[UD_INDEX(c->user_data)];
+    unsigned bid = c->flags >> IORING_CQE_BUFFER_SHIFT;
+    pj_bool_t has_buf = (c->flags & IORING_CQE_F_BUFFER) != 0;
+
+    pj_lock_acquire(key->rx_lock);
+
+    /* Stale completion for a key which has been unregistered */
+    if (key->gen != UD_GEN(c->user_data) || IS_CLOSING(key)) {
+	pj_lock_release(key->rx_lock);
+	if (has_buf)
+	    recycle_buf(ioqueue, bid);
+	return;
+    }
+
+    if (has_buf && c->res > 0) {
+	struct rx_node *node = &ioqueue->rx_nodes[bid];
+	char *buf = ioqueue->rx_buf + (pj_size_t)bid * ioqueue->rx_buf_len;
+
+	node->next = NULL;
+	if (key->fd_type == pj_SOCK_DGRAM()) {
+	    struct io_uring_recvmsg_out *out;
+
+	    out = (struct io_uring_recvmsg_out*)buf;
+	    node->name_off = sizeof(*out);
+	    node->namelen = out->namelen;
+	    if (node->namelen > ioqueue->rx_msg.msg_namelen)
+		node->namelen = ioqueue->rx_msg.msg_namelen;
+	    node->off = sizeof(*out) + ioqueue->rx_msg.msg_namelen +
+			ioqueue->rx_msg.msg_controllen;
+	    node->len = out->payloadlen;
+	    if (node->off + node->len > (unsigned)c->res)
+		node->len = c->res - node->off;
+	} else {
+	    node->name_off = node->namelen = 0;
+	    node->off = 0;
+	    node->len = c->res;
+	}
+
+	if (key->rx_tail)
+	    key->rx_tail->next = node;
+	else
+	    key->rx_head = node;
+	key->rx_tail = node;
+	++key->rx_cnt;
+
+	/* Pause receiving if the application is not reading */
+	if (key->rx_cnt >= MAX_RX_STASH && key->rx_armed &&
+	    !key->rx_paused)
+	{
+	    key->rx_paused = PJ_TRUE;
+	    cancel_req(key, REQ_RECV, 0);
+	}
+    } else if (has_buf) {
+	recycle_buf(ioqueue, bid);
+    }
+
+    if ((c->flags & IORING_CQE_F_MORE) == 0) {
+	/* The multishot recv has terminated */
+	key->rx_armed = PJ_FALSE;
+
+	if (c->res == -ENOBUFS) {
+	    /* Will be rearmed when buffers are returned to the ring */
+	    if (!key->rx_starved) {
+		key->rx_starved = PJ_TRUE;
+		++ioqueue->starved_cnt;
+	    }
+	} else if (c->res == -ECANCELED && key->rx_paused) {
+	    /* Paused, will be rearmed when application reads the data */
+	} else if (c->res == -ECANCELED) {
+	    rx_update_arm(key);
+	} else if (c->res == 0 && key->fd_type != pj_SOCK_DGRAM()) {
+	    /* Connection closed by remote */
+	    key->rx_has_final = PJ_TRUE;
+	    key->rx_final = 0;
+	} else if (c->res < 0) {
+	    key->rx_has_final = PJ_TRUE;
+	    key->rx_final = -PJ_STATUS_FROM_OS(-c->res);
+	} else {
+	    rx_update_arm(key);
+	}
+    }
+
+    pj_lock_release(key->rx_lock);
+}
+
+/* Fill the read operation with received data, if there is any.
+ * Must be called with key's lock held.
+ */
+static pj_bool_t rx_fetch(pj_ioqueue_key_t *key,
+			  struct read_operation *read_op,
+			  pj_ssize_t *bytes)
+{
+    pj_ioqueue_t *ioqueue = key->ioqueue;
+    pj_bool_t found = PJ_FALSE;
+
+    pj_lock_acquire(key->rx_lock);
+
+    if (key->rx_head && read_op->op == PJ_IOQUEUE_OP_RECVMMSG) {
+	pj_sock_msg *msgs = (pj_sock_msg*)read_op->buf;
+	unsigned cnt = 0;
+
+	/* Batched receive takes as many stashed datagrams as it can */
+	while (key->rx_head && cnt < read_op->size) {
+	    struct rx_node *node = key->rx_head;
+	    unsigned bid = (unsigned)(node - ioqueue->rx_nodes);
+	    char *buf = ioqueue->rx_buf + (pj_size_t)bid * ioqueue->rx_buf_len;
+	    pj_sock_msg *msg = &msgs[cnt++];
+	    unsigned namelen = node->namelen;
+
+	    if (msg->len > (pj_ssize_t)node->len)
+		msg->len = node->len;
+	    pj_memcpy(msg->buf, buf + node->off, msg->len);
+
+	    if (namelen > (unsigned)msg->addr_len)
+		namelen = msg->addr_len;
+	    pj_memcpy(&msg->addr, buf + node->name_off, namelen);
+	    msg->addr_len = node->namelen;
+
+	    key->rx_head = node->next;
+	    if (!key->rx_head)
+		key->rx_tail = NULL;
+	    --key->rx_cnt;
+	    recycle_buf(ioqueue, bid);
+	}
+	*bytes = cnt;
+
+	if (key->rx_paused && key->rx_cnt < MAX_RX_STASH / 2)
+	    key->rx_paused = PJ_FALSE;
+
+	found = PJ_TRUE;
+
+    } else if (key->rx_head) {
+	struct rx_node *node = key->rx_head;
+	unsigned bid = (unsigned)(node - ioqueue->rx_nodes);
+	char *buf = ioqueue->rx_buf + (pj_size_t)bid * ioqueue->rx_buf_len;
+	pj_size_t len = node->len;
+
+	if (len > read_op->size)
+	    len = read_op->size;
+	pj_memcpy(read_op->buf, buf + node->off, len);
+	*bytes = len;
+
+	if (read_op->op == PJ_IOQUEUE_OP_RECV_FROM && read_op->rmt_addr &&
+	    read_op->rmt_addrlen)
+	{
+	    unsigned namelen = node->namelen;
+	    if (namelen > (unsigned)*read_op->rmt_addrlen)
+		namelen = *read_op->rmt_addrlen;
+	    pj_memcpy(read_op->rmt_addr, buf + node->name_off, namelen);
+	    *read_op->rmt_addrlen = node->namelen;
+	}
+
+	node->off += (unsigned)len;
+	node->len -= (unsigned)len;
+
+	/* Datagram is always consumed as a whole */
+	if (node->len == 0 || key->fd_type == pj_SOCK_DGRAM()) {
+	    key->rx_head = node->next;
+	    if (!key->rx_head)
+		key->rx_tail = NULL;
+	    --key->rx_cnt;
+	    recycle_buf(ioqueue, bid);
+	}
+
+	if (key->rx_paused && key->rx_cnt < MAX_RX_STASH / 2)
+	    key->rx_paused = PJ_FALSE;
+
+	found = PJ_TRUE;
+
+    } else if (key->rx_has_final) {
+	*bytes = key->rx_final;
+
+	/* EOF is reported to all subsequent reads, while error is only
+	 * reported once.
+	 */
+	if (key->rx_final != 0)
+	    key->rx_has_final = PJ_FALSE;
+
+	found = PJ_TRUE;
+    }
+
+    pj_lock_release(key->rx_lock);
+    return found;
+}
+
+/* Re-arm the multishot recv of keys after running out of buffers. */
+static void rearm_starved_keys(pj_ioqueue_t *ioqueue)
+{
+    pj_ioqueue_key_t *key;
+
+    pj_lock_acquire(ioqueue->lock);
+    key = ioqueue->active_list.next;
+    while (key != &ioqueue->active_list && ioqueue->starved_cnt) {
+	pj_lock_acquire(key->rx_lock);
+	if (key->rx_starved) {
+	    key->rx_starved = PJ_FALSE;
+	    --ioqueue->starved_cnt;
+	    rx_update_arm(key);
+	}
+	pj_lock_release(key->rx_lock);
+	key = key->next;
+    }
+    pj_lock_release(ioqueue->lock);
+}
+
+/* Destroy the io_uring instance and buffers */
+static void destroy_ring(pj_ioqueue_t *ioqueue)
+{
+    if (ioqueue->ring_fd >= 0) {
+	close(ioqueue->ring_fd);
+	ioqueue->ring_fd = -1;
+    }
+    if (ioqueue->wake_fd >= 0) {
+	close(ioqueue->wake_fd);
+	ioqueue->wake_fd = -1;
+    }
+    if (ioqueue->sq.sqes) {
+	munmap(ioqueue->sq.sqes, ioqueue->sq.sqes_sz);
+	ioqueue->sq.sqes = NULL;
+    }
+    if (ioqueue->sq.ring_ptr) {
+	munmap(ioqueue->sq.ring_ptr, ioqueue->sq.ring_sz);
+	ioqueue->sq.ring_ptr = NULL;
+    }
+    if (ioqueue->br) {
+	munmap(ioqueue->br, ioqueue->br_sz);
+	ioqueue->br = NULL;
+    }
+    if (ioqueue->rx_buf) {
+	munmap(ioqueue->rx_buf, ioqueue->rx_buf_sz);
+	ioqueue->rx_buf = NULL;
+    }
+}
+
+/* Create the io_uring instance, and register the file table and the
+ * receive buffer ring.
+ */
+static pj_status_t create_ring(pj_ioqueue_t *ioqueue)
+{
+    struct io_uring_params p;
+    struct io_uring_rsrc_register files;
+    struct io_uring_buf_reg reg;
+    struct uring_sq *sq = &ioqueue->sq;
+    struct uring_cq *cq = &ioqueue->cq;
+    char *cq_ptr;
+    unsigned i;
+    pj_status_t status;
+
+    pj_bzero(&p, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = PJ_IOQUEUE_URING_ENTRIES * 4;
+
+    ioqueue->ring_fd = uring_setup(PJ_IOQUEUE_URING_ENTRIES, &p);
+    if (ioqueue->ring_fd < 0)
+	return PJ_RETURN_OS_ERROR(errno);
+
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) == 0 ||
+	(p.features & IORING_FEAT_EXT_ARG) == 0 ||
+	(p.features & IORING_FEAT_NODROP) == 0)
+    {
+	PJ_LOG(3,(THIS_FILE, "io_uring features are not supported by "
+			     "the kernel (0x%x)", p.features));
+	status = PJ_ENOTSUP;
+	goto on_error;
+    }
+
+    /* Map submission and completion queue rings */
+    sq->ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    if (p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe) >
+	sq->ring_sz)
+    {
+	sq->ring_sz = p.cq_off.cqes +
+		      p.cq_entries * sizeof(struct io_uring_cqe);
+    }
+    sq->ring_ptr = mmap(NULL, sq->ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ioqueue->ring_fd,
+			IORING_OFF_SQ_RING);
+    if (sq->ring_ptr == MAP_FAILED) {
+	sq->ring_ptr = NULL;
+	status = PJ_RETURN_OS_ERROR(errno);
+	goto on_error;
+    }
+
+    sq->khead = (unsigned*)((char*)sq->ring_ptr + p.sq_off.head);
+    sq->ktail = (unsigned*)((char*)sq->ring_ptr + p.sq_off.tail);
+    sq->kring_mask = (unsigned*)((char*)sq->ring_ptr + p.sq_off.ring_mask);
+    sq->kflags = (unsigned*)((char*)sq->ring_ptr + p.sq_off.flags);
+    sq->array = (unsigned*)((char*)sq->ring_ptr + p.sq_off.array);
+    sq->entries = p.sq_entries;
+    sq->tail = *sq->ktail;
+
+    sq->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    sq->sqes = (struct io_uring_sqe*)
+	       mmap(NULL, sq->sqes_sz, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, ioqueue->ring_fd,
+		    IORING_OFF_SQES);
+    if (sq->sqes == MAP_FAILED) {
+	sq->sqes = NULL;
+	status = PJ_RETURN_OS_ERROR(errno);
+	goto on_error;
+    }
+
+    cq_ptr = (char*)sq->ring_ptr;
+    cq->khead = (unsigned*)(cq_ptr + p.cq_off.head);
+    cq->ktail = (unsigned*)(cq_ptr + p.cq_off.tail);
+    cq->kring_mask = (unsigned*)(cq_ptr + p.cq_off.ring_mask);
+    cq->cqes = (struct io_uring_cqe*)(cq_ptr + p.cq_off.cqes);
+
+    /* Allocate receive buffers and the buffer ring */
+    ioqueue->rx_buf_cnt = PJ_IOQUEUE_URING_BUF_COUNT;
+    ioqueue->rx_buf_len = PJ_IOQUEUE_URING_BUF_SIZE;
+    ioqueue->rx_buf_sz = (pj_size_t)ioqueue->rx_buf_cnt *
+			 ioqueue->rx_buf_len;
+    ioqueue->rx_buf = (char*)mmap(NULL, ioqueue->rx_buf_sz,
+				  PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ioqueue->rx_buf == MAP_FAILED) {
+	ioqueue->rx_buf = NULL;
+	status = PJ_RETURN_OS_ERROR(errno);
+	goto on_error;
+    }
+
+    ioqueue->br_sz = ioqueue->rx_buf_cnt * sizeof(struct io_uring_buf);
+    ioqueue->br = (struct io_uring_buf_ring*)
+		  mmap(NULL, ioqueue->br_sz, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ioqueue->br == MAP_FAILED) {
+	ioqueue->br = NULL;
+	status = PJ_RETURN_OS_ERROR(errno);
+	goto on_error;
+    }
+
+    pj_bzero(&reg, sizeof(reg));
+    reg.ring_addr = (pj_uint64_t)(pj_size_t)ioqueue->br;
+    reg.ring_entries = ioqueue->rx_buf_cnt;
+    reg.bgid = RX_BGID;
+    if (uring_register(ioqueue->ring_fd, IORING_REGISTER_PBUF_RING,
+		       &reg, 1) != 0)
+    {
+	status = PJ_RETURN_OS_ERROR(errno);
+	PJ_PERROR(3,(THIS_FILE, status, "Unable to register buffer ring"));
+	goto on_error;
+    }
+
+    for (i=0; i<ioqueue->rx_buf_cnt; ++i)
+	recycle_buf(ioqueue, i);
+
+    /* Empty file table, sockets are added when registered */
+    pj_bzero(&files, sizeof(files));
+    files.nr = ioqueue->max;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (uring_register(ioqueue->ring_fd, IORING_REGISTER_FILES2,
+		       &files, sizeof(files)) != 0)
+    {
+	status = PJ_RETURN_OS_ERROR(errno);
+	PJ_PERROR(3,(THIS_FILE, status, "Unable to register file table"));
+	goto on_error;
+    }
+
+    /* Event to wake up the polling thread */
+    ioqueue->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ioqueue->wake_fd < 0) {
+	status = PJ_RETURN_OS_ERROR(errno);
+	goto on_error;
+    }
+
+    /* Message header template for the multishot recvmsg, which tells the
+     * kernel how much space to reserve for the source address.
+     */
+    pj_bzero(&ioqueue->rx_msg, sizeof(ioqueue->rx_msg));
+    ioqueue->rx_msg.msg_namelen = sizeof(pj_sockaddr);
+
+    return PJ_SUCCESS;
+
+on_error:
+    destroy_ring(ioqueue);
+    return status;
+}
+
+/*
+ * pj_ioqueue_create()
+ *
+ * Create io_uring ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
+                                       pj_size_t max_fd,
+                                       pj_ioqueue_t **p_ioqueue)
+{
+    return pj_ioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * Create io_uring ioqueue with the specified settings. The epoll flags
+ * are not applicable to this backend and are ignored.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool,
+                                       pj_size_t max_fd,
+                                       const pj_ioqueue_cfg *cfg,
+                                       pj_ioqueue_t **p_ioqueue)
+{
+    pj_ioqueue_t *ioqueue;
+    pj_lock_t *lock;
+    unsigned i;
+    pj_status_t rc;
+
+    /* Check that arguments are valid. */
+    PJ_ASSERT_RETURN(pool != NULL && p_ioqueue != NULL &&
+                     max_fd > 0 && max_fd <= 0xFFFFFF, PJ_EINVAL);
+
+    /* Check that size of pj_ioqueue_op_key_t is sufficient */
+    PJ_ASSERT_RETURN(sizeof(pj_ioqueue_op_key_t)-sizeof(void*) >=
+                     sizeof(union operation_key), PJ_EBUG);
+
+    /* Buffer count must be a power of two */
+    PJ_ASSERT_RETURN((PJ_IOQUEUE_URING_BUF_COUNT &
+		      (PJ_IOQUEUE_URING_BUF_COUNT-1)) == 0 &&
+		     PJ_IOQUEUE_URING_BUF_COUNT <= 32768, PJ_EBUG);
+    PJ_ASSERT_RETURN(PJ_IOQUEUE_URING_BUF_SIZE > RX_HDR_LEN, PJ_EBUG);
+
+    if (tls_dispatch_id == -1) {
+	rc = pj_thread_local_alloc(&tls_dispatch_id);
+	if (rc != PJ_SUCCESS)
+	    return rc;
+    }
+
+    ioqueue = PJ_POOL_ZALLOC_T(pool, pj_ioqueue_t);
+    ioqueue->ring_fd = -1;
+    ioqueue->wake_fd = -1;
+    ioqueue->default_concurrency = cfg ? cfg->default_concurrency :
+				   PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+    ioqueue->max = (unsigned)max_fd;
+    ioqueue->count = 0;
+    pj_list_init(&ioqueue->active_list);
+    pj_list_init(&ioqueue->free_list);
+    pj_list_init(&ioqueue->closing_list);
+
+    /* Mutex to protect key's reference counter
+     * We don't want to use key's mutex or ioqueue's mutex because
+     * that would create deadlock situation in some cases.
+     */
+    rc = pj_mutex_create_simple(pool, NULL, &ioqueue->ref_cnt_mutex);
+    if (rc != PJ_SUCCESS)
+	return rc;
+
+    rc = pj_lock_create_simple_mutex(pool, "ioqsq%p", &ioqueue->sq_lock);
+    if (rc != PJ_SUCCESS)
+	goto on_error;
+
+    rc = pj_lock_create_simple_mutex(pool, "ioqcq%p", &ioqueue->cq_lock);
+    if (rc != PJ_SUCCESS)
+	goto on_error;
+
+    rc = pj_lock_create_simple_mutex(pool, "ioqbr%p", &ioqueue->br_lock);
+    if (rc != PJ_SUCCESS)
+	goto on_error;
+
+    /* Pre-create all keys according to max_fd. Keys are never freed, so
+     * that late completions can always be matched against the key.
+     */
+    ioqueue->keys = (pj_ioqueue_key_t*)
+		    pj_pool_calloc(pool, max_fd, sizeof(pj_ioqueue_key_t));
+    for (i=0; i<max_fd; ++i) {
+	pj_ioqueue_key_t *key = &ioqueue->keys[i];
+
+	key->index = i;
+	key->ioqueue = ioqueue;
+	rc = pj_lock_create_recursive_mutex(pool, NULL, &key->lock);
+	if (rc != PJ_SUCCESS)
+	    goto on_error;
+	rc = pj_lock_create_simple_mutex(pool, NULL, &key->rx_lock);
+	if (rc != PJ_SUCCESS)
+	    goto on_error;
+
+	pj_list_push_back(&ioqueue->free_list, key);
+    }
+
+    ioqueue->rx_nodes = (struct rx_node*)
+			pj_pool_calloc(pool, PJ_IOQUEUE_URING_BUF_COUNT,
+				       sizeof(struct rx_node));
+    ioqueue->backlog_max = PJ_IOQUEUE_URING_ENTRIES;
+    ioqueue->backlog = (struct io_uring_sqe*)
+		       pj_pool_calloc(pool, ioqueue->backlog_max,
+				      sizeof(struct io_uring_sqe));
+
+    rc = create_ring(ioqueue);
+    if (rc != PJ_SUCCESS)
+	goto on_error;
+
+    rc = pj_lock_create_simple_mutex(pool, "ioq%p", &lock);
+    if (rc != PJ_SUCCESS)
+	goto on_error;
+
+    ioqueue->auto_delete_lock = PJ_TRUE;
+    ioqueue->lock = lock;
+
+    PJ_LOG(4, ("pjlib", "io_uring I/O Queue created (%p)", ioqueue));
+
+    *p_ioqueue = ioqueue;
+    return PJ_SUCCESS;
+
+on_error:
+    destroy_ring(ioqueue);
+    for (i=0; ioqueue->keys && i<max_fd; ++i) {
+	if (ioqueue->keys[i].lock)
+	    pj_lock_destroy(ioqueue->keys[i].lock);
+	if (ioqueue->keys[i].rx_lock)
+	    pj_lock_destroy(ioqueue->keys[i].rx_lock);
+    }
+    if (ioqueue->br_lock)
+	pj_lock_destroy(ioqueue->br_lock);
+    if (ioqueue->cq_lock)
+	pj_lock_destroy(ioqueue->cq_lock);
+    if (ioqueue->sq_lock)
+	pj_lock_destroy(ioqueue->sq_lock);
+    pj_mutex_destroy(ioqueue->ref_cnt_mutex);
+    return rc;
+}
+
+/*
+ * pj_ioqueue_destroy()
+ *
+ * Destroy ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
+{
+    unsigned i;
+
+    PJ_ASSERT_RETURN(ioqueue, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+
+    destroy_ring(ioqueue);
+
+    for (i=0; i<ioqueue->max; ++i) {
+	pj_lock_destroy(ioqueue->keys[i].lock);
+	pj_lock_destroy(ioqueue->keys[i].rx_lock);
+    }
+
+    pj_lock_destroy(ioqueue->br_lock);
+    pj_lock_destroy(ioqueue->cq_lock);
+    pj_lock_destroy(ioqueue->sq_lock);
+    pj_mutex_destroy(ioqueue->ref_cnt_mutex);
+
+    if (ioqueue->auto_delete_lock) {
+	pj_lock_release(ioqueue->lock);
+	return pj_lock_destroy(ioqueue->lock);
+    }
+
+    pj_lock_release(ioqueue->lock);
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_set_lock()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_set_lock( pj_ioqueue_t *ioqueue,
+					 pj_lock_t *lock,
+					 pj_bool_t auto_delete )
+{
+    PJ_ASSERT_RETURN(ioqueue && lock, PJ_EINVAL);
+
+    if (ioqueue->auto_delete_lock && ioqueue->lock) {
+        pj_lock_destroy(ioqueue->lock);
+    }
+
+    ioqueue->lock = lock;
+    ioqueue->auto_delete_lock = auto_delete;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_register_sock2()
+ *
+ * Register a socket to ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_register_sock2(pj_pool_t *pool,
+					      pj_ioqueue_t *ioqueue,
+					      pj_sock_t sock,
+					      pj_grp_lock_t *grp_lock,
+					      void *user_data,
+					      const pj_ioqueue_callback *cb,
+                                              pj_ioqueue_key_t **p_key)
+{
+    pj_ioqueue_key_t *key = NULL;
+    pj_uint32_t value;
+    int optlen;
+    pj_status_t rc = PJ_SUCCESS;
+
+    PJ_ASSERT_RETURN(pool && ioqueue && sock != PJ_INVALID_SOCKET &&
+                     cb && p_key, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+
+    if (ioqueue->count >= ioqueue->max) {
+        rc = PJ_ETOOMANY;
+	goto on_return;
+    }
+
+    /* Set socket to nonblocking. */
+    value = 1;
+    if (ioctl(sock, FIONBIO, &value)) {
+        rc = pj_get_netos_error();
+	goto on_return;
+    }
+
+    /* Scan closing_keys first to let them come back to free_list */
+    scan_closing_keys(ioqueue);
+
+    if (pj_list_empty(&ioqueue->free_list)) {
+	rc = PJ_ETOOMANY;
+	goto on_return;
+    }
+
+    key = ioqueue->free_list.next;
+    pj_list_erase(key);
+
+    /* Initialize the key */
+    key->fd = sock;
+    key->user_data = user_data;
+    pj_list_init(&key->read_list);
+    pj_list_init(&key->write_list);
+    pj_list_init(&key->accept_list);
+    key->connecting = 0;
+    pj_bzero(key->wr_slot, sizeof(key->wr_slot));
+    key->accept_op = NULL;
+    pj_memcpy(&key->cb, cb, sizeof(pj_ioqueue_callback));
+
+    pj_assert(key->ref_count == 0);
+    key->ref_count = 1;
+    key->closing = 0;
+
+    key->rx_armed = key->rx_paused = key->rx_starved = PJ_FALSE;
+    key->rx_has_final = PJ_FALSE;
+    key->rx_head = key->rx_tail = NULL;
+    key->rx_cnt = 0;
+
+    rc = pj_ioqueue_set_concurrency(key, ioqueue->default_concurrency);
+    if (rc != PJ_SUCCESS) {
+	pj_list_push_back(&ioqueue->free_list, key);
+	key = NULL;
+	goto on_return;
+    }
+
+    /* Requests refer to the socket by its slot in the registered file
+     * table, which is the key index.
+     */
+    rc = set_file_slot(ioqueue, key->index, sock);
+    if (rc != PJ_SUCCESS) {
+	pj_list_push_back(&ioqueue->free_list, key);
+	key = NULL;
+	goto on_return;
+    }
+
+    optlen = sizeof(key->fd_type);
+    rc = pj_sock_getsockopt(sock, pj_SOL_SOCKET(), pj_SO_TYPE(),
+                            &key->fd_type, &optlen);
+    if (rc != PJ_SUCCESS)
+        key->fd_type = pj_SOCK_STREAM();
+    rc = PJ_SUCCESS;
+
+    key->grp_lock = grp_lock;
+    if (key->grp_lock) {
+	pj_grp_lock_add_ref_dbg(key->grp_lock, "ioqueue", 0);
+    }
+
+    /* Register */
+    pj_list_insert_before(&ioqueue->active_list, key);
+    ++ioqueue->count;
+
+on_return:
+    *p_key = key;
+    pj_lock_release(ioqueue->lock);
+
+    return rc;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_register_sock( pj_pool_t *pool,
+					      pj_ioqueue_t *ioqueue,
+					      pj_sock_t sock,
+					      void *user_data,
+					      const pj_ioqueue_callback *cb,
+					      pj_ioqueue_key_t **p_key)
+{
+    return pj_ioqueue_register_sock2(pool, ioqueue, sock, NULL, user_data,
+                                     cb, p_key);
+}
+
+/* Increment key's reference counter */
+static void increment_counter(pj_ioqueue_key_t *key)
+{
+    pj_mutex_lock(key->ioqueue->ref_cnt_mutex);
+    ++key->ref_count;
+    pj_mutex_unlock(key->ioqueue->ref_cnt_mutex);
+}
+
+/* Decrement the key's reference counter, and when the counter reach zero,
+ * destroy the key.
+ *
+ * Note: MUST NOT CALL THIS FUNCTION WHILE HOLDING ioqueue's LOCK.
+ */
+static void decrement_counter(pj_ioqueue_key_t *key)
+{
+    pj_lock_acquire(key->ioqueue->lock);
+    pj_mutex_lock(key->ioqueue->ref_cnt_mutex);
+    --key->ref_count;
+    if (key->ref_count == 0) {
+
+	pj_assert(key->closing == 1);
+	pj_gettickcount(&key->free_time);
+	key->free_time.msec += PJ_IOQUEUE_KEY_FREE_DELAY;
+	pj_time_val_normalize(&key->free_time);
+
+	pj_list_erase(key);
+	pj_list_push_back(&key->ioqueue->closing_list, key);
+
+    }
+    pj_mutex_unlock(key->ioqueue->ref_cnt_mutex);
+    pj_lock_release(key->ioqueue->lock);
+}
+
+/*
+ * pj_ioqueue_unregister()
+ *
+ * Unregister handle from ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_unregister( pj_ioqueue_key_t *key)
+{
+    pj_ioqueue_t *ioqueue;
+    struct io_uring_sync_cancel_reg reg;
+
+    PJ_ASSERT_RETURN(key != NULL, PJ_EINVAL);
+
+    ioqueue = key->ioqueue;
+
+    /* Lock the key to make sure no callback is simultaneously modifying
+     * the key. We need to lock the key before ioqueue here to prevent
+     * deadlock.
+     */
+    pj_ioqueue_lock_key(key);
+
+    /* Also lock ioqueue */
+    pj_lock_acquire(ioqueue->lock);
+
+    pj_assert(ioqueue->count > 0);
+    --ioqueue->count;
+
+    /* Mark key as closing and invalidate completions of the requests
+     * which are still in flight.
+     */
+    pj_lock_acquire(key->rx_lock);
+    key->closing = 1;
+    rx_clear(key);
+    key->rx_armed = PJ_FALSE;
+    pj_lock_release(key->rx_lock);
+
+    /* New generation, from now on completions of this key are stale */
+    ++key->gen;
+
+    /* Cancel all requests on the socket and remove it from the file
+     * table, so that requests which have not been submitted yet will
+     * fail. The kernel holds a reference to the socket as long as there
+     * is a request for it, so this must be done before the socket is
+     * closed.
+     */
+    pj_bzero(&reg, sizeof(reg));
+    reg.fd = key->index;
+    reg.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_FD_FIXED |
+		IORING_ASYNC_CANCEL_ALL;
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    uring_register(ioqueue->ring_fd, IORING_REGISTER_SYNC_CANCEL, &reg, 1);
+    set_file_slot(ioqueue, key->index, -1);
+
+    /* Close the socket. */
+    pj_sock_close(key->fd);
+
+    pj_lock_release(ioqueue->lock);
+
+    /* Decrement counter. */
+    decrement_counter(key);
+
+    /* Done. */
+    if (key->grp_lock) {
+	/* just dec_ref and unlock. we will set grp_lock to NULL
+	 * elsewhere */
+	pj_grp_lock_t *grp_lock = key->grp_lock;
+	// Don't set grp_lock to NULL otherwise the other thread
+	// will crash. Just leave it as dangling pointer, but this
+	// should be safe
+	//key->grp_lock = NULL;
+	pj_grp_lock_dec_ref_dbg(grp_lock, "ioqueue", 0);
+	pj_grp_lock_release(grp_lock);
+    } else {
+	pj_ioqueue_unlock_key(key);
+    }
+
+    return PJ_SUCCESS;
+}
+
+/* Scan closing keys to be put to free list again */
+static void scan_closing_keys(pj_ioqueue_t *ioqueue)
+{
+    pj_time_val now;
+    pj_ioqueue_key_t *h;
+
+    pj_gettickcount(&now);
+    h = ioqueue->closing_list.next;
+    while (h != &ioqueue->closing_list) {
+	pj_ioqueue_key_t *next = h->next;
+
+	pj_assert(h->closing != 0);
+
+	if (PJ_TIME_VAL_GTE(now, h->free_time)) {
+	    pj_list_erase(h);
+	    pj_list_push_back(&ioqueue->free_list, h);
+	}
+	h = next;
+    }
+}
+
+/*
+ * pj_ioqueue_get_user_data()
+ *
+ * Obtain value associated with a key.
+ */
+PJ_DEF(void*) pj_ioqueue_get_user_data( pj_ioqueue_key_t *key )
+{
+    PJ_ASSERT_RETURN(key != NULL, NULL);
+    return key->user_data;
+}
+
+/*
+ * pj_ioqueue_set_user_data()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_set_user_data( pj_ioqueue_key_t *key,
+                                              void *user_data,
+                                              void **old_data)
+{
+    PJ_ASSERT_RETURN(key, PJ_EINVAL);
+
+    if (old_data)
+        *old_data = key->user_data;
+    key->user_data = user_data;
+
+    return PJ_SUCCESS;
+}
+
+/* Submit pending writes of the key while there are free write slots.
+ * Must be called with key's lock held.
+ */
+static void submit_writes(pj_ioqueue_key_t *key)
+{
+    struct write_operation *write_op = key->write_list.next;
+    unsigned max_slot;
+
+    max_slot = (key->fd_type == pj_SOCK_DGRAM()) ? MAX_WRITE_SLOTS : 1;
+
+    while (write_op != &key->write_list) {
+	struct io_uring_sqe req;
+	unsigned slot;
+
+	if (write_op->slot >= 0) {
+	    write_op = write_op->next;
+	    continue;
+	}
+
+	for (slot=0; slot<max_slot && key->wr_slot[slot]; ++slot)
+	    ;
+	if (slot == max_slot)
+	    break;
+
+	pj_bzero(&write_op->msg, sizeof(write_op->msg));
+	write_op->msg.msg_iov = &write_op->iov;
+	write_op->msg.msg_iovlen = 1;
+	if (write_op->op == PJ_IOQUEUE_OP_SENDMMSG) {
+	    /* Remaining datagrams of a batch are sent one at a time */
+	    pj_sock_msg *m = (pj_sock_msg*)write_op->buf + write_op->written;
+
+	    write_op->iov.iov_base = m->buf;
+	    write_op->iov.iov_len = m->len;
+	    if (m->addr_len) {
+		write_op->msg.msg_name = &m->addr;
+		write_op->msg.msg_namelen = m->addr_len;
+	    }
+	} else {
+	    write_op->iov.iov_base = write_op->buf + write_op->written;
+	    write_op->iov.iov_len = write_op->size - write_op->written;
+	    if (write_op->op == PJ_IOQUEUE_OP_SEND_TO) {
+		write_op->msg.msg_name = &write_op->rmt_addr;
+		write_op->msg.msg_namelen = write_op->rmt_addrlen;
+	    }
+	}
+
+	pj_bzero(&req, sizeof(req));
+	req.opcode = IORING_OP_SENDMSG;
+	req.fd = key->index;
+	req.flags = IOSQE_FIXED_FILE;
+	req.addr = (pj_uint64_t)(pj_size_t)&write_op->msg;
+	req.len = 1;
+	req.msg_flags = write_op->flags | MSG_NOSIGNAL;
+	req.user_data = UD_MAKE(key, REQ_SEND, slot);
+
+	if (submit_req(key->ioqueue, &req) != PJ_SUCCESS)
+	    break;
+
+	write_op->slot = slot;
+	key->wr_slot[slot] = write_op;
+	write_op = write_op->next;
+    }
+}
+
+#if PJ_HAS_TCP
+/* Submit the first pending accept of the key, if there is none in
+ * flight. Must be called with key's lock held.
+ */
+static void submit_accept(pj_ioqueue_key_t *key)
+{
+    struct accept_operation *accept_op;
+    struct io_uring_sqe req;
+
+    if (key->accept_op || pj_list_empty(&key->accept_list))
+	return;
+
+    accept_op = key->accept_list.next;
+
+    pj_bzero(&req, sizeof(req));
+    req.opcode = IORING_OP_ACCEPT;
+    req.fd = key->index;
+    req.flags = IOSQE_FIXED_FILE;
+    if (accept_op->rmt_addr && accept_op->addrlen) {
+	req.addr = (pj_uint64_t)(pj_size_t)accept_op->rmt_addr;
+	req.addr2 = (pj_uint64_t)(pj_size_t)accept_op->addrlen;
+    }
+    req.user_data = UD_MAKE(key, REQ_ACCEPT, 0);
+
+    if (submit_req(key->ioqueue, &req) == PJ_SUCCESS)
+	key->accept_op = accept_op;
+}
+#endif
+
+/* Lock the key and check that the completion belongs to the current
+ * registration of the key. Returns PJ_FALSE (with the key unlocked) if
+ * the completion is stale.
+ */
+static pj_bool_t lock_valid_key(pj_ioqueue_key_t *key, unsigned gen)
+{
+    pj_ioqueue_lock_key(key);
+    if (key->gen != gen || IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_FALSE;
+    }
+    return PJ_TRUE;
+}
+
+/* Unlock the key before calling the callback, unless concurrency is
+ * disabled, in which case we should hold the mutex while calling the
+ * callback. Returns whether the key is still locked.
+ */
+static pj_bool_t unlock_for_callback(pj_ioqueue_key_t *key)
+{
+    if (key->allow_concurrent) {
+	/* concurrency may be changed while we're in the callback, so
+	 * save it to a flag.
+	 */
+	pj_ioqueue_unlock_key(key);
+	PJ_RACE_ME(5);
+	return PJ_FALSE;
+    }
+    return PJ_TRUE;
+}
+
+/* Complete pending reads of the key with the received data. */
+static int dispatch_read(pj_ioqueue_key_t *key, unsigned gen)
+{
+    int count = 0;
+
+    for (;;) {
+	struct read_operation *read_op;
+	pj_ssize_t bytes_read;
+	pj_bool_t has_lock;
+
+	if (!lock_valid_key(key, gen))
+	    break;
+
+	if (pj_list_empty(&key->read_list)) {
+	    pj_ioqueue_unlock_key(key);
+	    break;
+	}
+
+	read_op = key->read_list.next;
+	if (!rx_fetch(key, read_op, &bytes_read)) {
+	    pj_ioqueue_unlock_key(key);
+	    break;
+	}
+
+	pj_list_erase(read_op);
+	read_op->op = PJ_IOQUEUE_OP_NONE;
+
+	pj_lock_acquire(key->rx_lock);
+	rx_update_arm(key);
+	pj_lock_release(key->rx_lock);
+
+	has_lock = unlock_for_callback(key);
+
+	if (key->cb.on_read_complete && !IS_CLOSING(key)) {
+	    (*key->cb.on_read_complete)(key,
+					(pj_ioqueue_op_key_t*)read_op,
+					bytes_read);
+	}
+
+	if (has_lock)
+	    pj_ioqueue_unlock_key(key);
+
+	++count;
+    }
+
+    return count;
+}
+
+/* Process completion of a write request. */
+static int dispatch_write(pj_ioqueue_key_t *key, unsigned gen,
+			  unsigned slot, int res)
+{
+    struct write_operation *write_op;
+    pj_ssize_t bytes;
+    pj_bool_t has_lock;
+
+    if (!lock_valid_key(key, gen))
+	return 0;
+
+    write_op = key->wr_slot[slot];
+    key->wr_slot[slot] = NULL;
+
+    if (!write_op) {
+	/* Operation has been completed with pj_ioqueue_post_completion() */
+	submit_writes(key);
+	pj_ioqueue_unlock_key(key);
+	return 0;
+    }
+
+    write_op->slot = -1;
+
+    if (res < 0) {
+	bytes = -PJ_STATUS_FROM_OS(-res);
+    } else if (write_op->op == PJ_IOQUEUE_OP_SENDMMSG) {
+	((pj_sock_msg*)write_op->buf)[write_op->written].len = res;
+	bytes = ++write_op->written;
+
+	/* Batch is reported when all datagrams have been sent */
+	if (write_op->written < (pj_ssize_t)write_op->size) {
+	    submit_writes(key);
+	    pj_ioqueue_unlock_key(key);
+	    return 0;
+	}
+    } else {
+	write_op->written += res;
+	bytes = write_op->written;
+
+	/* Stream socket is only reported when all data has been sent */
+	if (key->fd_type != pj_SOCK_DGRAM() && res > 0 &&
+	    write_op->written < (pj_ssize_t)write_op->size)
+	{
+	    submit_writes(key);
+	    pj_ioqueue_unlock_key(key);
+	    return 0;
+	}
+    }
+
+    pj_list_erase(write_op);
+    write_op->op = PJ_IOQUEUE_OP_NONE;
+
+    submit_writes(key);
+
+    has_lock = unlock_for_callback(key);
+
+    if (key->cb.on_write_complete && !IS_CLOSING(key)) {
+	(*key->cb.on_write_complete)(key, (pj_ioqueue_op_key_t*)write_op,
+				     bytes);
+    }
+
+    if (has_lock)
+	pj_ioqueue_unlock_key(key);
+
+    return 1;
+}
+
+#if PJ_HAS_TCP
+/* Process completion of an accept request. */
+static int dispatch_accept(pj_ioqueue_key_t *key, unsigned gen, int res)
+{
+    struct accept_operation *accept_op;
+    pj_status_t status;
+    pj_bool_t has_lock;
+
+    if (!lock_valid_key(key, gen)) {
+	if (res >= 0)
+	    close(res);
+	return 0;
+    }
+
+    accept_op = key->accept_op;
+    key->accept_op = NULL;
+
+    if (!accept_op) {
+	/* Operation has been completed with pj_ioqueue_post_completion() */
+	if (res >= 0)
+	    close(res);
+	submit_accept(key);
+	pj_ioqueue_unlock_key(key);
+	return 0;
+    }
+
+    pj_list_erase(accept_op);
+    accept_op->op = PJ_IOQUEUE_OP_NONE;
+
+    if (res >= 0) {
+	*accept_op->accept_fd = res;
+	status = PJ_SUCCESS;
+	if (accept_op->local_addr) {
+	    status = pj_sock_getsockname(res, accept_op->local_addr,
+					 accept_op->addrlen);
+	}
+    } else {
+	*accept_op->accept_fd = PJ_INVALID_SOCKET;
+	status = PJ_STATUS_FROM_OS(-res);
+    }
+
+    submit_accept(key);
+
+    has_lock = unlock_for_callback(key);
+
+    if (key->cb.on_accept_complete && !IS_CLOSING(key)) {
+	(*key->cb.on_accept_complete)(key, (pj_ioqueue_op_key_t*)accept_op,
+				      *accept_op->accept_fd, status);
+    }
+
+    if (has_lock)
+	pj_ioqueue_unlock_key(key);
+
+    return 1;
+}
+
+/* Process completion of a connect request. */
+static int dispatch_connect(pj_ioqueue_key_t *key, unsigned gen, int res)
+{
+    pj_bool_t has_lock;
+
+    if (!lock_valid_key(key, gen))
+	return 0;
+
+    if (!key->connecting) {
+	pj_ioqueue_unlock_key(key);
+	return 0;
+    }
+    key->connecting = 0;
+
+    has_lock = unlock_for_callback(key);
+
+    if (key->cb.on_connect_complete && !IS_CLOSING(key)) {
+	pj_status_t status = (res == 0) ? PJ_SUCCESS :
+					  PJ_STATUS_FROM_OS(-res);
+	(*key->cb.on_connect_complete)(key, status);
+    }
+
+    if (has_lock)
+	pj_ioqueue_unlock_key(key);
+
+    return 1;
+}
+#endif	/* PJ_HAS_TCP */
+
+/*
+ * pj_ioqueue_poll()
+ *
+ */
+PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
+{
+    struct completion events[PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL];
+    struct uring_cq *cq = &ioqueue->cq;
+    unsigned head, tail, count, i, n;
+    int processed = 0;
+    void *prev_dispatch;
+
+    PJ_CHECK_STACK();
+
+    prev_dispatch = pj_thread_local_get(tls_dispatch_id);
+    pj_thread_local_set(tls_dispatch_id, ioqueue);
+
+    /* Submit pending requests and wait for completion, unless there are
+     * completions already.
+     */
+    drain_backlog(ioqueue);
+
+    pj_lock_acquire(ioqueue->sq_lock);
+    n = ioqueue->sq_pending;
+    ioqueue->sq_pending = 0;
+    pj_lock_release(ioqueue->sq_lock);
+
+    if (load_acquire(cq->ktail) == *cq->khead) {
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	int rc;
+
+	pj_bzero(&arg, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	if (timeout) {
+	    ts.tv_sec = timeout->sec;
+	    ts.tv_nsec = timeout->msec * 1000000;
+	    arg.ts = (pj_uint64_t)(pj_size_t)&ts;
+	}
+
+	rc = uring_enter(ioqueue->ring_fd, n, 1,
+			 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			 &arg, sizeof(arg));
+	if (rc < 0 && n) {
+	    if (errno == ETIME || errno == EINTR) {
+		/* Wait was interrupted, but requests were submitted */
+	    } else {
+		pj_lock_acquire(ioqueue->sq_lock);
+		ioqueue->sq_pending += n;
+		pj_lock_release(ioqueue->sq_lock);
+	    }
+	}
+    } else if (n) {
+	if (uring_enter(ioqueue->ring_fd, n, 0, 0, NULL, 0) < 0) {
+	    pj_lock_acquire(ioqueue->sq_lock);
+	    ioqueue->sq_pending += n;
+	    pj_lock_release(ioqueue->sq_lock);
+	}
+    }
+
+    /* Copy completions. Received data is queued to the keys here, so
+     * that it is delivered in the order it was received.
+     */
+    pj_lock_acquire(ioqueue->cq_lock);
+    head = *cq->khead;
+    tail = load_acquire(cq->ktail);
+    for (count=0; head != tail && count < PJ_ARRAY_SIZE(events); ++head) {
+	struct io_uring_cqe *cqe = &cq->cqes[head & *cq->kring_mask];
+
+	if (UD_TYPE(cqe->user_data) == REQ_CANCEL)
+	    continue;
+
+	if (UD_TYPE(cqe->user_data) == REQ_WAKE) {
+	    /* Backlog will be submitted on the next poll */
+	    pj_lock_acquire(ioqueue->sq_lock);
+	    ioqueue->wake_armed = PJ_FALSE;
+	    pj_lock_release(ioqueue->sq_lock);
+	    continue;
+	}
+
+	events[count].user_data = cqe->user_data;
+	events[count].res = cqe->res;
+	events[count].flags = cqe->flags;
+	if (UD_TYPE(cqe->user_data) == REQ_RECV)
+	    on_recv_cqe(ioqueue, &events[count]);
+	++count;
+    }
+    store_release(cq->khead, head);
+    pj_lock_release(ioqueue->cq_lock);
+
+    /* Take a reference to the keys, see pj_ioqueue_unregister() */
+    pj_lock_acquire(ioqueue->lock);
+    for (i=0; i<count; ++i) {
+	pj_ioqueue_key_t *key = &ioqueue->keys[UD_INDEX(events[i].user_data)];
+
+	events[i].valid = (key->gen == UD_GEN(events[i].user_data) &&
+			   !IS_CLOSING(key));
+	if (events[i].valid) {
+	    increment_counter(key);
+	    if (key->grp_lock)
+		pj_grp_lock_add_ref_dbg(key->grp_lock, "ioqueue", 0);
+	}
+    }
+    pj_lock_release(ioqueue->lock);
+
+    PJ_RACE_ME(5);
+
+    /* Now process the events. */
+    for (i=0; i<count; ++i) {
+	pj_ioqueue_key_t *key = &ioqueue->keys[UD_INDEX(events[i].user_data)];
+	unsigned gen = UD_GEN(events[i].user_data);
+
+	if (!events[i].valid) {
+#if PJ_HAS_TCP
+	    /* Don't leak sockets accepted for unregistered key */
+	    if (UD_TYPE(events[i].user_data) == REQ_ACCEPT &&
+		events[i].res >= 0)
+	    {
+		close(events[i].res);
+	    }
+#endif
+	    continue;
+	}
+
+	switch (UD_TYPE(events[i].user_data)) {
+	case REQ_RECV:
+	case REQ_DELIVER:
+	    processed += dispatch_read(key, gen);
+	    break;
+	case REQ_SEND:
+	    processed += dispatch_write(key, gen,
+					UD_SLOT(events[i].user_data),
+					events[i].res);
+	    break;
+#if PJ_HAS_TCP
+	case REQ_ACCEPT:
+	    processed += dispatch_accept(key, gen, events[i].res);
+	    break;
+	case REQ_CONNECT:
+	    processed += dispatch_connect(key, gen, events[i].res);
+	    break;
+#endif
+	default:
+	    pj_assert(!"Invalid request type");
+	    break;
+	}
+
+	decrement_counter(key);
+
+	if (key->grp_lock)
+	    pj_grp_lock_dec_ref_dbg(key->grp_lock, "ioqueue", 0);
+    }
+
+    /* Re-arm receivers which have run out of buffers, if some buffers
+     * have been returned since.
+     */
+    if (ioqueue->starved_cnt && ioqueue->buf_returned) {
+	ioqueue->buf_returned = 0;
+	rearm_starved_keys(ioqueue);
+    }
+
+    /* Submit requests queued while dispatching the events */
+    flush_sq(ioqueue);
+
+    pj_thread_local_set(tls_dispatch_id, prev_dispatch);
+
+    /* Check the closing keys only when there's no activity and when there
+     * are pending closing keys.
+     */
+    if (count == 0 && !pj_list_empty(&ioqueue->closing_list)) {
+	pj_lock_acquire(ioqueue->lock);
+	scan_closing_keys(ioqueue);
+	pj_lock_release(ioqueue->lock);
+    }
+
+    return processed;
+}
+
+/* Schedule read operation. */
+static pj_status_t schedule_read(pj_ioqueue_key_t *key,
+				 struct read_operation *read_op,
+				 pj_ssize_t *length,
+				 unsigned flags)
+{
+    pj_bool_t has_data;
+
+    pj_ioqueue_lock_key(key);
+
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app.
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+
+    /* Data is read from the buffers received by the multishot recv,
+     * never directly from the socket, to preserve the ordering.
+     */
+    if ((flags & PJ_IOQUEUE_ALWAYS_ASYNC) == 0 &&
+	pj_list_empty(&key->read_list))
+    {
+	pj_ssize_t bytes;
+
+	if (rx_fetch(key, read_op, &bytes)) {
+	    read_op->op = PJ_IOQUEUE_OP_NONE;
+	    pj_lock_acquire(key->rx_lock);
+	    rx_update_arm(key);
+	    pj_lock_release(key->rx_lock);
+	    pj_ioqueue_unlock_key(key);
+
+	    if (bytes < 0)
+		return (pj_status_t)-bytes;
+
+	    *length = bytes;
+	    return PJ_SUCCESS;
+	}
+    }
+
+    pj_list_insert_before(&key->read_list, read_op);
+
+    pj_lock_acquire(key->rx_lock);
+    has_data = (key->rx_head != NULL || key->rx_has_final);
+    rx_update_arm(key);
+    pj_lock_release(key->rx_lock);
+
+    /* Data has been received already, have it delivered by the
+     * polling thread.
+     */
+    if (has_data)
+	post_deliver(key);
+
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
+/*
+ * pj_ioqueue_recv()
+ *
+ * Start asynchronous recv() from the socket.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recv(  pj_ioqueue_key_t *key,
+                                      pj_ioqueue_op_key_t *op_key,
+				      void *buffer,
+				      pj_ssize_t *length,
+				      unsigned flags )
+{
+    struct read_operation *read_op;
+
+    PJ_ASSERT_RETURN(key && op_key && buffer && length, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing (need to do this first before accessing
+     * other variables, since they might have been destroyed. See ticket
+     * #469).
+     */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    read_op = (struct read_operation*)op_key;
+    read_op->op = PJ_IOQUEUE_OP_RECV;
+    read_op->buf = buffer;
+    read_op->size = *length;
+    read_op->flags = flags & ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+    read_op->rmt_addr = NULL;
+    read_op->rmt_addrlen = NULL;
+
+    return schedule_read(key, read_op, length, flags);
+}
+
+/*
+ * pj_ioqueue_recvfrom()
+ *
+ * Start asynchronous recvfrom() from the socket.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recvfrom( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+				         void *buffer,
+				         pj_ssize_t *length,
+                                         unsigned flags,
+				         pj_sockaddr_t *addr,
+				         int *addrlen)
+{
+    struct read_operation *read_op;
+
+    PJ_ASSERT_RETURN(key && op_key && buffer && length, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    read_op = (struct read_operation*)op_key;
+    read_op->op = PJ_IOQUEUE_OP_RECV_FROM;
+    read_op->buf = buffer;
+    read_op->size = *length;
+    read_op->flags = flags & ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+    read_op->rmt_addr = addr;
+    read_op->rmt_addrlen = addrlen;
+
+    return schedule_read(key, read_op, length, flags);
+}
+
+/*
+ * pj_ioqueue_recvmmsg()
+ *
+ * Start asynchronous batched receive from the socket.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recvmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    struct read_operation *read_op;
+    pj_ssize_t cnt;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(key && op_key && msgs && count && *count, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    read_op = (struct read_operation*)op_key;
+    read_op->op = PJ_IOQUEUE_OP_RECVMMSG;
+    read_op->buf = msgs;
+    read_op->size = (*count < PJ_SOCK_MAX_MMSG) ? *count : PJ_SOCK_MAX_MMSG;
+    read_op->flags = flags & ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+    read_op->rmt_addr = NULL;
+    read_op->rmt_addrlen = NULL;
+
+    status = schedule_read(key, read_op, &cnt, flags);
+    if (status == PJ_SUCCESS)
+	*count = (unsigned)cnt;
+
+    return status;
+}
+
+/* Send data immediately or schedule asynchronous write. */
+static pj_status_t schedule_write(pj_ioqueue_key_t *key,
+				  pj_ioqueue_op_key_t *op_key,
+				  pj_ioqueue_operation_e op,
+				  const void *data,
+				  pj_ssize_t *length,
+				  unsigned flags,
+				  const pj_sockaddr_t *addr,
+				  int addrlen)
+{
+    struct write_operation *write_op;
+    unsigned retry;
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    /* We can not use PJ_IOQUEUE_ALWAYS_ASYNC for socket write. */
+    flags &= ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+
+    /* Fast track:
+     *   Try to send data immediately, only if there's no pending write!
+     *   Applications expect datagrams to be sent immediately, so this is
+     *   not deferred to the batch submitted when the poll finishes.
+     * Note:
+     *  We are speculating that the list is empty here without properly
+     *  acquiring key's mutex first. See ioqueue_common_abs.c.
+     */
+    if (pj_list_empty(&key->write_list)) {
+	pj_status_t status;
+	pj_ssize_t sent = *length;
+
+	if (op == PJ_IOQUEUE_OP_SEND_TO)
+	    status = pj_sock_sendto(key->fd, data, &sent, flags, addr,
+				    addrlen);
+	else
+	    status = pj_sock_send(key->fd, data, &sent, flags);
+
+        if (status == PJ_SUCCESS) {
+            *length = sent;
+            return PJ_SUCCESS;
+        } else if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL)) {
+	    return status;
+	}
+    }
+
+    /* Check that address storage can hold the address parameter. */
+    PJ_ASSERT_RETURN(addrlen <= (int)sizeof(pj_sockaddr), PJ_EBUG);
+
+    write_op = (struct write_operation*)op_key;
+
+    /* Spin if write_op has pending operation */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	pj_thread_sleep(0);
+
+    /* Last chance */
+    if (write_op->op) {
+	/* Unable to send packet because there is already pending write on
+	 * the write_op. See ioqueue_common_abs.c.
+	 */
+	return PJ_EBUSY;
+    }
+
+    write_op->op = op;
+    write_op->buf = (char*)data;
+    write_op->size = *length;
+    write_op->written = 0;
+    write_op->flags = flags;
+    write_op->slot = -1;
+    if (addr) {
+	pj_memcpy(&write_op->rmt_addr, addr, addrlen);
+	write_op->rmt_addrlen = addrlen;
+    } else {
+	write_op->rmt_addrlen = 0;
+    }
+
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app.
+     */
+    if (IS_CLOSING(key)) {
+	write_op->op = PJ_IOQUEUE_OP_NONE;
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+    pj_list_insert_before(&key->write_list, write_op);
+    submit_writes(key);
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
+/*
+ * pj_ioqueue_send()
+ *
+ * Start asynchronous send() to the descriptor.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_send( pj_ioqueue_key_t *key,
+                                     pj_ioqueue_op_key_t *op_key,
+			             const void *data,
+			             pj_ssize_t *length,
+                                     unsigned flags)
+{
+    PJ_ASSERT_RETURN(key && op_key && data && length, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    return schedule_write(key, op_key, PJ_IOQUEUE_OP_SEND, data, length,
+			  flags, NULL, 0);
+}
+
+/*
+ * pj_ioqueue_sendto()
+ *
+ * Start asynchronous write() to the descriptor.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_sendto( pj_ioqueue_key_t *key,
+                                       pj_ioqueue_op_key_t *op_key,
+			               const void *data,
+			               pj_ssize_t *length,
+                                       pj_uint32_t flags,
+			               const pj_sockaddr_t *addr,
+			               int addrlen)
+{
+    PJ_ASSERT_RETURN(key && op_key && data && length, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    return schedule_write(key, op_key, PJ_IOQUEUE_OP_SEND_TO, data, length,
+			  flags, addr, addrlen);
+}
+
+/*
+ * pj_ioqueue_sendmmsg()
+ *
+ * Start asynchronous batched send to the socket.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_sendmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    struct write_operation *write_op;
+    unsigned retry, total, sent = 0;
+
+    PJ_ASSERT_RETURN(key && op_key && msgs && count && *count, PJ_EINVAL);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    flags &= ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+    total = (*count < PJ_SOCK_MAX_MMSG) ? *count : PJ_SOCK_MAX_MMSG;
+
+    /* Fast track, see schedule_write() */
+    if (pj_list_empty(&key->write_list)) {
+	pj_status_t status;
+
+	sent = total;
+	status = pj_sock_sendmmsg(key->fd, msgs, &sent, flags);
+	if (status == PJ_SUCCESS) {
+	    if (sent == total) {
+		*count = sent;
+		return PJ_SUCCESS;
+	    }
+	} else if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL)) {
+	    return status;
+	} else {
+	    sent = 0;
+	}
+    }
+
+    write_op = (struct write_operation*)op_key;
+
+    /* Spin if write_op has pending operation */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	pj_thread_sleep(0);
+
+    /* Last chance */
+    if (write_op->op) {
+	*count = sent;
+	return PJ_EBUSY;
+    }
+
+    write_op->op = PJ_IOQUEUE_OP_SENDMMSG;
+    write_op->buf = (char*)msgs;
+    write_op->size = total;
+    write_op->written = sent;
+    write_op->flags = flags;
+    write_op->slot = -1;
+    write_op->rmt_addrlen = 0;
+
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app.
+     */
+    if (IS_CLOSING(key)) {
+	write_op->op = PJ_IOQUEUE_OP_NONE;
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+    pj_list_insert_before(&key->write_list, write_op);
+    submit_writes(key);
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
+#if PJ_HAS_TCP
+/*
+ * Initiate overlapped accept() operation.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_accept( pj_ioqueue_key_t *key,
+                                       pj_ioqueue_op_key_t *op_key,
+			               pj_sock_t *new_sock,
+			               pj_sockaddr_t *local,
+			               pj_sockaddr_t *remote,
+			               int *addrlen)
+{
+    struct accept_operation *accept_op;
+    pj_status_t status;
+
+    /* check parameters. All must be specified! */
+    PJ_ASSERT_RETURN(key && op_key && new_sock, PJ_EINVAL);
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    accept_op = (struct accept_operation*)op_key;
+    accept_op->op = PJ_IOQUEUE_OP_NONE;
+
+    /* Fast track:
+     *  See if there's new connection available immediately.
+     */
+    if (pj_list_empty(&key->accept_list)) {
+        status = pj_sock_accept(key->fd, new_sock, remote, addrlen);
+        if (status == PJ_SUCCESS) {
+            /* Yes! New connection is available! */
+            if (local && addrlen) {
+                status = pj_sock_getsockname(*new_sock, local, addrlen);
+                if (status != PJ_SUCCESS) {
+                    pj_sock_close(*new_sock);
+                    *new_sock = PJ_INVALID_SOCKET;
+                    return status;
+                }
+            }
+            return PJ_SUCCESS;
+        } else {
+            /* If error is not EWOULDBLOCK (or EAGAIN on Linux), report
+             * the error to caller.
+             */
+            if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL)) {
+                return status;
+            }
+        }
+    }
+
+    /*
+     * No connection is available immediately.
+     * Schedule accept() operation to be completed when there is incoming
+     * connection available.
+     */
+    accept_op->op = PJ_IOQUEUE_OP_ACCEPT;
+    accept_op->accept_fd = new_sock;
+    accept_op->rmt_addr = remote;
+    accept_op->addrlen= addrlen;
+    accept_op->local_addr = local;
+
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app.
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+    pj_list_insert_before(&key->accept_list, accept_op);
+    submit_accept(key);
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
+/*
+ * Initiate asynchronous connect() operation.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_connect( pj_ioqueue_key_t *key,
+					const pj_sockaddr_t *addr,
+					int addrlen )
+{
+    struct io_uring_sqe req;
+    pj_status_t status;
+
+    /* check parameters. All must be specified! */
+    PJ_ASSERT_RETURN(key && addr && addrlen, PJ_EINVAL);
+    PJ_ASSERT_RETURN(addrlen <= (int)sizeof(pj_sockaddr), PJ_EINVAL);
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    /* Check if socket has not been marked for connecting */
+    if (key->connecting != 0)
+        return PJ_EPENDING;
+
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous
+     * check in multithreaded app.
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+
+    pj_memcpy(&key->connect_addr, addr, addrlen);
+
+    pj_bzero(&req, sizeof(req));
+    req.opcode = IORING_OP_CONNECT;
+    req.fd = key->index;
+    req.flags = IOSQE_FIXED_FILE;
+    req.addr = (pj_uint64_t)(pj_size_t)&key->connect_addr;
+    req.off = addrlen;
+    req.user_data = UD_MAKE(key, REQ_CONNECT, 0);
+
+    status = submit_req(key->ioqueue, &req);
+    if (status == PJ_SUCCESS) {
+	key->connecting = PJ_TRUE;
+	status = PJ_EPENDING;
+    }
+    pj_ioqueue_unlock_key(key);
+
+    return status;
+}
+#endif	/* PJ_HAS_TCP */
+
+
+PJ_DEF(void) pj_ioqueue_op_key_init( pj_ioqueue_op_key_t *op_key,
+				     pj_size_t size )
+{
+    pj_bzero(op_key, size);
+}
+
+
+/*
+ * pj_ioqueue_is_pending()
+ */
+PJ_DEF(pj_bool_t) pj_ioqueue_is_pending( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key )
+{
+    struct generic_operation *op_rec;
+
+    PJ_UNUSED_ARG(key);
+
+    op_rec = (struct generic_operation*)op_key;
+    return op_rec->op != 0;
+}
+
+
+/*
+ * pj_ioqueue_post_completion()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_post_completion( pj_ioqueue_key_t *key,
+                                                pj_ioqueue_op_key_t *op_key,
+                                                pj_ssize_t bytes_status )
+{
+    struct generic_operation *op_rec;
+
+    /*
+     * Find the operation key in all pending operation list to
+     * really make sure that it's still there; then call the callback.
+     */
+    pj_ioqueue_lock_key(key);
+
+    /* Find the operation in the pending read list. */
+    op_rec = (struct generic_operation*)key->read_list.next;
+    while (op_rec != (void*)&key->read_list) {
+        if (op_rec == (void*)op_key) {
+            pj_list_erase(op_rec);
+            op_rec->op = PJ_IOQUEUE_OP_NONE;
+            pj_ioqueue_unlock_key(key);
+
+            (*key->cb.on_read_complete)(key, op_key, bytes_status);
+            return PJ_SUCCESS;
+        }
+        op_rec = op_rec->next;
+    }
+
+    /* Find the operation in the pending write list. If the write request
+     * is in flight, detach it from the slot and cancel the request.
+     */
+    op_rec = (struct generic_operation*)key->write_list.next;
+    while (op_rec != (void*)&key->write_list) {
+        if (op_rec == (void*)op_key) {
+	    struct write_operation *write_op = (struct write_operation*)op_rec;
+
+	    if (write_op->slot >= 0) {
+		key->wr_slot[write_op->slot] = NULL;
+		cancel_req(key, REQ_SEND, write_op->slot);
+		write_op->slot = -1;
+	    }
+            pj_list_erase(op_rec);
+            op_rec->op = PJ_IOQUEUE_OP_NONE;
+            pj_ioqueue_unlock_key(key);
+
+            (*key->cb.on_write_complete)(key, op_key, bytes_status);
+            return PJ_SUCCESS;
+        }
+        op_rec = op_rec->next;
+    }
+
+#if PJ_HAS_TCP
+    /* Find the operation in the pending accept list. */
+    op_rec = (struct generic_operation*)key->accept_list.next;
+    while (op_rec != (void*)&key->accept_list) {
+        if (op_rec == (void*)op_key) {
+	    if (key->accept_op == (struct accept_operation*)op_rec) {
+		key->accept_op = NULL;
+		cancel_req(key, REQ_ACCEPT, 0);
+	    }
+            pj_list_erase(op_rec);
+            op_rec->op = PJ_IOQUEUE_OP_NONE;
+            pj_ioqueue_unlock_key(key);
+
+            (*key->cb.on_accept_complete)(key, op_key,
+                                          PJ_INVALID_SOCKET,
+                                          (pj_status_t)bytes_status);
+            return PJ_SUCCESS;
+        }
+        op_rec = op_rec->next;
+    }
+#endif
+
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EINVALIDOP;
+}
+
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->epoll_flags = PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS;
+    cfg->default_concurrency = PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_set_default_concurrency( pj_ioqueue_t *ioqueue,
+							pj_bool_t allow)
+{
+    PJ_ASSERT_RETURN(ioqueue != NULL, PJ_EINVAL);
+    ioqueue->default_concurrency = allow;
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pj_ioqueue_set_concurrency(pj_ioqueue_key_t *key,
+					       pj_bool_t allow)
+{
+    PJ_ASSERT_RETURN(key, PJ_EINVAL);
+    key->allow_concurrent = allow;
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_lock_key(pj_ioqueue_key_t *key)
+{
+    if (key->grp_lock)
+	return pj_grp_lock_acquire(key->grp_lock);
+    else
+	return pj_lock_acquire(key->lock);
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_unlock_key(pj_ioqueue_key_t *key)
+{
+    if (key->grp_lock)
+	return pj_grp_lock_release(key->grp_lock);
+    else
+	return pj_lock_release(key->lock);
+}
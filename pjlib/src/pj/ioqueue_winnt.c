@@ -320,12 +320,35 @@ PJ_DEF(const char*) pj_ioqueue_name(void)
     return "iocp";
 }
 
+/*
+ * pj_ioqueue_cfg_default()
+ */
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->epoll_flags = PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS;
+    cfg->default_concurrency = PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+}
+
 /*
  * pj_ioqueue_create()
  */
 PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool, 
 				       pj_size_t max_fd,
 				       pj_ioqueue_t **p_ioqueue)
+{
+    return pj_ioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * The epoll flags are not applicable to IOCP and are ignored.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool, 
+				       pj_size_t max_fd,
+				       const pj_ioqueue_cfg *cfg,
+				       pj_ioqueue_t **p_ioqueue)
 {
     pj_ioqueue_t *ioqueue;
     unsigned i;
@@ -354,7 +377,8 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     }
 
     ioqueue->auto_delete_lock = PJ_TRUE;
-    ioqueue->default_concurrency = PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+    ioqueue->default_concurrency = cfg ? cfg->default_concurrency :
+				   PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
 
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
     /*
@@ -1186,6 +1210,44 @@ PJ_DEF(pj_status_t) pj_ioqueue_sendto( pj_ioqueue_key_t *key,
     return PJ_EPENDING;
 }
 
+/*
+ * pj_ioqueue_recvmmsg()
+ *
+ * Batched receive is not supported by IOCP backend.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recvmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(op_key);
+    PJ_UNUSED_ARG(msgs);
+    PJ_UNUSED_ARG(count);
+    PJ_UNUSED_ARG(flags);
+    return PJ_ENOTSUP;
+}
+
+/*
+ * pj_ioqueue_sendmmsg()
+ *
+ * Batched send is not supported by IOCP backend.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_sendmmsg( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+					 pj_sock_msg msgs[],
+					 unsigned *count,
+                                         pj_uint32_t flags)
+{
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(op_key);
+    PJ_UNUSED_ARG(msgs);
+    PJ_UNUSED_ARG(count);
+    PJ_UNUSED_ARG(flags);
+    return PJ_ENOTSUP;
+}
+
 #if PJ_HAS_TCP
 
 /*
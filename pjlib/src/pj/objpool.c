@@ -0,0 +1,505 @@
+/* $Id$ */
+/* 
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
+ */
+#include <pj/objpool.h>
+#include <pj/assert.h>
+#include <pj/errno.h>
+#include <pj/lock.h>
+#include <pj/os.h>
+#include <pj/string.h>
+
+/* Use the compiler atomic builtins for the lock-free depot slots. Without
+ * them, the depot only uses the lists protected by the mutex.
+ */
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#   define HAS_ATOMIC_BUILTINS	1
+#else
+#   define HAS_ATOMIC_BUILTINS	0
+#endif
+
+/* Alignment of the objects */
+#if PJ_POOL_ALIGNMENT > 8
+#   define OBJ_ALIGN		PJ_POOL_ALIGNMENT
+#else
+#   define OBJ_ALIGN		8
+#endif
+
+#define ALIGN_SIZE(s)	(((s) + OBJ_ALIGN - 1) & ~((pj_size_t)OBJ_ALIGN - 1))
+
+
+/* Magazine, an array of free objects. */
+typedef struct magazine
+{
+    struct magazine *next;	/* Next magazine in the depot list.	    */
+    unsigned	     cnt;	/* Number of objects in the magazine.	    */
+    void	    *obj[1];	/* Array of mag_size objects.		    */
+} magazine;
+
+/* Per-thread cache. The thread allocates from and frees to the loaded
+ * magazine, and the previous magazine is used to absorb alternating
+ * alloc/free patterns without going to the depot.
+ */
+typedef struct thread_cache
+{
+    magazine	    *loaded;
+    magazine	    *prev;
+    unsigned	     hint;	/* First depot slot to look at.		    */
+} thread_cache;
+
+struct pj_objpool_t
+{
+    char	     obj_name[PJ_MAX_OBJ_NAME];
+    pj_pool_t	    *pool;
+    pj_lock_t	    *lock;
+    pj_size_t	     obj_size;
+    pj_size_t	     elem_size;
+    unsigned	     mag_size;
+    long	     tls_id;
+    unsigned	     capacity;
+    unsigned	     cache_cnt;
+
+    /* One reference for each object in use, plus one held by the owner
+     * until pj_objpool_destroy() is called. The object pool is destroyed
+     * when this drops to zero.
+     */
+    volatile long    ref_cnt;
+
+    /* The depot. Magazines are exchanged between threads through the
+     * lock-free slots, and the lists (protected by the lock) hold the
+     * magazines that don't fit in the slots.
+     */
+    magazine *volatile full_slot[PJ_OBJPOOL_DEPOT_SIZE];
+    magazine *volatile empty_slot[PJ_OBJPOOL_DEPOT_SIZE];
+    magazine *volatile full_list;
+    magazine *volatile empty_list;
+};
+
+
+/* Pool callback: just return NULL to the caller when memory is exhausted */
+static void on_no_memory(pj_pool_t *pool, pj_size_t size)
+{
+    PJ_UNUSED_ARG(pool);
+    PJ_UNUSED_ARG(size);
+}
+
+/* Allocate a new empty magazine. Must be called with the lock held. */
+static magazine *new_magazine(pj_objpool_t *op)
+{
+    magazine *m;
+
+    m = (magazine*) pj_pool_alloc(op->pool, sizeof(magazine) +
+					    (op->mag_size-1) * sizeof(void*));
+    if (m) {
+	m->next = NULL;
+	m->cnt = 0;
+    }
+    return m;
+}
+
+/* Fill the empty magazine with newly allocated objects. */
+static pj_bool_t grow(pj_objpool_t *op, magazine *m)
+{
+    char *chunk;
+    unsigned i;
+
+    pj_assert(m->cnt == 0);
+
+    pj_lock_acquire(op->lock);
+    chunk = (char*) pj_pool_alloc(op->pool,
+				  op->elem_size * op->mag_size + OBJ_ALIGN);
+    if (chunk)
+	op->capacity += op->mag_size;
+    pj_lock_release(op->lock);
+
+    if (!chunk)
+	return PJ_FALSE;
+
+    chunk = (char*)ALIGN_SIZE((pj_size_t)chunk);
+    for (i=0; i<op->mag_size; ++i)
+	m->obj[i] = chunk + i * op->elem_size;
+    m->cnt = op->mag_size;
+
+    return PJ_TRUE;
+}
+
+#if HAS_ATOMIC_BUILTINS
+/* Take any magazine from the depot slots */
+static magazine *slot_take(magazine *volatile slot[], unsigned hint)
+{
+    unsigned i;
+
+    for (i=0; i<PJ_OBJPOOL_DEPOT_SIZE; ++i) {
+	magazine *volatile *s = &slot[(hint + i) % PJ_OBJPOOL_DEPOT_SIZE];
+	magazine *m;
+
+	if (__atomic_load_n(s, __ATOMIC_RELAXED) == NULL)
+	    continue;
+
+	m = __atomic_exchange_n(s, (magazine*)NULL, __ATOMIC_ACQ_REL);
+	if (m)
+	    return m;
+    }
+
+    return NULL;
+}
+
+/* Put the magazine in a free depot slot */
+static pj_bool_t slot_put(magazine *volatile slot[], unsigned hint,
+			  magazine *m)
+{
+    unsigned i;
+
+    for (i=0; i<PJ_OBJPOOL_DEPOT_SIZE; ++i) {
+	magazine *volatile *s = &slot[(hint + i) % PJ_OBJPOOL_DEPOT_SIZE];
+	magazine *expected = NULL;
+
+	if (__atomic_load_n(s, __ATOMIC_RELAXED) != NULL)
+	    continue;
+
+	if (__atomic_compare_exchange_n(s, &expected, m, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	{
+	    return PJ_TRUE;
+	}
+    }
+
+    return PJ_FALSE;
+}
+#endif	/* HAS_ATOMIC_BUILTINS */
+
+/* Get a full or empty magazine from the depot */
+static magazine *depot_get(pj_objpool_t *op, pj_bool_t full, unsigned hint)
+{
+    magazine *volatile *list = full ? &op->full_list : &op->empty_list;
+    magazine *m;
+
+#if HAS_ATOMIC_BUILTINS
+    m = slot_take(full ? op->full_slot : op->empty_slot, hint);
+    if (m)
+	return m;
+#else
+    PJ_UNUSED_ARG(hint);
+#endif
+
+    /* Avoid taking the lock when the list is obviously empty */
+    if (*list == NULL)
+	return NULL;
+
+    pj_lock_acquire(op->lock);
+    m = *list;
+    if (m)
+	*list = m->next;
+    pj_lock_release(op->lock);
+
+    return m;
+}
+
+/* Put a full or empty magazine to the depot */
+static void depot_put(pj_objpool_t *op, pj_bool_t full, unsigned hint,
+		      magazine *m)
+{
+    magazine *volatile *list = full ? &op->full_list : &op->empty_list;
+
+#if HAS_ATOMIC_BUILTINS
+    if (slot_put(full ? op->full_slot : op->empty_slot, hint, m))
+	return;
+#else
+    PJ_UNUSED_ARG(hint);
+#endif
+
+    pj_lock_acquire(op->lock);
+    m->next = *list;
+    *list = m;
+    pj_lock_release(op->lock);
+}
+
+/* Release all resources of the object pool. */
+static void objpool_on_destroy(pj_objpool_t *op)
+{
+    pj_thread_local_free(op->tls_id);
+    pj_lock_destroy(op->lock);
+    pj_pool_release(op->pool);
+}
+
+/* Add a reference to the object pool. */
+static void objpool_add_ref(pj_objpool_t *op)
+{
+#if HAS_ATOMIC_BUILTINS
+    __atomic_add_fetch(&op->ref_cnt, 1, __ATOMIC_RELAXED);
+#else
+    pj_lock_acquire(op->lock);
+    ++op->ref_cnt;
+    pj_lock_release(op->lock);
+#endif
+}
+
+/* Release a reference, destroying the object pool on the last one. */
+static void objpool_dec_ref(pj_objpool_t *op)
+{
+    long ref_cnt;
+
+#if HAS_ATOMIC_BUILTINS
+    ref_cnt = __atomic_sub_fetch(&op->ref_cnt, 1, __ATOMIC_ACQ_REL);
+#else
+    pj_lock_acquire(op->lock);
+    ref_cnt = --op->ref_cnt;
+    pj_lock_release(op->lock);
+#endif
+
+    if (ref_cnt == 0)
+	objpool_on_destroy(op);
+}
+
+/* Get the cache of the calling thread, creating it if necessary. */
+static thread_cache *get_cache(pj_objpool_t *op)
+{
+    thread_cache *tc;
+
+    tc = (thread_cache*) pj_thread_local_get(op->tls_id);
+    if (tc)
+	return tc;
+
+    pj_lock_acquire(op->lock);
+    tc = PJ_POOL_ZALLOC_T(op->pool, thread_cache);
+    if (tc) {
+	tc->loaded = new_magazine(op);
+	tc->prev = new_magazine(op);
+	tc->hint = op->cache_cnt++;
+    }
+    pj_lock_release(op->lock);
+
+    if (!tc || !tc->loaded || !tc->prev)
+	return NULL;
+
+    if (pj_thread_local_set(op->tls_id, tc) != PJ_SUCCESS)
+	return NULL;
+
+    return tc;
+}
+
+
+/*
+ * Create the object pool.
+ */
+PJ_DEF(pj_status_t) pj_objpool_create(pj_pool_factory *factory,
+				      const char *name,
+				      pj_size_t obj_size,
+				      unsigned mag_size,
+				      pj_objpool_t **p_objpool)
+{
+    pj_pool_t *pool;
+    pj_objpool_t *op;
+    pj_size_t elem_size;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(factory && obj_size && p_objpool, PJ_EINVAL);
+
+    if (mag_size == 0)
+	mag_size = PJ_OBJPOOL_MAG_SIZE;
+    elem_size = ALIGN_SIZE(obj_size);
+
+    if (name == NULL)
+	name = "objpool%p";
+
+    pool = pj_pool_create(factory, name,
+			  sizeof(pj_objpool_t) + 256 +
+			      mag_size * (elem_size + 2 * sizeof(void*)),
+			  4 * mag_size * elem_size,
+			  &on_no_memory);
+    if (!pool)
+	return PJ_ENOMEM;
+
+    op = PJ_POOL_ZALLOC_T(pool, pj_objpool_t);
+    if (!op) {
+	pj_pool_release(pool);
+	return PJ_ENOMEM;
+    }
+
+    pj_ansi_strncpy(op->obj_name, pool->obj_name, PJ_MAX_OBJ_NAME);
+    op->obj_name[PJ_MAX_OBJ_NAME-1] = '\0';
+    op->pool = pool;
+    op->obj_size = obj_size;
+    op->elem_size = elem_size;
+    op->mag_size = mag_size;
+    op->ref_cnt = 1;
+
+    status = pj_lock_create_simple_mutex(pool, op->obj_name, &op->lock);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return status;
+    }
+
+    status = pj_thread_local_alloc(&op->tls_id);
+    if (status != PJ_SUCCESS) {
+	pj_lock_destroy(op->lock);
+	pj_pool_release(pool);
+	return status;
+    }
+
+    *p_objpool = op;
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Destroy the object pool.
+ */
+PJ_DEF(void) pj_objpool_destroy(pj_objpool_t *op)
+{
+    PJ_ASSERT_ON_FAIL(op, return);
+
+    /* Objects that are still in use keep the object pool alive */
+    objpool_dec_ref(op);
+}
+
+
+/*
+ * Allocate an object.
+ */
+PJ_DEF(void*) pj_objpool_alloc(pj_objpool_t *op)
+{
+    thread_cache *tc;
+    magazine *m;
+
+    PJ_ASSERT_RETURN(op, NULL);
+
+    tc = get_cache(op);
+    if (!tc)
+	return NULL;
+
+    /* Take from the loaded magazine, or swap with the previous magazine
+     * if it has some objects.
+     */
+    if (tc->loaded->cnt == 0 && tc->prev->cnt) {
+	m = tc->loaded;
+	tc->loaded = tc->prev;
+	tc->prev = m;
+    }
+
+    /* Both magazines are empty. Get a full one from the depot, giving
+     * the spare empty one back to the depot, or create new objects.
+     */
+    if (tc->loaded->cnt == 0) {
+	m = depot_get(op, PJ_TRUE, tc->hint);
+	if (m) {
+	    depot_put(op, PJ_FALSE, tc->hint, tc->prev);
+	    tc->prev = tc->loaded;
+	    tc->loaded = m;
+	} else if (!grow(op, tc->loaded)) {
+	    return NULL;
+	}
+    }
+
+    objpool_add_ref(op);
+    return tc->loaded->obj[--tc->loaded->cnt];
+}
+
+
+/*
+ * Allocate a zero initialized object.
+ */
+PJ_DEF(void*) pj_objpool_zalloc(pj_objpool_t *op)
+{
+    void *obj = pj_objpool_alloc(op);
+    if (obj)
+	pj_bzero(obj, op->obj_size);
+    return obj;
+}
+
+
+/*
+ * Free an object.
+ */
+PJ_DEF(void) pj_objpool_free(pj_objpool_t *op, void *obj)
+{
+    thread_cache *tc;
+    magazine *m;
+
+    PJ_ASSERT_ON_FAIL(op && obj, return);
+
+    tc = get_cache(op);
+    if (!tc)
+	goto on_return;
+
+    /* Put in the loaded magazine, or swap with the previous magazine if
+     * it's empty.
+     */
+    if (tc->loaded->cnt == op->mag_size && tc->prev->cnt == 0) {
+	m = tc->loaded;
+	tc->loaded = tc->prev;
+	tc->prev = m;
+    }
+
+    /* Both magazines are full. Hand the previous one over to the depot
+     * and continue with an empty magazine.
+     */
+    if (tc->loaded->cnt == op->mag_size) {
+	m = depot_get(op, PJ_FALSE, tc->hint);
+	if (!m) {
+	    pj_lock_acquire(op->lock);
+	    m = new_magazine(op);
+	    pj_lock_release(op->lock);
+
+	    /* The object will be lost until the object pool is destroyed */
+	    if (!m)
+		goto on_return;
+	}
+
+	depot_put(op, PJ_TRUE, tc->hint, tc->prev);
+	tc->prev = tc->loaded;
+	tc->loaded = m;
+    }
+
+    tc->loaded->obj[tc->loaded->cnt++] = obj;
+
+on_return:
+    /* This may destroy the object pool if it's the last object of an
+     * object pool which destruction has been requested.
+     */
+    objpool_dec_ref(op);
+}
+
+
+/*
+ * Get object size.
+ */
+PJ_DEF(pj_size_t) pj_objpool_get_obj_size(const pj_objpool_t *op)
+{
+    PJ_ASSERT_RETURN(op, 0);
+    return op->obj_size;
+}
+
+
+/*
+ * Get number of objects created.
+ */
+PJ_DEF(unsigned) pj_objpool_get_capacity(pj_objpool_t *op)
+{
+    unsigned capacity;
+
+    PJ_ASSERT_RETURN(op, 0);
+
+    pj_lock_acquire(op->lock);
+    capacity = op->capacity;
+    pj_lock_release(op->lock);
+
+    return capacity;
+}
+
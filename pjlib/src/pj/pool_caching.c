@@ -49,6 +49,47 @@ static pj_size_t pool_sizes[PJ_CACHING_POOL_ARRAY_SIZE] =
  */
 #define START_SIZE  5
 
+/* Per-thread pool cache. The used_count of the caching pool is updated
+ * with atomic operations, since it's also modified outside the mutex.
+ */
+#if PJ_CACHING_POOL_THREAD_CACHE_CNT > 0 && !PJ_SAFE_POOL && \
+    defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#   define THREAD_CACHE	    1
+#   define USED_COUNT_INC(cp) __atomic_add_fetch(&(cp)->used_count, 1, \
+						 __ATOMIC_RELAXED)
+#   define USED_COUNT_DEC(cp) __atomic_sub_fetch(&(cp)->used_count, 1, \
+						 __ATOMIC_RELAXED)
+#else
+#   define THREAD_CACHE	    0
+#   define USED_COUNT_INC(cp) ++(cp)->used_count
+#   define USED_COUNT_DEC(cp) --(cp)->used_count
+#endif
+
+#if THREAD_CACHE
+/* Number of pools to move between the thread cache and the shared list */
+#define BATCH_CNT   ((PJ_CACHING_POOL_THREAD_CACHE_CNT + 1) / 2)
+
+typedef struct thread_cache
+{
+    PJ_DECL_LIST_MEMBER(struct thread_cache);
+    pj_list	    free_list[PJ_CACHING_POOL_ARRAY_SIZE];
+    unsigned	    count[PJ_CACHING_POOL_ARRAY_SIZE];
+} thread_cache;
+
+static thread_cache *get_thread_cache(pj_caching_pool *cp);
+static pj_pool_t* tcache_create_pool(pj_caching_pool *cp,
+				     thread_cache *tc,
+				     int idx,
+				     const char *name,
+				     pj_size_t increment_sz,
+				     pj_pool_callback *callback);
+static void tcache_release_pool(pj_caching_pool *cp,
+				thread_cache *tc,
+				unsigned idx,
+				pj_pool_t *pool);
+#endif
+
 
 PJ_DEF(void) pj_caching_pool_init( pj_caching_pool *cp, 
 				   const pj_pool_factory_policy *policy,
@@ -66,6 +107,13 @@ PJ_DEF(void) pj_caching_pool_init( pj_caching_pool *cp,
     for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i)
 	pj_list_init(&cp->free_list[i]);
 
+    cp->tls_id = -1;
+    pj_list_init(&cp->thread_cache_list);
+#if THREAD_CACHE
+    if (pj_thread_local_alloc(&cp->tls_id) != PJ_SUCCESS)
+	cp->tls_id = -1;
+#endif
+
     if (policy == NULL) {
     	policy = &pj_pool_factory_default_policy;
     }
@@ -88,6 +136,28 @@ PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
 
     PJ_CHECK_STACK();
 
+#if THREAD_CACHE
+    /* Delete all pools in the thread caches */
+    while (!pj_list_empty(&cp->thread_cache_list)) {
+	thread_cache *tc = (thread_cache*) cp->thread_cache_list.next;
+
+	pj_list_erase(tc);
+	for (i=0; i < PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
+	    while (!pj_list_empty(&tc->free_list[i])) {
+		pool = (pj_pool_t*) tc->free_list[i].next;
+		pj_list_erase(pool);
+		pj_pool_destroy_int(pool);
+	    }
+	}
+	cp->factory.policy.block_free(&cp->factory, tc, sizeof(*tc));
+    }
+
+    if (cp->tls_id != -1) {
+	pj_thread_local_free(cp->tls_id);
+	cp->tls_id = -1;
+    }
+#endif
+
     /* Delete all pool in free list */
     for (i=0; i < PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
 	pj_pool_t *pool = (pj_pool_t*) cp->free_list[i].next;
@@ -125,11 +195,12 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
     pj_caching_pool *cp = (pj_caching_pool*)pf;
     pj_pool_t *pool;
     int idx;
+#if THREAD_CACHE
+    thread_cache *tc;
+#endif
 
     PJ_CHECK_STACK();
 
-    pj_lock_acquire(cp->lock);
-
     /* Use pool factory's policy when callback is NULL */
     if (callback == NULL) {
 	callback = pf->policy.callback;
@@ -154,6 +225,17 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
 	    ;
     }
 
+#if THREAD_CACHE
+    /* Take the pool from this thread's cache if possible */
+    if (idx < PJ_CACHING_POOL_ARRAY_SIZE &&
+	(tc = get_thread_cache(cp)) != NULL)
+    {
+	return tcache_create_pool(cp, tc, idx, name, increment_sz, callback);
+    }
+#endif
+
+    pj_lock_acquire(cp->lock);
+
     /* Check whether there's a pool in the list. */
     if (idx==PJ_CACHING_POOL_ARRAY_SIZE || pj_list_empty(&cp->free_list[idx])) {
 	/* No pool is available. */
@@ -194,7 +276,7 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
     pool->factory_data = (void*) (pj_ssize_t) idx;
 
     /* Increment used count. */
-    ++cp->used_count;
+    USED_COUNT_INC(cp);
 
     pj_lock_release(cp->lock);
     return pool;
@@ -210,6 +292,19 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
 
     PJ_ASSERT_ON_FAIL(pf && pool, return);
 
+#if THREAD_CACHE
+    /* Pools that are not in the used list go back to this thread's cache */
+    if (pool->next == pool) {
+	thread_cache *tc = get_thread_cache(cp);
+
+	i = (unsigned) (unsigned long) (pj_ssize_t) pool->factory_data;
+	if (tc && i < PJ_CACHING_POOL_ARRAY_SIZE) {
+	    tcache_release_pool(cp, tc, i, pool);
+	    return;
+	}
+    }
+#endif
+
     pj_lock_acquire(cp->lock);
 
 #if PJ_SAFE_POOL
@@ -224,7 +319,7 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
     pj_list_erase(pool);
 
     /* Decrement used count. */
-    --cp->used_count;
+    USED_COUNT_DEC(cp);
 
     pool_capacity = pj_pool_get_capacity(pool);
 
@@ -267,6 +362,157 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
     pj_lock_release(cp->lock);
 }
 
+#if THREAD_CACHE
+/* Get the pool cache of the calling thread, creating it if necessary. */
+static thread_cache *get_thread_cache(pj_caching_pool *cp)
+{
+    thread_cache *tc;
+    int i;
+
+    if (cp->tls_id == -1)
+	return NULL;
+
+    tc = (thread_cache*) pj_thread_local_get(cp->tls_id);
+    if (tc)
+	return tc;
+
+    tc = (thread_cache*) cp->factory.policy.block_alloc(&cp->factory,
+							 sizeof(*tc));
+    if (!tc)
+	return NULL;
+
+    for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
+	pj_list_init(&tc->free_list[i]);
+	tc->count[i] = 0;
+    }
+
+    if (pj_thread_local_set(cp->tls_id, tc) != PJ_SUCCESS) {
+	cp->factory.policy.block_free(&cp->factory, tc, sizeof(*tc));
+	return NULL;
+    }
+
+    pj_lock_acquire(cp->lock);
+    pj_list_push_back(&cp->thread_cache_list, tc);
+    pj_lock_release(cp->lock);
+
+    return tc;
+}
+
+/* Create pool from the thread cache. The mutex is only needed when the
+ * thread cache is empty, to refill it from the shared free list.
+ */
+static pj_pool_t* tcache_create_pool(pj_caching_pool *cp,
+				     thread_cache *tc,
+				     int idx,
+				     const char *name,
+				     pj_size_t increment_sz,
+				     pj_pool_callback *callback)
+{
+    pj_pool_t *pool;
+
+    if (pj_list_empty(&tc->free_list[idx])) {
+	unsigned i;
+
+	pj_lock_acquire(cp->lock);
+	for (i=0; i<BATCH_CNT && !pj_list_empty(&cp->free_list[idx]); ++i) {
+	    pool = (pj_pool_t*) cp->free_list[idx].next;
+	    pj_list_erase(pool);
+
+	    /* Update pool manager's free capacity. */
+	    if (cp->capacity > pj_pool_get_capacity(pool)) {
+		cp->capacity -= pj_pool_get_capacity(pool);
+	    } else {
+		cp->capacity = 0;
+	    }
+
+	    pj_list_push_back(&tc->free_list[idx], pool);
+	    ++tc->count[idx];
+	}
+	pj_lock_release(cp->lock);
+    }
+
+    if (pj_list_empty(&tc->free_list[idx])) {
+	/* Create new pool */
+	pool = pj_pool_create_int(&cp->factory, name, pool_sizes[idx], 
+				  increment_sz, callback);
+	if (!pool)
+	    return NULL;
+
+	pj_list_init(pool);
+
+    } else {
+	/* Get the most recently released pool from the cache. */
+	pool = (pj_pool_t*) tc->free_list[idx].next;
+	pj_list_erase(pool);
+	--tc->count[idx];
+
+	/* Initialize the pool. */
+	pj_pool_init_int(pool, name, increment_sz, callback);
+
+	PJ_LOG(6, (pool->obj_name, "pool reused, size=%u", pool->capacity));
+    }
+
+    /* Mark factory data */
+    pool->factory_data = (void*) (pj_ssize_t) idx;
+
+    /* Increment used count. */
+    USED_COUNT_INC(cp);
+
+    return pool;
+}
+
+/* Release pool to the thread cache. When the cache is full, the older
+ * half of it is moved to the shared free list.
+ */
+static void tcache_release_pool(pj_caching_pool *cp,
+				thread_cache *tc,
+				unsigned idx,
+				pj_pool_t *pool)
+{
+    pj_size_t pool_capacity;
+
+    /* Decrement used count. */
+    USED_COUNT_DEC(cp);
+
+    /* Destroy the pool if it has grown bigger than our size. */
+    pool_capacity = pj_pool_get_capacity(pool);
+    if (pool_capacity > pool_sizes[PJ_CACHING_POOL_ARRAY_SIZE-1]) {
+	pj_pool_destroy_int(pool);
+	return;
+    }
+
+    /* Reset pool. */
+    PJ_LOG(6, (pool->obj_name, "recycle(): cap=%d, used=%d(%d%%)", 
+	       pool_capacity, pj_pool_get_used_size(pool), 
+	       pj_pool_get_used_size(pool)*100/pool_capacity));
+    pj_pool_reset(pool);
+
+    if (tc->count[idx] >= PJ_CACHING_POOL_THREAD_CACHE_CNT) {
+	unsigned i;
+
+	pj_lock_acquire(cp->lock);
+	for (i=0; i<BATCH_CNT; ++i) {
+	    pj_pool_t *old = (pj_pool_t*) tc->free_list[idx].prev;
+
+	    pj_list_erase(old);
+	    --tc->count[idx];
+
+	    pool_capacity = pj_pool_get_capacity(old);
+	    if (cp->capacity + pool_capacity > cp->max_capacity) {
+		pj_pool_destroy_int(old);
+	    } else {
+		pj_list_insert_after(&cp->free_list[idx], old);
+		cp->capacity += pool_capacity;
+	    }
+	}
+	pj_lock_release(cp->lock);
+    }
+
+    pj_list_insert_after(&tc->free_list[idx], pool);
+    ++tc->count[idx];
+}
+#endif	/* THREAD_CACHE */
+
 static void cpool_dump_status(pj_pool_factory *factory, pj_bool_t detail )
 {
 #if PJ_LOG_MAX_LEVEL >= 3
@@ -314,9 +560,16 @@ static pj_bool_t cpool_on_block_alloc(pj_pool_factory *f, pj_size_t sz)
     //Can't lock because mutex is not recursive
     //if (cp->mutex) pj_mutex_lock(cp->mutex);
 
+#if THREAD_CACHE
+    /* Pools may grow outside the mutex when the thread cache is used */
+    sz = __atomic_add_fetch(&cp->used_size, sz, __ATOMIC_RELAXED);
+    if (sz > cp->peak_used_size)
+	cp->peak_used_size = sz;
+#else
     cp->used_size += sz;
     if (cp->used_size > cp->peak_used_size)
 	cp->peak_used_size = cp->used_size;
+#endif
 
     //if (cp->mutex) pj_mutex_unlock(cp->mutex);
 
@@ -329,7 +582,11 @@ static void cpool_on_block_free(pj_pool_factory *f, pj_size_t sz)
     pj_caching_pool *cp = (pj_caching_pool*)f;
 
     //pj_mutex_lock(cp->mutex);
+#if THREAD_CACHE
+    __atomic_sub_fetch(&cp->used_size, sz, __ATOMIC_RELAXED);
+#else
     cp->used_size -= sz;
+#endif
     //pj_mutex_unlock(cp->mutex);
 }
 
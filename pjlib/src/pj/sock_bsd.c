@@ -17,6 +17,10 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
+/* recvmmsg() and sendmmsg() are only declared with _GNU_SOURCE on glibc */
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
 #include <pj/sock.h>
 #include <pj/os.h>
 #include <pj/assert.h>
@@ -24,6 +28,7 @@
 #include <pj/compat/socket.h>
 #include <pj/addr_resolv.h>
 #include <pj/errno.h>
+#include <pj/math.h>
 #include <pj/unicode.h>
 
 /*
@@ -135,6 +140,11 @@ const pj_uint16_t PJ_SO_RCVBUF  = SO_RCVBUF;
 const pj_uint16_t PJ_SO_SNDBUF  = SO_SNDBUF;
 const pj_uint16_t PJ_TCP_NODELAY= TCP_NODELAY;
 const pj_uint16_t PJ_SO_REUSEADDR= SO_REUSEADDR;
+#ifdef SO_REUSEPORT
+const pj_uint16_t PJ_SO_REUSEPORT = SO_REUSEPORT;
+#else
+const pj_uint16_t PJ_SO_REUSEPORT = 0xFFFF;
+#endif
 #ifdef SO_NOSIGPIPE
 const pj_uint16_t PJ_SO_NOSIGPIPE = SO_NOSIGPIPE;
 #else
@@ -738,6 +748,99 @@ PJ_DEF(pj_status_t) pj_sock_recvfrom(pj_sock_t sock,
     }
 }
 
+#if defined(PJ_SOCK_HAS_RECVMMSG) && PJ_SOCK_HAS_RECVMMSG!=0
+/*
+ * Receive multiple datagrams.
+ */
+PJ_DEF(pj_status_t) pj_sock_recvmmsg(pj_sock_t sock,
+				     pj_sock_msg msgs[],
+				     unsigned *count,
+				     unsigned flags)
+{
+    struct mmsghdr hdr[PJ_SOCK_MAX_MMSG];
+    struct iovec iov[PJ_SOCK_MAX_MMSG];
+    unsigned i, cnt;
+    int rc;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    pj_bzero(hdr, cnt * sizeof(hdr[0]));
+    for (i=0; i<cnt; ++i) {
+	iov[i].iov_base = msgs[i].buf;
+	iov[i].iov_len = msgs[i].len;
+	hdr[i].msg_hdr.msg_iov = &iov[i];
+	hdr[i].msg_hdr.msg_iovlen = 1;
+	hdr[i].msg_hdr.msg_name = &msgs[i].addr;
+	hdr[i].msg_hdr.msg_namelen = msgs[i].addr_len;
+    }
+
+#ifdef MSG_WAITFORONE
+    /* Don't block for the rest of the batch once a datagram is in */
+    flags |= MSG_WAITFORONE;
+#endif
+
+    rc = recvmmsg(sock, hdr, cnt, flags, NULL);
+    if (rc < 0) {
+	*count = 0;
+	return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    }
+
+    for (i=0; i<(unsigned)rc; ++i) {
+	msgs[i].len = hdr[i].msg_len;
+	msgs[i].addr_len = hdr[i].msg_hdr.msg_namelen;
+	PJ_SOCKADDR_RESET_LEN(&msgs[i].addr);
+    }
+    *count = rc;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Send multiple datagrams.
+ */
+PJ_DEF(pj_status_t) pj_sock_sendmmsg(pj_sock_t sock,
+				     pj_sock_msg msgs[],
+				     unsigned *count,
+				     unsigned flags)
+{
+    struct mmsghdr hdr[PJ_SOCK_MAX_MMSG];
+    struct iovec iov[PJ_SOCK_MAX_MMSG];
+    unsigned i, cnt;
+    int rc;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    pj_bzero(hdr, cnt * sizeof(hdr[0]));
+    for (i=0; i<cnt; ++i) {
+	iov[i].iov_base = msgs[i].buf;
+	iov[i].iov_len = msgs[i].len;
+	hdr[i].msg_hdr.msg_iov = &iov[i];
+	hdr[i].msg_hdr.msg_iovlen = 1;
+	if (msgs[i].addr_len) {
+	    CHECK_ADDR_LEN(&msgs[i].addr, msgs[i].addr_len);
+	    hdr[i].msg_hdr.msg_name = &msgs[i].addr;
+	    hdr[i].msg_hdr.msg_namelen = msgs[i].addr_len;
+	}
+    }
+
+    rc = sendmmsg(sock, hdr, cnt, flags);
+    if (rc < 0) {
+	*count = 0;
+	return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    }
+
+    for (i=0; i<(unsigned)rc; ++i)
+	msgs[i].len = hdr[i].msg_len;
+    *count = rc;
+
+    return PJ_SUCCESS;
+}
+#endif	/* PJ_SOCK_HAS_RECVMMSG */
+
 /*
  * Get socket option.
  */
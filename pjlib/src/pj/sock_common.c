@@ -21,11 +21,13 @@
 #include <pj/assert.h>
 #include <pj/ctype.h>
 #include <pj/errno.h>
+#include <pj/math.h>
 #include <pj/ip_helper.h>
 #include <pj/os.h>
 #include <pj/addr_resolv.h>
 #include <pj/rand.h>
 #include <pj/string.h>
+#include <pj/sock_select.h>
 #include <pj/compat/socket.h>
 
 #if 0
@@ -1142,6 +1144,76 @@ PJ_DEF(pj_status_t) pj_sock_setsockopt_sobuf( pj_sock_t sockfd,
 }
 
 
+#if !defined(PJ_SOCK_HAS_RECVMMSG) || PJ_SOCK_HAS_RECVMMSG==0
+/*
+ * Receive multiple datagrams, emulated with recvfrom().
+ */
+PJ_DEF(pj_status_t) pj_sock_recvmmsg(pj_sock_t sockfd,
+				     pj_sock_msg msgs[],
+				     unsigned *count,
+				     unsigned flags)
+{
+    unsigned i, cnt;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    for (i=0; i<cnt; ++i) {
+	/* Only wait for the first datagram, even on a blocking socket */
+	if (i > 0) {
+	    pj_fd_set_t rset;
+	    pj_time_val timeout = {0, 0};
+
+	    PJ_FD_ZERO(&rset);
+	    PJ_FD_SET(sockfd, &rset);
+	    if (pj_sock_select((int)sockfd+1, &rset, NULL, NULL, &timeout) < 1)
+		break;
+	}
+
+	status = pj_sock_recvfrom(sockfd, msgs[i].buf, &msgs[i].len, flags,
+				  &msgs[i].addr, &msgs[i].addr_len);
+	if (status != PJ_SUCCESS)
+	    break;
+    }
+
+    *count = i;
+    return (i > 0) ? PJ_SUCCESS : status;
+}
+
+/*
+ * Send multiple datagrams, emulated with sendto().
+ */
+PJ_DEF(pj_status_t) pj_sock_sendmmsg(pj_sock_t sockfd,
+				     pj_sock_msg msgs[],
+				     unsigned *count,
+				     unsigned flags)
+{
+    unsigned i, cnt;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    for (i=0; i<cnt; ++i) {
+	if (msgs[i].addr_len) {
+	    status = pj_sock_sendto(sockfd, msgs[i].buf, &msgs[i].len, flags,
+				    &msgs[i].addr, msgs[i].addr_len);
+	} else {
+	    status = pj_sock_send(sockfd, msgs[i].buf, &msgs[i].len, flags);
+	}
+	if (status != PJ_SUCCESS)
+	    break;
+    }
+
+    *count = i;
+    return (i > 0) ? PJ_SUCCESS : status;
+}
+#endif	/* !PJ_SOCK_HAS_RECVMMSG */
+
+
 /* Only need to implement these in DLL build */
 #if defined(PJ_DLL)
 
@@ -1270,6 +1342,11 @@ PJ_DEF(pj_uint16_t) pj_SO_REUSEADDR(void)
     return PJ_SO_REUSEADDR;
 }
 
+PJ_DEF(pj_uint16_t) pj_SO_REUSEPORT(void)
+{
+    return PJ_SO_REUSEPORT;
+}
+
 PJ_DEF(pj_uint16_t) pj_SO_NOSIGPIPE(void)
 {
     return PJ_SO_NOSIGPIPE;
@@ -78,6 +78,7 @@ PJ_EXPORT_SYMBOL(pj_create_unique_string)
  */
 PJ_EXPORT_SYMBOL(pj_hash_calc)
 PJ_EXPORT_SYMBOL(pj_hash_create)
+PJ_EXPORT_SYMBOL(pj_hash_create2)
 PJ_EXPORT_SYMBOL(pj_hash_get)
 PJ_EXPORT_SYMBOL(pj_hash_set)
 PJ_EXPORT_SYMBOL(pj_hash_count)
@@ -88,7 +89,9 @@ PJ_EXPORT_SYMBOL(pj_hash_this)
 /*
  * ioqueue.h
  */
+PJ_EXPORT_SYMBOL(pj_ioqueue_cfg_default)
 PJ_EXPORT_SYMBOL(pj_ioqueue_create)
+PJ_EXPORT_SYMBOL(pj_ioqueue_create2)
 PJ_EXPORT_SYMBOL(pj_ioqueue_destroy)
 PJ_EXPORT_SYMBOL(pj_ioqueue_set_lock)
 PJ_EXPORT_SYMBOL(pj_ioqueue_register_sock)
@@ -101,6 +104,8 @@ PJ_EXPORT_SYMBOL(pj_ioqueue_recvfrom)
 PJ_EXPORT_SYMBOL(pj_ioqueue_write)
 PJ_EXPORT_SYMBOL(pj_ioqueue_send)
 PJ_EXPORT_SYMBOL(pj_ioqueue_sendto)
+PJ_EXPORT_SYMBOL(pj_ioqueue_recvmmsg)
+PJ_EXPORT_SYMBOL(pj_ioqueue_sendmmsg)
 #if defined(PJ_HAS_TCP) && PJ_HAS_TCP != 0
 PJ_EXPORT_SYMBOL(pj_ioqueue_accept)
 PJ_EXPORT_SYMBOL(pj_ioqueue_connect)
@@ -225,6 +230,17 @@ PJ_EXPORT_SYMBOL(pj_pool_destroy_int)
 PJ_EXPORT_SYMBOL(pj_caching_pool_init)
 PJ_EXPORT_SYMBOL(pj_caching_pool_destroy)
 
+/*
+ * objpool.h
+ */
+PJ_EXPORT_SYMBOL(pj_objpool_create)
+PJ_EXPORT_SYMBOL(pj_objpool_destroy)
+PJ_EXPORT_SYMBOL(pj_objpool_alloc)
+PJ_EXPORT_SYMBOL(pj_objpool_zalloc)
+PJ_EXPORT_SYMBOL(pj_objpool_free)
+PJ_EXPORT_SYMBOL(pj_objpool_get_obj_size)
+PJ_EXPORT_SYMBOL(pj_objpool_get_capacity)
+
 /*
  * rand.h
  */
@@ -291,6 +307,8 @@ PJ_EXPORT_SYMBOL(pj_sock_recv)
 PJ_EXPORT_SYMBOL(pj_sock_recvfrom)
 PJ_EXPORT_SYMBOL(pj_sock_send)
 PJ_EXPORT_SYMBOL(pj_sock_sendto)
+PJ_EXPORT_SYMBOL(pj_sock_recvmmsg)
+PJ_EXPORT_SYMBOL(pj_sock_sendmmsg)
 
 /*
  * sock_select.h
@@ -334,6 +352,8 @@ PJ_EXPORT_SYMBOL(pj_utoa_pad)
  */
 PJ_EXPORT_SYMBOL(pj_timer_heap_mem_size)
 PJ_EXPORT_SYMBOL(pj_timer_heap_create)
+PJ_EXPORT_SYMBOL(pj_timer_heap_param_default)
+PJ_EXPORT_SYMBOL(pj_timer_heap_create2)
 PJ_EXPORT_SYMBOL(pj_timer_entry_init)
 PJ_EXPORT_SYMBOL(pj_timer_heap_schedule)
 PJ_EXPORT_SYMBOL(pj_timer_heap_cancel)
@@ -45,6 +45,35 @@
 
 #define DEFAULT_MAX_TIMED_OUT_PER_POLL  (64)
 
+/* How late (msec) the entries of a shard may be before threads which
+ * have another home shard help with polling it.
+ */
+#define SHARD_HELP_DELAY		(10)
+
+/* Time value in msec, used for the due time of shards */
+#define TIME_MSEC(t)			((pj_uint32_t)((t).sec*1000 + (t).msec))
+
+/*
+ * Timing wheel geometry. Level zero has 256 slots of one tick each, and
+ * each of the three upper levels has 64 slots spanning the whole range of
+ * the level below, giving 2^26 ticks (about 7.7 days with 10 msec ticks)
+ * before timers need to be clamped to the last slot.
+ */
+#define WHEEL_L0_BITS		8
+#define WHEEL_LN_BITS		6
+#define WHEEL_LEVELS		4
+#define WHEEL_L0_SIZE		(1 << WHEEL_L0_BITS)
+#define WHEEL_LN_SIZE		(1 << WHEEL_LN_BITS)
+#define WHEEL_L0_MASK		(WHEEL_L0_SIZE - 1)
+#define WHEEL_LN_MASK		(WHEEL_LN_SIZE - 1)
+#define WHEEL_SHIFT(L)		(WHEEL_L0_BITS + ((L)-1) * WHEEL_LN_BITS)
+#define WHEEL_MAX_TICKS		((pj_uint32_t)1 << WHEEL_SHIFT(WHEEL_LEVELS))
+#define WHEEL_SLOT(L,I)		((L)==0 ? (I) : \
+				 WHEEL_L0_SIZE + ((L)-1)*WHEEL_LN_SIZE + (I))
+#define WHEEL_SLOT_LEVEL(S)	((S) < WHEEL_L0_SIZE ? 0 : \
+				 1 + ((S) - WHEEL_L0_SIZE) / WHEEL_LN_SIZE)
+#define WHEEL_PENDING		(WHEEL_SLOT(WHEEL_LEVELS, 0))
+
 enum
 {
     F_DONT_CALL = 1,
@@ -53,6 +82,62 @@ enum
 };
 
 
+/**
+ * A node in the timing wheel. Nodes are linked with timer ids rather than
+ * pointers, so that the node array can be grown just like the heap.
+ */
+typedef struct wheel_node
+{
+    /** The timer entry, or NULL if this node is in the freelist. */
+    pj_timer_entry *entry;
+
+    /** Previous node in the slot, or zero if this is the first node. */
+    pj_timer_id_t prev;
+
+    /** Next node in the slot or in the freelist, zero terminated. */
+    pj_timer_id_t next;
+
+    /** The slot where this node currently resides. */
+    unsigned slot;
+
+} wheel_node;
+
+
+/**
+ * The timing wheel, only allocated for PJ_TIMER_HEAP_TYPE_WHEEL.
+ */
+typedef struct timer_wheel
+{
+    /** Duration of one tick, in msec. */
+    unsigned resolution;
+
+    /** Number of ticks per second. */
+    unsigned ticks_per_sec;
+
+    /** The second where tick zero starts. */
+    long base_sec;
+
+    /** The next tick to be processed. */
+    pj_uint32_t cur_tick;
+
+    /** Node array, indexed by timer id. Id zero is never used. */
+    wheel_node *nodes;
+
+    /** First free node, or zero if the node array is full. */
+    pj_timer_id_t freelist;
+
+    /** Number of entries in each level. */
+    unsigned level_cnt[WHEEL_LEVELS];
+
+    /**
+     * The first node in each slot, followed by the list of expired entries
+     * waiting for their callbacks to be called.
+     */
+    pj_timer_id_t head[WHEEL_PENDING + 1];
+
+} timer_wheel;
+
+
 /**
  * The implementation of timer heap.
  */
@@ -61,10 +146,13 @@ struct pj_timer_heap_t
     /** Pool from which the timer heap resize will get the storage from */
     pj_pool_t *pool;
 
-    /** Maximum size of the heap. */
+    /** Implementation type. */
+    pj_timer_heap_type type;
+
+    /** Maximum size of the heap (or the wheel node array). */
     pj_size_t max_size;
 
-    /** Current size of the heap. */
+    /** Current number of scheduled entries. */
     pj_size_t cur_size;
 
     /** Max timed out entries to process per poll. */
@@ -105,6 +193,31 @@ struct pj_timer_heap_t
     /** Callback to be called when a timer expires. */
     pj_timer_heap_callback *callback;
 
+    /** The timing wheel, if type is PJ_TIMER_HEAP_TYPE_WHEEL. */
+    timer_wheel *wheel;
+
+    /** Number of shards, zero if this timer heap is not sharded. */
+    unsigned shard_cnt;
+
+    /** Non-zero if this timer heap is a shard of a sharded timer heap. */
+    pj_bool_t is_shard;
+
+    /**
+     * For shards, the expiration (TIME_MSEC) of the earliest entry, or
+     * earlier if it has been cancelled. Other threads read this without
+     * the lock to find out whether they need to help with the shard.
+     */
+    pj_uint32_t due_msec;
+
+    /** The shards, each with its own pool and lock. */
+    pj_timer_heap_t **shards;
+
+    /** Thread local index to store the home shard of polling threads. */
+    long home_shard_tls;
+
+    /** Counter to assign home shards to polling threads. */
+    pj_atomic_t *home_shard_cnt;
+
 };
 
 
@@ -301,10 +414,331 @@ static void insert_node(pj_timer_heap_t *ht, pj_timer_entry *new_node)
 }
 
 
+/*
+ * Convert time to wheel tick, rounding down or up to tick boundary.
+ */
+static pj_uint32_t wheel_tick(const timer_wheel *w, const pj_time_val *t,
+			      pj_bool_t round_up)
+{
+    pj_uint32_t tick;
+
+    tick = (pj_uint32_t)(t->sec - w->base_sec) * w->ticks_per_sec;
+    if (round_up)
+	tick += (t->msec + w->resolution - 1) / w->resolution;
+    else
+	tick += t->msec / w->resolution;
+
+    return tick;
+}
+
+static void wheel_link(timer_wheel *w, pj_timer_id_t id, unsigned slot)
+{
+    wheel_node *node = &w->nodes[id];
+
+    node->slot = slot;
+    node->prev = 0;
+    node->next = w->head[slot];
+    if (node->next)
+	w->nodes[node->next].prev = id;
+    w->head[slot] = id;
+
+    if (slot != WHEEL_PENDING)
+	++w->level_cnt[WHEEL_SLOT_LEVEL(slot)];
+}
+
+static void wheel_unlink(timer_wheel *w, pj_timer_id_t id)
+{
+    wheel_node *node = &w->nodes[id];
+
+    if (node->prev)
+	w->nodes[node->prev].next = node->next;
+    else
+	w->head[node->slot] = node->next;
+    if (node->next)
+	w->nodes[node->next].prev = node->prev;
+
+    if (node->slot != WHEEL_PENDING)
+	--w->level_cnt[WHEEL_SLOT_LEVEL(node->slot)];
+}
+
+/*
+ * Put the node in the lowest level that can hold its expiration, relative
+ * to the current tick.
+ */
+static void wheel_add(timer_wheel *w, pj_timer_id_t id)
+{
+    pj_timer_entry *entry = w->nodes[id].entry;
+    pj_uint32_t expires, delta;
+    unsigned level, slot;
+
+    expires = wheel_tick(w, &entry->_timer_value, PJ_TRUE);
+    delta = expires - w->cur_tick;
+
+    if ((pj_int32_t)delta < 0) {
+	/* Already expired, process on the next tick */
+	expires = w->cur_tick;
+	delta = 0;
+    } else if (delta >= WHEEL_MAX_TICKS) {
+	/* Too far ahead, park in the last slot. It will be re-added when
+	 * the slot is cascaded.
+	 */
+	delta = WHEEL_MAX_TICKS - 1;
+	expires = w->cur_tick + delta;
+    }
+
+    if (delta < WHEEL_L0_SIZE) {
+	slot = expires & WHEEL_L0_MASK;
+    } else {
+	for (level=1; level<WHEEL_LEVELS-1; ++level) {
+	    if (delta < ((pj_uint32_t)1 << WHEEL_SHIFT(level+1)))
+		break;
+	}
+	slot = WHEEL_SLOT(level,
+			  (expires >> WHEEL_SHIFT(level)) & WHEEL_LN_MASK);
+    }
+
+    wheel_link(w, id, slot);
+}
+
+static void wheel_grow(pj_timer_heap_t *ht)
+{
+    timer_wheel *w = ht->wheel;
+    pj_size_t new_size = ht->max_size * 2;
+    wheel_node *new_nodes;
+    pj_size_t i;
+
+    new_nodes = (wheel_node*)
+		pj_pool_alloc(ht->pool, new_size * sizeof(wheel_node));
+    pj_memcpy(new_nodes, w->nodes, ht->max_size * sizeof(wheel_node));
+    w->nodes = new_nodes;
+
+    /* Put the new nodes in the freelist */
+    for (i = ht->max_size; i < new_size; ++i) {
+	w->nodes[i].entry = NULL;
+	w->nodes[i].next = (pj_timer_id_t)(i + 1 < new_size ? i + 1 : 0);
+    }
+    w->freelist = (pj_timer_id_t)ht->max_size;
+
+    ht->max_size = new_size;
+}
+
+static pj_status_t wheel_schedule(pj_timer_heap_t *ht,
+				  pj_timer_entry *entry,
+				  const pj_time_val *future_time)
+{
+    timer_wheel *w = ht->wheel;
+    pj_timer_id_t id;
+
+    if (w->freelist == 0)
+	wheel_grow(ht);
+
+    id = w->freelist;
+    w->freelist = w->nodes[id].next;
+
+    w->nodes[id].entry = entry;
+    entry->_timer_id = id;
+    entry->_timer_value = *future_time;
+    ++ht->cur_size;
+
+    wheel_add(w, id);
+    return PJ_SUCCESS;
+}
+
+static pj_timer_entry *wheel_remove(pj_timer_heap_t *ht, pj_timer_id_t id)
+{
+    timer_wheel *w = ht->wheel;
+    pj_timer_entry *entry = w->nodes[id].entry;
+
+    wheel_unlink(w, id);
+
+    w->nodes[id].entry = NULL;
+    w->nodes[id].next = w->freelist;
+    w->freelist = id;
+    --ht->cur_size;
+
+    entry->_timer_id = -1;
+    return entry;
+}
+
+static int wheel_cancel(pj_timer_heap_t *ht,
+			pj_timer_entry *entry,
+			unsigned flags)
+{
+    timer_wheel *w = ht->wheel;
+
+    if (entry->_timer_id < 1 || (pj_size_t)entry->_timer_id >= ht->max_size) {
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    if (w->nodes[entry->_timer_id].entry != entry) {
+	if ((flags & F_DONT_ASSERT) == 0)
+	    pj_assert(w->nodes[entry->_timer_id].entry == entry);
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    wheel_remove(ht, entry->_timer_id);
+
+    if ((flags & F_DONT_CALL) == 0)
+	(*ht->callback)(ht, entry);
+    return 1;
+}
+
+/*
+ * Move the entries in the slot down to lower levels.
+ */
+static void wheel_cascade(timer_wheel *w, unsigned level, unsigned index)
+{
+    unsigned slot = WHEEL_SLOT(level, index);
+    pj_timer_id_t id = w->head[slot];
+
+    w->head[slot] = 0;
+    while (id) {
+	pj_timer_id_t next = w->nodes[id].next;
+
+	--w->level_cnt[level];
+	wheel_add(w, id);
+	id = next;
+    }
+}
+
+/*
+ * Process the current tick: cascade the upper levels if the lower level
+ * has wrapped around, then move the expired slot to the pending list.
+ * The pending list must be empty when this is called.
+ */
+static void wheel_advance(timer_wheel *w)
+{
+    pj_uint32_t tick = w->cur_tick;
+    unsigned level, slot;
+    pj_timer_id_t id;
+
+    if ((tick & WHEEL_L0_MASK) == 0) {
+	for (level=1; level<WHEEL_LEVELS; ++level) {
+	    unsigned index = (tick >> WHEEL_SHIFT(level)) & WHEEL_LN_MASK;
+
+	    if (w->level_cnt[level])
+		wheel_cascade(w, level, index);
+	    if (index != 0)
+		break;
+	}
+    }
+
+    slot = tick & WHEEL_L0_MASK;
+    w->head[WHEEL_PENDING] = id = w->head[slot];
+    w->head[slot] = 0;
+    for (; id; id = w->nodes[id].next) {
+	w->nodes[id].slot = WHEEL_PENDING;
+	--w->level_cnt[0];
+    }
+
+    w->cur_tick = tick + 1;
+}
+
+/*
+ * Get the earliest tick where an entry may expire. This may return an
+ * earlier tick than the real one when the upper levels need cascading.
+ */
+static pj_uint32_t wheel_next_tick(const timer_wheel *w)
+{
+    pj_uint32_t tick = w->cur_tick;
+    pj_uint32_t limit;
+    unsigned level;
+
+    for (level=1; level<WHEEL_LEVELS; ++level) {
+	if (w->level_cnt[level])
+	    break;
+    }
+
+    if (level == WHEEL_LEVELS)
+	limit = tick + WHEEL_L0_SIZE;
+    else if (tick & WHEEL_L0_MASK)
+	limit = (tick | WHEEL_L0_MASK) + 1;
+    else
+	return tick;
+
+    if (w->level_cnt[0] == 0)
+	return limit;
+
+    for (; tick != limit; ++tick) {
+	if (w->head[tick & WHEEL_L0_MASK])
+	    break;
+    }
+    return tick;
+}
+
+/*
+ * Find the earliest entry in a slot list.
+ */
+static pj_timer_entry *wheel_slot_earliest(const timer_wheel *w,
+					   unsigned slot,
+					   pj_timer_entry *earliest)
+{
+    pj_timer_id_t id;
+
+    for (id = w->head[slot]; id; id = w->nodes[id].next) {
+	pj_timer_entry *e = w->nodes[id].entry;
+	if (!earliest || PJ_TIME_VAL_LT(e->_timer_value, earliest->_timer_value))
+	    earliest = e;
+    }
+    return earliest;
+}
+
+/*
+ * Find the entry with the earliest expiration. On each level, the slots
+ * hold increasing expiration ranges starting from the current tick, so
+ * only the first non-empty slot of each level needs to be inspected.
+ */
+static pj_timer_entry *wheel_earliest(const timer_wheel *w)
+{
+    pj_timer_entry *earliest;
+    unsigned level, i;
+
+    earliest = wheel_slot_earliest(w, WHEEL_PENDING, NULL);
+
+    if (w->level_cnt[0]) {
+	for (i=0; i<WHEEL_L0_SIZE; ++i) {
+	    unsigned slot = (w->cur_tick + i) & WHEEL_L0_MASK;
+	    if (w->head[slot]) {
+		earliest = wheel_slot_earliest(w, slot, earliest);
+		break;
+	    }
+	}
+    }
+
+    for (level=1; level<WHEEL_LEVELS; ++level) {
+	pj_uint32_t mask = ((pj_uint32_t)1 << WHEEL_SHIFT(level)) - 1;
+	unsigned index = (w->cur_tick >> WHEEL_SHIFT(level)) & WHEEL_LN_MASK;
+
+	if (w->level_cnt[level] == 0)
+	    continue;
+
+	/* The current slot has not been cascaded yet if the current tick
+	 * is at its boundary, otherwise it holds the farthest entries.
+	 */
+	if (w->cur_tick & mask)
+	    ++index;
+
+	for (i=0; i<WHEEL_LN_SIZE; ++i) {
+	    unsigned slot = WHEEL_SLOT(level, (index + i) & WHEEL_LN_MASK);
+	    if (w->head[slot]) {
+		earliest = wheel_slot_earliest(w, slot, earliest);
+		break;
+	    }
+	}
+    }
+
+    return earliest;
+}
+
 static pj_status_t schedule_entry( pj_timer_heap_t *ht,
 				   pj_timer_entry *entry, 
 				   const pj_time_val *future_time )
 {
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL)
+	return wheel_schedule(ht, entry, future_time);
+
     if (ht->cur_size < ht->max_size)
     {
 	// Obtain the next unique sequence number.
@@ -327,6 +761,9 @@ static int cancel( pj_timer_heap_t *ht,
 
   PJ_CHECK_STACK();
 
+  if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL)
+    return wheel_cancel(ht, entry, flags);
+
   // Check to see if the timer_id is out of range
   if (entry->_timer_id < 0 || (pj_size_t)entry->_timer_id > ht->max_size) {
     entry->_timer_id = -1;
@@ -372,6 +809,17 @@ PJ_DEF(pj_size_t) pj_timer_heap_mem_size(pj_size_t count)
            132;
 }
 
+/*
+ * Initialize timer heap parameters.
+ */
+PJ_DEF(void) pj_timer_heap_param_default(pj_timer_heap_param *param)
+{
+    pj_bzero(param, sizeof(*param));
+    param->type = PJ_TIMER_HEAP_TYPE_HEAP;
+    param->wheel_resolution = PJ_TIMER_WHEEL_RESOLUTION;
+    param->shard_cnt = 1;
+}
+
 /*
  * Create a new timer heap.
  */
@@ -379,6 +827,131 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
 					  pj_size_t size,
                                           pj_timer_heap_t **p_heap)
 {
+    return pj_timer_heap_create2(pool, size, NULL, p_heap);
+}
+
+/*
+ * Create the shards of a sharded timer heap. Each shard gets its own pool
+ * since shards grow independently under their own locks.
+ */
+static pj_status_t create_shards(pj_timer_heap_t *ht,
+				 pj_size_t size,
+				 const pj_timer_heap_param *param)
+{
+    pj_timer_heap_param shard_param;
+    unsigned i;
+    pj_status_t status;
+
+    shard_param = *param;
+    shard_param.shard_cnt = 1;
+
+    ht->shards = (pj_timer_heap_t**)
+		 pj_pool_calloc(ht->pool, param->shard_cnt,
+				sizeof(pj_timer_heap_t*));
+    if (!ht->shards)
+	return PJ_ENOMEM;
+
+    status = pj_atomic_create(ht->pool, 0, &ht->home_shard_cnt);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = pj_thread_local_alloc(&ht->home_shard_tls);
+    if (status != PJ_SUCCESS) {
+	pj_atomic_destroy(ht->home_shard_cnt);
+	ht->home_shard_cnt = NULL;
+	return status;
+    }
+
+    for (i=0; i<param->shard_cnt; ++i) {
+	pj_pool_t *pool;
+	pj_timer_heap_t *shard;
+	pj_lock_t *lock;
+
+	pool = pj_pool_create(ht->pool->factory, "tsh%p", 512, 512, NULL);
+	if (!pool) {
+	    status = PJ_ENOMEM;
+	    break;
+	}
+
+	status = pj_timer_heap_create2(pool, size / param->shard_cnt + 1,
+				       &shard_param, &shard);
+	if (status == PJ_SUCCESS)
+	    status = pj_lock_create_simple_mutex(pool, "tsh%p", &lock);
+	if (status != PJ_SUCCESS) {
+	    pj_pool_release(pool);
+	    break;
+	}
+
+	pj_timer_heap_set_lock(shard, lock, PJ_TRUE);
+	shard->is_shard = PJ_TRUE;
+	ht->shards[i] = shard;
+	++ht->shard_cnt;
+    }
+
+    if (status != PJ_SUCCESS) {
+	pj_timer_heap_destroy(ht);
+	return status;
+    }
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Get the home shard of the calling thread, assigning one if the thread
+ * has not used this timer heap before.
+ */
+static unsigned get_home_shard(pj_timer_heap_t *ht)
+{
+    pj_ssize_t home;
+
+    home = (pj_ssize_t)pj_thread_local_get(ht->home_shard_tls);
+    if (home == 0) {
+	home = pj_atomic_inc_and_get(ht->home_shard_cnt) % ht->shard_cnt + 1;
+	pj_thread_local_set(ht->home_shard_tls, (void*)home);
+    }
+
+    return (unsigned)(home - 1);
+}
+
+/*
+ * Select the shard for the entry. Entries with a group lock all go to the
+ * same shard, the others go to the home shard of the calling thread, so
+ * that a thread normally schedules and polls its own shard.
+ */
+static pj_timer_heap_t *select_shard(pj_timer_heap_t *ht,
+				     const pj_grp_lock_t *grp_lock)
+{
+    pj_size_t key;
+
+    if (!grp_lock)
+	return ht->shards[get_home_shard(ht)];
+
+    /* Drop the alignment bits and mix the rest */
+    key = ((pj_size_t)grp_lock >> 4) * 2654435761U;
+    return ht->shards[(key >> 8) % ht->shard_cnt];
+}
+
+/*
+ * Update the due time of a shard after an entry is scheduled in it.
+ */
+PJ_INLINE(void) update_shard_due(pj_timer_heap_t *ht,
+				 const pj_time_val *expires)
+{
+    pj_uint32_t msec = TIME_MSEC(*expires);
+
+    if (ht->cur_size == 1 || (pj_int32_t)(msec - ht->due_msec) < 0)
+	ht->due_msec = msec;
+}
+
+/*
+ * Create a new timer heap with the specified parameters.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_create2(pj_pool_t *pool,
+					  pj_size_t size,
+					  const pj_timer_heap_param *param,
+					  pj_timer_heap_t **p_heap)
+{
+    pj_timer_heap_param default_param;
     pj_timer_heap_t *ht;
     pj_size_t i;
 
@@ -386,6 +959,15 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
 
     *p_heap = NULL;
 
+    if (!param) {
+	pj_timer_heap_param_default(&default_param);
+	param = &default_param;
+    }
+
+    PJ_ASSERT_RETURN(param->type == PJ_TIMER_HEAP_TYPE_HEAP ||
+		     param->type == PJ_TIMER_HEAP_TYPE_WHEEL, PJ_EINVAL);
+    PJ_ASSERT_RETURN(param->shard_cnt > 0, PJ_EINVAL);
+
     /* Magic? */
     size += 2;
 
@@ -395,16 +977,64 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
         return PJ_ENOMEM;
 
     /* Initialize timer heap sizes */
+    ht->type = param->type;
     ht->max_size = size;
     ht->cur_size = 0;
     ht->max_entries_per_poll = DEFAULT_MAX_TIMED_OUT_PER_POLL;
     ht->timer_ids_freelist = 1;
     ht->pool = pool;
+    ht->wheel = NULL;
+    ht->shard_cnt = 0;
+    ht->shards = NULL;
+    ht->home_shard_cnt = NULL;
 
     /* Lock. */
     ht->lock = NULL;
     ht->auto_delete_lock = 0;
 
+    if (param->shard_cnt > 1) {
+	pj_status_t status;
+
+	status = create_shards(ht, size, param);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	*p_heap = ht;
+	return PJ_SUCCESS;
+    }
+
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+	timer_wheel *w;
+	pj_time_val now;
+
+	PJ_ASSERT_RETURN(param->wheel_resolution > 0 &&
+			 param->wheel_resolution <= 1000 &&
+			 1000 % param->wheel_resolution == 0, PJ_EINVAL);
+
+	w = ht->wheel = PJ_POOL_ZALLOC_T(pool, timer_wheel);
+	if (!w)
+	    return PJ_ENOMEM;
+
+	w->resolution = param->wheel_resolution;
+	w->ticks_per_sec = 1000 / param->wheel_resolution;
+	pj_gettickcount(&now);
+	w->base_sec = now.sec;
+	w->cur_tick = wheel_tick(w, &now, PJ_FALSE);
+
+	w->nodes = (wheel_node*)
+		   pj_pool_calloc(pool, size, sizeof(wheel_node));
+	if (!w->nodes)
+	    return PJ_ENOMEM;
+
+	/* Node zero is never used, so that zero can terminate the lists */
+	for (i=1; i<size; ++i)
+	    w->nodes[i].next = (pj_timer_id_t)(i + 1 < size ? i + 1 : 0);
+	w->freelist = 1;
+
+	*p_heap = ht;
+	return PJ_SUCCESS;
+    }
+
     // Create the heap array.
     ht->heap = (pj_timer_entry**)
     	       pj_pool_alloc(pool, sizeof(pj_timer_entry*) * size);
@@ -429,6 +1059,25 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
 
 PJ_DEF(void) pj_timer_heap_destroy( pj_timer_heap_t *ht )
 {
+    if (ht->shards) {
+	unsigned i;
+
+	for (i=0; i<ht->shard_cnt; ++i) {
+	    pj_pool_t *pool = ht->shards[i]->pool;
+
+	    pj_timer_heap_destroy(ht->shards[i]);
+	    pj_pool_release(pool);
+	}
+	ht->shard_cnt = 0;
+	ht->shards = NULL;
+    }
+
+    if (ht->home_shard_cnt) {
+	pj_thread_local_free(ht->home_shard_tls);
+	pj_atomic_destroy(ht->home_shard_cnt);
+	ht->home_shard_cnt = NULL;
+    }
+
     if (ht->lock && ht->auto_delete_lock) {
         pj_lock_destroy(ht->lock);
         ht->lock = NULL;
@@ -467,6 +1116,7 @@ PJ_DEF(pj_timer_entry*) pj_timer_entry_init( pj_timer_entry *entry,
     entry->user_data = user_data;
     entry->cb = cb;
     entry->_grp_lock = NULL;
+    entry->_timer_heap = NULL;
 
     return entry;
 }
@@ -503,6 +1153,9 @@ static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
     /* Prevent same entry from being scheduled more than once */
     PJ_ASSERT_RETURN(entry->_timer_id < 1, PJ_EINVALIDOP);
 
+    if (ht->shards)
+	ht = select_shard(ht, grp_lock);
+
 #if PJ_TIMER_DEBUG
     entry->src_file = src_file;
     entry->src_line = src_line;
@@ -515,10 +1168,13 @@ static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
     if (status == PJ_SUCCESS) {
 	if (set_id)
 	    entry->id = id_val;
+	entry->_timer_heap = ht;
 	entry->_grp_lock = grp_lock;
 	if (entry->_grp_lock) {
 	    pj_grp_lock_add_ref(entry->_grp_lock);
 	}
+	if (ht->is_shard)
+	    update_shard_due(ht, &expires);
     }
     unlock_timer_heap(ht);
 
@@ -573,22 +1229,35 @@ static int cancel_timer(pj_timer_heap_t *ht,
 			unsigned flags,
 			int id_val)
 {
+    pj_grp_lock_t *grp_lock;
     int count;
 
     PJ_ASSERT_RETURN(ht && entry, PJ_EINVAL);
 
+    /* The entry knows which shard it was scheduled in */
+    if (ht->shards) {
+	if (entry->_timer_heap)
+	    ht = entry->_timer_heap;
+	else
+	    ht = ht->shards[0];
+    }
+
     lock_timer_heap(ht);
     count = cancel(ht, entry, flags | F_DONT_CALL);
     if (flags & F_SET_ID) {
 	entry->id = id_val;
     }
-    if (entry->_grp_lock) {
-	pj_grp_lock_t *grp_lock = entry->_grp_lock;
-	entry->_grp_lock = NULL;
-	pj_grp_lock_dec_ref(grp_lock);
-    }
+    grp_lock = entry->_grp_lock;
+    entry->_grp_lock = NULL;
     unlock_timer_heap(ht);
 
+    /* Release the group lock outside the timer heap lock, as this may
+     * destroy the group lock, and its handlers may cancel or schedule
+     * other entries in the same (non-recursive) shard.
+     */
+    if (grp_lock)
+	pj_grp_lock_dec_ref(grp_lock);
+
     return count;
 }
 
@@ -605,13 +1274,104 @@ PJ_DEF(int) pj_timer_heap_cancel_if_active(pj_timer_heap_t *ht,
     return cancel_timer(ht, entry, F_SET_ID | F_DONT_ASSERT, id_val);
 }
 
-PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht, 
-                                     pj_time_val *next_delay )
+static unsigned wheel_poll( pj_timer_heap_t *ht, pj_time_val *next_delay,
+			    unsigned max_count )
+{
+    timer_wheel *w = ht->wheel;
+    pj_time_val now;
+    pj_uint32_t now_tick;
+    unsigned count = 0;
+
+    lock_timer_heap(ht);
+
+    pj_gettickcount(&now);
+    now_tick = wheel_tick(w, &now, PJ_FALSE);
+
+    while (count < max_count) {
+	pj_timer_id_t id = w->head[WHEEL_PENDING];
+	pj_timer_entry *node;
+	pj_grp_lock_t *grp_lock;
+
+	if (id == 0) {
+	    /* Nothing pending, advance the wheel up to the current tick */
+	    if ((pj_int32_t)(now_tick - w->cur_tick) < 0)
+		break;
+
+	    if (ht->cur_size == 0) {
+		w->cur_tick = now_tick + 1;
+		break;
+	    }
+
+	    /* Skip empty level zero slots up to the next cascade */
+	    if (w->level_cnt[0] == 0 && (w->cur_tick & WHEEL_L0_MASK)) {
+		pj_uint32_t next = (w->cur_tick | WHEEL_L0_MASK) + 1;
+
+		if ((pj_int32_t)(now_tick - next) < 0) {
+		    w->cur_tick = now_tick + 1;
+		    break;
+		}
+		w->cur_tick = next;
+	    }
+
+	    wheel_advance(w);
+	    continue;
+	}
+
+	node = wheel_remove(ht, id);
+	++count;
+
+	grp_lock = node->_grp_lock;
+	node->_grp_lock = NULL;
+
+	unlock_timer_heap(ht);
+
+	PJ_RACE_ME(5);
+
+	if (node->cb)
+	    (*node->cb)(ht, node);
+
+	if (grp_lock)
+	    pj_grp_lock_dec_ref(grp_lock);
+
+	lock_timer_heap(ht);
+    }
+
+    if (next_delay || (ht->is_shard && ht->cur_size)) {
+	pj_time_val delay;
+
+	if (ht->cur_size == 0) {
+	    delay.sec = delay.msec = PJ_MAXINT32;
+	} else if (w->head[WHEEL_PENDING]) {
+	    delay.sec = delay.msec = 0;
+	} else {
+	    pj_int32_t ticks = (pj_int32_t)(wheel_next_tick(w) - now_tick);
+	    long msec = ticks * (long)w->resolution -
+			now.msec % w->resolution;
+
+	    delay.sec = 0;
+	    delay.msec = msec > 0 ? msec : 0;
+	    pj_time_val_normalize(&delay);
+	}
+
+	if (ht->is_shard && ht->cur_size)
+	    ht->due_msec = TIME_MSEC(now) + TIME_MSEC(delay);
+	if (next_delay)
+	    *next_delay = delay;
+    }
+
+    unlock_timer_heap(ht);
+
+    return count;
+}
+
+static unsigned poll_heap( pj_timer_heap_t *ht, pj_time_val *next_delay,
+			   unsigned max_count )
 {
     pj_time_val now;
     unsigned count;
 
-    PJ_ASSERT_RETURN(ht, 0);
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL)
+	return wheel_poll(ht, next_delay, max_count);
 
     lock_timer_heap(ht);
     if (!ht->cur_size && next_delay) {
@@ -625,7 +1385,7 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
 
     while ( ht->cur_size && 
 	    PJ_TIME_VAL_LTE(ht->heap[0]->_timer_value, now) &&
-            count < ht->max_entries_per_poll ) 
+            count < max_count ) 
     {
 	pj_timer_entry *node = remove_node(ht, 0);
 	pj_grp_lock_t *grp_lock;
@@ -647,6 +1407,8 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
 
 	lock_timer_heap(ht);
     }
+    if (ht->cur_size && ht->is_shard)
+	ht->due_msec = TIME_MSEC(ht->heap[0]->_timer_value);
     if (ht->cur_size && next_delay) {
 	*next_delay = ht->heap[0]->_timer_value;
 	PJ_TIME_VAL_SUB(*next_delay, now);
@@ -660,22 +1422,122 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
     return count;
 }
 
+/*
+ * Poll the home shard of the calling thread. The other shards are polled
+ * by their own threads, so they are only helped with when their entries
+ * are SHARD_HELP_DELAY late, e.g. when no thread polls them. Their due
+ * time is checked without locking them.
+ */
+static unsigned poll_shards( pj_timer_heap_t *ht, pj_time_val *next_delay )
+{
+    unsigned home, i, count;
+    pj_bool_t has_now = PJ_FALSE;
+    pj_time_val now;
+
+    home = get_home_shard(ht);
+    count = poll_heap(ht->shards[home], next_delay, ht->max_entries_per_poll);
+
+    for (i=1; i<ht->shard_cnt; ++i) {
+	pj_timer_heap_t *shard = ht->shards[(home + i) % ht->shard_cnt];
+	pj_int32_t late;
+
+	if (shard->cur_size == 0)
+	    continue;
+
+	if (!has_now) {
+	    pj_gettickcount(&now);
+	    has_now = PJ_TRUE;
+	}
+
+	late = (pj_int32_t)(TIME_MSEC(now) - shard->due_msec);
+	if (late >= SHARD_HELP_DELAY) {
+	    if (count >= ht->max_entries_per_poll) {
+		/* Out of budget, let the caller come back soon */
+		if (next_delay)
+		    next_delay->sec = next_delay->msec = 0;
+		break;
+	    }
+
+	    count += poll_heap(shard, NULL, ht->max_entries_per_poll - count);
+	    if (shard->cur_size == 0)
+		continue;
+	    late = (pj_int32_t)(TIME_MSEC(now) - shard->due_msec);
+	}
+
+	/* Come back when the shard would need help */
+	if (next_delay) {
+	    pj_time_val help;
+
+	    help.sec = 0;
+	    help.msec = late < SHARD_HELP_DELAY ? SHARD_HELP_DELAY - late : 0;
+	    pj_time_val_normalize(&help);
+	    if (PJ_TIME_VAL_LT(help, *next_delay))
+		*next_delay = help;
+	}
+    }
+
+    return count;
+}
+
+PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht, 
+                                     pj_time_val *next_delay )
+{
+    PJ_ASSERT_RETURN(ht, 0);
+
+    if (ht->shards)
+	return poll_shards(ht, next_delay);
+
+    return poll_heap(ht, next_delay, ht->max_entries_per_poll);
+}
+
 PJ_DEF(pj_size_t) pj_timer_heap_count( pj_timer_heap_t *ht )
 {
     PJ_ASSERT_RETURN(ht, 0);
 
+    if (ht->shards) {
+	pj_size_t count = 0;
+	unsigned i;
+
+	for (i=0; i<ht->shard_cnt; ++i)
+	    count += ht->shards[i]->cur_size;
+	return count;
+    }
+
     return ht->cur_size;
 }
 
 PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
 					         pj_time_val *timeval)
 {
+    if (ht->shards) {
+	pj_bool_t found = PJ_FALSE;
+	unsigned i;
+
+	for (i=0; i<ht->shard_cnt; ++i) {
+	    pj_time_val t;
+
+	    if (ht->shards[i]->cur_size == 0 ||
+		pj_timer_heap_earliest_time(ht->shards[i], &t) != PJ_SUCCESS)
+	    {
+		continue;
+	    }
+	    if (!found || PJ_TIME_VAL_LT(t, *timeval)) {
+		*timeval = t;
+		found = PJ_TRUE;
+	    }
+	}
+	return found ? PJ_SUCCESS : PJ_ENOTFOUND;
+    }
+
     pj_assert(ht->cur_size != 0);
     if (ht->cur_size == 0)
         return PJ_ENOTFOUND;
 
     lock_timer_heap(ht);
-    *timeval = ht->heap[0]->_timer_value;
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL)
+	*timeval = wheel_earliest(ht->wheel)->_timer_value;
+    else
+	*timeval = ht->heap[0]->_timer_value;
     unlock_timer_heap(ht);
 
     return PJ_SUCCESS;
@@ -684,6 +1546,16 @@ PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
 #if PJ_TIMER_DEBUG
 PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
 {
+    if (ht->shards) {
+	unsigned i;
+
+	for (i=0; i<ht->shard_cnt; ++i) {
+	    PJ_LOG(3,(THIS_FILE, "Shard %d:", i));
+	    pj_timer_heap_dump(ht->shards[i]);
+	}
+	return;
+    }
+
     lock_timer_heap(ht);
 
     PJ_LOG(3,(THIS_FILE, "Dumping timer heap:"));
@@ -700,10 +1572,20 @@ PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
 
 	pj_gettickcount(&now);
 
-	for (i=0; i<(unsigned)ht->cur_size; ++i) {
-	    pj_timer_entry *e = ht->heap[i];
+	for (i=0; i<(unsigned)ht->max_size; ++i) {
+	    pj_timer_entry *e;
 	    pj_time_val delta;
 
+	    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+		e = ht->wheel->nodes[i].entry;
+		if (!e)
+		    continue;
+	    } else if (i < (unsigned)ht->cur_size) {
+		e = ht->heap[i];
+	    } else {
+		break;
+	    }
+
 	    if (PJ_TIME_VAL_LTE(e->_timer_value, now))
 		delta.sec = delta.msec = 0;
 	    else {
@@ -311,6 +311,30 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+/*
+ * Initialize timer heap parameters.
+ */
+PJ_DEF(void) pj_timer_heap_param_default(pj_timer_heap_param *param)
+{
+    pj_bzero(param, sizeof(*param));
+    param->type = PJ_TIMER_HEAP_TYPE_HEAP;
+    param->wheel_resolution = PJ_TIMER_WHEEL_RESOLUTION;
+}
+
+/*
+ * Create a new timer heap with the specified parameters. The timer
+ * implementation type is ignored since timers are implemented with
+ * Active Objects on Symbian.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_create2(pj_pool_t *pool,
+					  pj_size_t size,
+					  const pj_timer_heap_param *param,
+					  pj_timer_heap_t **p_heap)
+{
+    PJ_UNUSED_ARG(param);
+    return pj_timer_heap_create(pool, size, p_heap);
+}
+
 PJ_DEF(void) pj_timer_heap_destroy( pj_timer_heap_t *ht )
 {
     /* Cancel and delete pending active objects */
@@ -251,6 +251,193 @@ on_return:
 
 
 
+/*******************************************************************
+ * UDP batch test (send a batch of packets with pj_ioqueue_sendmmsg()
+ * and receive them with pj_activesock_start_recvmmsg()).
+ */
+#define BATCH_PKT_CNT	16
+#define BATCH_SIZE	8
+
+struct udp_batch_rx
+{
+    unsigned		 rx_cnt;
+    unsigned		 max_batch;
+    unsigned		 err_cnt;
+    unsigned		 bad_seq;
+};
+
+static pj_bool_t udp_batch_on_data_recvfrom_batch(pj_activesock_t *asock,
+						  pj_sock_msg msgs[],
+						  unsigned count,
+						  pj_status_t status)
+{
+    struct udp_batch_rx *rx;
+    unsigned i;
+
+    rx = (struct udp_batch_rx*) pj_activesock_get_user_data(asock);
+
+    if (status != PJ_SUCCESS) {
+	rx->err_cnt++;
+	udp_echo_err("recvmmsg() callback", status);
+	return PJ_TRUE;
+    }
+
+    for (i=0; i<count; ++i) {
+	pj_uint32_t seq;
+
+	if (msgs[i].len != sizeof(seq)) {
+	    rx->bad_seq++;
+	    continue;
+	}
+	pj_memcpy(&seq, msgs[i].buf, sizeof(seq));
+	if (seq != rx->rx_cnt)
+	    rx->bad_seq++;
+	rx->rx_cnt++;
+    }
+
+    if (count > rx->max_batch)
+	rx->max_batch = count;
+
+    return PJ_TRUE;
+}
+
+static int udp_batch_test(void)
+{
+    pj_ioqueue_t *ioqueue = NULL;
+    pj_pool_t *pool = NULL;
+    pj_activesock_t *asock = NULL;
+    pj_sock_t sock = PJ_INVALID_SOCKET;
+    pj_ioqueue_key_t *key = NULL;
+    pj_ioqueue_op_key_t send_key;
+    pj_activesock_cb activesock_cb;
+    pj_ioqueue_callback ioqueue_cb;
+    struct udp_batch_rx rx;
+    pj_sock_msg msgs[BATCH_PKT_CNT];
+    pj_uint32_t seq[BATCH_PKT_CNT];
+    pj_sockaddr addr;
+    pj_str_t loopback;
+    unsigned i, count;
+    int ret;
+    pj_status_t status;
+
+    pool = pj_pool_create(mem, "udpbatch", 512, 512, NULL);
+    if (!pool)
+	return -100;
+
+    status = pj_ioqueue_create(pool, 4, &ioqueue);
+    if (status != PJ_SUCCESS) {
+	ret = -110;
+	udp_echo_err("pj_ioqueue_create()", status);
+	goto on_return;
+    }
+
+    /* Receiver */
+    pj_bzero(&rx, sizeof(rx));
+    pj_bzero(&activesock_cb, sizeof(activesock_cb));
+    activesock_cb.on_data_recvfrom_batch = &udp_batch_on_data_recvfrom_batch;
+
+    loopback = pj_str("127.0.0.1");
+    pj_sockaddr_init(pj_AF_INET(), &addr, &loopback, 0);
+    status = pj_activesock_create_udp(pool, &addr, NULL, ioqueue,
+				      &activesock_cb, &rx, &asock, &addr);
+    if (status != PJ_SUCCESS) {
+	ret = -120;
+	udp_echo_err("pj_activesock_create_udp()", status);
+	goto on_return;
+    }
+
+    status = pj_activesock_start_recvmmsg(asock, pool, 64, BATCH_SIZE, 0);
+    if (status == PJ_ENOTSUP) {
+	PJ_LOG(3,("", "...skipped, batched receive is not supported"));
+	ret = 0;
+	goto on_return;
+    } else if (status != PJ_SUCCESS) {
+	ret = -130;
+	udp_echo_err("pj_activesock_start_recvmmsg()", status);
+	goto on_return;
+    }
+
+    /* Sender */
+    status = pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &sock);
+    if (status != PJ_SUCCESS) {
+	ret = -140;
+	goto on_return;
+    }
+
+    pj_bzero(&ioqueue_cb, sizeof(ioqueue_cb));
+    status = pj_ioqueue_register_sock(pool, ioqueue, sock, NULL,
+				      &ioqueue_cb, &key);
+    if (status != PJ_SUCCESS) {
+	ret = -150;
+	goto on_return;
+    }
+
+    for (i=0; i<BATCH_PKT_CNT; ++i) {
+	seq[i] = i;
+	msgs[i].buf = &seq[i];
+	msgs[i].len = sizeof(seq[i]);
+	pj_sockaddr_cp(&msgs[i].addr, &addr);
+	msgs[i].addr_len = pj_sockaddr_get_len(&addr);
+    }
+
+    pj_ioqueue_op_key_init(&send_key, sizeof(send_key));
+    count = BATCH_PKT_CNT;
+    status = pj_ioqueue_sendmmsg(key, &send_key, msgs, &count, 0);
+    if (status != PJ_SUCCESS && status != PJ_EPENDING) {
+	ret = -160;
+	udp_echo_err("pj_ioqueue_sendmmsg()", status);
+	goto on_return;
+    }
+
+    for (i=0; i<100 && rx.rx_cnt < BATCH_PKT_CNT; ++i) {
+	pj_time_val delay = {0, 10};
+	pj_ioqueue_poll(ioqueue, &delay);
+    }
+
+    if (rx.err_cnt) {
+	ret = -170;
+	goto on_return;
+    }
+
+    if (rx.rx_cnt != BATCH_PKT_CNT) {
+	ret = -180;
+	udp_echo_err("packets have been lost", PJ_ETIMEDOUT);
+	goto on_return;
+    }
+
+    if (rx.bad_seq) {
+	PJ_LOG(3,("", "...error: %u packets out of sequence", rx.bad_seq));
+	ret = -190;
+	goto on_return;
+    }
+
+    /* All packets were queued before polling, so they must have been
+     * received in batches.
+     */
+    if (rx.max_batch < 2 || rx.max_batch > BATCH_SIZE) {
+	PJ_LOG(3,("", "...error: unexpected batch size %u", rx.max_batch));
+	ret = -200;
+	goto on_return;
+    }
+
+    ret = 0;
+
+on_return:
+    if (key)
+	pj_ioqueue_unregister(key);
+    else if (sock != PJ_INVALID_SOCKET)
+	pj_sock_close(sock);
+    if (asock)
+	pj_activesock_close(asock);
+    if (ioqueue)
+	pj_ioqueue_destroy(ioqueue);
+    if (pool)
+	pj_pool_release(pool);
+
+    return ret;
+}
+
+
 #define SIGNATURE   0xdeadbeef
 struct tcp_pkt
 {
@@ -503,6 +690,11 @@ int activesock_test(void)
     if (ret != 0)
 	return ret;
 
+    PJ_LOG(3,("", "..udp batch test"));
+    ret = udp_batch_test();
+    if (ret != 0)
+	return ret;
+
     PJ_LOG(3,("", "..tcp perf test"));
     ret = tcp_perf_test();
     if (ret != 0)
@@ -21,20 +21,22 @@
 #include <pj/rand.h>
 #include <pj/log.h>
 #include <pj/pool.h>
+#include <pj/string.h>
 #include "test.h"
 
 #if INCLUDE_HASH_TEST
 
 #define HASH_COUNT  31
 
-static int hash_test_with_key(pj_pool_t *pool, unsigned char key)
+static int hash_test_with_key(pj_pool_t *pool, unsigned flags,
+			      unsigned char key)
 {
     pj_hash_table_t *ht;
     unsigned value = 0x12345;
     pj_hash_iterator_t it_buf, *it;
     unsigned *entry;
 
-    ht = pj_hash_create(pool, HASH_COUNT);
+    ht = pj_hash_create2(pool, HASH_COUNT, flags);
     if (!ht)
 	return -10;
 
@@ -83,7 +85,7 @@ static int hash_test_with_key(pj_pool_t *pool, unsigned char key)
 }
 
 
-static int hash_collision_test(pj_pool_t *pool)
+static int hash_collision_test(pj_pool_t *pool, unsigned flags)
 {
     enum {
 	COUNT = HASH_COUNT * 4
@@ -93,7 +95,7 @@ static int hash_collision_test(pj_pool_t *pool)
     unsigned char *values;
     unsigned i;
 
-    ht = pj_hash_create(pool, HASH_COUNT);
+    ht = pj_hash_create2(pool, HASH_COUNT, flags);
     if (!ht)
 	return -200;
 
@@ -130,6 +132,120 @@ static int hash_collision_test(pj_pool_t *pool)
 }
 
 
+/*
+ * Open addressing hash table: resize, delete, case-insensitive keys, and
+ * deleting entries while iterating.
+ */
+static int hash_open_addressing_test(pj_pool_t *pool)
+{
+    enum {
+	COUNT = HASH_COUNT * 32
+    };
+    pj_hash_table_t *ht;
+    pj_hash_iterator_t it_buf, *it;
+    unsigned *values;
+    char (*keys)[16];
+    pj_hash_entry_buf *entry_buf;
+    unsigned i, cnt;
+
+    ht = pj_hash_create2(pool, HASH_COUNT, PJ_HASH_OPEN_ADDRESSING);
+    if (!ht)
+	return -300;
+
+    values = (unsigned*) pj_pool_calloc(pool, COUNT, sizeof(unsigned));
+    keys = (char(*)[16]) pj_pool_calloc(pool, COUNT, sizeof(keys[0]));
+    entry_buf = (pj_hash_entry_buf*) 
+		pj_pool_calloc(pool, COUNT, sizeof(pj_hash_entry_buf));
+
+    /* Add many more entries than the initial size, so that the table is
+     * resized several times. Look up all entries after each insertion
+     * every once in a while, since entries are moved between the arrays.
+     */
+    for (i=0; i<COUNT; ++i) {
+	values[i] = i;
+	pj_ansi_snprintf(keys[i], sizeof(keys[i]), "Key-%u", i);
+	pj_hash_set_np_lower(ht, keys[i], PJ_HASH_KEY_STRING, 0,
+			     entry_buf[i], &values[i]);
+
+	if (i % 61 == 0) {
+	    unsigned j;
+	    for (j=0; j<=i; ++j) {
+		if (pj_hash_get_lower(ht, keys[j], PJ_HASH_KEY_STRING, 
+				      NULL) != &values[j])
+		{
+		    return -310;
+		}
+	    }
+	}
+    }
+
+    if (pj_hash_count(ht) != COUNT)
+	return -320;
+
+    /* Lookup with different case and precomputed hash value */
+    for (i=0; i<COUNT; ++i) {
+	char key[16];
+	pj_str_t str;
+	pj_uint32_t hval;
+
+	pj_ansi_snprintf(key, sizeof(key), "kEY-%u", i);
+	str = pj_str(key);
+	hval = pj_hash_calc_tolower(0, NULL, &str);
+	if (pj_hash_get_lower(ht, key, PJ_HASH_KEY_STRING, 
+			      &hval) != &values[i])
+	{
+	    return -330;
+	}
+	if (pj_hash_get(ht, key, PJ_HASH_KEY_STRING, NULL) != NULL)
+	    return -340;
+    }
+
+    /* Delete odd entries */
+    for (i=1; i<COUNT; i+=2) {
+	pj_hash_set_lower(NULL, ht, keys[i], PJ_HASH_KEY_STRING, 0, NULL);
+    }
+
+    if (pj_hash_count(ht) != COUNT/2)
+	return -350;
+
+    for (i=0; i<COUNT; ++i) {
+	void *value = pj_hash_get_lower(ht, keys[i], PJ_HASH_KEY_STRING,
+					NULL);
+	if ((i & 1) && value != NULL)
+	    return -360;
+	if (!(i & 1) && value != &values[i])
+	    return -370;
+    }
+
+    /* Iterate and delete the current entry. Each entry must be visited
+     * exactly once.
+     */
+    cnt = 0;
+    it = pj_hash_first(ht, &it_buf);
+    while (it) {
+	unsigned *value = (unsigned*) pj_hash_this(ht, it);
+	pj_hash_iterator_t *next = pj_hash_next(ht, it);
+
+	if (value == NULL || (*value & 1) || (*value & 0x80000000))
+	    return -380;
+
+	pj_hash_set_lower(NULL, ht, keys[*value], PJ_HASH_KEY_STRING, 0,
+			  NULL);
+	*value |= 0x80000000;
+	++cnt;
+	it = next;
+    }
+
+    if (cnt != COUNT/2)
+	return -390;
+
+    if (pj_hash_count(ht) != 0 || pj_hash_first(ht, &it_buf) != NULL)
+	return -400;
+
+    return 0;
+}
+
+
 /*
  * Hash table test.
  */
@@ -137,19 +253,27 @@ int hash_test(void)
 {
     pj_pool_t *pool = pj_pool_create(mem, "hash", 512, 512, NULL);
     int rc;
-    unsigned i;
+    unsigned i, flags;
+
+    for (flags=0; flags<=PJ_HASH_OPEN_ADDRESSING; ++flags) {
+	/* Test to fill in each row in the table */
+	for (i=0; i<=HASH_COUNT; ++i) {
+	    rc = hash_test_with_key(pool, flags, (unsigned char)i);
+	    if (rc != 0) {
+		pj_pool_release(pool);
+		return rc;
+	    }
+	}
 
-    /* Test to fill in each row in the table */
-    for (i=0; i<=HASH_COUNT; ++i) {
-	rc = hash_test_with_key(pool, (unsigned char)i);
+	/* Collision test */
+	rc = hash_collision_test(pool, flags);
 	if (rc != 0) {
 	    pj_pool_release(pool);
 	    return rc;
 	}
     }
 
-    /* Collision test */
-    rc = hash_collision_test(pool);
+    rc = hash_open_addressing_test(pool);
     if (rc != 0) {
 	pj_pool_release(pool);
 	return rc;
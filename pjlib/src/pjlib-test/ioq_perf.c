@@ -222,7 +222,7 @@ static int worker_thread(void *p)
  *  - measure the total bytes received by all consumers during a
  *    period of time.
  */
-static int perform_test(pj_bool_t allow_concur,
+static int perform_test(pj_bool_t allow_concur, unsigned epoll_flags,
 			int sock_type, const char *type_name,
                         unsigned thread_cnt, unsigned sockpair_cnt,
                         pj_size_t buffer_size, 
@@ -233,6 +233,7 @@ static int perform_test(pj_bool_t allow_concur,
     test_item *items;
     pj_thread_t **thread;
     pj_ioqueue_t *ioqueue;
+    pj_ioqueue_cfg ioqueue_cfg;
     pj_status_t rc;
     pj_ioqueue_callback ioqueue_callback;
     pj_uint32_t total_elapsed_usec, total_received;
@@ -256,18 +257,15 @@ static int perform_test(pj_bool_t allow_concur,
     	     pj_pool_alloc(pool, thread_cnt*sizeof(pj_thread_t*));
 
     TRACE_((THIS_FILE, "     creating ioqueue.."));
-    rc = pj_ioqueue_create(pool, sockpair_cnt*2, &ioqueue);
+    pj_ioqueue_cfg_default(&ioqueue_cfg);
+    ioqueue_cfg.epoll_flags = epoll_flags;
+    ioqueue_cfg.default_concurrency = allow_concur;
+    rc = pj_ioqueue_create2(pool, sockpair_cnt*2, &ioqueue_cfg, &ioqueue);
     if (rc != PJ_SUCCESS) {
         app_perror("...error: unable to create ioqueue", rc);
         return -15;
     }
 
-    rc = pj_ioqueue_set_default_concurrency(ioqueue, allow_concur);
-    if (rc != PJ_SUCCESS) {
-	app_perror("...error: pj_ioqueue_set_default_concurrency()", rc);
-        return -16;
-    }
-
     /* Initialize each producer-consumer pair. */
     for (i=0; i<sockpair_cnt; ++i) {
         pj_ssize_t bytes;
@@ -277,6 +275,8 @@ static int perform_test(pj_bool_t allow_concur,
         items[i].outgoing_buffer = (char*) pj_pool_alloc(pool, buffer_size);
         items[i].incoming_buffer = (char*) pj_pool_alloc(pool, buffer_size);
         items[i].bytes_recv = items[i].bytes_sent = 0;
+        pj_ioqueue_op_key_init(&items[i].recv_op, sizeof(items[i].recv_op));
+        pj_ioqueue_op_key_init(&items[i].send_op, sizeof(items[i].send_op));
 
         /* randomize outgoing buffer. */
         pj_create_random_string(items[i].outgoing_buffer, buffer_size);
@@ -424,7 +424,7 @@ static int perform_test(pj_bool_t allow_concur,
     /* Calculate total bytes received. */
     total_received = 0;
     for (i=0; i<sockpair_cnt; ++i) {
-        total_received = (pj_uint32_t)items[i].bytes_recv;
+        total_received += (pj_uint32_t)items[i].bytes_recv;
     }
 
     /* bandwidth = total_received*1000/total_elapsed_usec */
@@ -514,7 +514,7 @@ static int ioqueue_perf_test_imp(pj_bool_t allow_concur)
     for (i=0; i<(int)(sizeof(test_param)/sizeof(test_param[0])); ++i) {
         pj_size_t bandwidth;
 
-        rc = perform_test(allow_concur,
+        rc = perform_test(allow_concur, PJ_IOQUEUE_DEFAULT_EPOLL_FLAGS,
 			  test_param[i].type, 
                           test_param[i].type_name,
                           test_param[i].thread_cnt, 
@@ -544,6 +544,52 @@ static int ioqueue_perf_test_imp(pj_bool_t allow_concur)
     return 0;
 }
 
+/* Measure how the epoll ioqueue scales with the number of polling
+ * threads, for each epoll registration mode.
+ */
+static int ioqueue_perf_epoll_scaling_test(void)
+{
+    enum { BUF_SIZE = 512, SOCKPAIR_CNT = 16 };
+    static const struct {
+	unsigned    flags;
+	const char *name;
+    } modes[] =
+    {
+	{ 0,				"level" },
+	{ PJ_IOQUEUE_EPOLL_EXCLUSIVE,	"exclusive" },
+	{ PJ_IOQUEUE_EPOLL_ONESHOT,	"oneshot" },
+    };
+    static const unsigned thread_cnt[] = { 1, 2, 4, 8, 16 };
+    unsigned i, j;
+    int rc;
+
+    /* Epoll flags are ignored by the other backends */
+    if (pj_ansi_strncmp(pj_ioqueue_name(), "epoll", 5) != 0)
+	return 0;
+
+    for (i=0; i<PJ_ARRAY_SIZE(modes); ++i) {
+	PJ_LOG(3,(THIS_FILE, "   Benchmarking epoll thread scaling, mode=%s:",
+		  modes[i].name));
+	PJ_LOG(3,(THIS_FILE, "   ======================================="));
+	PJ_LOG(3,(THIS_FILE, "   Type  Threads  Skt.Pairs      Bandwidth"));
+	PJ_LOG(3,(THIS_FILE, "   ======================================="));
+
+	for (j=0; j<PJ_ARRAY_SIZE(thread_cnt); ++j) {
+	    pj_size_t bandwidth;
+
+	    rc = perform_test(PJ_TRUE, modes[i].flags, pj_SOCK_DGRAM(), "udp",
+			      thread_cnt[j], SOCKPAIR_CNT, BUF_SIZE,
+			      &bandwidth);
+	    if (rc != 0)
+		return rc;
+
+	    pj_thread_sleep(500);
+	}
+    }
+
+    return 0;
+}
+
 /*
  * main test entry.
  */
@@ -559,6 +605,10 @@ int ioqueue_perf_test(void)
     if (rc != 0)
 	return rc;
 
+    rc = ioqueue_perf_epoll_scaling_test();
+    if (rc != 0)
+	return rc;
+
     return 0;
 }
 
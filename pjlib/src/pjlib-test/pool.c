@@ -19,7 +19,10 @@
  */
 #include <pj/pool.h>
 #include <pj/pool_buf.h>
+#include <pj/objpool.h>
+#include <pj/os.h>
 #include <pj/rand.h>
+#include <pj/string.h>
 #include <pj/log.h>
 #include <pj/except.h>
 #include "test.h"
@@ -277,6 +280,299 @@ static int pool_buf_test(void)
     return 0;
 }
 
+/* Object pool test. The objects are passed around between threads
+ * through a shared stack, and each object carries a stamp to detect
+ * objects being handed out twice.
+ */
+#define OBJPOOL_THREADS	    4
+#define OBJPOOL_STACK	    256
+#define OBJPOOL_LOOP	    20000
+
+typedef struct objpool_obj
+{
+    unsigned	stamp;
+    char	payload[60];
+} objpool_obj;
+
+static struct objpool_test_data
+{
+    pj_objpool_t    *objpool;
+    pj_mutex_t	    *mutex;
+    objpool_obj	    *stack[OBJPOOL_STACK];
+    unsigned	     stamp[OBJPOOL_STACK];
+    unsigned	     top;
+    unsigned	     next_stamp;
+    int		     err;
+} otd;
+
+static int objpool_thread(void *arg)
+{
+    unsigned i, seed = (unsigned)(pj_ssize_t)arg;
+
+    for (i=0; i<OBJPOOL_LOOP && !otd.err; ++i) {
+	objpool_obj *obj = NULL;
+	unsigned stamp = 0, j;
+
+	seed = seed * 1103515245 + 12345;
+
+	if ((seed >> 16) % 2) {
+	    /* Allocate an object and push it to the stack */
+	    obj = (objpool_obj*) pj_objpool_alloc(otd.objpool);
+	    if (!obj) {
+		otd.err = -91;
+		break;
+	    }
+
+	    pj_mutex_lock(otd.mutex);
+	    stamp = ++otd.next_stamp;
+	    obj->stamp = stamp;
+	    pj_memset(obj->payload, stamp & 0xFF, sizeof(obj->payload));
+	    if (otd.top < OBJPOOL_STACK) {
+		otd.stamp[otd.top] = stamp;
+		otd.stack[otd.top++] = obj;
+		obj = NULL;
+	    }
+	    pj_mutex_unlock(otd.mutex);
+
+	} else {
+	    /* Pop an object, which may have been allocated by another
+	     * thread.
+	     */
+	    pj_mutex_lock(otd.mutex);
+	    if (otd.top) {
+		obj = otd.stack[--otd.top];
+		stamp = otd.stamp[otd.top];
+	    }
+	    pj_mutex_unlock(otd.mutex);
+	}
+
+	if (obj) {
+	    /* Check that nobody else has touched the object */
+	    if (obj->stamp != stamp)
+		otd.err = -92;
+	    for (j=0; j<sizeof(obj->payload); ++j) {
+		if (obj->payload[j] != (char)(stamp & 0xFF))
+		    otd.err = -93;
+	    }
+	    pj_objpool_free(otd.objpool, obj);
+	}
+    }
+
+    return 0;
+}
+
+static int objpool_test(void)
+{
+    enum { COUNT = 100 };
+    pj_pool_t *pool;
+    pj_thread_t *thread[OBJPOOL_THREADS];
+    void *obj[COUNT];
+    unsigned i, j, capacity;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,("test", "...objpool test"));
+
+    status = pj_objpool_create(mem, NULL, sizeof(objpool_obj), 8,
+			       &otd.objpool);
+    if (status != PJ_SUCCESS)
+	return -80;
+
+    /* Single thread: objects must be distinct and aligned */
+    for (i=0; i<COUNT; ++i) {
+	obj[i] = pj_objpool_zalloc(otd.objpool);
+	if (!obj[i]) {
+	    rc = -81;
+	    goto on_return;
+	}
+	if (((pj_size_t)obj[i] & (sizeof(void*)-1)) != 0) {
+	    rc = -82;
+	    goto on_return;
+	}
+	for (j=0; j<i; ++j) {
+	    if (obj[j] == obj[i]) {
+		rc = -83;
+		goto on_return;
+	    }
+	}
+    }
+
+    /* Freed objects must be reused */
+    capacity = pj_objpool_get_capacity(otd.objpool);
+    if (capacity < COUNT) {
+	rc = -84;
+	goto on_return;
+    }
+    for (i=0; i<COUNT; ++i)
+	pj_objpool_free(otd.objpool, obj[i]);
+    for (i=0; i<COUNT; ++i)
+	obj[i] = pj_objpool_alloc(otd.objpool);
+    if (pj_objpool_get_capacity(otd.objpool) != capacity) {
+	rc = -85;
+	goto on_return;
+    }
+    for (i=0; i<COUNT; ++i)
+	pj_objpool_free(otd.objpool, obj[i]);
+
+    /* Multiple threads, with objects freed by other threads */
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    status = pj_mutex_create_simple(pool, NULL, &otd.mutex);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	rc = -86;
+	goto on_return;
+    }
+
+    for (i=0; i<OBJPOOL_THREADS; ++i) {
+	status = pj_thread_create(pool, "objpool", &objpool_thread,
+				  (void*)(pj_ssize_t)(i+1), 0, 0, &thread[i]);
+	if (status != PJ_SUCCESS) {
+	    otd.err = -87;
+	    break;
+	}
+    }
+    while (i > 0) {
+	--i;
+	pj_thread_join(thread[i]);
+	pj_thread_destroy(thread[i]);
+    }
+
+    while (otd.top)
+	pj_objpool_free(otd.objpool, otd.stack[--otd.top]);
+
+    pj_mutex_destroy(otd.mutex);
+    pj_pool_release(pool);
+    rc = otd.err;
+
+on_return:
+    pj_objpool_destroy(otd.objpool);
+    if (rc != 0)
+	return rc;
+
+    /* Destroying the object pool with objects in use must be deferred
+     * until the objects are freed.
+     */
+    status = pj_objpool_create(mem, NULL, sizeof(objpool_obj), 8,
+			       &otd.objpool);
+    if (status != PJ_SUCCESS)
+	return -88;
+
+    for (i=0; i<COUNT; ++i)
+	obj[i] = pj_objpool_zalloc(otd.objpool);
+    pj_objpool_destroy(otd.objpool);
+    for (i=0; i<COUNT; ++i) {
+	if (obj[i]) {
+	    pj_memset(obj[i], 0xAA, sizeof(objpool_obj));
+	    pj_objpool_free(otd.objpool, obj[i]);
+	}
+    }
+
+    return 0;
+}
+
+/* Caching pool test with pools created and released by multiple threads,
+ * where pools are often released by a different thread than the one
+ * that created them.
+ */
+#define CPOOL_THREADS	    4
+#define CPOOL_LOOP	    5000
+
+static struct cpool_test_data
+{
+    pj_caching_pool  cp;
+    pj_mutex_t	    *mutex;
+    pj_pool_t	    *pool[OBJPOOL_STACK];
+    unsigned	     top;
+    int		     err;
+} ctd;
+
+static int cpool_thread(void *arg)
+{
+    unsigned i, seed = (unsigned)(pj_ssize_t)arg;
+
+    for (i=0; i<CPOOL_LOOP && !ctd.err; ++i) {
+	pj_pool_t *pool = NULL;
+
+	seed = seed * 1103515245 + 12345;
+
+	if ((seed >> 16) % 2) {
+	    /* Create pool of various sizes, and push it to the stack */
+	    pool = pj_pool_create(&ctd.cp.factory, "cpool",
+				  256 << ((seed >> 20) % 6), 512, NULL);
+	    if (!pool) {
+		ctd.err = -101;
+		break;
+	    }
+	    pj_memset(pj_pool_alloc(pool, 700), 0, 700);
+
+	    pj_mutex_lock(ctd.mutex);
+	    if (ctd.top < OBJPOOL_STACK) {
+		ctd.pool[ctd.top++] = pool;
+		pool = NULL;
+	    }
+	    pj_mutex_unlock(ctd.mutex);
+
+	} else {
+	    pj_mutex_lock(ctd.mutex);
+	    if (ctd.top)
+		pool = ctd.pool[--ctd.top];
+	    pj_mutex_unlock(ctd.mutex);
+	}
+
+	if (pool)
+	    pj_pool_release(pool);
+    }
+
+    return 0;
+}
+
+static int caching_pool_thread_test(void)
+{
+    pj_pool_t *pool;
+    pj_thread_t *thread[CPOOL_THREADS];
+    unsigned i;
+    pj_status_t status;
+
+    PJ_LOG(3,("test", "...caching pool multithread test"));
+
+    pj_caching_pool_init(&ctd.cp, NULL, 64 * 1024);
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    status = pj_mutex_create_simple(pool, NULL, &ctd.mutex);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	pj_caching_pool_destroy(&ctd.cp);
+	return -100;
+    }
+
+    for (i=0; i<CPOOL_THREADS; ++i) {
+	status = pj_thread_create(pool, "cpool", &cpool_thread,
+				  (void*)(pj_ssize_t)(i+1), 0, 0, &thread[i]);
+	if (status != PJ_SUCCESS) {
+	    ctd.err = -102;
+	    break;
+	}
+    }
+    while (i > 0) {
+	--i;
+	pj_thread_join(thread[i]);
+	pj_thread_destroy(thread[i]);
+    }
+
+    while (ctd.top)
+	pj_pool_release(ctd.pool[--ctd.top]);
+
+    /* All pools must have been accounted for */
+    if (ctd.err == 0 && ctd.cp.used_count != 0)
+	ctd.err = -103;
+
+    pj_mutex_destroy(ctd.mutex);
+    pj_pool_release(pool);
+    pj_caching_pool_destroy(&ctd.cp);
+
+    return ctd.err;
+}
+
 
 int pool_test(void)
 {
@@ -309,6 +605,14 @@ int pool_test(void)
     if (rc != 0)
 	return rc;
 
+    rc = objpool_test();
+    if (rc != 0)
+	return rc;
+
+    rc = caching_pool_thread_test();
+    if (rc != 0)
+	return rc;
+
 
     return 0;
 }
@@ -118,6 +118,102 @@ static int pool_test_malloc_free()
 
 #endif /* PJ_SYMBIAN */
 
+/* Fixed-size objects: one pool per object vs object pool */
+#define OBJ_SIZE    512
+static void	   *obj[COUNT];
+
+static int pool_test_pool_per_obj()
+{
+    int i;
+
+    for (i=0; i<COUNT; ++i) {
+	pj_pool_t *pool = pj_pool_create(mem, NULL, OBJ_SIZE + 256, 256, NULL);
+	if (!pool) {
+	    PJ_LOG(3,(THIS_FILE,"   error: unable to create pool"));
+	    while (--i >= 0)
+		pj_pool_release((pj_pool_t*)obj[i]);
+	    return -1;
+	}
+	*(char*)pj_pool_alloc(pool, OBJ_SIZE) = '\0';
+	obj[i] = pool;
+    }
+
+    for (i=0; i<COUNT; ++i) {
+	pj_pool_release((pj_pool_t*)obj[i]);
+    }
+
+    return 0;
+}
+
+static int pool_test_objpool(pj_objpool_t *objpool)
+{
+    int i;
+
+    for (i=0; i<COUNT; ++i) {
+	obj[i] = pj_objpool_alloc(objpool);
+	if (!obj[i]) {
+	    PJ_LOG(3,(THIS_FILE,"   error: objpool failed to allocate"));
+	    while (--i >= 0)
+		pj_objpool_free(objpool, obj[i]);
+	    return -1;
+	}
+	*(char*)obj[i] = '\0';
+    }
+
+    for (i=0; i<COUNT; ++i) {
+	pj_objpool_free(objpool, obj[i]);
+    }
+
+    return 0;
+}
+
+static int objpool_perf_test()
+{
+    pj_objpool_t *objpool;
+    pj_uint32_t pool_time=0, objpool_time=0;
+    pj_timestamp start, end;
+    pj_status_t status;
+    unsigned i;
+
+    status = pj_objpool_create(mem, NULL, OBJ_SIZE, 0, &objpool);
+    if (status != PJ_SUCCESS)
+	return 10;
+
+    /* Warmup */
+    pool_test_pool_per_obj();
+    pool_test_objpool(objpool);
+
+    for (i=0; i<LOOP; ++i) {
+	pj_get_timestamp(&start);
+	if (pool_test_pool_per_obj()) {
+	    pj_objpool_destroy(objpool);
+	    return 11;
+	}
+	pj_get_timestamp(&end);
+	pool_time += (end.u32.lo - start.u32.lo);
+
+	pj_get_timestamp(&start);
+	if (pool_test_objpool(objpool)) {
+	    pj_objpool_destroy(objpool);
+	    return 12;
+	}
+	pj_get_timestamp(&end);
+	objpool_time += (end.u32.lo - start.u32.lo);
+    }
+
+    pj_objpool_destroy(objpool);
+
+    PJ_LOG(4,(THIS_FILE,"..object size:                       %u",OBJ_SIZE));
+    PJ_LOG(4,(THIS_FILE,"..pool per object time:              %u",pool_time));
+    PJ_LOG(4,(THIS_FILE,"..objpool alloc/free time:           %u",
+	      objpool_time));
+
+    if (objpool_time==0) objpool_time=1;
+    PJ_LOG(3, (THIS_FILE, "..objpool speedup over pool per object=%dx", 
+			  (int)(pool_time/objpool_time)));
+    return 0;
+}
+
 int pool_perf_test()
 {
     unsigned i;
@@ -186,7 +282,8 @@ int pool_perf_test()
     PJ_LOG(3, (THIS_FILE, "..pool speedup over malloc best=%dx, worst=%dx", 
 			  (int)(malloc_time/best),
 			  (int)(malloc_time/worst)));
-    return 0;
+
+    return objpool_perf_test();
 }
 
 
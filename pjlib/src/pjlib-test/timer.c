@@ -45,13 +45,22 @@
 #define THIS_FILE	"timer_test"
 
 
+static const char *type_names[] = { "heap", "wheel" };
+static int early_expire;
+
 static void timer_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
 {
+    pj_time_val now;
+
     PJ_UNUSED_ARG(ht);
-    PJ_UNUSED_ARG(e);
+
+    /* Timers must never expire before their time */
+    pj_gettickcount(&now);
+    if (PJ_TIME_VAL_LT(now, e->_timer_value))
+	++early_expire;
 }
 
-static int test_timer_heap(void)
+static int test_timer_heap(pj_timer_heap_type type, unsigned shard_cnt)
 {
     int i, j;
     pj_timer_entry *entry;
@@ -61,6 +70,9 @@ static int test_timer_heap(void)
     pj_status_t rc;    int err=0;
     pj_size_t size;
     unsigned count;
+    pj_timer_heap_param param;
+
+    PJ_LOG(3,(THIS_FILE, "..%s, %d shard(s)", type_names[type], shard_cnt));
 
     size = pj_timer_heap_mem_size(MAX_COUNT)+MAX_COUNT*sizeof(pj_timer_entry);
     pool = pj_pool_create( mem, NULL, size, 4000, NULL);
@@ -77,7 +89,11 @@ static int test_timer_heap(void)
     for (i=0; i<MAX_COUNT; ++i) {
 	entry[i].cb = &timer_callback;
     }
-    rc = pj_timer_heap_create(pool, MAX_COUNT, &timer);
+    pj_timer_heap_param_default(&param);
+    param.type = type;
+    param.shard_cnt = shard_cnt;
+    early_expire = 0;
+    rc = pj_timer_heap_create2(pool, MAX_COUNT, &param, &timer);
     if (rc != PJ_SUCCESS) {
         app_perror("...error: unable to create timer heap", rc);
 	return -30;
@@ -163,6 +179,12 @@ static int test_timer_heap(void)
 		       pj_timer_heap_count(timer)));
 	    ++err;
 	}
+
+	if (early_expire) {
+	    PJ_LOG(3, (THIS_FILE, "ERROR: %d timers expired early",
+		       early_expire));
+	    ++err;
+	}
 	t_sched.u32.lo /= count; 
 	t_cancel.u32.lo /= count;
 	t_poll.u32.lo /= count;
@@ -177,14 +199,484 @@ static int test_timer_heap(void)
 	    break;
     }
 
+    pj_timer_heap_destroy(timer);
     pj_pool_release(pool);
     return err;
 }
 
 
+/*
+ * Test that the group lock destroy handler, called when cancelling the last
+ * entry holding the group lock, may use the same shard of a sharded timer
+ * heap.
+ */
+#define GLOCK_ENTRIES	64
+
+struct glock_test
+{
+    pj_pool_t	    *pool;
+    pj_timer_heap_t *timer;
+    pj_timer_heap_t *shard;
+    pj_timer_entry   entry[GLOCK_ENTRIES];
+    pj_bool_t	     used_shard;
+};
+
+static void glock_on_destroy(void *arg)
+{
+    struct glock_test *gt = (struct glock_test*)arg;
+    pj_time_val delay = { 10, 0 };
+    pj_grp_lock_t *glock[GLOCK_ENTRIES];
+    unsigned i, cnt;
+
+    /* Schedule and cancel entries with other group locks until one lands
+     * in the same shard. The group locks are kept until the end so that
+     * each of them gets a different address.
+     */
+    for (cnt=0; cnt<GLOCK_ENTRIES && !gt->used_shard; ++cnt) {
+	pj_timer_entry *e = &gt->entry[cnt];
+
+	if (pj_grp_lock_create(gt->pool, NULL, &glock[cnt]) != PJ_SUCCESS)
+	    break;
+	pj_grp_lock_add_ref(glock[cnt]);
+
+	pj_timer_entry_init(e, 0, NULL, &timer_callback);
+	if (pj_timer_heap_schedule_w_grp_lock(gt->timer, e, &delay, 1,
+					      glock[cnt]) == PJ_SUCCESS)
+	{
+	    gt->used_shard = (e->_timer_heap == gt->shard);
+	    pj_timer_heap_cancel(gt->timer, e);
+	}
+    }
+
+    for (i=0; i<cnt; ++i)
+	pj_grp_lock_dec_ref(glock[i]);
+}
+
+static int test_grp_lock_destroy(void)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_param param;
+    pj_grp_lock_t *grp_lock;
+    pj_timer_entry entry;
+    pj_time_val delay = { 10, 0 };
+    struct glock_test gt;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "..group lock destroyed by cancel, 4 shards"));
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    pj_bzero(&gt, sizeof(gt));
+    gt.pool = pool;
+
+    pj_timer_heap_param_default(&param);
+    param.shard_cnt = 4;
+    if (pj_timer_heap_create2(pool, 16, &param, &gt.timer) != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return -400;
+    }
+
+    if (pj_grp_lock_create(pool, NULL, &grp_lock) != PJ_SUCCESS) {
+	rc = -410;
+	goto on_return;
+    }
+    pj_grp_lock_add_ref(grp_lock);
+    pj_grp_lock_add_handler(grp_lock, pool, &gt, &glock_on_destroy);
+
+    pj_timer_entry_init(&entry, 0, NULL, &timer_callback);
+    if (pj_timer_heap_schedule_w_grp_lock(gt.timer, &entry, &delay, 1,
+					  grp_lock) != PJ_SUCCESS)
+    {
+	pj_grp_lock_dec_ref(grp_lock);
+	rc = -420;
+	goto on_return;
+    }
+    gt.shard = entry._timer_heap;
+
+    /* The timer holds the last reference now */
+    pj_grp_lock_dec_ref(grp_lock);
+    pj_timer_heap_cancel(gt.timer, &entry);
+
+    if (!gt.used_shard) {
+	PJ_LOG(3,(THIS_FILE, "...error: destroy handler didn't use the "
+			     "shard"));
+	rc = -430;
+    }
+
+on_return:
+    pj_timer_heap_destroy(gt.timer);
+    pj_pool_release(pool);
+    return rc;
+}
+
+
+/*
+ * Test that entries in shards which are not the home shard of the polling
+ * thread are still expired, and that the poll delay accounts for them.
+ */
+#define HELP_ENTRIES	16
+
+static unsigned help_expired;
+
+static void help_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
+{
+    PJ_UNUSED_ARG(ht);
+    PJ_UNUSED_ARG(e);
+    ++help_expired;
+}
+
+static int test_shard_help(void)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_param param;
+    pj_timer_heap_t *timer;
+    pj_grp_lock_t *glock[HELP_ENTRIES];
+    pj_timer_entry entry[HELP_ENTRIES];
+    pj_time_val delay = { 0, 0 };
+    pj_time_val expire, now;
+    unsigned i, cnt, other = 0;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "..expiring entries of other shards, 4 shards"));
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+
+    pj_timer_heap_param_default(&param);
+    param.shard_cnt = 4;
+    if (pj_timer_heap_create2(pool, 16, &param, &timer) != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return -500;
+    }
+
+    /* Entries with different group locks are spread over the shards */
+    help_expired = 0;
+    for (cnt=0; cnt<HELP_ENTRIES; ++cnt) {
+	if (pj_grp_lock_create(pool, NULL, &glock[cnt]) != PJ_SUCCESS) {
+	    rc = -510;
+	    goto on_return;
+	}
+	pj_grp_lock_add_ref(glock[cnt]);
+
+	pj_timer_entry_init(&entry[cnt], 0, NULL, &help_callback);
+	if (pj_timer_heap_schedule_w_grp_lock(timer, &entry[cnt], &delay, 1,
+					      glock[cnt]) != PJ_SUCCESS)
+	{
+	    ++cnt;
+	    rc = -520;
+	    goto on_return;
+	}
+	if (entry[cnt]._timer_heap != entry[0]._timer_heap)
+	    ++other;
+    }
+
+    if (other == 0) {
+	PJ_LOG(3,(THIS_FILE, "...error: all entries are in one shard"));
+	rc = -530;
+	goto on_return;
+    }
+
+    /* Only this thread polls, sleeping for the delay that poll returns */
+    pj_gettickcount(&expire);
+    expire.sec += 1;
+    do {
+	pj_timer_heap_poll(timer, &delay);
+	if (pj_timer_heap_count(timer) && PJ_TIME_VAL_MSEC(delay) > 100) {
+	    PJ_LOG(3,(THIS_FILE, "...error: poll delay is %ld msec with "
+				 "pending entries",
+		      (long)PJ_TIME_VAL_MSEC(delay)));
+	    rc = -540;
+	    goto on_return;
+	}
+	if (help_expired < HELP_ENTRIES)
+	    pj_thread_sleep(PJ_TIME_VAL_MSEC(delay));
+	pj_gettickcount(&now);
+    } while (help_expired < HELP_ENTRIES && PJ_TIME_VAL_LT(now, expire));
+
+    if (help_expired != HELP_ENTRIES) {
+	PJ_LOG(3,(THIS_FILE, "...error: only %d of %d entries expired",
+		  help_expired, HELP_ENTRIES));
+	rc = -550;
+    }
+
+on_return:
+    for (i=0; i<cnt; ++i) {
+	pj_timer_heap_cancel(timer, &entry[i]);
+	pj_grp_lock_dec_ref(glock[i]);
+    }
+    pj_timer_heap_destroy(timer);
+    pj_pool_release(pool);
+    return rc;
+}
+
+
+/*
+ * Scaling benchmark: schedule, cancel, and expire increasing number of
+ * timers, and report the average cost per operation for each type.
+ */
+#define BENCH_MIN_COUNT	1000
+#define BENCH_MAX_COUNT	100000
+
+static int bench_timer_heap(pj_timer_heap_type type, unsigned count)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_t *timer;
+    pj_timer_heap_param param;
+    pj_timer_entry *entry;
+    pj_time_val *delay;
+    pj_timestamp t1, t2, t_poll;
+    pj_time_val expire, now;
+    pj_uint32_t t_sched, t_cancel;
+    unsigned i, done;
+    pj_status_t rc;
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    entry = (pj_timer_entry*)pj_pool_calloc(pool, count, sizeof(*entry));
+    delay = (pj_time_val*)pj_pool_calloc(pool, count, sizeof(*delay));
+    if (!entry || !delay) {
+	pj_pool_release(pool);
+	return -200;
+    }
+
+    pj_timer_heap_param_default(&param);
+    param.type = type;
+    rc = pj_timer_heap_create2(pool, count, &param, &timer);
+    if (rc != PJ_SUCCESS) {
+	app_perror("...error: unable to create timer heap", rc);
+	pj_pool_release(pool);
+	return -210;
+    }
+
+    for (i=0; i<count; ++i) {
+	pj_timer_entry_init(&entry[i], 0, NULL, &timer_callback);
+	delay[i].sec = 1 + pj_rand() % 600;
+	delay[i].msec = pj_rand() % 1000;
+    }
+
+    /* Schedule all timers far in the future, like idle SIP transactions */
+    pj_get_timestamp(&t1);
+    for (i=0; i<count; ++i)
+	pj_timer_heap_schedule(timer, &entry[i], &delay[i]);
+    pj_get_timestamp(&t2);
+    t_sched = pj_elapsed_nanosec(&t1, &t2) / count;
+
+    /* Cancel all of them */
+    pj_get_timestamp(&t1);
+    for (i=0; i<count; ++i)
+	pj_timer_heap_cancel(timer, &entry[i]);
+    pj_get_timestamp(&t2);
+    t_cancel = pj_elapsed_nanosec(&t1, &t2) / count;
+
+    /* Schedule them again with short delays and poll until all expire */
+    for (i=0; i<count; ++i) {
+	delay[i].sec = 0;
+	delay[i].msec = pj_rand() % 200;
+	pj_timer_heap_schedule(timer, &entry[i], &delay[i]);
+    }
+
+    pj_gettickcount(&expire);
+    expire.sec += 2;
+    done = 0;
+    t_poll.u64 = 0;
+    do {
+	unsigned n;
+
+	pj_get_timestamp(&t1);
+	n = pj_timer_heap_poll(timer, NULL);
+	pj_get_timestamp(&t2);
+
+	/* Only account polls that expire something */
+	if (n > 0) {
+	    done += n;
+	    t_poll.u64 += t2.u64 - t1.u64;
+	}
+	pj_gettickcount(&now);
+    } while (done < count && PJ_TIME_VAL_LT(now, expire));
+
+    t1.u64 = 0;
+    PJ_LOG(3,(THIS_FILE, "...%-5s count:%6u sched:%4u ns cancel:%4u ns "
+	      "expire:%4u ns",
+	      type_names[type], count, t_sched, t_cancel,
+	      pj_elapsed_nanosec(&t1, &t_poll) / count));
+
+    pj_pool_release(pool);
+    return done == count ? 0 : -220;
+}
+
+/*
+ * Multithreaded benchmark: several threads schedule and poll short timers
+ * on the same timer heap, to compare a single lock with sharded locks.
+ */
+#define THREAD_CNT	    4
+#define THREAD_TIMERS	    20000
+
+struct thread_bench
+{
+    pj_timer_heap_t *timer;
+    pj_timer_entry  *entry;
+    pj_atomic_t	    *expired;
+};
+
+static void thread_timer_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
+{
+    struct thread_bench *tb = (struct thread_bench*)e->user_data;
+    PJ_UNUSED_ARG(ht);
+    pj_atomic_inc(tb->expired);
+}
+
+static int bench_thread(void *arg)
+{
+    struct thread_bench *tb = (struct thread_bench*)arg;
+    pj_time_val delay = { 0, 0 };
+    pj_time_val expire, now;
+    unsigned i;
+
+    for (i=0; i<THREAD_TIMERS; ++i) {
+	pj_timer_heap_schedule(tb->timer, &tb->entry[i], &delay);
+	pj_timer_heap_poll(tb->timer, NULL);
+    }
+
+    pj_gettickcount(&expire);
+    expire.sec += 2;
+    do {
+	pj_timer_heap_poll(tb->timer, NULL);
+	pj_gettickcount(&now);
+    } while (pj_timer_heap_count(tb->timer) && PJ_TIME_VAL_LT(now, expire));
+
+    return 0;
+}
+
+static int bench_timer_threads(pj_timer_heap_type type, unsigned shard_cnt)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_param param;
+    pj_thread_t *thread[THREAD_CNT];
+    struct thread_bench tb[THREAD_CNT];
+    pj_timer_heap_t *timer;
+    pj_atomic_t *expired;
+    pj_lock_t *lock;
+    pj_timestamp t1, t2;
+    pj_uint32_t msec;
+    unsigned i, j;
+    int rc = 0;
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+
+    pj_timer_heap_param_default(&param);
+    param.type = type;
+    param.shard_cnt = shard_cnt;
+    if (pj_timer_heap_create2(pool, THREAD_CNT, &param, &timer) != PJ_SUCCESS ||
+	pj_atomic_create(pool, 0, &expired) != PJ_SUCCESS)
+    {
+	pj_pool_release(pool);
+	return -300;
+    }
+    if (shard_cnt == 1) {
+	pj_lock_create_simple_mutex(pool, NULL, &lock);
+	pj_timer_heap_set_lock(timer, lock, PJ_TRUE);
+    }
+    pj_timer_heap_set_max_timed_out_per_poll(timer, 64);
+
+    for (i=0; i<THREAD_CNT; ++i) {
+	tb[i].timer = timer;
+	tb[i].expired = expired;
+	tb[i].entry = (pj_timer_entry*)
+		      pj_pool_calloc(pool, THREAD_TIMERS, sizeof(pj_timer_entry));
+	for (j=0; j<THREAD_TIMERS; ++j) {
+	    pj_timer_entry_init(&tb[i].entry[j], 0, &tb[i],
+				&thread_timer_callback);
+	}
+    }
+
+    pj_get_timestamp(&t1);
+    for (i=0; i<THREAD_CNT; ++i) {
+	if (pj_thread_create(pool, "timer", &bench_thread, &tb[i], 0, 0,
+			     &thread[i]) != PJ_SUCCESS)
+	{
+	    rc = -310;
+	    break;
+	}
+    }
+    for (j=0; j<i; ++j) {
+	pj_thread_join(thread[j]);
+	pj_thread_destroy(thread[j]);
+    }
+    pj_get_timestamp(&t2);
+
+    msec = pj_elapsed_msec(&t1, &t2);
+    if (rc == 0 &&
+	pj_atomic_get(expired) != THREAD_CNT * THREAD_TIMERS)
+    {
+	PJ_LOG(3,(THIS_FILE, "...error: only %d of %d timers expired",
+		  pj_atomic_get(expired), THREAD_CNT * THREAD_TIMERS));
+	rc = -320;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "...%-5s %d threads, %d shard(s): %u timers/sec",
+	      type_names[type], THREAD_CNT, shard_cnt,
+	      (unsigned)(THREAD_CNT * THREAD_TIMERS * 1000.0 /
+			 (msec ? msec : 1))));
+
+    pj_atomic_destroy(expired);
+    pj_timer_heap_destroy(timer);
+    pj_pool_release(pool);
+    return rc;
+}
+
+static int timer_bench(void)
+{
+    unsigned count;
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "..benchmarking timer heap types"));
+
+    for (count=BENCH_MIN_COUNT; count<=BENCH_MAX_COUNT; count*=10) {
+	rc = bench_timer_heap(PJ_TIMER_HEAP_TYPE_HEAP, count);
+	if (rc != 0)
+	    return rc;
+	rc = bench_timer_heap(PJ_TIMER_HEAP_TYPE_WHEEL, count);
+	if (rc != 0)
+	    return rc;
+    }
+
+#if PJ_HAS_THREADS
+    rc = bench_timer_threads(PJ_TIMER_HEAP_TYPE_HEAP, 1);
+    if (rc != 0)
+	return rc;
+    rc = bench_timer_threads(PJ_TIMER_HEAP_TYPE_HEAP, THREAD_CNT);
+    if (rc != 0)
+	return rc;
+    rc = bench_timer_threads(PJ_TIMER_HEAP_TYPE_WHEEL, THREAD_CNT);
+    if (rc != 0)
+	return rc;
+#endif
+
+    return 0;
+}
+
 int timer_test()
 {
-    return test_timer_heap();
+    int rc;
+
+    rc = test_timer_heap(PJ_TIMER_HEAP_TYPE_HEAP, 1);
+    if (rc != 0)
+	return rc;
+
+    rc = test_timer_heap(PJ_TIMER_HEAP_TYPE_WHEEL, 1);
+    if (rc != 0)
+	return rc;
+
+    rc = test_timer_heap(PJ_TIMER_HEAP_TYPE_HEAP, 4);
+    if (rc != 0)
+	return rc;
+
+    rc = test_grp_lock_destroy();
+    if (rc != 0)
+	return rc;
+
+    rc = test_shard_help();
+    if (rc != 0)
+	return rc;
+
+    return timer_bench();
 }
 
 #else
@@ -129,8 +129,10 @@ PJ_DEF(pj_status_t) pj_turn_srv_create(pj_pool_factory *pf,
 					sizeof(srv->core.listener[0]));
 
     /* Create hash tables */
-    srv->tables.alloc = pj_hash_create(pool, MAX_CLIENTS);
-    srv->tables.res = pj_hash_create(pool, MAX_CLIENTS);
+    srv->tables.alloc = pj_hash_create2(pool, MAX_CLIENTS,
+					PJ_HASH_OPEN_ADDRESSING);
+    srv->tables.res = pj_hash_create2(pool, MAX_CLIENTS,
+				      PJ_HASH_OPEN_ADDRESSING);
 
     /* Init ports settings */
     srv->ports.min_udp = srv->ports.next_udp = MIN_PORT;
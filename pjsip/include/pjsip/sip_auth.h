@@ -175,6 +175,10 @@ typedef struct pjsip_cached_auth
     pj_str_t			 cnonce;    /**< Cnonce value.		    */
 #endif
     pjsip_www_authenticate_hdr	*last_chal; /**< Last challenge seen.	    */
+    const pjsip_cred_info	*ha1_cred;  /**< Credential of cached HA1.  */
+    char			 ha1[PJSIP_MD5STRLEN];
+					    /**< HA1 of the plain password
+						 credential for this realm. */
 #if PJSIP_AUTH_HEADER_CACHING
     pjsip_cached_auth_hdr	 cached_hdr;/**< List of cached header for
 						 each method.		    */
@@ -202,6 +206,17 @@ typedef struct pjsip_auth_clt_pref
      */
     pj_str_t	algorithm;
 
+    /**
+     * If this flag is set, the authentication client framework will
+     * proactively send Authorization/Proxy-Authorization headers in
+     * subsequent requests, computed from the last challenge of each realm
+     * (with incremented nonce-count when the server requires qop), instead
+     * of waiting for the server to challenge each request again. This is
+     * the run-time equivalent of PJSIP_AUTH_AUTO_SEND_NEXT.
+     * Default is no.
+     */
+    pj_bool_t	auto_send_next;
+
 } pjsip_auth_clt_pref;
 
 
@@ -306,6 +321,62 @@ typedef pj_status_t pjsip_auth_lookup_cred2(
 				pjsip_cred_info *cred_info );
 
 
+/**
+ * Opaque structure describing a pending asynchronous credential lookup
+ * started by #pjsip_auth_srv_verify_async().
+ */
+typedef struct pjsip_auth_lookup_op pjsip_auth_lookup_op;
+
+
+/**
+ * Type of function to start an asynchronous credential lookup, for example
+ * a query to a database. The function must not block; when the credential
+ * is available (or known to be unavailable), application reports the
+ * result by calling #pjsip_auth_srv_lookup_complete() with the \a op.
+ * The completion may be reported from any thread, including from inside
+ * this function.
+ *
+ * @param param		The input param for credential lookup. The
+ *			\a rdata in the param is a clone of the request
+ *			and remains valid until the lookup is completed.
+ * @param op		The lookup operation, to be passed to
+ *			#pjsip_auth_srv_lookup_complete().
+ *
+ * @return		PJ_SUCCESS if the lookup has been started (or has
+ *			been completed). Any other value means the lookup
+ *			could not be started, and in this case application
+ *			must not call #pjsip_auth_srv_lookup_complete().
+ */
+typedef pj_status_t pjsip_auth_lookup_cred_async(
+				const pjsip_auth_lookup_cred_param *param,
+				pjsip_auth_lookup_op *op);
+
+
+/* Forward declaration. */
+struct pjsip_auth_srv;
+
+/**
+ * Type of callback to receive the result of #pjsip_auth_srv_verify_async()
+ * when the verification could not be completed immediately.
+ *
+ * @param auth_srv	The server authentication structure.
+ * @param rdata		Clone of the request being authenticated. It is
+ *			only valid for the duration of the callback; clone
+ *			it again with #pjsip_rx_data_clone() if it is needed
+ *			afterwards.
+ * @param token		The token given to #pjsip_auth_srv_verify_async().
+ * @param status	PJ_SUCCESS if the request is successfully
+ *			authenticated, or the error code as described in
+ *			#pjsip_auth_srv_verify().
+ * @param status_code	Suitable status code to be sent to the client.
+ */
+typedef void pjsip_auth_srv_verify_cb(struct pjsip_auth_srv *auth_srv,
+				      pjsip_rx_data *rdata,
+				      void *token,
+				      pj_status_t status,
+				      int status_code);
+
+
 /** Flag to specify that server is a proxy. */
 #define PJSIP_AUTH_SRV_IS_PROXY	    1
 
@@ -319,6 +390,12 @@ typedef struct pjsip_auth_srv
     pjsip_auth_lookup_cred  *lookup;	/**< Lookup function.		    */
     pjsip_auth_lookup_cred2 *lookup2;	/**< Lookup function with additional
 					     info in its input param.	    */
+    pjsip_auth_lookup_cred_async *lookup_async;
+					/**< Asynchronous lookup function.  */
+    pj_mutex_t		    *mutex;	/**< Protects the cache and pending
+					     lookups.			    */
+    struct pjsip_auth_srv_cache *cache;	/**< Cache of credential digests,
+					     NULL when disabled.	    */
 } pjsip_auth_srv;
 
 
@@ -481,6 +558,12 @@ typedef struct pjsip_auth_srv_init_param
      */
     pjsip_auth_lookup_cred2	*lookup2;
 
+    /**
+     * Asynchronous account lookup function, used by
+     * #pjsip_auth_srv_verify_async(). Optional.
+     */
+    pjsip_auth_lookup_cred_async *lookup_async;
+
     /**
      * Options, bitmask of:
      * - PJSIP_AUTH_SRV_IS_PROXY: to specify that the server will authorize
@@ -489,6 +572,22 @@ typedef struct pjsip_auth_srv_init_param
      */
     unsigned			 options;
 
+    /**
+     * Maximum number of credential digests to cache. A cached digest is
+     * accepted without calling the lookup function until it expires, even
+     * if the account has been deleted or its password changed in the
+     * meantime, unless application removes it with
+     * #pjsip_auth_srv_cache_remove(). Zero (the default) disables the
+     * cache.
+     */
+    unsigned			 cache_size;
+
+    /**
+     * Number of seconds a cached credential digest stays valid. Zero means
+     * PJSIP_AUTH_SRV_CACHE_TTL.
+     */
+    unsigned			 cache_ttl;
+
 } pjsip_auth_srv_init_param;
 
 
@@ -532,6 +631,80 @@ PJ_DECL(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
 					    int *status_code );
 
 
+/**
+ * Verify the authorization information in the specified request without
+ * blocking on the credential lookup. If the credential digest is found in
+ * the cache, or if the server has no asynchronous lookup function, the
+ * request is verified immediately just like #pjsip_auth_srv_verify().
+ * Otherwise the asynchronous lookup function is called and the result
+ * will be reported to \a cb once application completes the lookup with
+ * #pjsip_auth_srv_lookup_complete().
+ *
+ * @param auth_srv	The server authentication structure.
+ * @param rdata		Incoming request to be authenticated.
+ * @param status_code	Filled with suitable status code to be sent to the
+ *			client when the verification completes immediately.
+ * @param token		Arbitrary token to be given back to \a cb.
+ * @param cb		Callback to receive the result when the
+ *			verification completes later.
+ *
+ * @return		PJ_EPENDING if the result will be reported to
+ *			\a cb. Otherwise the result of the verification,
+ *			as described in #pjsip_auth_srv_verify(), and
+ *			\a cb will not be called.
+ */
+PJ_DECL(pj_status_t) pjsip_auth_srv_verify_async(pjsip_auth_srv *auth_srv,
+						 pjsip_rx_data *rdata,
+						 int *status_code,
+						 void *token,
+						 pjsip_auth_srv_verify_cb *cb);
+
+
+/**
+ * Report the result of an asynchronous credential lookup started by the
+ * server's asynchronous lookup function.
+ *
+ * @param op		The lookup operation.
+ * @param status	PJ_SUCCESS if the credential is found, otherwise
+ *			the lookup error such as PJSIP_EAUTHACCNOTFOUND.
+ * @param cred_info	The credential found, when \a status is PJ_SUCCESS.
+ *			It will be copied.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_auth_srv_lookup_complete(
+					pjsip_auth_lookup_op *op,
+					pj_status_t status,
+					const pjsip_cred_info *cred_info);
+
+
+/**
+ * Remove the cached credential digest of the specified account, for example
+ * after its password has been changed. Note that a cached digest that fails
+ * to authenticate a request is discarded automatically.
+ *
+ * @param auth_srv	The server authentication structure.
+ * @param acc_name	The account name.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_auth_srv_cache_remove(pjsip_auth_srv *auth_srv,
+						 const pj_str_t *acc_name);
+
+
+/**
+ * Release the resources held by the server authorization session. This is
+ * only needed when the server has been initialized with a digest cache or
+ * an asynchronous lookup function. There must not be any asynchronous
+ * lookup pending.
+ *
+ * @param auth_srv	The server authentication structure.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_auth_srv_deinit(pjsip_auth_srv *auth_srv);
+
+
 /**
  * Add authentication challenge headers to the outgoing response in tdata. 
  * Application may specify its customized nonce and opaque for the challenge, 
@@ -145,6 +145,42 @@ typedef struct pjsip_cfg_t
 	 */
 	pj_bool_t resolve_hostname_to_get_interface;
 
+	/**
+	 * Parse incoming messages lazily. When enabled, only the headers
+	 * needed to process every message (Via, From, To, Call-ID, CSeq,
+	 * Max-Forwards, Content-Length and Content-Type) and the headers
+	 * used by the dialog and 100rel code (Route, Record-Route and
+	 * Require) are parsed when the message is received. The other
+	 * headers are kept unparsed (see #pjsip_lazy_hdr) until they are
+	 * looked up with #pjsip_msg_find_hdr() or the other header lookup
+	 * functions.
+	 *
+	 * This reduces the processing and memory needed for messages
+	 * that are only forwarded, e.g. by stateless proxies. Note that
+	 * with lazy parsing, the \a supported field of the rdata's
+	 * \a msg_info is not set, and application that walks the header
+	 * list directly will see the unparsed headers as PJSIP_H_OTHER.
+	 *
+	 * Default is PJSIP_LAZY_PARSE.
+	 */
+	pj_bool_t lazy_parse;
+
+	/**
+	 * Number of worker threads to process incoming messages. When
+	 * non-zero, the thread that reads a message from the network only
+	 * parses it, and hands a clone of the rdata (see
+	 * #pjsip_rx_data_clone()) to one of these workers to be distributed
+	 * to modules. Messages with the same Call-ID are always processed
+	 * by the same worker, so they are processed in the order they are
+	 * received. When zero, messages are processed by the thread that
+	 * reads them.
+	 *
+	 * This setting is read when the endpoint is created.
+	 *
+	 * Default is PJSIP_RX_WORKER_CNT.
+	 */
+	unsigned rx_worker_cnt;
+
     } endpt;
 
     /** Transaction layer settings. */
@@ -205,6 +241,53 @@ typedef struct pjsip_cfg_t
 
     } regc;
 
+    /** Transport layer settings. */
+    struct {
+	/**
+	 * Maximum number of connections that may be opened to the same
+	 * destination with connection oriented transports such as TCP and
+	 * TLS. When all connections to the destination have messages
+	 * waiting to be sent, another connection is created until this
+	 * number is reached; otherwise the connection with the fewest
+	 * pending messages is used.
+	 *
+	 * Default is PJSIP_TP_POOL_SIZE.
+	 */
+	unsigned    pool_size;
+
+	/**
+	 * Maximum number of messages waiting to be sent on a transport.
+	 * When this number is reached, sending more messages on the
+	 * transport fails with PJSIP_ETPBUSY until some of the pending
+	 * messages have been sent. Zero means no limit.
+	 *
+	 * Default is PJSIP_TP_MAX_PENDING_TX.
+	 */
+	unsigned    max_pending_tx;
+
+	/**
+	 * Maximum size, in bytes, of a coalesced write on TCP and TLS
+	 * transports. When non-zero, messages sent while an earlier write
+	 * on the connection is still in progress are queued and written
+	 * together, in one send operation (and one TLS record), once the
+	 * earlier write completes. Zero disables send batching.
+	 *
+	 * Default is PJSIP_TP_TX_BATCH_SIZE.
+	 */
+	unsigned    tx_batch_size;
+
+	/**
+	 * Maximum time, in milliseconds, a message may be held in the send
+	 * batching queue waiting for the previous write to complete. When
+	 * this expires the queue is written anyway. Zero means the queue
+	 * is only written when the previous write completes.
+	 *
+	 * Default is PJSIP_TP_TX_BATCH_DELAY.
+	 */
+	unsigned    tx_batch_delay;
+
+    } tp;
+
 } pjsip_cfg_t;
 
 
@@ -257,6 +340,115 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_MAX_DIALOG_COUNT	(512-1)
 #endif
 
+/**
+ * Specify whether the transaction and dialog hash tables use open
+ * addressing (see #PJ_HASH_OPEN_ADDRESSING). Open addressing hash table
+ * grows as needed, so lookups stay fast when the number of transactions
+ * or dialogs exceeds PJSIP_MAX_TSX_COUNT or PJSIP_MAX_DIALOG_COUNT.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_HASH_OPEN_ADDRESSING
+#   define PJSIP_HASH_OPEN_ADDRESSING	1
+#endif
+
+/**
+ * Specify the number of lock stripes in the transaction table. The table
+ * is split into this many hash tables, each protected by its own mutex,
+ * and a transaction is kept in the stripe selected by the hash value of
+ * its key. Messages belonging to transactions in different stripes can
+ * then be matched concurrently by different worker threads. Each stripe
+ * also has a mutex which protects the timers of its transactions. Set
+ * this to 1 to use a single table and mutex.
+ *
+ * Default: 16
+ */
+#ifndef PJSIP_TSX_TABLE_STRIPE_COUNT
+#   define PJSIP_TSX_TABLE_STRIPE_COUNT	16
+#endif
+
+/**
+ * Specify the interval, in milliseconds, at which the transaction layer
+ * sweeps its retransmission schedule. Instead of scheduling a timer heap
+ * entry for every retransmission, transactions are put in the slot of a
+ * timer wheel according to the time their next retransmission is due,
+ * and a single timer sweeps the due slots and retransmits all of their
+ * transactions in one pass. Retransmissions may be sent up to this much
+ * later than the exact retransmission interval. The value must divide
+ * 1000. The timeout timers of the transactions are not affected.
+ *
+ * Set this to 0 to schedule every retransmission on the timer heap of
+ * the endpoint.
+ *
+ * Default: 10
+ */
+#ifndef PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+#   define PJSIP_TSX_RETRANS_SWEEP_INTERVAL	10
+#endif
+
+/**
+ * Specify the number of slots in the retransmission timer wheel of the
+ * transaction layer (see PJSIP_TSX_RETRANS_SWEEP_INTERVAL). A
+ * retransmission which is due further than this many sweep intervals
+ * away wraps around the wheel and is skipped by the sweeps until it is
+ * due, so the wheel should preferably span T2.
+ *
+ * Default: 512
+ */
+#ifndef PJSIP_TSX_RETRANS_WHEEL_SIZE
+#   define PJSIP_TSX_RETRANS_WHEEL_SIZE	512
+#endif
+
+/**
+ * Specify the number of lock stripes in the dialog set table of the user
+ * agent layer. The dialog sets are kept in this many hash tables, each
+ * protected by its own mutex, and the stripe is selected by the hash
+ * value of the local tag. Requests and responses of unrelated dialogs can
+ * then be matched to their dialogs without contending on a single user
+ * agent mutex. Set this to 1 to use a single table and mutex.
+ *
+ * Default: 16
+ */
+#ifndef PJSIP_DLG_TABLE_STRIPE_COUNT
+#   define PJSIP_DLG_TABLE_STRIPE_COUNT	16
+#endif
+
+
+/**
+ * Specify whether incoming messages are parsed lazily by default. See
+ * \a lazy_parse in #pjsip_cfg_t.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_LAZY_PARSE
+#   define PJSIP_LAZY_PARSE		0
+#endif
+
+
+/**
+ * Number of worker threads the endpoint creates to process incoming
+ * messages, so that reading from the network is not stalled by slow
+ * application callbacks. Zero processes messages in the thread that
+ * reads them. See \a rx_worker_cnt in #pjsip_cfg_t.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_RX_WORKER_CNT
+#   define PJSIP_RX_WORKER_CNT		0
+#endif
+
+
+/**
+ * Maximum number of messages waiting to be processed by each receive
+ * worker (see PJSIP_RX_WORKER_CNT). Messages received when the queue
+ * is full are dropped.
+ *
+ * Default: 1024
+ */
+#ifndef PJSIP_RX_WORKER_MAX_QUEUE
+#   define PJSIP_RX_WORKER_MAX_QUEUE	1024
+#endif
+
 
 /**
  * Specify maximum number of transports.
@@ -305,6 +497,35 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum length of an outgoing message sent over a stream oriented
+ * transport such as TCP or TLS. Messages that do not fit in
+ * PJSIP_MAX_PKT_LEN, normally because of a large body, are printed to a
+ * transmit buffer sized for the message, up to this length. Datagram
+ * transports still reject messages larger than PJSIP_MAX_PKT_LEN.
+ *
+ * Set this to PJSIP_MAX_PKT_LEN to disable large messages.
+ *
+ * Default: 16384
+ */
+#ifndef PJSIP_MAX_STREAM_TX_LEN
+#   define PJSIP_MAX_STREAM_TX_LEN	16384
+#endif
+
+
+/**
+ * Maximum length of an incoming message received over a stream oriented
+ * transport such as TCP or TLS. Each TCP and TLS connection allocates a
+ * receive buffer of this size, and messages that do not fit in it are
+ * rejected with PJSIP_ERXOVERFLOW.
+ *
+ * Default: PJSIP_MAX_STREAM_TX_LEN
+ */
+#ifndef PJSIP_MAX_STREAM_RX_LEN
+#   define PJSIP_MAX_STREAM_RX_LEN	PJSIP_MAX_STREAM_TX_LEN
+#endif
+
+
 /**
  * RFC 3261 section 18.1.1:
  * If a request is within 200 bytes of the path MTU, or if it is larger
@@ -590,6 +811,69 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum number of connections to the same destination that may be
+ * opened with connection oriented transports (TCP, TLS). Messages are
+ * sent on the connection with the fewest pending messages, and a new
+ * connection is opened when all of them are busy. The default value of
+ * 1 keeps one connection per destination.
+ *
+ * This option can also be controlled at run-time by the \a pool_size
+ * setting in pjsip_cfg_t.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_TP_POOL_SIZE
+#   define PJSIP_TP_POOL_SIZE		1
+#endif
+
+
+/**
+ * Maximum number of messages waiting to be sent on a transport, after
+ * which sending fails with PJSIP_ETPBUSY. Zero means no limit.
+ *
+ * This option can also be controlled at run-time by the
+ * \a max_pending_tx setting in pjsip_cfg_t.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_TP_MAX_PENDING_TX
+#   define PJSIP_TP_MAX_PENDING_TX	0
+#endif
+
+
+/**
+ * Maximum size of a coalesced write on TCP and TLS transports. Messages
+ * sent while an earlier write is still pending are queued and written
+ * together once the pending write completes, reducing the number of send
+ * operations and TLS records under load. Zero disables send batching.
+ *
+ * This option can also be controlled at run-time by the \a tx_batch_size
+ * setting in pjsip_cfg_t. Changing it only affects transports created
+ * afterwards.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_TP_TX_BATCH_SIZE
+#   define PJSIP_TP_TX_BATCH_SIZE	0
+#endif
+
+
+/**
+ * Maximum time, in milliseconds, queued messages wait for the previous
+ * write to complete before the send batching queue is written anyway.
+ * Zero means no limit.
+ *
+ * This option can also be controlled at run-time by the
+ * \a tx_batch_delay setting in pjsip_cfg_t.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_TP_TX_BATCH_DELAY
+#   define PJSIP_TP_TX_BATCH_DELAY	0
+#endif
+
+
 /**
  * Maximum number of usages for a transport before a new transport is
  * created. This only applies for ephemeral transports such as TCP.
@@ -603,6 +887,42 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Number of UDP sockets to be opened on the same local address by each
+ * UDP transport created with #pjsip_udp_transport_start2(). When the value
+ * is greater than one, the sockets are bound with SO_REUSEPORT so that
+ * the kernel distributes the incoming datagrams among them, and each
+ * socket is registered to the ioqueue with its own key and receive
+ * buffers. This lets SIP ingress scale with the number of worker threads.
+ * This constant is used as the default value for the "sock_cnt" field of
+ * pjsip_udp_transport_cfg structure.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_UDP_TRANSPORT_SOCK_CNT
+#   define PJSIP_UDP_TRANSPORT_SOCK_CNT	1
+#endif
+
+
+/**
+ * Maximum number of datagrams the UDP transport receives with a single
+ * read operation. Each pending read of the transport (see the "async_cnt"
+ * field of pjsip_udp_transport_cfg) gets this many receive buffers, and
+ * a burst of incoming datagrams is read with one pj_ioqueue_recvmmsg()
+ * call. The value is capped to PJ_SOCK_MAX_MMSG. Since every receive
+ * buffer has its own rdata pool, this multiplies the memory used for
+ * receiving by the same factor. With the default value of 1, each read
+ * operation receives one datagram. The transport also falls back to that,
+ * and releases the extra buffers, when the ioqueue doesn't support
+ * batched receive.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_UDP_RECV_BATCH
+#   define PJSIP_UDP_RECV_BATCH		1
+#endif
+
+
 /**
  * The TCP incoming connection backlog number to be set in accept().
  *
@@ -761,6 +1081,35 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #define PJSIP_MAX_TIMER_COUNT		(2*pjsip_cfg()->tsx.max_count + \
 					 2*PJSIP_MAX_DIALOG_COUNT)
 
+/**
+ * The timer heap implementation type to be used by the endpoint. See
+ * #pj_timer_heap_type for the possible values. The timing wheel type
+ * makes scheduling and cancelling SIP timers O(1), which helps when
+ * there are a lot of active transactions.
+ *
+ * Default: PJ_TIMER_HEAP_TYPE_HEAP
+ */
+#ifndef PJSIP_TIMER_HEAP_TYPE
+#   define PJSIP_TIMER_HEAP_TYPE	PJ_TIMER_HEAP_TYPE_HEAP
+#endif
+
+/**
+ * Number of shards of the endpoint timer heap. When this is greater than
+ * one, the timer heap is split into this many sub-heaps with their own
+ * locks, and each thread calling #pjsip_endpt_handle_events() polls its
+ * own shard (see #pj_timer_heap_param.shard_cnt). This only helps when
+ * several threads poll the endpoint on different CPU cores and contend
+ * for the timer heap lock, otherwise it adds overhead, so the default of
+ * one is the recommended setting. When it is used, set it to the number
+ * of threads polling the endpoint (for PJSUA-LIB, the \a thread_cnt
+ * setting in pjsua_config plus the application thread, if any).
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_TIMER_HEAP_SHARD_CNT
+#   define PJSIP_TIMER_HEAP_SHARD_CNT	1
+#endif
+
 /**
  * Initial memory block for the endpoint.
  */
@@ -809,6 +1158,40 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_POOL_INC_TDATA		4000
 #endif
 
+/**
+ * Enable adaptive sizing of rdata and tdata pools. The transport manager
+ * keeps a histogram of the pool memory used by received and transmitted
+ * messages (see #pjsip_tp_size_stat), and new pools get an initial size
+ * that fits most messages instead of PJSIP_POOL_RDATA_LEN and
+ * PJSIP_POOL_LEN_TDATA. The UDP transport also replaces the pools of its
+ * receive buffers when their size no longer matches the traffic.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_POOL_ADAPTIVE_SIZE
+#   define PJSIP_POOL_ADAPTIVE_SIZE	1
+#endif
+
+/**
+ * Width, in bytes, of each bin of the message and pool size histograms
+ * in #pjsip_tp_size_stat.
+ *
+ * Default: 512
+ */
+#ifndef PJSIP_TP_SIZE_STAT_BIN_LEN
+#   define PJSIP_TP_SIZE_STAT_BIN_LEN	512
+#endif
+
+/**
+ * Number of bins of the message and pool size histograms in
+ * #pjsip_tp_size_stat. The last bin also counts all larger sizes.
+ *
+ * Default: 32
+ */
+#ifndef PJSIP_TP_SIZE_STAT_BINS
+#   define PJSIP_TP_SIZE_STAT_BINS	32
+#endif
+
 /**
  * Initial memory size for UA layer
  */
@@ -854,7 +1237,7 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
  * Initial memory size for a SIP transaction object.
  */
 #ifndef PJSIP_POOL_TSX_LEN
-#   define PJSIP_POOL_TSX_LEN		1536 /* 768 */
+#   define PJSIP_POOL_TSX_LEN		512
 #endif
 
 /**
@@ -864,6 +1247,19 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_POOL_TSX_INC		256
 #endif
 
+/**
+ * Size of the buffer in the transaction object to store the transaction
+ * key. The key of RFC 3261 transactions consists of the role, the method
+ * and the branch parameter, and the branch of the transaction shares the
+ * same storage. Keys which don't fit are allocated from the pool of the
+ * transaction.
+ *
+ * Default: 80
+ */
+#ifndef PJSIP_TSX_KEY_BUF_LEN
+#   define PJSIP_TSX_KEY_BUF_LEN	80
+#endif
+
 /**
  * Delay for non-100 1xx retransmission, in seconds.
  * Set to 0 to disable this feature.
@@ -974,6 +1370,20 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Default number of seconds a credential digest is kept in the server
+ * authentication cache, when application enables the cache with the
+ * \a cache_size setting of #pjsip_auth_srv_init_param. This is also the
+ * longest time a changed password may still be accepted, unless
+ * application removes the digest with #pjsip_auth_srv_cache_remove().
+ *
+ * Default: 300
+ */
+#ifndef PJSIP_AUTH_SRV_CACHE_TTL
+#   define PJSIP_AUTH_SRV_CACHE_TTL	    300
+#endif
+
+
 /**
  * Maximum number of stale retries when server keeps rejecting our request
  * with stale=true.
@@ -235,6 +235,13 @@ PJ_BEGIN_DECL
  * application.
  */
 #define PJSIP_ETPNOTAVAIL	(PJSIP_ERRNO_START_PJSIP + 65)	/* 171065 */
+/**
+ * @hideinitializer
+ * Transport is busy. This error occurs when the number of messages
+ * waiting to be sent on the transport has reached the limit set in
+ * \a max_pending_tx setting of #pjsip_cfg_t.
+ */
+#define PJSIP_ETPBUSY		(PJSIP_ERRNO_START_PJSIP + 66)	/* 171066 */
 
 /************************************************************
  * TRANSACTION ERRORS
@@ -933,6 +933,77 @@ PJ_INLINE(void) pjsip_msg_insert_first_hdr( pjsip_msg *msg, pjsip_hdr *hdr )
 PJ_DECL(pj_ssize_t) pjsip_msg_print(const pjsip_msg *msg, 
 				    char *buf, pj_size_t size);
 
+/**
+ * Location of a header in a printed message.
+ */
+typedef struct pjsip_msg_print_span
+{
+    const pjsip_hdr *hdr;	/**< The header.			    */
+    unsigned	     offset;	/**< Offset of the header in the buffer.    */
+    int		     len;	/**< Printed length including CRLF, or
+				     negative if the header has changed.    */
+} pjsip_msg_print_span;
+
+/**
+ * This structure records where each header of a message was printed by
+ * #pjsip_msg_print2(), so that the next print of the same message only
+ * needs to print the headers that were added or have changed, and can
+ * copy everything else from the previous print.
+ *
+ * Application must initialize this structure with zero before first use.
+ */
+typedef struct pjsip_msg_print_cache
+{
+    const char		 *buf;	    /**< Buffer of the last print, or NULL
+					 if the cache is empty.		    */
+    unsigned		  cnt;	    /**< Number of headers in \a span.	    */
+    unsigned		  max;	    /**< Capacity of \a span and \a spare.  */
+    pjsip_msg_print_span *span;	    /**< Headers of the last print.	    */
+    pjsip_msg_print_span *spare;    /**< Scratch array for the next print.  */
+    const pjsip_msg_body *body;	    /**< Body of the last print.	    */
+    unsigned		  body_off; /**< Offset of the body part, starting
+					 with Content-Type header.	    */
+    unsigned		  body_len; /**< Length of the body part.	    */
+} pjsip_msg_print_cache;
+
+/**
+ * Print the message to the specified buffer, reusing the headers from the
+ * previous print recorded in the cache. A header is copied from the
+ * previous print if it is still present in the message and it has not
+ * been marked with #pjsip_msg_print_cache_invalidate_hdr(); all other
+ * headers, and the start line, are printed. The message body is copied
+ * if the message still refers to the same body.
+ *
+ * On return, the cache describes the new print in \a buf. The previous
+ * buffer is no longer referenced and may be reused by the caller for the
+ * next print.
+ *
+ * @param msg	The message to print.
+ * @param buf	The buffer, which must not be the buffer of the previous
+ *		print in the cache.
+ * @param size	The size of the buffer.
+ * @param pool	Pool to allocate the cache's header table.
+ * @param cache	The print cache.
+ *
+ * @return	The length of the printed characters (in bytes), or NEGATIVE
+ *		value if the message is too large for the specified buffer.
+ *		On failure the cache is left unchanged.
+ */
+PJ_DECL(pj_ssize_t) pjsip_msg_print2(const pjsip_msg *msg,
+				     char *buf, pj_size_t size,
+				     pj_pool_t *pool,
+				     pjsip_msg_print_cache *cache);
+
+/**
+ * Mark a header as changed, so that the next #pjsip_msg_print2() prints
+ * it again instead of copying it from the previous print.
+ *
+ * @param cache	The print cache.
+ * @param hdr	The header which has been modified.
+ */
+PJ_DECL(void) pjsip_msg_print_cache_invalidate_hdr(pjsip_msg_print_cache *cache,
+						   const void *hdr);
+
 
 /*
  * Some usefull macros to find common headers.
@@ -1058,6 +1129,86 @@ PJ_DECL(void) pjsip_generic_string_hdr_init2(pjsip_generic_string_hdr *h,
 					     pj_str_t *hvalue);
 
 
+/* **************************************************************************/
+
+/**
+ * Header which value has not been parsed yet. When lazy parsing is enabled
+ * (see \a lazy_parse setting in #pjsip_cfg_t), the parser only parses the
+ * headers that are needed to process every incoming message, and keeps
+ * the other headers as this header type. The header type of this header
+ * is PJSIP_H_OTHER.
+ *
+ * The header is parsed the first time #pjsip_msg_find_hdr(),
+ * #pjsip_msg_find_hdr_by_name() or #pjsip_msg_find_hdr_by_names()
+ * reaches it, and the parsed header then replaces this header in the
+ * message. Printing or cloning this header does not parse it. When the
+ * type that the header will have once parsed is known (\a htype),
+ * #pjsip_msg_find_hdr() only parses the header when looking for that type.
+ *
+ * The first members of this structure are the same as
+ * #pjsip_generic_string_hdr, so it can be accessed as generic string
+ * header too.
+ */
+typedef struct pjsip_lazy_hdr
+{
+    /** Standard header field. */
+    PJSIP_DECL_HDR_MEMBER(struct pjsip_lazy_hdr);
+    /** The unparsed header value. */
+    pj_str_t hvalue;
+    /** Pool to allocate the parsed header from. */
+    pj_pool_t *pool;
+    /** The type of the header once parsed, or PJSIP_H_OTHER if unknown. */
+    pjsip_hdr_e htype;
+} pjsip_lazy_hdr;
+
+
+/**
+ * Create a new instance of unparsed header.
+ *
+ * @param pool	    The pool, which will also be used to allocate the
+ *		    parsed header.
+ * @param hname	    The header name to be assigned to the header, or NULL to
+ *		    assign the header name later.
+ * @param hvalue    Optional string to be assigned as the value.
+ *
+ * @return	    The header.
+ */
+PJ_DECL(pjsip_lazy_hdr*) pjsip_lazy_hdr_create( pj_pool_t *pool,
+						const pj_str_t *hname,
+						const pj_str_t *hvalue);
+
+
+/**
+ * Create a new instance of unparsed header, without duplicating the name
+ * and value. The type of the header once parsed (\a htype) is looked up
+ * from the header name.
+ *
+ * @param pool	    The pool, which will also be used to allocate the
+ *		    parsed header.
+ * @param hname	    The header name, which will be referenced as is.
+ * @param hvalue    The header value, which will be referenced as is.
+ *
+ * @return	    The header.
+ */
+PJ_DECL(pjsip_lazy_hdr*) pjsip_lazy_hdr_create2( pj_pool_t *pool,
+						 pj_str_t *hname,
+						 pj_str_t *hvalue);
+
+
+/**
+ * Parse the header if it is an unparsed header (#pjsip_lazy_hdr) which is
+ * in a header list, and replace it with the parsed header(s) in the list.
+ * If the value can't be parsed, the header is converted into a generic
+ * string header.
+ *
+ * @param hdr	    The header.
+ *
+ * @return	    The first parsed header, or the header itself if it is
+ *		    not an unparsed header.
+ */
+PJ_DECL(pjsip_hdr*) pjsip_lazy_hdr_parse( pjsip_hdr *hdr );
+
+
 /* **************************************************************************/
 
 /**
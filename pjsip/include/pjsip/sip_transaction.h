@@ -28,6 +28,7 @@
 #include <pjsip/sip_msg.h>
 #include <pjsip/sip_util.h>
 #include <pjsip/sip_transport.h>
+#include <pj/objpool.h>
 #include <pj/timer.h>
 
 PJ_BEGIN_DECL
@@ -73,6 +74,19 @@ typedef enum pjsip_tsx_state_e
 } pjsip_tsx_state_e;
 
 
+/**
+ * This structure describes the node by which a transaction is kept in the
+ * retransmission schedule of the transaction layer. It is used internally
+ * by the transaction layer.
+ */
+typedef struct pjsip_tsx_retrans_node
+{
+    PJ_DECL_LIST_MEMBER(struct pjsip_tsx_retrans_node);	/**< List member. */
+    struct pjsip_transaction   *tsx;	/**< The transaction.		    */
+    unsigned			due;	/**< Sweep tick when it is due.	    */
+} pjsip_tsx_retrans_node;
+
+
 /**
  * This structure describes SIP transaction object. The transaction object
  * is used to handle both UAS and UAC transaction.
@@ -83,13 +97,11 @@ struct pjsip_transaction
      * Administrivia
      */
     pj_pool_t		       *pool;           /**< Pool owned by the tsx. */
+    pj_objpool_t	       *objpool;	/**< Allocator of the tsx.  */
     pjsip_module	       *tsx_user;	/**< Transaction user.	    */
     pjsip_endpoint	       *endpt;          /**< Endpoint instance.     */
     pj_bool_t			terminating;	/**< terminate() was called */
     pj_grp_lock_t	       *grp_lock;       /**< Transaction grp lock.  */
-    pj_mutex_t		       *mutex_b;	/**< Second mutex to avoid
-						     deadlock. It is used to
-						     protect timer.	    */
 
     /*
      * Transaction identification.
@@ -99,6 +111,8 @@ struct pjsip_transaction
     pjsip_method		method;         /**< The method.            */
     pj_int32_t			cseq;           /**< The CSeq               */
     pj_str_t			transaction_key;/**< Hash table key.        */
+    char			key_buf[PJSIP_TSX_KEY_BUF_LEN]; /**< Key
+						     storage.		    */
     pj_uint32_t			hashed_key;	/**< Key's hashed value.    */
     pj_str_t			branch;         /**< The branch Id.         */
 
@@ -137,6 +151,7 @@ struct pjsip_transaction
     pjsip_tx_data	       *last_tx;        /**< Msg kept for retrans.  */
     int				retransmit_count;/**< Retransmission count. */
     pj_timer_entry		retransmit_timer;/**< Retransmit timer.     */
+    pjsip_tsx_retrans_node	retrans_node;	/**< Retransmit schedule.   */
     pj_timer_entry		timeout_timer;  /**< Timeout timer.         */
 
     /** Module specific data. */
@@ -311,12 +311,19 @@ struct pjsip_rx_data
 	/** Time when the message was received. */
 	pj_time_val		 timestamp;
 
-	/** Pointer to the original packet. */
+	/** Pointer to the original packet, unless \a ext_packet is set. */
 	char			 packet[PJSIP_MAX_PKT_LEN];
 
 	/** Zero termination for the packet. */
 	pj_uint32_t		 zero;
 
+	/** Buffer holding the packet instead of \a packet, or NULL. Stream
+	 *  transports receive into a buffer of PJSIP_MAX_STREAM_RX_LEN bytes
+	 *  (plus one for the zero termination), so that messages larger
+	 *  than PJSIP_MAX_PKT_LEN can be received.
+	 */
+	char			*ext_packet;
+
 	/** The length of the packet received. */
 	pj_ssize_t		 len;
 
@@ -628,6 +635,19 @@ struct pjsip_tx_data
      */
     pjsip_host_port          via_addr;      /**< Via address.	        */
     const void              *via_tp;        /**< Via transport.	        */
+
+    /**
+     * Location of the headers in \a buf, used by #pjsip_tx_data_encode()
+     * to only re-print the headers invalidated with
+     * #pjsip_tx_data_invalidate_hdr(). Application should not use or
+     * access this field.
+     */
+    pjsip_msg_print_cache    print_cache;
+
+    /** Second print buffer, used when the message is re-encoded from
+     *  \a print_cache. The two buffers are swapped on every re-encode.
+     */
+    char		    *print_buf;
 };
 
 
@@ -697,6 +717,24 @@ PJ_DECL(pj_bool_t) pjsip_tx_data_is_valid( pjsip_tx_data *tdata );
  */
 PJ_DECL(void) pjsip_tx_data_invalidate_msg( pjsip_tx_data *tdata );
 
+/**
+ * Invalidate the print buffer after a single header of the message has
+ * been modified. Unlike #pjsip_tx_data_invalidate_msg(), the next encoding
+ * of the message only re-prints this header, the start line, and the
+ * headers that have been added since the message was last printed; other
+ * headers and the message body are copied from the previous print.
+ *
+ * Headers may be added to or removed from the message freely, but any
+ * other header modified in place must be invalidated with this function
+ * too. If the message body has been modified in place, use
+ * #pjsip_tx_data_invalidate_msg() instead.
+ *
+ * @param tdata	    The transmit buffer.
+ * @param hdr	    The header which has been modified.
+ */
+PJ_DECL(void) pjsip_tx_data_invalidate_hdr( pjsip_tx_data *tdata,
+					    const void *hdr );
+
 /**
  * Get short printable info about the transmit data. This will normally return
  * short information about the message.
@@ -768,6 +806,63 @@ typedef enum pjsip_transport_dir
 } pjsip_transport_dir;
 
 
+/**
+ * Running statistics of the size of SIP messages and of the pool memory
+ * used to process them. The transport manager keeps these for received
+ * and transmitted messages, and uses them to choose the initial size of
+ * rdata and tdata pools (see #PJSIP_POOL_ADAPTIVE_SIZE). The histograms
+ * are halved from time to time, so they follow changes in the traffic.
+ *
+ * The statistics are updated without locking, so the numbers may be
+ * slightly off when several threads process messages at the same time.
+ */
+typedef struct pjsip_tp_size_stat
+{
+    /** Number of messages counted in the histograms. */
+    unsigned	count;
+
+    /** Histogram of the message sizes. Bin n counts the messages of
+     *  less than (n+1)*PJSIP_TP_SIZE_STAT_BIN_LEN bytes. */
+    unsigned	msg_len[PJSIP_TP_SIZE_STAT_BINS];
+
+    /** Histogram of the pool memory used per message, with the same
+     *  bins as \a msg_len. */
+    unsigned	pool_used[PJSIP_TP_SIZE_STAT_BINS];
+
+} pjsip_tp_size_stat;
+
+
+/**
+ * Add a message to the size statistics.
+ *
+ * @param stat		The statistics.
+ * @param msg_len	The size of the message.
+ * @param pool_used	The pool memory used to process the message.
+ */
+PJ_DECL(void) pjsip_tp_size_stat_add(pjsip_tp_size_stat *stat,
+				     pj_size_t msg_len,
+				     pj_size_t pool_used);
+
+/**
+ * Get the initial pool size that is large enough to process most of the
+ * messages counted in the statistics without allocating more memory
+ * blocks.
+ *
+ * @param stat		The statistics.
+ * @param reserved	Size of other data that will be allocated from the
+ *			pool, e.g. the rdata structure itself.
+ * @param def_size	The size to return when there are too few messages
+ *			in the statistics, or when #PJSIP_POOL_ADAPTIVE_SIZE
+ *			is disabled.
+ *
+ * @return		The pool size.
+ */
+PJ_DECL(pj_size_t) pjsip_tp_size_stat_get_pool_size(
+					const pjsip_tp_size_stat *stat,
+					pj_size_t reserved,
+					pj_size_t def_size);
+
+
 /**
  * This structure represent the "public" interface of a SIP transport.
  * Applications normally extend this structure to include transport
@@ -806,6 +901,12 @@ struct pjsip_transport
 
     void		   *data;	    /**< Internal transport data.   */
 
+    pj_atomic_t		   *pending_tx;	    /**< Messages being sent.	    */
+    pjsip_transport	   *pool_next;	    /**< Next connection to the same
+						 destination, managed by
+						 transport manager.	    */
+    pjsip_tp_size_stat	    rx_size_stat;   /**< Sizes of received messages.*/
+
     /**
      * Function to be called by transport manager to send SIP message.
      *
@@ -939,6 +1040,18 @@ PJ_DECL(pj_status_t) pjsip_transport_add_ref( pjsip_transport *tp );
  */
 PJ_DECL(pj_status_t) pjsip_transport_dec_ref( pjsip_transport *tp );
 
+/**
+ * Get the number of messages that have been submitted to the transport
+ * with #pjsip_transport_send() and are still waiting to be sent.
+ * Application may use this to detect a congested transport, see also
+ * \a max_pending_tx setting in #pjsip_cfg_t.
+ *
+ * @param tp		The transport instance.
+ *
+ * @return		Number of pending messages.
+ */
+PJ_DECL(unsigned) pjsip_transport_get_pending_tx( pjsip_transport *tp );
+
 
 /**
  * This function is called by transport instances to report an incoming 
@@ -1214,6 +1327,38 @@ PJ_DECL(pj_status_t) pjsip_tpmgr_find_local_addr2(pjsip_tpmgr *tpmgr,
 PJ_DECL(unsigned) pjsip_tpmgr_get_transport_count(pjsip_tpmgr *mgr);
 
 
+/**
+ * Get the size statistics of the messages received and transmitted by all
+ * transports of the transport manager. The statistics of the messages
+ * received by a single transport are in its \a rx_size_stat member.
+ *
+ * @param mgr	    The transport manager.
+ * @param rx_stat   Optional argument to receive the statistics of the
+ *		    received messages.
+ * @param tx_stat   Optional argument to receive the statistics of the
+ *		    transmitted messages.
+ *
+ * @return	    PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_tpmgr_get_size_stat(pjsip_tpmgr *mgr,
+					       pjsip_tp_size_stat *rx_stat,
+					       pjsip_tp_size_stat *tx_stat);
+
+/**
+ * Get the initial size of a new rdata pool, based on the statistics of
+ * the messages received by all transports. Transports call this when
+ * they create the pool for a receive buffer.
+ *
+ * @param mgr	    The transport manager.
+ * @param reserved  Size of other data that the transport will allocate
+ *		    from the pool, e.g. the rdata structure itself.
+ *
+ * @return	    The pool size.
+ */
+PJ_DECL(pj_size_t) pjsip_tpmgr_get_rdata_pool_size(pjsip_tpmgr *mgr,
+						   pj_size_t reserved);
+
+
 /**
  * Destroy a transport manager. Normally application doesn't need to call
  * this function directly, since a transport manager will be created and
@@ -1383,6 +1528,90 @@ PJ_DECL(pj_status_t) pjsip_tpmgr_send_raw(pjsip_tpmgr *mgr,
 					  pjsip_tp_send_callback cb);
 
 
+/**
+ * This structure describes an incoming OPTIONS or REGISTER request which
+ * is offered to the fast response callback of the transport manager (see
+ * #pjsip_tpmgr_set_fast_req_cb()). The request has not been parsed, the
+ * strings point to the header values in the received packet and are only
+ * valid during the callback.
+ */
+typedef struct pjsip_tp_fast_req
+{
+    /**
+     * The receive data. Only the \a tp_info and \a pkt_info parts are
+     * initialized.
+     */
+    pjsip_rx_data	*rdata;
+
+    /** The request method, either OPTIONS or REGISTER. */
+    pjsip_method	 method;
+
+    /** The Request-URI. */
+    pj_str_t		 req_uri;
+
+    /** The value of the From header. */
+    pj_str_t		 from;
+
+    /** The value of the To header. */
+    pj_str_t		 to;
+
+    /** The value of the Call-ID header. */
+    pj_str_t		 call_id;
+
+    /** The value of the CSeq header. */
+    pj_str_t		 cseq;
+
+    /** The value of the Contact header, or empty if it's not present. */
+    pj_str_t		 contact;
+
+    /** The value of the Expires header, or -1 if it's not present. */
+    int			 expires;
+
+} pjsip_tp_fast_req;
+
+
+/**
+ * Type of callback to decide whether an incoming request is answered by
+ * the fast response path of the transport manager.
+ *
+ * @param mgr	    The transport manager.
+ * @param req	    The request.
+ *
+ * @return	    The final status code to respond the request with, or
+ *		    zero to process the request normally.
+ */
+typedef int (*pjsip_tp_on_rx_fast_req)(pjsip_tpmgr *mgr,
+				       const pjsip_tp_fast_req *req);
+
+
+/**
+ * Set the callback of the fast response path. Large numbers of OPTIONS
+ * pings and keep-alive REGISTER refreshes can be answered statelessly
+ * without parsing the message, creating a transaction or a response
+ * message. When the callback is set, the transport manager scans the
+ * headers of incoming OPTIONS and REGISTER requests and offers them to
+ * the callback before the message is parsed. If the callback returns a
+ * status code, the response is built from the Via, From, To, Call-ID and
+ * CSeq headers of the request, in a buffer which is reused by each
+ * thread, and sent as raw data on the receiving transport. A successful
+ * response to REGISTER also echoes the Contact (unless it is "*") and
+ * Expires headers of the request. The request
+ * is not passed to the endpoint, so modules such as the message logger
+ * won't see it.
+ *
+ * Requests which can't be handled this way, for example because they
+ * have folded headers, or are received over datagram transport without
+ * the rport parameter in the top Via, are always processed normally.
+ *
+ * @param mgr	    The transport manager.
+ * @param cb	    The callback, or NULL to disable the fast response path.
+ *
+ * @return	    PJ_SUCCESS on success, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pjsip_tpmgr_set_fast_req_cb(pjsip_tpmgr *mgr,
+						 pjsip_tp_on_rx_fast_req cb);
+
+
 /**
  * Enumeration of transport state types.
  */
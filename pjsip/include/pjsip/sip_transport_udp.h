@@ -59,6 +59,89 @@ enum
 };
 
 
+/**
+ * Settings to be specified when creating the UDP transport with
+ * #pjsip_udp_transport_start2(). Application should initialize this
+ * structure with its default values by calling
+ * pjsip_udp_transport_cfg_default().
+ */
+typedef struct pjsip_udp_transport_cfg
+{
+    /**
+     * Address family to use. Valid values are pj_AF_INET() and
+     * pj_AF_INET6(). Default is pj_AF_INET().
+     */
+    int			af;
+
+    /**
+     * Optional address to bind the socket to. Default is to bind to 
+     * PJ_INADDR_ANY and to any available port.
+     */
+    pj_sockaddr		bind_addr;
+
+    /**
+     * Optional published address, which is the address to be
+     * advertised as the address of this SIP transport. 
+     * By default the bound address will be used as the published address.
+     */
+    pjsip_host_port	addr_name;
+
+    /**
+     * Number of simultaneous asynchronous read operations for each
+     * socket of the transport.
+     *
+     * Default: 1
+     */
+    unsigned		async_cnt;
+
+    /**
+     * Number of sockets to be opened on the bound address. When this is
+     * greater than one, all the sockets are bound with SO_REUSEPORT and
+     * the kernel distributes incoming datagrams among them. Each socket
+     * has its own ioqueue key and \a async_cnt receive buffers, while the
+     * transport manager still sees a single transport, which sends
+     * outgoing messages through the first socket. If the platform does
+     * not support SO_REUSEPORT, only one socket will be opened.
+     *
+     * Default: PJSIP_UDP_TRANSPORT_SOCK_CNT
+     */
+    unsigned		sock_cnt;
+
+} pjsip_udp_transport_cfg;
+
+
+/**
+ * Initialize pjsip_udp_transport_cfg structure with default values for
+ * the specifed address family.
+ *
+ * @param cfg		The structure to initialize.
+ * @param af		Address family to be used.
+ */
+PJ_DECL(void) pjsip_udp_transport_cfg_default(pjsip_udp_transport_cfg *cfg,
+					      int af);
+
+
+/**
+ * Start UDP transport with the specified settings. This is the most
+ * flexible variant to start a UDP transport, and it is the only one that
+ * allows opening multiple SO_REUSEPORT sockets for the transport.
+ *
+ * @param endpt		The SIP endpoint.
+ * @param cfg		UDP transport settings. Application should
+ *			initialize this setting with
+ *			#pjsip_udp_transport_cfg_default().
+ * @param p_transport	Pointer to receive the transport.
+ *
+ * @return		PJ_SUCCESS when the transport has been successfully
+ *			started and registered to transport manager, or
+ *			the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pjsip_udp_transport_start2(
+					pjsip_endpoint *endpt,
+					const pjsip_udp_transport_cfg *cfg,
+					pjsip_transport **p_transport);
+
+
 /**
  * Start UDP transport.
  *
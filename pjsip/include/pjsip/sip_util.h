@@ -783,6 +783,29 @@ PJ_DECL(pj_status_t) pjsip_endpt_send_request( pjsip_endpoint *endpt,
  * @{
  */
 
+/**
+ * Option flags for #pjsip_endpt_create_request_fwd() and
+ * #pjsip_endpt_create_response_fwd().
+ */
+typedef enum pjsip_fwd_option
+{
+    /**
+     * Build the message from the packet received in rdata instead of
+     * cloning the parsed message. Only the headers changed by forwarding
+     * (the top-most Via and Max-Forwards) are created. Other header lines
+     * are kept as unparsed headers (#pjsip_lazy_hdr) which refer to a copy
+     * of the packet, so they are printed back as they were received and
+     * are only parsed when application looks them up. The message body
+     * refers to the same copy.
+     *
+     * If the packet can't be spliced this way (for example it contains
+     * folded header lines), the message is cloned as usual.
+     */
+    PJSIP_FWD_SPLICE = 1
+
+} pjsip_fwd_option;
+
+
 /**
  * Create new request message to be forwarded upstream to new destination URI 
  * in uri. The new request is a full/deep clone of the request received in 
@@ -803,7 +826,8 @@ PJ_DECL(pj_status_t) pjsip_endpt_send_request( pjsip_endpoint *endpt,
  *		    detection. If the branch parameter is not specified,
  *		    this function will generate its own by calling 
  *		    #pjsip_calculate_branch_id() function.
- * @param options   Optional option flags when duplicating the message.
+ * @param options   Optional option flags when duplicating the message
+ *		    (see #pjsip_fwd_option).
  * @param tdata	    The result.
  *
  * @return	    PJ_SUCCESS on success.
@@ -827,7 +851,8 @@ PJ_DECL(pj_status_t) pjsip_endpt_create_request_fwd(pjsip_endpoint *endpt,
  *
  * @param endpt	    The endpoint instance.
  * @param rdata	    The incoming response message.
- * @param options   Optional option flags when duplicate the message.
+ * @param options   Optional option flags when duplicate the message
+ *		    (see #pjsip_fwd_option).
  * @param tdata	    The result
  *
  * @return	    PJ_SUCCESS on success.
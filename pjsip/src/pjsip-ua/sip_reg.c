@@ -890,15 +890,17 @@ static pj_int32_t calculate_response_expiration(const pjsip_regc *regc,
     const pjsip_msg *msg = rdata->msg_info.msg;
     const pjsip_hdr *hdr;
 
-    /* Enumerate all Contact headers in the response */
+    /* Enumerate all Contact headers in the response. Use
+     * pjsip_msg_find_hdr() so that Contact headers which parsing has
+     * been deferred (lazy parsing) are parsed too.
+     */
     *contact_cnt = 0;
-    for (hdr=msg->hdr.next; hdr!=&msg->hdr; hdr=hdr->next) {
-	if (hdr->type == PJSIP_H_CONTACT && 
-	    *contact_cnt < max_contact) 
-	{
-	    contacts[*contact_cnt] = (pjsip_contact_hdr*)hdr;
-	    ++(*contact_cnt);
-	}
+    hdr = (const pjsip_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, NULL);
+    while (hdr && *contact_cnt < max_contact) {
+	contacts[*contact_cnt] = (pjsip_contact_hdr*)hdr;
+	++(*contact_cnt);
+	hdr = (const pjsip_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT,
+						    hdr->next);
     }
 
     if (regc->current_op == REGC_REGISTERING) {
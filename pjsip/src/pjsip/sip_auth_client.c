@@ -50,6 +50,10 @@
 #define PASSWD_MASK	    0x000F
 #define EXT_MASK	    0x00F0
 
+/* Whether to send authorization proactively in subsequent requests. */
+#define AUTO_SEND_NEXT(sess)	(PJSIP_AUTH_AUTO_SEND_NEXT || \
+				 (sess)->pref.auto_send_next)
+
 
 static void dup_bin(pj_pool_t *pool, pj_str_t *dst, const pj_str_t *src)
 {
@@ -135,6 +139,31 @@ static void digest2str(const unsigned char digest[], char *output)
 }
 
 
+/* Create HA1 of plain password credential.
+ * output must be at least PJSIP_MD5STRLEN bytes.
+ */
+static void create_ha1(const pj_str_t *realm,
+		       const pjsip_cred_info *cred_info,
+		       char ha1[])
+{
+    unsigned char digest[16];
+    pj_md5_context pms;
+
+    /***
+     *** ha1 = MD5(username ":" realm ":" password)
+     ***/
+    pj_md5_init(&pms);
+    MD5_APPEND( &pms, cred_info->username.ptr, cred_info->username.slen);
+    MD5_APPEND( &pms, ":", 1);
+    MD5_APPEND( &pms, realm->ptr, realm->slen);
+    MD5_APPEND( &pms, ":", 1);
+    MD5_APPEND( &pms, cred_info->data.ptr, cred_info->data.slen);
+    pj_md5_final(&pms, digest);
+
+    digest2str(digest, ha1);
+}
+
+
 /*
  * Create response digest based on the parameters and store the
  * digest ASCII in 'result'.
@@ -159,18 +188,7 @@ PJ_DEF(void) pjsip_auth_create_digest( pj_str_t *result,
     AUTH_TRACE_((THIS_FILE, "Begin creating digest"));
 
     if ((cred_info->data_type & PASSWD_MASK) == PJSIP_CRED_DATA_PLAIN_PASSWD) {
-	/***
-	 *** ha1 = MD5(username ":" realm ":" password)
-	 ***/
-	pj_md5_init(&pms);
-	MD5_APPEND( &pms, cred_info->username.ptr, cred_info->username.slen);
-	MD5_APPEND( &pms, ":", 1);
-	MD5_APPEND( &pms, realm->ptr, realm->slen);
-	MD5_APPEND( &pms, ":", 1);
-	MD5_APPEND( &pms, cred_info->data.ptr, cred_info->data.slen);
-	pj_md5_final(&pms, digest);
-
-	digest2str(digest, ha1);
+	create_ha1(realm, cred_info, ha1);
 
     } else if ((cred_info->data_type & PASSWD_MASK) == PJSIP_CRED_DATA_DIGEST) {
 	pj_assert(cred_info->data.slen == 32);
@@ -273,9 +291,11 @@ static pj_status_t respond_digest( pj_pool_t *pool,
 				   const pjsip_cred_info *cred_info,
 				   const pj_str_t *cnonce,
 				   pj_uint32_t nc,
-				   const pj_str_t *method)
+				   const pj_str_t *method,
+				   pjsip_cached_auth *cached_auth)
 {
     const pj_str_t pjsip_AKAv1_MD5_STR = { "AKAv1-MD5", 9 };
+    pjsip_cred_info ha1_cred;
 
     /* Check algorithm is supported. We support MD5 and AKAv1-MD5. */
     if (chal->algorithm.slen==0 ||
@@ -302,6 +322,26 @@ static pj_status_t respond_digest( pj_pool_t *pool,
     cred->response.ptr = (char*) pj_pool_alloc(pool, PJSIP_MD5STRLEN);
     cred->response.slen = PJSIP_MD5STRLEN;
 
+    /* Use the HA1 cached in the session instead of hashing the plain
+     * password again.
+     */
+    if (cached_auth &&
+	(cred_info->data_type & EXT_MASK) != PJSIP_CRED_DATA_EXT_AKA &&
+	(cred_info->data_type & PASSWD_MASK) == PJSIP_CRED_DATA_PLAIN_PASSWD &&
+	pj_strcmp(&cached_auth->realm, &chal->realm) == 0)
+    {
+	if (cached_auth->ha1_cred != cred_info) {
+	    create_ha1(&chal->realm, cred_info, cached_auth->ha1);
+	    cached_auth->ha1_cred = cred_info;
+	}
+
+	pj_memcpy(&ha1_cred, cred_info, sizeof(ha1_cred));
+	ha1_cred.data_type = PJSIP_CRED_DATA_DIGEST;
+	ha1_cred.data.ptr = cached_auth->ha1;
+	ha1_cred.data.slen = PJSIP_MD5STRLEN;
+	cred_info = &ha1_cred;
+    }
+
     if (chal->qop.slen == 0) {
 	/* Server doesn't require quality of protection. */
 
@@ -359,10 +399,14 @@ static pj_status_t respond_digest( pj_pool_t *pool,
  */
 static void update_digest_session( pj_pool_t *ses_pool,
 				   pjsip_cached_auth *cached_auth,
-				   const pjsip_www_authenticate_hdr *hdr )
+				   const pjsip_www_authenticate_hdr *hdr,
+				   pj_bool_t auto_send_next )
 {
     if (hdr->challenge.digest.qop.slen == 0) {
-#if PJSIP_AUTH_AUTO_SEND_NEXT!=0
+	/* The last challenge is only needed to send the next request */
+	if (!auto_send_next)
+	    return;
+
 	if (!cached_auth->last_chal || pj_stricmp2(&hdr->scheme, "digest")) {
 	    cached_auth->last_chal = (pjsip_www_authenticate_hdr*)
 				     pjsip_hdr_clone(ses_pool, hdr);
@@ -385,7 +429,6 @@ static void update_digest_session( pj_pool_t *ses_pool,
 				         pjsip_hdr_clone(ses_pool, hdr);
 	    }
 	}
-#endif
 	return;
     }
 
@@ -596,6 +639,15 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_set_credentials( pjsip_auth_clt_sess *sess,
 	sess->cred_cnt = cred_cnt;
     }
 
+    /* Forget HA1 of the previous credentials */
+    {
+	pjsip_cached_auth *auth = sess->cached_auth.next;
+	while (auth != &sess->cached_auth) {
+	    auth->ha1_cred = NULL;
+	    auth = auth->next;
+	}
+    }
+
     return PJ_SUCCESS;
 }
 
@@ -641,6 +693,7 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
 				 const pjsip_method *method,
 				 pj_pool_t *sess_pool,
 				 pjsip_cached_auth *cached_auth,
+				 pj_bool_t auto_send_next,
 				 pjsip_authorization_hdr **p_h_auth)
 {
     pjsip_authorization_hdr *hauth;
@@ -691,7 +744,8 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
 #	if PJSIP_AUTH_QOP_SUPPORT
 	{
 	    if (cached_auth) {
-		update_digest_session( sess_pool, cached_auth, hdr );
+		update_digest_session( sess_pool, cached_auth, hdr,
+				       auto_send_next );
 
 		cnonce = &cached_auth->cnonce;
 		nc = cached_auth->nc;
@@ -702,7 +756,7 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
 	hauth->scheme = pjsip_DIGEST_STR;
 	status = respond_digest( pool, &hauth->credential.digest,
 				 &hdr->challenge.digest, &uri_str, cred_info,
-				 cnonce, nc, &method->name);
+				 cnonce, nc, &method->name, cached_auth);
 	if (status != PJ_SUCCESS)
 	    return status;
 
@@ -748,11 +802,9 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
 	    }
 	}
 
-#	if defined(PJSIP_AUTH_AUTO_SEND_NEXT) && PJSIP_AUTH_AUTO_SEND_NEXT!=0
-	    if (hdr != cached_auth->last_chal) {
+	    if (auto_send_next && hdr != cached_auth->last_chal) {
 		cached_auth->last_chal = pjsip_hdr_clone(sess_pool, hdr);
 	    }
-#	endif
     }
 #   endif
 
@@ -762,7 +814,6 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
 }
 
 
-#if defined(PJSIP_AUTH_AUTO_SEND_NEXT) && PJSIP_AUTH_AUTO_SEND_NEXT!=0
 static pj_status_t new_auth_for_req( pjsip_tx_data *tdata,
 				     pjsip_auth_clt_sess *sess,
 				     pjsip_cached_auth *auth,
@@ -782,18 +833,15 @@ static pj_status_t new_auth_for_req( pjsip_tx_data *tdata,
     status = auth_respond( tdata->pool, auth->last_chal,
 			   tdata->msg->line.req.uri,
 			   cred, &tdata->msg->line.req.method,
-			   sess->pool, auth, &hauth);
+			   sess->pool, auth, PJ_TRUE, &hauth);
     if (status != PJ_SUCCESS)
 	return status;
 
-    pjsip_msg_add_hdr( tdata->msg, (pjsip_hdr*)hauth);
-
     if (p_h_auth)
 	*p_h_auth = hauth;
 
     return PJ_SUCCESS;
 }
-#endif
 
 
 /* Find credential in list of (Proxy-)Authorization headers */
@@ -835,6 +883,8 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_init_req( pjsip_auth_clt_sess *sess,
 
     auth = sess->cached_auth.next;
     while (auth != &sess->cached_auth) {
+	pjsip_authorization_hdr *hauth = NULL;
+
 	/* Reset stale counter */
 	auth->stale_cnt = 0;
 
@@ -845,40 +895,26 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_init_req( pjsip_auth_clt_sess *sess,
 		pjsip_cached_auth_hdr *entry = auth->cached_hdr.next;
 		while (entry != &auth->cached_hdr) {
 		    if (pjsip_method_cmp(&entry->method, method)==0) {
-			pjsip_authorization_hdr *hauth;
 			hauth = pjsip_hdr_shallow_clone(tdata->pool, entry->hdr);
-			//pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr*)hauth);
-			pj_list_push_back(&added, hauth);
 			break;
 		    }
 		    entry = entry->next;
 		}
-
-#		if defined(PJSIP_AUTH_AUTO_SEND_NEXT) && \
-			   PJSIP_AUTH_AUTO_SEND_NEXT!=0
-		{
-		    if (entry == &auth->cached_hdr)
-			new_auth_for_req( tdata, sess, auth, NULL);
-		}
-#		endif
-
-	    }
-#	    elif defined(PJSIP_AUTH_AUTO_SEND_NEXT) && \
-		 PJSIP_AUTH_AUTO_SEND_NEXT!=0
-	    {
-		new_auth_for_req( tdata, sess, auth, NULL);
 	    }
 #	    endif
 
+	    if (!hauth && AUTO_SEND_NEXT(sess) && auth->last_chal)
+		new_auth_for_req( tdata, sess, auth, &hauth);
+
 	}
-#	if defined(PJSIP_AUTH_QOP_SUPPORT) && \
-	   defined(PJSIP_AUTH_AUTO_SEND_NEXT) && \
-	   (PJSIP_AUTH_QOP_SUPPORT && PJSIP_AUTH_AUTO_SEND_NEXT)
-	else if (auth->qop_value == PJSIP_AUTH_QOP_AUTH) {
-	    /* For qop="auth", we have to re-create the authorization header.
+#	if defined(PJSIP_AUTH_QOP_SUPPORT) && PJSIP_AUTH_QOP_SUPPORT!=0
+	else if (auth->qop_value == PJSIP_AUTH_QOP_AUTH &&
+		 AUTO_SEND_NEXT(sess))
+	{
+	    /* For qop="auth", we have to re-create the authorization header
+	     * with the next nonce-count.
 	     */
 	    const pjsip_cred_info *cred;
-	    pjsip_authorization_hdr *hauth;
 	    pj_status_t status;
 
 	    cred = auth_find_cred(sess, &auth->realm,
@@ -892,14 +928,14 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_init_req( pjsip_auth_clt_sess *sess,
 				   tdata->msg->line.req.uri,
 				   cred,
 				   &tdata->msg->line.req.method,
-				   sess->pool, auth, &hauth);
+				   sess->pool, auth, PJ_TRUE, &hauth);
 	    if (status != PJ_SUCCESS)
 		return status;
+	}
+#	endif	/* PJSIP_AUTH_QOP_SUPPORT */
 
-	    //pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr*)hauth);
+	if (hauth)
 	    pj_list_push_back(&added, hauth);
-	}
-#	endif	/* PJSIP_AUTH_QOP_SUPPORT && PJSIP_AUTH_AUTO_SEND_NEXT */
 
 	auth = auth->next;
     }
@@ -1070,7 +1106,8 @@ static pj_status_t process_auth( pj_pool_t *req_pool,
     /* Respond to authorization challenge. */
     status = auth_respond( req_pool, hchal, uri, cred,
 			   &tdata->msg->line.req.method,
-			   sess->pool, cached_auth, h_auth);
+			   sess->pool, cached_auth, AUTO_SEND_NEXT(sess),
+			   h_auth);
     return status;
 }
 
@@ -1173,8 +1210,10 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_reinit_req(	pjsip_auth_clt_sess *sess,
      */
     pjsip_restore_strict_route_set(tdata);
 
-    /* Must invalidate the message! */
-    pjsip_tx_data_invalidate_msg(tdata);
+    /* Must invalidate the message! Besides the Via header, only headers
+     * that have been added or removed have changed.
+     */
+    pjsip_tx_data_invalidate_hdr(tdata, via);
 
     /* Retrying.. */
     tdata->auth_retry = PJ_TRUE;
@@ -23,8 +23,224 @@
 #include <pjsip/sip_auth_msg.h>
 #include <pjsip/sip_errno.h>
 #include <pjsip/sip_transport.h>
-#include <pj/string.h>
+#include <pjlib-util/md5.h>
 #include <pj/assert.h>
+#include <pj/ctype.h>
+#include <pj/hash.h>
+#include <pj/list.h>
+#include <pj/os.h>
+#include <pj/pool.h>
+#include <pj/string.h>
+
+
+/* Longest account name to be kept in the credential digest cache. */
+#define CACHE_MAX_NAME_LEN	64
+
+/* Cached credential digest (HA1) of an account. */
+typedef struct cache_entry
+{
+    PJ_DECL_LIST_MEMBER(struct cache_entry);
+    pj_hash_entry_buf	 hbuf;
+    char		 acc_name[CACHE_MAX_NAME_LEN];
+    unsigned		 name_len;
+    char		 ha1[PJSIP_MD5STRLEN];
+    pj_time_val		 expire;
+} cache_entry;
+
+/* Least recently used cache of credential digests. A server only serves
+ * one realm, so the digests are keyed by the account name.
+ */
+struct pjsip_auth_srv_cache
+{
+    pj_hash_table_t	*table;
+    unsigned		 ttl;
+    cache_entry		 lru;		/* Most recently used first.	*/
+    cache_entry		 free_list;
+};
+
+/* Pending asynchronous credential lookup. */
+struct pjsip_auth_lookup_op
+{
+    pjsip_auth_srv	     *auth_srv;
+    pjsip_rx_data	     *rdata;	/* Clone of the request.	    */
+    pjsip_authorization_hdr  *h_auth;	/* Header in the cloned request.    */
+    void		     *token;
+    pjsip_auth_srv_verify_cb *cb;
+    pj_bool_t		      in_lookup;/* Inside the lookup function.	    */
+    pj_bool_t		      completed;
+    pj_status_t		      status;
+    pjsip_cred_info	      cred_info;
+};
+
+
+/* Create the digest cache of the server, and the lock when the cache or
+ * the asynchronous lookup needs it.
+ */
+static pj_status_t init_auth_srv_cache(pj_pool_t *pool,
+				       pjsip_auth_srv *auth_srv,
+				       unsigned cache_size,
+				       unsigned cache_ttl)
+{
+    struct pjsip_auth_srv_cache *cache;
+    cache_entry *entries;
+    unsigned i;
+    pj_status_t status;
+
+    if (cache_size == 0 && !auth_srv->lookup_async)
+	return PJ_SUCCESS;
+
+    status = pj_mutex_create_simple(pool, "authsrv%p", &auth_srv->mutex);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (cache_size == 0)
+	return PJ_SUCCESS;
+
+    cache = PJ_POOL_ZALLOC_T(pool, struct pjsip_auth_srv_cache);
+    cache->table = pj_hash_create(pool, cache_size);
+    cache->ttl = cache_ttl;
+    pj_list_init(&cache->lru);
+    pj_list_init(&cache->free_list);
+
+    entries = (cache_entry*) pj_pool_calloc(pool, cache_size,
+					    sizeof(cache_entry));
+    for (i=0; i<cache_size; ++i)
+	pj_list_push_back(&cache->free_list, &entries[i]);
+
+    auth_srv->cache = cache;
+    return PJ_SUCCESS;
+}
+
+/* Remove an entry from the cache. Must be called with the mutex held. */
+static void cache_erase(struct pjsip_auth_srv_cache *cache, cache_entry *e)
+{
+    pj_hash_set_np(cache->table, e->acc_name, e->name_len, 0, e->hbuf, NULL);
+    pj_list_erase(e);
+    pj_list_push_back(&cache->free_list, e);
+}
+
+/* Get the cached digest of the account in the credential. */
+static pj_bool_t cache_get(pjsip_auth_srv *auth_srv,
+			   const pjsip_digest_credential *dig,
+			   char ha1[])
+{
+    struct pjsip_auth_srv_cache *cache = auth_srv->cache;
+    cache_entry *e;
+    pj_time_val now;
+    pj_bool_t found = PJ_FALSE;
+
+    if (!cache || pj_strcmp(&dig->realm, &auth_srv->realm) != 0 ||
+	dig->username.slen > CACHE_MAX_NAME_LEN)
+    {
+	return PJ_FALSE;
+    }
+
+    pj_gettickcount(&now);
+
+    pj_mutex_lock(auth_srv->mutex);
+
+    e = (cache_entry*) pj_hash_get(cache->table, dig->username.ptr,
+				   (unsigned)dig->username.slen, NULL);
+    if (e && PJ_TIME_VAL_GTE(now, e->expire)) {
+	cache_erase(cache, e);
+    } else if (e) {
+	/* Move to the front of the LRU list */
+	pj_list_erase(e);
+	pj_list_push_front(&cache->lru, e);
+	pj_memcpy(ha1, e->ha1, PJSIP_MD5STRLEN);
+	found = PJ_TRUE;
+    }
+
+    pj_mutex_unlock(auth_srv->mutex);
+
+    return found;
+}
+
+/* Put the digest of the credential in the cache. */
+static void cache_put(pjsip_auth_srv *auth_srv,
+		      const pjsip_cred_info *cred_info)
+{
+    struct pjsip_auth_srv_cache *cache = auth_srv->cache;
+    char ha1[PJSIP_MD5STRLEN];
+    cache_entry *e;
+
+    if (!cache || pj_strcmp(&cred_info->realm, &auth_srv->realm) != 0 ||
+	cred_info->username.slen > CACHE_MAX_NAME_LEN)
+    {
+	return;
+    }
+
+    if (cred_info->data_type == PJSIP_CRED_DATA_PLAIN_PASSWD) {
+	pj_md5_context pms;
+	unsigned char digest[16];
+	unsigned i;
+
+	/* ha1 = MD5(username ":" realm ":" password) */
+	pj_md5_init(&pms);
+	pj_md5_update(&pms, (const pj_uint8_t*)cred_info->username.ptr,
+		      (unsigned)cred_info->username.slen);
+	pj_md5_update(&pms, (const pj_uint8_t*)":", 1);
+	pj_md5_update(&pms, (const pj_uint8_t*)cred_info->realm.ptr,
+		      (unsigned)cred_info->realm.slen);
+	pj_md5_update(&pms, (const pj_uint8_t*)":", 1);
+	pj_md5_update(&pms, (const pj_uint8_t*)cred_info->data.ptr,
+		      (unsigned)cred_info->data.slen);
+	pj_md5_final(&pms, digest);
+
+	for (i=0; i<16; ++i)
+	    pj_val_to_hex_digit(digest[i], ha1 + i*2);
+
+    } else if (cred_info->data_type == PJSIP_CRED_DATA_DIGEST &&
+	       cred_info->data.slen == PJSIP_MD5STRLEN)
+    {
+	pj_memcpy(ha1, cred_info->data.ptr, PJSIP_MD5STRLEN);
+    } else {
+	/* AKA credentials can't be cached */
+	return;
+    }
+
+    pj_mutex_lock(auth_srv->mutex);
+
+    e = (cache_entry*) pj_hash_get(cache->table, cred_info->username.ptr,
+				   (unsigned)cred_info->username.slen, NULL);
+    if (e) {
+	pj_list_erase(e);
+    } else {
+	if (pj_list_empty(&cache->free_list))
+	    cache_erase(cache, cache->lru.prev);
+
+	e = cache->free_list.next;
+	pj_list_erase(e);
+
+	pj_memcpy(e->acc_name, cred_info->username.ptr,
+		  cred_info->username.slen);
+	e->name_len = (unsigned)cred_info->username.slen;
+	pj_hash_set_np(cache->table, e->acc_name, e->name_len, 0, e->hbuf, e);
+    }
+
+    pj_memcpy(e->ha1, ha1, PJSIP_MD5STRLEN);
+    pj_gettickcount(&e->expire);
+    e->expire.sec += cache->ttl;
+    pj_list_push_front(&cache->lru, e);
+
+    pj_mutex_unlock(auth_srv->mutex);
+}
+
+/* Remove the cached digest of the account. */
+static void cache_remove(pjsip_auth_srv *auth_srv, const pj_str_t *acc_name)
+{
+    cache_entry *e;
+
+    if (!auth_srv->cache || acc_name->slen > CACHE_MAX_NAME_LEN)
+	return;
+
+    pj_mutex_lock(auth_srv->mutex);
+    e = (cache_entry*) pj_hash_get(auth_srv->cache->table, acc_name->ptr,
+				   (unsigned)acc_name->slen, NULL);
+    if (e)
+	cache_erase(auth_srv->cache, e);
+    pj_mutex_unlock(auth_srv->mutex);
+}
 
 
 /*
@@ -59,12 +275,46 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_init2(
 				    const pjsip_auth_srv_init_param *param)
 {
     PJ_ASSERT_RETURN(pool && auth_srv && param, PJ_EINVAL);
+    PJ_ASSERT_RETURN(param->lookup2 || param->lookup_async, PJ_EINVAL);
 
     pj_bzero(auth_srv, sizeof(*auth_srv));
     pj_strdup( pool, &auth_srv->realm, param->realm);
     auth_srv->lookup2 = param->lookup2;
+    auth_srv->lookup_async = param->lookup_async;
     auth_srv->is_proxy = (param->options & PJSIP_AUTH_SRV_IS_PROXY);
 
+    return init_auth_srv_cache(pool, auth_srv, param->cache_size,
+			       param->cache_ttl ? param->cache_ttl :
+						  PJSIP_AUTH_SRV_CACHE_TTL);
+}
+
+
+/*
+ * Release the resources held by the server authorization session.
+ */
+PJ_DEF(pj_status_t) pjsip_auth_srv_deinit(pjsip_auth_srv *auth_srv)
+{
+    PJ_ASSERT_RETURN(auth_srv, PJ_EINVAL);
+
+    if (auth_srv->mutex) {
+	pj_mutex_destroy(auth_srv->mutex);
+	auth_srv->mutex = NULL;
+    }
+    auth_srv->cache = NULL;
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Remove the cached credential digest of the account.
+ */
+PJ_DEF(pj_status_t) pjsip_auth_srv_cache_remove(pjsip_auth_srv *auth_srv,
+						const pj_str_t *acc_name)
+{
+    PJ_ASSERT_RETURN(auth_srv && acc_name, PJ_EINVAL);
+
+    cache_remove(auth_srv, acc_name);
     return PJ_SUCCESS;
 }
 
@@ -116,30 +366,18 @@ static pj_status_t pjsip_auth_verify( const pjsip_authorization_hdr *hdr,
 }
 
 
-/*
- * Request the authorization server framework to verify the authorization 
- * information in the specified request in rdata.
- */
-PJ_DEF(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
-					   pjsip_rx_data *rdata,
-					   int *status_code)
+/* Find the Authorization/Proxy-Authorization header for our realm. */
+static pj_status_t find_auth_hdr(pjsip_auth_srv *auth_srv,
+				 const pjsip_msg *msg,
+				 pjsip_authorization_hdr **p_h_auth,
+				 int *status_code)
 {
     pjsip_authorization_hdr *h_auth;
-    pjsip_msg *msg = rdata->msg_info.msg;
     pjsip_hdr_e htype;
-    pj_str_t acc_name;
-    pjsip_cred_info cred_info;
-    pj_status_t status;
-
-    PJ_ASSERT_RETURN(auth_srv && rdata, PJ_EINVAL);
-    PJ_ASSERT_RETURN(msg->type == PJSIP_REQUEST_MSG, PJSIP_ENOTREQUESTMSG);
 
     htype = auth_srv->is_proxy ? PJSIP_H_PROXY_AUTHORIZATION : 
 				 PJSIP_H_AUTHORIZATION;
 
-    /* Initialize status with 200. */
-    *status_code = 200;
-
     /* Find authorization header for our realm. */
     h_auth = (pjsip_authorization_hdr*) pjsip_msg_find_hdr(msg, htype, NULL);
     while (h_auth) {
@@ -161,13 +399,97 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
     }
 
     /* Check authorization scheme. */
-    if (pj_stricmp(&h_auth->scheme, &pjsip_DIGEST_STR) == 0)
-	acc_name = h_auth->credential.digest.username;
-    else {
+    if (pj_stricmp(&h_auth->scheme, &pjsip_DIGEST_STR) != 0) {
 	*status_code = auth_srv->is_proxy ? 407 : 401;
 	return PJSIP_EINVALIDAUTHSCHEME;
     }
 
+    *p_h_auth = h_auth;
+    return PJ_SUCCESS;
+}
+
+
+/* Verify the request against the cached digest of the account, if any. */
+static pj_bool_t verify_cached(pjsip_auth_srv *auth_srv,
+			       const pjsip_authorization_hdr *h_auth,
+			       const pj_str_t *method)
+{
+    const pjsip_digest_credential *dig = &h_auth->credential.digest;
+    char ha1[PJSIP_MD5STRLEN];
+    pjsip_cred_info cred_info;
+
+    if (!cache_get(auth_srv, dig, ha1))
+	return PJ_FALSE;
+
+    pj_bzero(&cred_info, sizeof(cred_info));
+    cred_info.realm = dig->realm;
+    cred_info.scheme = pjsip_DIGEST_STR;
+    cred_info.username = dig->username;
+    cred_info.data_type = PJSIP_CRED_DATA_DIGEST;
+    cred_info.data.ptr = ha1;
+    cred_info.data.slen = PJSIP_MD5STRLEN;
+
+    if (pjsip_auth_verify(h_auth, method, &cred_info) == PJ_SUCCESS)
+	return PJ_TRUE;
+
+    /* The password may have been changed, let the lookup decide */
+    cache_remove(auth_srv, &dig->username);
+    return PJ_FALSE;
+}
+
+
+/* Verify the request against the credential found by the lookup, and
+ * cache the credential digest when it matches.
+ */
+static pj_status_t verify_cred(pjsip_auth_srv *auth_srv,
+			       const pjsip_authorization_hdr *h_auth,
+			       const pj_str_t *method,
+			       const pjsip_cred_info *cred_info,
+			       int *status_code)
+{
+    pj_status_t status;
+
+    status = pjsip_auth_verify(h_auth, method, cred_info);
+    if (status != PJ_SUCCESS) {
+	*status_code = PJSIP_SC_FORBIDDEN;
+	return status;
+    }
+
+    cache_put(auth_srv, cred_info);
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Request the authorization server framework to verify the authorization 
+ * information in the specified request in rdata.
+ */
+PJ_DEF(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
+					   pjsip_rx_data *rdata,
+					   int *status_code)
+{
+    pjsip_authorization_hdr *h_auth;
+    pjsip_msg *msg = rdata->msg_info.msg;
+    pj_str_t acc_name;
+    pjsip_cred_info cred_info;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(auth_srv && rdata, PJ_EINVAL);
+    PJ_ASSERT_RETURN(msg->type == PJSIP_REQUEST_MSG, PJSIP_ENOTREQUESTMSG);
+
+    /* Initialize status with 200. */
+    *status_code = 200;
+
+    status = find_auth_hdr(auth_srv, msg, &h_auth, status_code);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Try the cached credential digest first. */
+    if (verify_cached(auth_srv, h_auth, &msg->line.req.method.name))
+	return PJ_SUCCESS;
+
+    acc_name = h_auth->credential.digest.username;
+
     /* Find the credential information for the account. */
     if (auth_srv->lookup2) {
 	pjsip_auth_lookup_cred_param param;
@@ -181,25 +503,155 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
 	    *status_code = PJSIP_SC_FORBIDDEN;
 	    return status;
 	}
-    } else {
+    } else if (auth_srv->lookup) {
 	status = (*auth_srv->lookup)(rdata->tp_info.pool, &auth_srv->realm,
 				     &acc_name, &cred_info);
 	if (status != PJ_SUCCESS) {
 	    *status_code = PJSIP_SC_FORBIDDEN;
 	    return status;
 	}
+    } else {
+	/* Only asynchronous lookup is available */
+	*status_code = PJSIP_SC_INTERNAL_SERVER_ERROR;
+	return PJ_EINVALIDOP;
     }
 
     /* Authenticate with the specified credential. */
-    status = pjsip_auth_verify(h_auth, &msg->line.req.method.name, 
-			       &cred_info);
+    return verify_cred(auth_srv, h_auth, &msg->line.req.method.name,
+		       &cred_info, status_code);
+}
+
+
+/* Verify the request of a completed asynchronous lookup. */
+static pj_status_t finish_lookup(pjsip_auth_lookup_op *op, int *status_code)
+{
+    if (op->status != PJ_SUCCESS) {
+	*status_code = PJSIP_SC_FORBIDDEN;
+	return op->status;
+    }
+
+    *status_code = 200;
+    return verify_cred(op->auth_srv, op->h_auth,
+		       &op->rdata->msg_info.msg->line.req.method.name,
+		       &op->cred_info, status_code);
+}
+
+
+/*
+ * Verify the authorization information in the request, looking up the
+ * credential asynchronously when it is not cached.
+ */
+PJ_DEF(pj_status_t) pjsip_auth_srv_verify_async(pjsip_auth_srv *auth_srv,
+						pjsip_rx_data *rdata,
+						int *status_code,
+						void *token,
+						pjsip_auth_srv_verify_cb *cb)
+{
+    pjsip_authorization_hdr *h_auth;
+    pjsip_msg *msg = rdata->msg_info.msg;
+    pjsip_rx_data *clone;
+    pjsip_auth_lookup_op *op;
+    pjsip_auth_lookup_cred_param param;
+    pj_bool_t completed;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(auth_srv && rdata && status_code && cb, PJ_EINVAL);
+    PJ_ASSERT_RETURN(msg->type == PJSIP_REQUEST_MSG, PJSIP_ENOTREQUESTMSG);
+
+    if (!auth_srv->lookup_async)
+	return pjsip_auth_srv_verify(auth_srv, rdata, status_code);
+
+    *status_code = 200;
+
+    status = find_auth_hdr(auth_srv, msg, &h_auth, status_code);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (verify_cached(auth_srv, h_auth, &msg->line.req.method.name))
+	return PJ_SUCCESS;
+
+    /* The request must outlive this call, keep a copy of it. */
+    status = pjsip_rx_data_clone(rdata, 0, &clone);
+    if (status != PJ_SUCCESS) {
+	*status_code = PJSIP_SC_INTERNAL_SERVER_ERROR;
+	return status;
+    }
+
+    op = PJ_POOL_ZALLOC_T(clone->tp_info.pool, pjsip_auth_lookup_op);
+    op->auth_srv = auth_srv;
+    op->rdata = clone;
+    op->token = token;
+    op->cb = cb;
+    op->in_lookup = PJ_TRUE;
+    find_auth_hdr(auth_srv, clone->msg_info.msg, &op->h_auth, status_code);
+
+    pj_bzero(&param, sizeof(param));
+    param.realm = auth_srv->realm;
+    param.acc_name = op->h_auth->credential.digest.username;
+    param.rdata = clone;
+    status = (*auth_srv->lookup_async)(&param, op);
+
+    pj_mutex_lock(auth_srv->mutex);
+    op->in_lookup = PJ_FALSE;
+    completed = op->completed;
+    pj_mutex_unlock(auth_srv->mutex);
+
     if (status != PJ_SUCCESS) {
+	pjsip_rx_data_free_cloned(clone);
 	*status_code = PJSIP_SC_FORBIDDEN;
+	return status;
     }
+
+    /* The lookup may have completed already, e.g. from its own cache. */
+    if (!completed)
+	return PJ_EPENDING;
+
+    status = finish_lookup(op, status_code);
+    pjsip_rx_data_free_cloned(clone);
+
     return status;
 }
 
 
+/*
+ * Report the result of an asynchronous credential lookup.
+ */
+PJ_DEF(pj_status_t) pjsip_auth_srv_lookup_complete(
+					pjsip_auth_lookup_op *op,
+					pj_status_t status,
+					const pjsip_cred_info *cred_info)
+{
+    pjsip_auth_srv *auth_srv;
+    pj_bool_t in_lookup;
+    int status_code;
+
+    PJ_ASSERT_RETURN(op && (status != PJ_SUCCESS || cred_info), PJ_EINVAL);
+
+    op->status = status;
+    if (status == PJ_SUCCESS)
+	pjsip_cred_info_dup(op->rdata->tp_info.pool, &op->cred_info,
+			    cred_info);
+
+    auth_srv = op->auth_srv;
+    pj_mutex_lock(auth_srv->mutex);
+    in_lookup = op->in_lookup;
+    op->completed = PJ_TRUE;
+    pj_mutex_unlock(auth_srv->mutex);
+
+    /* Completed from inside the lookup function, the result will be
+     * returned by pjsip_auth_srv_verify_async().
+     */
+    if (in_lookup)
+	return PJ_SUCCESS;
+
+    status = finish_lookup(op, &status_code);
+    (*op->cb)(auth_srv, op->rdata, op->token, status, status_code);
+    pjsip_rx_data_free_cloned(op->rdata);
+
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Add authentication challenge headers to the outgoing response in tdata. 
  * Application may specify its customized nonce and opaque for the challenge, 
@@ -33,7 +33,9 @@ pjsip_cfg_t pjsip_sip_cfg_var =
        PJSIP_DONT_SWITCH_TO_TLS,
        PJSIP_FOLLOW_EARLY_MEDIA_FORK,
        PJSIP_REQ_HAS_VIA_ALIAS,
-       PJSIP_RESOLVE_HOSTNAME_TO_GET_INTERFACE
+       PJSIP_RESOLVE_HOSTNAME_TO_GET_INTERFACE,
+       PJSIP_LAZY_PARSE,
+       PJSIP_RX_WORKER_CNT
     },
 
     /* Transaction settings */
@@ -48,6 +50,14 @@ pjsip_cfg_t pjsip_sip_cfg_var =
     /* Client registration client */
     {
 	PJSIP_REGISTER_CLIENT_CHECK_CONTACT
+    },
+
+    /* Transport settings */
+    {
+	PJSIP_TP_POOL_SIZE,
+	PJSIP_TP_MAX_PENDING_TX,
+	PJSIP_TP_TX_BATCH_SIZE,
+	PJSIP_TP_TX_BATCH_DELAY
     }
 };
 
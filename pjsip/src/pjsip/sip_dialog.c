@@ -1201,8 +1201,8 @@ PJ_DEF(pj_status_t) pjsip_dlg_send_request( pjsip_dialog *dlg,
 
 	ch->cseq = dlg->local.cseq++;
 
-	/* Force the whole message to be re-printed. */
-	pjsip_tx_data_invalidate_msg( tdata );
+	/* Force the CSeq header to be re-printed. */
+	pjsip_tx_data_invalidate_hdr( tdata, ch );
     }
 
     /* Create a new transaction if method is not ACK.
@@ -49,6 +49,29 @@ typedef struct exit_cb
 } exit_cb;
 
 
+/* Incoming message waiting to be processed by a receive worker. */
+typedef struct rx_job
+{
+    PJ_DECL_LIST_MEMBER		    (struct rx_job);
+    pjsip_rx_data		   *rdata;
+} rx_job;
+
+
+/* Receive worker thread. Messages with the same Call-ID are always queued
+ * to the same worker, so they are processed in the order of arrival.
+ */
+typedef struct rx_worker
+{
+    pjsip_endpoint		   *endpt;
+    pj_thread_t			   *thread;
+    pj_sem_t			   *sem;
+    pj_mutex_t			   *mutex;
+    rx_job			    queue;
+    unsigned			    queue_len;
+    pj_bool_t			    quit;
+} rx_worker;
+
+
 /**
  * The SIP endpoint.
  */
@@ -98,6 +121,14 @@ struct pjsip_endpoint
 
     /** List of exit callback. */
     exit_cb		 exit_cb_list;
+
+    /** Number of receive workers. It doesn't change while there are
+     *  transports delivering messages, so it's read without lock.
+     */
+    unsigned		 rx_worker_cnt;
+
+    /** Receive workers. */
+    rx_worker		*rx_worker;
 };
 
 
@@ -116,6 +147,11 @@ struct pjsip_endpoint
  */
 static void endpt_on_rx_msg( pjsip_endpoint*, 
 			     pj_status_t, pjsip_rx_data*);
+static void queue_rx_msg( pjsip_endpoint*, unsigned, pjsip_rx_data*);
+static void process_rx_msg( pjsip_endpoint*, pjsip_rx_data*);
+static pj_status_t start_rx_workers(pjsip_endpoint *endpt, unsigned count);
+static void stop_rx_workers(pjsip_endpoint *endpt);
+static void destroy_rx_workers(pjsip_endpoint *endpt);
 static pj_status_t endpt_on_tx_msg( pjsip_endpoint *endpt,
 				    pjsip_tx_data *tdata );
 static pj_status_t unload_module(pjsip_endpoint *endpt,
@@ -431,6 +467,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_create(pj_pool_factory *pf,
     pj_pool_t *pool;
     pjsip_endpoint *endpt;
     pjsip_max_fwd_hdr *mf_hdr;
+    pj_timer_heap_param timer_param;
     pj_lock_t *lock = NULL;
 
 
@@ -486,18 +523,26 @@ PJ_DEF(pj_status_t) pjsip_endpt_create(pj_pool_factory *pf,
     }
 
     /* Create timer heap to manage all timers within this endpoint. */
-    status = pj_timer_heap_create( endpt->pool, PJSIP_MAX_TIMER_COUNT, 
-                                   &endpt->timer_heap);
+    pj_timer_heap_param_default(&timer_param);
+    timer_param.type = PJSIP_TIMER_HEAP_TYPE;
+    timer_param.shard_cnt = PJSIP_TIMER_HEAP_SHARD_CNT;
+    status = pj_timer_heap_create2( endpt->pool, PJSIP_MAX_TIMER_COUNT, 
+                                    &timer_param, &endpt->timer_heap);
     if (status != PJ_SUCCESS) {
 	goto on_error;
     }
 
-    /* Set recursive lock for the timer heap. */
-    status = pj_lock_create_recursive_mutex( endpt->pool, "edpt%p", &lock);
-    if (status != PJ_SUCCESS) {
-	goto on_error;
+    /* Set recursive lock for the timer heap. Sharded timer heap has
+     * its own lock for each shard.
+     */
+    if (timer_param.shard_cnt <= 1) {
+	status = pj_lock_create_recursive_mutex( endpt->pool, "edpt%p",
+						 &lock);
+	if (status != PJ_SUCCESS) {
+	    goto on_error;
+	}
+	pj_timer_heap_set_lock(endpt->timer_heap, lock, PJ_TRUE);
     }
-    pj_timer_heap_set_lock(endpt->timer_heap, lock, PJ_TRUE);
 
     /* Set maximum timed out entries to process in a single poll. */
     pj_timer_heap_set_max_timed_out_per_poll(endpt->timer_heap, 
@@ -536,16 +581,24 @@ PJ_DEF(pj_status_t) pjsip_endpt_create(pj_pool_factory *pf,
     /* Initialize capability header list. */
     pj_list_init(&endpt->cap_hdr);
 
+    /* Start receive workers. */
+    if (pjsip_cfg()->endpt.rx_worker_cnt) {
+	status = start_rx_workers(endpt, pjsip_cfg()->endpt.rx_worker_cnt);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+    }
 
     /* Done. */
     *p_endpt = endpt;
     return status;
 
 on_error:
+    stop_rx_workers(endpt);
     if (endpt->transport_mgr) {
 	pjsip_tpmgr_destroy(endpt->transport_mgr);
 	endpt->transport_mgr = NULL;
     }
+    destroy_rx_workers(endpt);
     if (endpt->ioqueue) {
 	pj_ioqueue_destroy(endpt->ioqueue);
 	endpt->ioqueue = NULL;
@@ -579,6 +632,9 @@ PJ_DEF(void) pjsip_endpt_destroy(pjsip_endpoint *endpt)
 
     PJ_LOG(5, (THIS_FILE, "Destroying endpoing instance.."));
 
+    /* Process remaining incoming messages and stop receive workers */
+    stop_rx_workers(endpt);
+
     /* Phase 1: stop all modules */
     mod = endpt->module_list.prev;
     while (mod != &endpt->module_list) {
@@ -603,6 +659,9 @@ PJ_DEF(void) pjsip_endpt_destroy(pjsip_endpoint *endpt)
     /* Shutdown and destroy all transports. */
     pjsip_tpmgr_destroy(endpt->transport_mgr);
 
+    /* No more incoming messages now, destroy receive workers. */
+    destroy_rx_workers(endpt);
+
     /* Destroy ioqueue */
     pj_ioqueue_destroy(endpt->ioqueue);
 
@@ -919,11 +978,7 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
 			     pj_status_t status,
 			     pjsip_rx_data *rdata )
 {
-    pjsip_msg *msg = rdata->msg_info.msg;
-    pjsip_process_rdata_param proc_prm;
-    pj_bool_t handled = PJ_FALSE;
-
-    PJ_UNUSED_ARG(msg);
+    unsigned rx_worker_cnt;
 
     if (status != PJ_SUCCESS) {
 	char info[30];
@@ -966,6 +1021,28 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
 	return;
     }
 
+    /* Hand the message over to a receive worker, if enabled */
+    rx_worker_cnt = endpt->rx_worker_cnt;
+    if (rx_worker_cnt) {
+	queue_rx_msg(endpt, rx_worker_cnt, rdata);
+	return;
+    }
+
+    process_rx_msg(endpt, rdata);
+}
+
+/*
+ * Distribute incoming message to modules.
+ */
+static void process_rx_msg( pjsip_endpoint *endpt,
+			    pjsip_rx_data *rdata )
+{
+    pjsip_msg *msg = rdata->msg_info.msg;
+    pjsip_process_rdata_param proc_prm;
+    pj_bool_t handled = PJ_FALSE;
+
+    PJ_UNUSED_ARG(msg);
+
     PJ_LOG(5, (THIS_FILE, "Processing incoming message: %s", 
 	       pjsip_rx_data_get_info(rdata)));
     pj_log_push_indent();
@@ -1052,6 +1129,199 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
     pj_log_pop_indent();
 }
 
+/*
+ * Receive worker thread: process queued incoming messages in order.
+ */
+static int rx_worker_thread(void *arg)
+{
+    rx_worker *w = (rx_worker*) arg;
+
+    for (;;) {
+	rx_job *job;
+
+	pj_sem_wait(w->sem);
+
+	pj_mutex_lock(w->mutex);
+	if (pj_list_empty(&w->queue)) {
+	    pj_bool_t quit = w->quit;
+	    pj_mutex_unlock(w->mutex);
+	    if (quit)
+		break;
+	    continue;
+	}
+	job = w->queue.next;
+	pj_list_erase(job);
+	--w->queue_len;
+	pj_mutex_unlock(w->mutex);
+
+	process_rx_msg(w->endpt, job->rdata);
+	pjsip_rx_data_free_cloned(job->rdata);
+    }
+
+    return 0;
+}
+
+/*
+ * Queue incoming message to the receive worker selected by its Call-ID.
+ */
+static void queue_rx_msg( pjsip_endpoint *endpt,
+			  unsigned rx_worker_cnt,
+			  pjsip_rx_data *rdata )
+{
+    const pj_str_t *call_id = &rdata->msg_info.cid->id;
+    pjsip_rx_data *clone;
+    rx_worker *w;
+    rx_job *job;
+    pj_status_t status;
+
+    w = &endpt->rx_worker[pj_hash_calc(0, call_id->ptr,
+				       (unsigned)call_id->slen) %
+			  rx_worker_cnt];
+
+    /* The original rdata will be reused by the transport once we return,
+     * so the worker gets a copy.
+     */
+    status = pjsip_rx_data_clone(rdata, 0, &clone);
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(2, (THIS_FILE, status, "Dropping %s from %s:%d: "
+		      "unable to clone rdata",
+		      pjsip_rx_data_get_info(rdata),
+		      rdata->pkt_info.src_name,
+		      rdata->pkt_info.src_port));
+	return;
+    }
+
+    job = PJ_POOL_ZALLOC_T(clone->tp_info.pool, rx_job);
+    job->rdata = clone;
+
+    pj_mutex_lock(w->mutex);
+    if (w->quit || w->queue_len >= PJSIP_RX_WORKER_MAX_QUEUE) {
+	pj_bool_t quit = w->quit;
+
+	pj_mutex_unlock(w->mutex);
+	if (quit) {
+	    PJ_LOG(4, (THIS_FILE, "Dropping %s from %s:%d: endpoint is "
+		       "shutting down",
+		       pjsip_rx_data_get_info(rdata),
+		       rdata->pkt_info.src_name,
+		       rdata->pkt_info.src_port));
+	} else {
+	    PJ_LOG(2, (THIS_FILE, "Dropping %s from %s:%d: receive worker "
+		       "queue is full",
+		       pjsip_rx_data_get_info(rdata),
+		       rdata->pkt_info.src_name,
+		       rdata->pkt_info.src_port));
+	}
+	pjsip_rx_data_free_cloned(clone);
+	return;
+    }
+    pj_list_push_back(&w->queue, job);
+    ++w->queue_len;
+    pj_mutex_unlock(w->mutex);
+
+    pj_sem_post(w->sem);
+}
+
+/*
+ * Create receive worker threads.
+ */
+static pj_status_t start_rx_workers(pjsip_endpoint *endpt, unsigned count)
+{
+    unsigned i;
+    pj_status_t status;
+
+    endpt->rx_worker = (rx_worker*)
+		       pj_pool_calloc(endpt->pool, count, sizeof(rx_worker));
+
+    for (i=0; i<count; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+
+	w->endpt = endpt;
+	pj_list_init(&w->queue);
+
+	status = pj_mutex_create_simple(endpt->pool, "rxw%p", &w->mutex);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	status = pj_sem_create(endpt->pool, "rxw%p", 0,
+			       PJSIP_RX_WORKER_MAX_QUEUE + 1, &w->sem);
+	if (status != PJ_SUCCESS) {
+	    pj_mutex_destroy(w->mutex);
+	    return status;
+	}
+
+	status = pj_thread_create(endpt->pool, "rxw%p", &rx_worker_thread, w,
+				  0, 0, &w->thread);
+	if (status != PJ_SUCCESS) {
+	    pj_sem_destroy(w->sem);
+	    pj_mutex_destroy(w->mutex);
+	    return status;
+	}
+
+	++endpt->rx_worker_cnt;
+    }
+
+    PJ_LOG(4, (THIS_FILE, "%d receive worker(s) started", count));
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Process the messages still queued, then stop the receive worker threads.
+ * Messages received afterwards are dropped. The workers are still used
+ * by the transports, so they are destroyed later by destroy_rx_workers().
+ */
+static void stop_rx_workers(pjsip_endpoint *endpt)
+{
+    unsigned i;
+
+    for (i=0; i<endpt->rx_worker_cnt; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+
+	pj_mutex_lock(w->mutex);
+	w->quit = PJ_TRUE;
+	pj_mutex_unlock(w->mutex);
+	pj_sem_post(w->sem);
+    }
+
+    for (i=0; i<endpt->rx_worker_cnt; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+
+	if (w->thread) {
+	    pj_thread_join(w->thread);
+	    pj_thread_destroy(w->thread);
+	    w->thread = NULL;
+	}
+    }
+}
+
+/*
+ * Destroy the receive workers stopped by stop_rx_workers(). Must only be
+ * called once the transports are destroyed.
+ */
+static void destroy_rx_workers(pjsip_endpoint *endpt)
+{
+    unsigned i, count;
+
+    count = endpt->rx_worker_cnt;
+    endpt->rx_worker_cnt = 0;
+
+    for (i=0; i<count; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+
+	/* Free messages that the worker didn't get to process */
+	while (!pj_list_empty(&w->queue)) {
+	    rx_job *job = w->queue.next;
+	    pj_list_erase(job);
+	    pjsip_rx_data_free_cloned(job->rdata);
+	}
+	w->queue_len = 0;
+
+	pj_sem_destroy(w->sem);
+	pj_mutex_destroy(w->mutex);
+    }
+}
+
 /*
  * This callback is called by transport manager before message is sent.
  * Modules may inspect the message before it's actually sent.
@@ -71,6 +71,7 @@ static const struct
     PJ_BUILD_ERR( PJSIP_EBUFDESTROYED,	"Buffer destroyed"),
     PJ_BUILD_ERR( PJSIP_ETPNOTSUITABLE,	"Unsuitable transport selected"),
     PJ_BUILD_ERR( PJSIP_ETPNOTAVAIL,	"Transport not available for use"),
+    PJ_BUILD_ERR( PJSIP_ETPBUSY,	"Too many messages pending on transport"),
 
     /* Transaction errors */
     PJ_BUILD_ERR( PJSIP_ETSXDESTROYED,	"Transaction has been destroyed"),
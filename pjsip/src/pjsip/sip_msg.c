@@ -149,6 +149,8 @@ pj_bool_t pjsip_use_compact_form = PJSIP_ENCODE_SHORT_HNAME;
 static pj_str_t status_phrase[710];
 static int print_media_type(char *buf, unsigned len,
 			    const pjsip_media_type *media);
+static pjsip_lazy_hdr* pjsip_lazy_hdr_clone( pj_pool_t *pool, 
+					     const pjsip_lazy_hdr *hdr);
 
 static int init_status_phrase()
 {
@@ -344,6 +346,15 @@ PJ_DEF(void*)  pjsip_msg_find_hdr( const pjsip_msg *msg,
 	hdr = msg->hdr.next;
     }
     for (; hdr!=end; hdr = hdr->next) {
+	/* Parse the header now if its parsing has been deferred, unless
+	 * it is already known to be of other type.
+	 */
+	if (hdr->vptr->clone == (pjsip_hdr_clone_fptr)&pjsip_lazy_hdr_clone) {
+	    pjsip_hdr_e htype = ((const pjsip_lazy_hdr*)hdr)->htype;
+	    if (htype != PJSIP_H_OTHER && htype != hdr_type)
+		continue;
+	    hdr = pjsip_lazy_hdr_parse((pjsip_hdr*)hdr);
+	}
 	if (hdr->type == hdr_type)
 	    return (void*)hdr;
     }
@@ -361,7 +372,7 @@ PJ_DEF(void*)  pjsip_msg_find_hdr_by_name( const pjsip_msg *msg,
     }
     for (; hdr!=end; hdr = hdr->next) {
 	if (pj_stricmp(&hdr->name, name) == 0)
-	    return (void*)hdr;
+	    return pjsip_lazy_hdr_parse((pjsip_hdr*)hdr);
     }
     return NULL;
 }
@@ -378,9 +389,9 @@ PJ_DEF(void*)  pjsip_msg_find_hdr_by_names( const pjsip_msg *msg,
     }
     for (; hdr!=end; hdr = hdr->next) {
 	if (pj_stricmp(&hdr->name, name) == 0)
-	    return (void*)hdr;
+	    return pjsip_lazy_hdr_parse((pjsip_hdr*)hdr);
 	if (pj_stricmp(&hdr->name, sname) == 0)
-	    return (void*)hdr;
+	    return pjsip_lazy_hdr_parse((pjsip_hdr*)hdr);
     }
     return NULL;
 }
@@ -395,13 +406,70 @@ PJ_DEF(void*) pjsip_msg_find_remove_hdr( pjsip_msg *msg,
     return hdr;
 }
 
-PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg, 
-				    char *buf, pj_size_t size)
+/*
+ * Find the position of a header in the previous print. Headers are
+ * normally printed in the same order, so the search starts at *hint.
+ */
+static const pjsip_msg_print_span*
+find_print_span(const pjsip_msg_print_cache *cache, const pjsip_hdr *hdr,
+		unsigned *hint)
+{
+    unsigned i;
+
+    for (i=*hint; i<cache->cnt; ++i) {
+	if (cache->span[i].hdr == hdr) {
+	    *hint = i+1;
+	    return &cache->span[i];
+	}
+    }
+    for (i=0; i<*hint && i<cache->cnt; ++i) {
+	if (cache->span[i].hdr == hdr) {
+	    *hint = i+1;
+	    return &cache->span[i];
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Print the message. When cache is given, unchanged headers and body are
+ * copied from the previous print and the new print is recorded.
+ */
+static pj_ssize_t print_msg( const pjsip_msg *msg, char *buf, pj_size_t size,
+			     pj_pool_t *pool, pjsip_msg_print_cache *cache)
 {
     char *p=buf, *end=buf+size;
     pj_ssize_t len;
     pjsip_hdr *hdr;
     pj_str_t clen_hdr =  { "Content-Length: ", 16};
+    const char *old = NULL;
+    pjsip_msg_print_span *span = NULL, *spare = NULL;
+    unsigned cnt = 0, max = 0, hint = 0;
+    unsigned body_off = 0;
+
+    if (cache) {
+	unsigned hdr_cnt = 0;
+
+	for (hdr=msg->hdr.next; hdr!=&msg->hdr; hdr=hdr->next)
+	    ++hdr_cnt;
+
+	/* Record the new print in the spare table, so that the table of
+	 * the previous print remains intact until we are done.
+	 */
+	max = cache->max;
+	span = cache->spare;
+	spare = cache->span;
+	if (hdr_cnt > max) {
+	    /* Leave some room for headers added later */
+	    max = hdr_cnt + 8;
+	    span = (pjsip_msg_print_span*)
+		   pj_pool_alloc(pool, 2 * max * sizeof(pjsip_msg_print_span));
+	    if (!span)
+		return -1;
+	    spare = span + max;
+	}
+	old = cache->buf;
+    }
 
     if (pjsip_use_compact_form) {
 	clen_hdr.ptr = "l: ";
@@ -460,6 +528,26 @@ PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg,
 
     /* Print each of the headers. */
     for (hdr=msg->hdr.next; hdr!=&msg->hdr; hdr=hdr->next) {
+	char *start = p;
+
+	if (old) {
+	    const pjsip_msg_print_span *prev;
+
+	    /* Copy the header from previous print if it hasn't changed */
+	    prev = find_print_span(cache, hdr, &hint);
+	    if (prev && prev->len >= 0) {
+		if (p+prev->len+3 >= end)
+		    return -1;
+		pj_memcpy(p, old+prev->offset, prev->len);
+		span[cnt].hdr = hdr;
+		span[cnt].offset = (unsigned)(p-buf);
+		span[cnt].len = prev->len;
+		++cnt;
+		p += prev->len;
+		continue;
+	    }
+	}
+
 	len = pjsip_hdr_print_on(hdr, p, end-p);
 	if (len < 0)
 	    return -1;
@@ -472,10 +560,28 @@ PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg,
 	    *p++ = '\r';
 	    *p++ = '\n';
 	}
+
+	if (span) {
+	    span[cnt].hdr = hdr;
+	    span[cnt].offset = (unsigned)(start-buf);
+	    span[cnt].len = (int)(p-start);
+	    ++cnt;
+	}
     }
 
+    body_off = (unsigned)(p-buf);
+
     /* Process message body. */
-    if (msg->body) {
+    if (old && msg->body && msg->body == cache->body) {
+	/* Same body as previous print, including Content-Type and
+	 * Content-Length headers.
+	 */
+	if (p+cache->body_len >= end)
+	    return -1;
+	pj_memcpy(p, old+cache->body_off, cache->body_len);
+	p += cache->body_len;
+
+    } else if (msg->body) {
 	enum { CLEN_SPACE = 5 };
 	char *clen_pos = NULL;
 
@@ -558,9 +664,51 @@ PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg,
     }
 
     *p = '\0';
+
+    if (cache) {
+	cache->buf = buf;
+	cache->cnt = cnt;
+	cache->max = max;
+	cache->span = span;
+	cache->spare = spare;
+	cache->body = msg->body;
+	cache->body_off = body_off;
+	cache->body_len = (unsigned)(p-buf) - body_off;
+    }
+
     return p-buf;
 }
 
+PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg, 
+				    char *buf, pj_size_t size)
+{
+    return print_msg(msg, buf, size, NULL, NULL);
+}
+
+PJ_DEF(pj_ssize_t) pjsip_msg_print2( const pjsip_msg *msg,
+				     char *buf, pj_size_t size,
+				     pj_pool_t *pool,
+				     pjsip_msg_print_cache *cache)
+{
+    PJ_ASSERT_RETURN(msg && buf && pool && cache && buf != cache->buf, -1);
+    return print_msg(msg, buf, size, pool, cache);
+}
+
+PJ_DEF(void) pjsip_msg_print_cache_invalidate_hdr(pjsip_msg_print_cache *cache,
+						  const void *hdr)
+{
+    unsigned i;
+
+    PJ_ASSERT_ON_FAIL(cache && hdr, return);
+
+    for (i=0; i<cache->cnt; ++i) {
+	if (cache->span[i].hdr == hdr) {
+	    cache->span[i].len = -1;
+	    break;
+	}
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 PJ_DEF(void*) pjsip_hdr_clone( pj_pool_t *pool, const void *hdr_ptr )
 {
@@ -785,6 +933,132 @@ static pjsip_generic_string_hdr* pjsip_generic_string_hdr_shallow_clone( pj_pool
     return hdr;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/*
+ * Unparsed header (lazy parsing).
+ */
+
+static pjsip_lazy_hdr* pjsip_lazy_hdr_shallow_clone( pj_pool_t *pool,
+						     const pjsip_lazy_hdr *hdr);
+
+static pjsip_hdr_vptr lazy_hdr_vptr = 
+{
+    (pjsip_hdr_clone_fptr) &pjsip_lazy_hdr_clone,
+    (pjsip_hdr_clone_fptr) &pjsip_lazy_hdr_shallow_clone,
+    (pjsip_hdr_print_fptr) &pjsip_generic_string_hdr_print,
+};
+
+
+PJ_DEF(pjsip_lazy_hdr*) pjsip_lazy_hdr_create( pj_pool_t *pool,
+					       const pj_str_t *hname,
+					       const pj_str_t *hvalue)
+{
+    pjsip_lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, pjsip_lazy_hdr);
+
+    pjsip_generic_string_hdr_init(pool, hdr, hname, hvalue);
+    hdr->vptr = &lazy_hdr_vptr;
+    hdr->pool = pool;
+    hdr->htype = PJSIP_H_OTHER;
+    return hdr;
+}
+
+PJ_DEF(pjsip_lazy_hdr*) pjsip_lazy_hdr_create2( pj_pool_t *pool,
+						pj_str_t *hname,
+						pj_str_t *hvalue)
+{
+    pjsip_lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, pjsip_lazy_hdr);
+    unsigned i;
+    char c;
+
+    pjsip_generic_string_hdr_init2((pjsip_generic_string_hdr*)hdr,
+				   hname, hvalue);
+    hdr->vptr = &lazy_hdr_vptr;
+    hdr->pool = pool;
+    hdr->htype = PJSIP_H_OTHER;
+
+    if (hname->slen == 0)
+	return hdr;
+
+    /* Look up the header type. Header names start with a letter, so
+     * the first character can be compared without calling tolower(),
+     * and the names in pjsip_hdr_names are sorted so the search can
+     * stop once the first character is past.
+     */
+    c = (char) pj_tolower(*hname->ptr);
+    for (i=0; i<PJSIP_H_OTHER; ++i) {
+	const pjsip_hdr_name_info_t *info = &pjsip_hdr_names[i];
+
+	if (hname->slen == 1) {
+	    if (info->sname && *info->sname == c)
+		break;
+	} else if ((info->name[0] | 0x20) > c) {
+	    i = PJSIP_H_OTHER;
+	    break;
+	} else if (hname->slen == (pj_ssize_t)info->name_len &&
+		   (info->name[0] | 0x20) == c &&
+		   pj_ansi_strnicmp(hname->ptr, info->name,
+				    info->name_len) == 0)
+	{
+	    break;
+	}
+    }
+    hdr->htype = (pjsip_hdr_e) i;
+
+    return hdr;
+}
+
+PJ_DEF(pjsip_hdr*) pjsip_lazy_hdr_parse( pjsip_hdr *hdr )
+{
+    pjsip_lazy_hdr *lazy = (pjsip_lazy_hdr*)hdr;
+    pjsip_hdr *parsed;
+    pj_str_t hvalue;
+
+    if (hdr->vptr != &lazy_hdr_vptr)
+	return hdr;
+
+    /* The scanner needs NULL terminated input, and the value still
+     * points to the packet buffer.
+     */
+    pj_strdup_with_null(lazy->pool, &hvalue, &lazy->hvalue);
+
+    parsed = (pjsip_hdr*) pjsip_parse_hdr(lazy->pool, &hdr->name, 
+					  hvalue.ptr, hvalue.slen, NULL);
+    if (parsed == NULL) {
+	/* Keep the value as generic string header. */
+	hdr->vptr = &generic_hdr_vptr;
+	lazy->htype = PJSIP_H_OTHER;
+	return hdr;
+    }
+
+    /* A header line may be parsed into more than one headers, e.g.
+     * Contact with multiple values, so insert the list of headers.
+     */
+    pj_list_insert_nodes_before(hdr, parsed);
+    pj_list_erase(hdr);
+
+    return parsed;
+}
+
+static pjsip_lazy_hdr* pjsip_lazy_hdr_clone( pj_pool_t *pool, 
+					     const pjsip_lazy_hdr *rhs)
+{
+    pjsip_lazy_hdr *hdr;
+
+    hdr = pjsip_lazy_hdr_create(pool, &rhs->name, &rhs->hvalue);
+    pj_strdup(pool, &hdr->sname, &rhs->sname);
+    hdr->htype = rhs->htype;
+    return hdr;
+}
+
+static pjsip_lazy_hdr* pjsip_lazy_hdr_shallow_clone( pj_pool_t *pool,
+						     const pjsip_lazy_hdr *rhs)
+{
+    pjsip_lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, pjsip_lazy_hdr);
+    pj_memcpy(hdr, rhs, sizeof(*hdr));
+    hdr->pool = pool;
+    return hdr;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /*
  * Generic pjsip_hdr_names/integer value header.
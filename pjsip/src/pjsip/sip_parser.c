@@ -122,7 +122,8 @@ static pj_cis_buf_t cis_buf;
  * Forward decl.
  */
 static pjsip_msg *  int_parse_msg( pjsip_parse_ctx *ctx, 
-				   pjsip_parser_err_report *err_list);
+				   pjsip_parser_err_report *err_list,
+				   pj_bool_t lazy);
 static void	    int_parse_param( pj_scanner *scanner, 
 				     pj_pool_t *pool,
 				     pj_str_t *pname, 
@@ -184,6 +185,7 @@ static pjsip_hdr*   parse_hdr_to( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_unsupported( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_via( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_generic_string( pjsip_parse_ctx *ctx);
+static pjsip_hdr*   parse_hdr_lazy( pjsip_parse_ctx *ctx);
 
 /* Convert non NULL terminated string to integer. */
 static unsigned long pj_strtoul_mindigit(const pj_str_t *str, 
@@ -739,7 +741,7 @@ PJ_DEF(pjsip_msg*) pjsip_parse_msg( pj_pool_t *pool,
     context.pool = pool;
     context.rdata = NULL;
 
-    msg = int_parse_msg(&context, err_list);
+    msg = int_parse_msg(&context, err_list, PJ_FALSE);
 
     pj_scan_fini(&scanner);
     return msg;
@@ -759,24 +761,80 @@ PJ_DEF(pjsip_msg *) pjsip_parse_rdata( char *buf, pj_size_t size,
     context.pool = rdata->tp_info.pool;
     context.rdata = rdata;
 
-    rdata->msg_info.msg = int_parse_msg(&context, &rdata->msg_info.parse_err);
+    rdata->msg_info.msg = int_parse_msg(&context, &rdata->msg_info.parse_err,
+					pjsip_cfg()->endpt.lazy_parse);
 
     pj_scan_fini(&scanner);
     return rdata->msg_info.msg;
 }
 
+#if PJ_HAS_TCP
+/* Parse the value of Content-Length header in a line which starts right
+ * after the header name, without using the scanner (so no exception
+ * and setjmp() is involved). Returns -1 if the line is not a valid
+ * Content-Length header, or if the value doesn't fit in int.
+ */
+static int parse_clen_value(const char *p, const char *end)
+{
+    int clen = 0;
+    const char *digit;
+
+    /* Skip whitespace and line folding before the colon */
+    while (p < end && (*p==' ' || *p=='\t' || IS_NEWLINE(*p))) {
+	if (IS_NEWLINE(*p)) {
+	    if (*p=='\r' && p+1 < end && p[1]=='\n')
+		++p;
+	    if (p+1 >= end || (p[1]!=' ' && p[1]!='\t'))
+		return -1;
+	}
+	++p;
+    }
+
+    if (p == end || *p != ':')
+	return -1;
+    ++p;
+
+    /* Skip whitespace and line folding after the colon */
+    while (p < end && (*p==' ' || *p=='\t' || IS_NEWLINE(*p))) {
+	if (IS_NEWLINE(*p)) {
+	    if (*p=='\r' && p+1 < end && p[1]=='\n')
+		++p;
+	    if (p+1 >= end || (p[1]!=' ' && p[1]!='\t'))
+		return -1;
+	}
+	++p;
+    }
+
+    /* Get number */
+    digit = p;
+    while (p < end && pj_isdigit(*p)) {
+	if (clen > (PJ_MAXINT32 - (*p - '0')) / 10)
+	    return -1;
+	clen = clen * 10 + (*p - '0');
+	++p;
+    }
+    if (p == digit)
+	return -1;
+
+    /* Skip trailing whitespace, then must get newline. */
+    while (p < end && (*p==' ' || *p=='\t'))
+	++p;
+    if (p == end || !IS_NEWLINE(*p))
+	return -1;
+
+    return clen;
+}
+#endif	/* PJ_HAS_TCP */
+
 /* Determine if a message has been received. */
 PJ_DEF(pj_bool_t) pjsip_find_msg( const char *buf, pj_size_t size, 
 				  pj_bool_t is_datagram, pj_size_t *msg_size)
 {
 #if PJ_HAS_TCP
-    const char *hdr_end;
-    const char *body_start;
-    const char *pos;
+    const char *end = buf + size;
+    const char *body_start = NULL;
     const char *line;
     int content_length = -1;
-    pj_str_t cur_msg;
-    const pj_str_t end_hdr = { "\n\r\n", 3};
 
     *msg_size = size;
 
@@ -785,75 +843,41 @@ PJ_DEF(pj_bool_t) pjsip_find_msg( const char *buf, pj_size_t size,
 	return PJ_SUCCESS;
     }
 
-
-    /* Find the end of header area by finding an empty line. 
-     * Don't use plain strstr() since we want to be able to handle
-     * NULL character in the message
+    /* Walk the header lines once, looking for Content-Length header and
+     * the empty line which ends the header area. Don't use plain strchr()
+     * since we want to be able to handle NULL character in the message.
      */
-    cur_msg.ptr = (char*)buf; cur_msg.slen = size;
-    pos = pj_strstr(&cur_msg, &end_hdr);
-    if (pos == NULL) {
-	return PJSIP_EPARTIALMSG;
-    }
- 
-    hdr_end = pos+1;
-    body_start = pos+3;
-
-    /* Find "Content-Length" header the hard way. */
-    line = pj_strchr(&cur_msg, '\n');
-    while (line && line < hdr_end) {
+    line = (const char*) pj_memchr(buf, '\n', size);
+    while (line) {
 	++line;
-	if ( ((*line=='C' || *line=='c') && 
-              strnicmp_alnum(line, "Content-Length", 14) == 0) ||
-	     ((*line=='l' || *line=='L') && 
-              (*(line+1)==' ' || *(line+1)=='\t' || *(line+1)==':')))
-	{
-	    /* Try to parse the header. */
-	    pj_scanner scanner;
-	    PJ_USE_EXCEPTION;
-
-	    pj_scan_init(&scanner, (char*)line, hdr_end-line, 
-			 PJ_SCAN_AUTOSKIP_WS_HEADER, &on_syntax_error);
-
-	    PJ_TRY {
-		pj_str_t str_clen;
-
-		/* Get "Content-Length" or "L" name */
-		if (*line=='C' || *line=='c')
-		    pj_scan_advance_n(&scanner, 14, PJ_TRUE);
-		else if (*line=='l' || *line=='L')
-		    pj_scan_advance_n(&scanner, 1, PJ_TRUE);
-
-		/* Get colon */
-		if (pj_scan_get_char(&scanner) != ':') {
-		    PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
-		}
 
-		/* Get number */
-		pj_scan_get(&scanner, &pconst.pjsip_DIGIT_SPEC, &str_clen);
+	if (line + 2 > end)
+	    break;
 
-		/* Get newline. */
-		pj_scan_get_newline(&scanner);
+	/* Empty line marks the end of the header area. */
+	if (line[0]=='\r' && line[1]=='\n') {
+	    body_start = line + 2;
+	    break;
+	}
 
-		/* Found a valid Content-Length header. */
-		content_length = pj_strtoul(&str_clen);
-	    }
-	    PJ_CATCH_ANY {
-		content_length = -1;
+	if (content_length == -1) {
+	    if ((*line=='C' || *line=='c') && line + 14 <= end &&
+		strnicmp_alnum(line, "Content-Length", 14) == 0)
+	    {
+		content_length = parse_clen_value(line+14, end);
+	    } else if ((*line=='l' || *line=='L') && 
+		       (line[1]==' ' || line[1]=='\t' || line[1]==':'))
+	    {
+		content_length = parse_clen_value(line+1, end);
 	    }
-	    PJ_END
-
-	    pj_scan_fini(&scanner);
 	}
 
-	/* Found valid Content-Length? */
-	if (content_length != -1)
-	    break;
-
 	/* Go to next line. */
-	cur_msg.slen -= (line - cur_msg.ptr);
-	cur_msg.ptr = (char*)line;
-	line = pj_strchr(&cur_msg, '\n');
+	line = (const char*) pj_memchr(line, '\n', end - line);
+    }
+
+    if (body_start == NULL) {
+	return PJSIP_EPARTIALMSG;
     }
 
     /* Found Content-Length? */
@@ -934,9 +958,31 @@ static pj_bool_t is_next_sip_version(pj_scanner *scanner)
     return c && (c=='/' || c==' ' || c=='\t') && pj_stricmp(&sip, &SIP)==0;
 }
 
+/* Check if the header must be parsed when the message is parsed, even
+ * when lazy parsing is enabled. These are the headers that are needed to
+ * process every incoming message, the Content-Type to parse the body, and
+ * the headers which are accessed through the rdata's msg_info by the
+ * dialog and 100rel code.
+ */
+static pj_bool_t is_eager_hdr(pjsip_parse_hdr_func *handler)
+{
+    return handler == &parse_hdr_via ||
+	   handler == &parse_hdr_from ||
+	   handler == &parse_hdr_to ||
+	   handler == &parse_hdr_call_id ||
+	   handler == &parse_hdr_cseq ||
+	   handler == &parse_hdr_max_forwards ||
+	   handler == &parse_hdr_content_len ||
+	   handler == &parse_hdr_content_type ||
+	   handler == &parse_hdr_route ||
+	   handler == &parse_hdr_rr ||
+	   handler == &parse_hdr_require;
+}
+
 /* Internal function to parse SIP message */
 static pjsip_msg *int_parse_msg( pjsip_parse_ctx *ctx,
-				 pjsip_parser_err_report *err_list)
+				 pjsip_parser_err_report *err_list,
+				 pj_bool_t lazy)
 {
     pj_bool_t parsing_headers;
     pjsip_msg *msg = NULL;
@@ -1000,8 +1046,14 @@ parse_headers:
 	    /* Call the handler if found.
 	     * If no handler is found, then treat the header as generic
 	     * hname/hvalue pair.
+	     * With lazy parsing, only keep the value of the header for
+	     * now, it will be parsed when the header is looked up.
 	     */
-	    if (handler) {
+	    if (handler && lazy && !is_eager_hdr(handler)) {
+		hdr = parse_hdr_lazy(ctx);
+		hdr->name = hdr->sname = hname;
+
+	    } else if (handler) {
 		hdr = (*handler)(ctx);
 
 		/* Note:
@@ -1593,7 +1645,7 @@ static void int_parse_status_line( pj_scanner *scanner,
     pj_scan_get( scanner, &pconst.pjsip_DIGIT_SPEC, &token);
     status_line->code = pj_strtoul(&token);
     if (*scanner->curptr != '\r' && *scanner->curptr != '\n')
-	pj_scan_get( scanner, &pconst.pjsip_NOT_NEWLINE, &status_line->reason);
+	pj_scan_get_until_newline( scanner, &status_line->reason);
     else
 	status_line->reason.slen=0, status_line->reason.ptr=NULL;
     pj_scan_get_newline( scanner );
@@ -1705,7 +1757,7 @@ static void parse_generic_string_hdr( pjsip_generic_string_hdr *hdr,
     while (pj_cis_match(&pconst.pjsip_NOT_NEWLINE, *scanner->curptr)) {
 	pj_str_t next, tmp;
 
-	pj_scan_get( scanner, &pconst.pjsip_NOT_NEWLINE, &hdr->hvalue);
+	pj_scan_get_until_newline( scanner, &hdr->hvalue);
 	if (pj_scan_is_eof(scanner) || IS_NEWLINE(*scanner->curptr))
 	    break;
 	/* mangled, get next fraction */
@@ -2245,6 +2297,16 @@ static pjsip_hdr* parse_hdr_generic_string( pjsip_parse_ctx *ctx )
 
 }
 
+/* Parse header which parsing is deferred. */
+static pjsip_hdr* parse_hdr_lazy( pjsip_parse_ctx *ctx )
+{
+    pjsip_lazy_hdr *hdr;
+
+    hdr = pjsip_lazy_hdr_create(ctx->pool, NULL, NULL);
+    parse_generic_string_hdr((pjsip_generic_string_hdr*)hdr, ctx);
+    return (pjsip_hdr*)hdr;
+}
+
 /* Public function to parse a header value. */
 PJ_DEF(void*) pjsip_parse_hdr( pj_pool_t *pool, const pj_str_t *hname,
 			       char *buf, pj_size_t size, int *parsed_len )
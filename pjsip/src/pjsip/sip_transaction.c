@@ -25,6 +25,7 @@
 #include <pjsip/sip_event.h>
 #include <pjlib-util/errno.h>
 #include <pj/hash.h>
+#include <pj/objpool.h>
 #include <pj/pool.h>
 #include <pj/os.h>
 #include <pj/rand.h>
@@ -48,6 +49,10 @@
  */
 #define PRECALC_HASH
 
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL && \
+    (1000 % PJSIP_TSX_RETRANS_SWEEP_INTERVAL) != 0
+#   error "PJSIP_TSX_RETRANS_SWEEP_INTERVAL must divide 1000"
+#endif
 
 /* Defined in sip_util_statefull.c */
 extern pjsip_module mod_stateful_util;
@@ -67,14 +72,33 @@ static pj_status_t mod_tsx_layer_unload(void);
 static pj_bool_t   mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata);
 static pj_bool_t   mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata);
 
+/* Lock stripe of the transaction table. */
+typedef struct tsx_stripe
+{
+    pj_pool_t		*pool;		/* Used with mutex held only.	*/
+    pj_mutex_t		*mutex;
+    pj_hash_table_t	*htable;
+    pj_mutex_t		*timer_mutex;	/* Protects timers of the tsx.	*/
+} tsx_stripe;
+
 /* Transaction layer module definition. */
 static struct mod_tsx_layer
 {
     struct pjsip_module  mod;
     pj_pool_t		*pool;
     pjsip_endpoint	*endpt;
-    pj_mutex_t		*mutex;
-    pj_hash_table_t	*htable;
+    pj_objpool_t	*objpool;
+    tsx_stripe		 stripe[PJSIP_TSX_TABLE_STRIPE_COUNT];
+
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    /* Retransmission timer wheel. */
+    pj_mutex_t		*retrans_mutex;
+    pj_timer_entry	 retrans_sweep;	    /* The sweep timer.		    */
+    unsigned		 retrans_tick;	    /* Next tick to be swept.	    */
+    unsigned		 retrans_count;	    /* Number of tsx in the wheel.  */
+    pj_bool_t		 retrans_sweeping;  /* Sweep callback is running.   */
+    pjsip_tsx_retrans_node retrans_slot[PJSIP_TSX_RETRANS_WHEEL_SIZE];
+#endif
 } mod_tsx_layer = 
 {   {
 	NULL, NULL,			/* List's prev and next.    */
@@ -162,6 +186,10 @@ static pj_status_t tsx_on_state_destroyed(	pjsip_transaction *tsx,
 					        pjsip_event *event);
 static void        tsx_timer_callback( pj_timer_heap_t *theap, 
 			               pj_timer_entry *entry);
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+static void        tsx_retrans_sweep( pj_timer_heap_t *theap,
+			              pj_timer_entry *entry);
+#endif
 static void	   tsx_tp_state_callback(
 				       pjsip_transport *tp,
 				       pjsip_transport_state state,
@@ -345,20 +373,28 @@ static pj_status_t create_tsx_key_2543( pj_pool_t *pool,
 }
 
 /*
- * Create transaction key for RFC3161 compliant system.
+ * Create transaction key for RFC3161 compliant system. The key is stored
+ * in the buffer if it's specified and large enough, otherwise it is
+ * allocated from the pool.
  */
 static pj_status_t create_tsx_key_3261( pj_pool_t *pool,
+					char *buf,
+					pj_size_t buf_len,
 		                        pj_str_t *key,
 		                        pjsip_role_e role,
 		                        const pjsip_method *method,
 		                        const pj_str_t *branch)
 {
+    pj_size_t len;
     char *p;
 
     PJ_ASSERT_RETURN(pool && key && method && branch, PJ_EINVAL);
 
-    p = key->ptr = (char*) 
-    		   pj_pool_alloc(pool, branch->slen + method->name.slen + 4 );
+    len = branch->slen + method->name.slen + 4;
+    if (buf && buf_len >= len)
+	p = key->ptr = buf;
+    else
+	p = key->ptr = (char*) pj_pool_alloc(pool, len);
     
     /* Add role. */
     *p++ = (char)(role==PJSIP_ROLE_UAC ? 'c' : 's');
@@ -382,13 +418,16 @@ static pj_status_t create_tsx_key_3261( pj_pool_t *pool,
 }
 
 /*
- * Create key from the incoming data, to be used to search the transaction
- * in the transaction hash table.
+ * Create key from the incoming data, storing RFC 3261 keys in the buffer
+ * if it's large enough.
  */
-PJ_DEF(pj_status_t) pjsip_tsx_create_key( pj_pool_t *pool, pj_str_t *key, 
-				          pjsip_role_e role, 
-				          const pjsip_method *method, 
-				          const pjsip_rx_data *rdata)
+static pj_status_t create_tsx_key( pj_pool_t *pool,
+				   char *buf,
+				   pj_size_t buf_len,
+				   pj_str_t *key,
+				   pjsip_role_e role,
+				   const pjsip_method *method,
+				   const pjsip_rx_data *rdata)
 {
     pj_str_t rfc3261_branch = {PJSIP_RFC3261_BRANCH_ID, 
                                PJSIP_RFC3261_BRANCH_LEN};
@@ -404,7 +443,8 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_key( pj_pool_t *pool, pj_str_t *key,
     if (pj_strnicmp(branch,&rfc3261_branch,PJSIP_RFC3261_BRANCH_LEN)==0) {
 
 	/* Create transaction key. */
-	return create_tsx_key_3261(pool, key, role, method, branch);
+	return create_tsx_key_3261(pool, buf, buf_len, key, role, method,
+				   branch);
 
     } else {
 	/* Create the key for the message. This key will be matched up 
@@ -416,18 +456,90 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_key( pj_pool_t *pool, pj_str_t *key,
     }
 }
 
+/*
+ * Create key from the incoming data, to be used to search the transaction
+ * in the transaction hash table.
+ */
+PJ_DEF(pj_status_t) pjsip_tsx_create_key( pj_pool_t *pool, pj_str_t *key, 
+				          pjsip_role_e role, 
+				          const pjsip_method *method, 
+				          const pjsip_rx_data *rdata)
+{
+    return create_tsx_key(pool, NULL, 0, key, role, method, rdata);
+}
+
 /*****************************************************************************
  **
  ** Transaction layer module
  **
  *****************************************************************************
  **/
+/*
+ * Get the stripe of the transaction table for the hash value of the
+ * transaction key.
+ */
+static tsx_stripe *get_stripe(pj_uint32_t hval)
+{
+    /* The hash tables use the low bits of the hash value to select the
+     * bucket, so use the high bits here.
+     */
+    return &mod_tsx_layer.stripe[(hval >> 16) % PJSIP_TSX_TABLE_STRIPE_COUNT];
+}
+
+/*
+ * Get the hash value of the transaction key.
+ */
+static pj_uint32_t tsx_hash(const pjsip_transaction *tsx)
+{
+#ifdef PRECALC_HASH
+    return tsx->hashed_key;
+#else
+    return pj_hash_calc_tolower(0, NULL, &tsx->transaction_key);
+#endif
+}
+
+/*
+ * Destroy the transaction table stripes and the mutex of the
+ * retransmission timer wheel.
+ */
+static void destroy_stripes(void)
+{
+    unsigned i;
+
+    for (i=0; i<PJSIP_TSX_TABLE_STRIPE_COUNT; ++i) {
+	tsx_stripe *stripe = &mod_tsx_layer.stripe[i];
+
+	if (stripe->mutex) {
+	    pj_mutex_destroy(stripe->mutex);
+	    stripe->mutex = NULL;
+	}
+	if (stripe->timer_mutex) {
+	    pj_mutex_destroy(stripe->timer_mutex);
+	    stripe->timer_mutex = NULL;
+	}
+	stripe->htable = NULL;
+
+	if (stripe->pool) {
+	    pjsip_endpt_release_pool(mod_tsx_layer.endpt, stripe->pool);
+	    stripe->pool = NULL;
+	}
+    }
+
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    if (mod_tsx_layer.retrans_mutex) {
+	pj_mutex_destroy(mod_tsx_layer.retrans_mutex);
+	mod_tsx_layer.retrans_mutex = NULL;
+    }
+#endif
+}
+
 /*
  * Create transaction layer module and registers it to the endpoint.
  */
 PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
 {
     pj_pool_t *pool;
+    unsigned i;
     pj_status_t status;
 
 
@@ -466,16 +578,73 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
     mod_tsx_layer.endpt = endpt;
 
 
-    /* Create hash table. */
-    mod_tsx_layer.htable = pj_hash_create( pool, pjsip_cfg()->tsx.max_count );
-    if (!mod_tsx_layer.htable) {
+    /* Create the pool, hash table and mutexes of each stripe. The hash
+     * table may grow while holding the stripe mutex only, hence each
+     * stripe needs its own pool.
+     */
+    for (i=0; i<PJSIP_TSX_TABLE_STRIPE_COUNT; ++i) {
+	tsx_stripe *stripe = &mod_tsx_layer.stripe[i];
+
+	stripe->pool = pjsip_endpt_create_pool(endpt, "tsxstripe",
+					       PJSIP_POOL_TSX_LAYER_LEN,
+					       PJSIP_POOL_TSX_LAYER_INC);
+	if (!stripe->pool) {
+	    destroy_stripes();
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return PJ_ENOMEM;
+	}
+
+	stripe->htable = pj_hash_create2(stripe->pool,
+				pjsip_cfg()->tsx.max_count /
+				    PJSIP_TSX_TABLE_STRIPE_COUNT,
+				(PJSIP_HASH_OPEN_ADDRESSING ?
+				 PJ_HASH_OPEN_ADDRESSING : 0));
+	if (!stripe->htable) {
+	    destroy_stripes();
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return PJ_ENOMEM;
+	}
+
+	status = pj_mutex_create_recursive(pool, "tsxlayer", &stripe->mutex);
+	if (status != PJ_SUCCESS) {
+	    destroy_stripes();
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return status;
+	}
+
+	status = pj_mutex_create_recursive(pool, "tsxtimer",
+					   &stripe->timer_mutex);
+	if (status != PJ_SUCCESS) {
+	    destroy_stripes();
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return status;
+	}
+    }
+
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    /* Initialize the retransmission timer wheel. */
+    for (i=0; i<PJSIP_TSX_RETRANS_WHEEL_SIZE; ++i)
+	pj_list_init(&mod_tsx_layer.retrans_slot[i]);
+    pj_timer_entry_init(&mod_tsx_layer.retrans_sweep, TIMER_INACTIVE, NULL,
+			&tsx_retrans_sweep);
+    mod_tsx_layer.retrans_count = 0;
+    mod_tsx_layer.retrans_sweeping = PJ_FALSE;
+
+    status = pj_mutex_create_simple(pool, "tsxretrans",
+				    &mod_tsx_layer.retrans_mutex);
+    if (status != PJ_SUCCESS) {
+	destroy_stripes();
 	pjsip_endpt_release_pool(endpt, pool);
-	return PJ_ENOMEM;
+	return status;
     }
+#endif
 
-    /* Create group lock. */
-    status = pj_mutex_create_recursive(pool, "tsxlayer", &mod_tsx_layer.mutex);
+    /* Create object pool for the transaction instances. */
+    status = pj_objpool_create(pool->factory, "tsxobj%p",
+			       sizeof(pjsip_transaction), 0,
+			       &mod_tsx_layer.objpool);
     if (status != PJ_SUCCESS) {
+	destroy_stripes();
 	pjsip_endpt_release_pool(endpt, pool);
 	return status;
     }
@@ -485,7 +654,9 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
      */
     status = pjsip_endpt_register_module( endpt, &mod_tsx_layer.mod );
     if (status != PJ_SUCCESS) {
-	pj_mutex_destroy(mod_tsx_layer.mutex);
+	pj_objpool_destroy(mod_tsx_layer.objpool);
+	mod_tsx_layer.objpool = NULL;
+	destroy_stripes();
 	pjsip_endpt_release_pool(endpt, pool);
 	return status;
     }
@@ -530,21 +701,24 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_destroy(void)
  */
 static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
 {
+    tsx_stripe *stripe;
+
     pj_assert(tsx->transaction_key.slen != 0);
 
     /* Lock hash table mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    stripe = get_stripe(tsx_hash(tsx));
+    pj_mutex_lock(stripe->mutex);
 
     /* Check if no transaction with the same key exists. 
      * Do not use PJ_ASSERT_RETURN since it evaluates the expression
      * twice!
      */
-    if(pj_hash_get_lower(mod_tsx_layer.htable, 
+    if(pj_hash_get_lower(stripe->htable, 
 		         tsx->transaction_key.ptr,
 		         (unsigned)tsx->transaction_key.slen, 
 		         NULL))
     {
-	pj_mutex_unlock(mod_tsx_layer.mutex);
+	pj_mutex_unlock(stripe->mutex);
 	PJ_LOG(2,(THIS_FILE, 
 		  "Unable to register %.*s transaction (key exists)",
 		  (int)tsx->method.name.slen,
@@ -559,18 +733,18 @@ static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
 
     /* Register the transaction to the hash table. */
 #ifdef PRECALC_HASH
-    pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable,
+    pj_hash_set_lower( tsx->pool, stripe->htable,
                        tsx->transaction_key.ptr,
     		       (unsigned)tsx->transaction_key.slen, 
 		       tsx->hashed_key, tsx);
 #else
-    pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable,
+    pj_hash_set_lower( tsx->pool, stripe->htable,
                        tsx->transaction_key.ptr,
     		       tsx->transaction_key.slen, 0, tsx);
 #endif
 
     /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(stripe->mutex);
 
     return PJ_SUCCESS;
 }
@@ -581,6 +755,8 @@ static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
  */
 static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
 {
+    tsx_stripe *stripe;
+
     if (mod_tsx_layer.mod.id == -1) {
 	/* The transaction layer has been unregistered. This could happen
 	 * if the transaction was pending on transport and the application
@@ -594,15 +770,16 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
     //pj_assert(tsx->state != PJSIP_TSX_STATE_NULL);
 
     /* Lock hash table mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    stripe = get_stripe(tsx_hash(tsx));
+    pj_mutex_lock(stripe->mutex);
 
     /* Register the transaction to the hash table. */
 #ifdef PRECALC_HASH
-    pj_hash_set_lower( NULL, mod_tsx_layer.htable, tsx->transaction_key.ptr,
+    pj_hash_set_lower( NULL, stripe->htable, tsx->transaction_key.ptr,
     		       (unsigned)tsx->transaction_key.slen, tsx->hashed_key, 
 		       NULL);
 #else
-    pj_hash_set_lower( NULL, mod_tsx_layer.htable, tsx->transaction_key.ptr,
+    pj_hash_set_lower( NULL, stripe->htable, tsx->transaction_key.ptr,
     		       tsx->transaction_key.slen, 0, NULL);
 #endif
 
@@ -612,7 +789,7 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
 		tsx->transaction_key.ptr));
 
     /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(stripe->mutex);
 }
 
 
@@ -622,14 +799,18 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
  */
 PJ_DEF(unsigned) pjsip_tsx_layer_get_tsx_count(void)
 {
-    unsigned count;
+    unsigned i, count = 0;
 
     /* Are we registered? */
     PJ_ASSERT_RETURN(mod_tsx_layer.endpt!=NULL, 0);
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
-    count = pj_hash_count(mod_tsx_layer.htable);
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    for (i=0; i<PJSIP_TSX_TABLE_STRIPE_COUNT; ++i) {
+	tsx_stripe *stripe = &mod_tsx_layer.stripe[i];
+
+	pj_mutex_lock(stripe->mutex);
+	count += pj_hash_count(stripe->htable);
+	pj_mutex_unlock(stripe->mutex);
+    }
 
     return count;
 }
@@ -642,11 +823,15 @@ PJ_DEF(pjsip_transaction*) pjsip_tsx_layer_find_tsx( const pj_str_t *key,
 						     pj_bool_t lock )
 {
     pjsip_transaction *tsx;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
+    tsx_stripe *stripe;
+
+    hval = pj_hash_calc_tolower(0, NULL, key);
+    stripe = get_stripe(hval);
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    pj_mutex_lock(stripe->mutex);
     tsx = (pjsip_transaction*)
-    	  pj_hash_get_lower( mod_tsx_layer.htable, key->ptr, 
+    	  pj_hash_get_lower( stripe->htable, key->ptr, 
 			     (unsigned)key->slen, &hval );
     
     /* Prevent the transaction to get deleted before we have chance to lock it.
@@ -654,7 +839,7 @@ PJ_DEF(pjsip_transaction*) pjsip_tsx_layer_find_tsx( const pj_str_t *key,
     if (tsx && lock)
         pj_grp_lock_add_ref(tsx->grp_lock);
     
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(stripe->mutex);
 
     TSX_TRACE_((THIS_FILE, 
 		"Finding tsx with hkey=0x%p and key=%.*s: found %p",
@@ -697,26 +882,31 @@ static pj_status_t mod_tsx_layer_start(void)
 static pj_status_t mod_tsx_layer_stop(void)
 {
     pj_hash_iterator_t it_buf, *it;
+    unsigned i;
 
     PJ_LOG(4,(THIS_FILE, "Stopping transaction layer module"));
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
-
     /* Destroy all transactions. */
-    it = pj_hash_first(mod_tsx_layer.htable, &it_buf);
-    while (it) {
-	pjsip_transaction *tsx = (pjsip_transaction*) 
-				 pj_hash_this(mod_tsx_layer.htable, it);
-	pj_hash_iterator_t *next = pj_hash_next(mod_tsx_layer.htable, it);
-	if (tsx) {
-	    pjsip_tsx_terminate(tsx, PJSIP_SC_SERVICE_UNAVAILABLE);
-	    mod_tsx_layer_unregister_tsx(tsx);
-	    tsx_shutdown(tsx);
+    for (i=0; i<PJSIP_TSX_TABLE_STRIPE_COUNT; ++i) {
+	tsx_stripe *stripe = &mod_tsx_layer.stripe[i];
+
+	pj_mutex_lock(stripe->mutex);
+
+	it = pj_hash_first(stripe->htable, &it_buf);
+	while (it) {
+	    pjsip_transaction *tsx = (pjsip_transaction*) 
+				     pj_hash_this(stripe->htable, it);
+	    pj_hash_iterator_t *next = pj_hash_next(stripe->htable, it);
+	    if (tsx) {
+		pjsip_tsx_terminate(tsx, PJSIP_SC_SERVICE_UNAVAILABLE);
+		mod_tsx_layer_unregister_tsx(tsx);
+		tsx_shutdown(tsx);
+	    }
+	    it = next;
 	}
-	it = next;
-    }
 
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+	pj_mutex_unlock(stripe->mutex);
+    }
 
     PJ_LOG(4,(THIS_FILE, "Stopped transaction layer module"));
 
@@ -729,8 +919,14 @@ static void tsx_layer_destroy(pjsip_endpoint *endpt)
 {
     PJ_UNUSED_ARG(endpt);
 
-    /* Destroy mutex. */
-    pj_mutex_destroy(mod_tsx_layer.mutex);
+    /* Destroy the stripes and mutexes. */
+    destroy_stripes();
+
+    /* Destroy transaction object pool. Transactions which are still
+     * alive (e.g. kept by a dialog) keep it until they are destroyed.
+     */
+    pj_objpool_destroy(mod_tsx_layer.objpool);
+    mod_tsx_layer.objpool = NULL;
 
     /* Release pool. */
     pjsip_endpt_release_pool(mod_tsx_layer.endpt, mod_tsx_layer.pool);
@@ -747,13 +943,25 @@ static void tsx_layer_destroy(pjsip_endpoint *endpt)
  */
 static pj_status_t mod_tsx_layer_unload(void)
 {
+    unsigned i, count = 0;
+
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    /* Stop the retransmission sweep while the timer heap still exists. */
+    pj_timer_heap_cancel_if_active(
+	    pjsip_endpt_get_timer_heap(mod_tsx_layer.endpt),
+	    &mod_tsx_layer.retrans_sweep, TIMER_INACTIVE);
+#endif
+
+    for (i=0; i<PJSIP_TSX_TABLE_STRIPE_COUNT; ++i)
+	count += pj_hash_count(mod_tsx_layer.stripe[i].htable);
+
     /* Only self destroy when there's no transaction in the table.
      * Transaction may refuse to destroy when it has pending
      * transmission. If we destroy the module now, application will
      * crash when the pending transaction finally got error response
      * from transport and when it tries to unregister itself.
      */
-    if (pj_hash_count(mod_tsx_layer.htable) != 0) {
+    if (count != 0) {
 	if (pjsip_endpt_atexit(mod_tsx_layer.endpt, &tsx_layer_destroy) !=
 	    PJ_SUCCESS)
 	{
@@ -775,17 +983,22 @@ static pj_status_t mod_tsx_layer_unload(void)
 static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 {
     pj_str_t key;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
     pjsip_transaction *tsx;
+    tsx_stripe *stripe;
 
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAS,
 			 &rdata->msg_info.cseq->method, rdata);
 
-    /* Find transaction. */
-    pj_mutex_lock( mod_tsx_layer.mutex );
+    /* Find transaction. Only the stripe that may contain the transaction
+     * is locked.
+     */
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    stripe = get_stripe(hval);
+    pj_mutex_lock( stripe->mutex );
 
     tsx = (pjsip_transaction*) 
-    	  pj_hash_get_lower( mod_tsx_layer.htable, key.ptr, (unsigned)key.slen, 
+    	  pj_hash_get_lower( stripe->htable, key.ptr, (unsigned)key.slen, 
 			     &hval );
 
 
@@ -799,7 +1012,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 	 * Reject the request so that endpoint passes the request to
 	 * upper layer modules.
 	 */
-	pj_mutex_unlock( mod_tsx_layer.mutex);
+	pj_mutex_unlock( stripe->mutex);
 	return PJ_FALSE;
     }
 
@@ -809,7 +1022,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
     pj_grp_lock_add_ref(tsx->grp_lock);
     
     /* Unlock hash table. */
-    pj_mutex_unlock( mod_tsx_layer.mutex );
+    pj_mutex_unlock( stripe->mutex );
 
     /* Simulate race condition! */
     PJ_RACE_ME(5);
@@ -829,17 +1042,22 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
 {
     pj_str_t key;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
     pjsip_transaction *tsx;
+    tsx_stripe *stripe;
 
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAC,
 			 &rdata->msg_info.cseq->method, rdata);
 
-    /* Find transaction. */
-    pj_mutex_lock( mod_tsx_layer.mutex );
+    /* Find transaction. Only the stripe that may contain the transaction
+     * is locked.
+     */
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    stripe = get_stripe(hval);
+    pj_mutex_lock( stripe->mutex );
 
     tsx = (pjsip_transaction*) 
-    	  pj_hash_get_lower( mod_tsx_layer.htable, key.ptr, (unsigned)key.slen, 
+    	  pj_hash_get_lower( stripe->htable, key.ptr, (unsigned)key.slen, 
 			     &hval );
 
 
@@ -853,7 +1071,7 @@ static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
 	 * Reject the request so that endpoint passes the request to
 	 * upper layer modules.
 	 */
-	pj_mutex_unlock( mod_tsx_layer.mutex);
+	pj_mutex_unlock( stripe->mutex);
 	return PJ_FALSE;
     }
 
@@ -863,7 +1081,7 @@ static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
     pj_grp_lock_add_ref(tsx->grp_lock);
 
     /* Unlock hash table. */
-    pj_mutex_unlock( mod_tsx_layer.mutex );
+    pj_mutex_unlock( stripe->mutex );
 
     /* Simulate race condition! */
     PJ_RACE_ME(5);
@@ -894,22 +1112,26 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
 {
 #if PJ_LOG_MAX_LEVEL >= 3
     pj_hash_iterator_t itbuf, *it;
+    unsigned i, count;
 
-    /* Lock mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    count = pjsip_tsx_layer_get_tsx_count();
 
     PJ_LOG(3, (THIS_FILE, "Dumping transaction table:"));
-    PJ_LOG(3, (THIS_FILE, " Total %d transactions", 
-			  pj_hash_count(mod_tsx_layer.htable)));
+    PJ_LOG(3, (THIS_FILE, " Total %d transactions", count));
 
-    if (detail) {
-	it = pj_hash_first(mod_tsx_layer.htable, &itbuf);
-	if (it == NULL) {
-	    PJ_LOG(3, (THIS_FILE, " - none - "));
-	} else {
+    if (detail && count == 0) {
+	PJ_LOG(3, (THIS_FILE, " - none - "));
+    } else if (detail) {
+	for (i=0; i<PJSIP_TSX_TABLE_STRIPE_COUNT; ++i) {
+	    tsx_stripe *stripe = &mod_tsx_layer.stripe[i];
+
+	    /* Lock mutex. */
+	    pj_mutex_lock(stripe->mutex);
+
+	    it = pj_hash_first(stripe->htable, &itbuf);
 	    while (it != NULL) {
 		pjsip_transaction *tsx = (pjsip_transaction*) 
-					 pj_hash_this(mod_tsx_layer.htable,it);
+					 pj_hash_this(stripe->htable, it);
 
 		PJ_LOG(3, (THIS_FILE, " %s %s|%d|%s",
 			   tsx->obj_name,
@@ -919,13 +1141,13 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
 			   tsx->status_code,
 			   pjsip_tsx_state_str(tsx->state)));
 
-		it = pj_hash_next(mod_tsx_layer.htable, it);
+		it = pj_hash_next(stripe->htable, it);
 	    }
+
+	    /* Unlock mutex. */
+	    pj_mutex_unlock(stripe->mutex);
 	}
     }
-
-    /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
 #endif
 }
 
@@ -935,18 +1157,144 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
  **
  *****************************************************************************
  **/
-/* Lock transaction for accessing the timeout timer only. */
+/* Lock transaction for accessing the timeout timer only. The timer
+ * mutexes are shared by the transactions of the same table stripe.
+ */
 static void lock_timer(pjsip_transaction *tsx)
 {
-    pj_mutex_lock(tsx->mutex_b);
+    pj_mutex_lock(get_stripe(tsx_hash(tsx))->timer_mutex);
 }
 
 /* Unlock timer */
 static void unlock_timer(pjsip_transaction *tsx)
 {
-    pj_mutex_unlock(tsx->mutex_b);
+    pj_mutex_unlock(get_stripe(tsx_hash(tsx))->timer_mutex);
 }
 
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+/*
+ * Retransmission timer wheel.
+ *
+ * Retransmissions are the bulk of the transaction timers, so rather than
+ * scheduling a timer heap entry for each of them, transactions are kept
+ * in the slot of the wheel for the tick their retransmission is due, and
+ * one timer entry periodically sweeps the due slots and retransmits all
+ * their transactions in one pass. The wheel holds a reference to the
+ * group lock of each transaction in it, like the timer heap does.
+ */
+
+/* Maximum number of transactions taken out of the wheel at a time. */
+#define RETRANS_SWEEP_BATCH	32
+
+/* Get the current tick of the retransmission wheel. */
+static unsigned retrans_get_tick(void)
+{
+    pj_time_val now;
+
+    pj_gettickcount(&now);
+    return (unsigned)now.sec * (1000 / PJSIP_TSX_RETRANS_SWEEP_INTERVAL) +
+	   (unsigned)now.msec / PJSIP_TSX_RETRANS_SWEEP_INTERVAL;
+}
+
+/* Schedule the sweep timer. Wheel mutex must be held. */
+static void retrans_start_sweep(void)
+{
+    pj_timer_heap_t *timer_heap;
+    pj_time_val delay;
+    pj_status_t status;
+
+    timer_heap = pjsip_endpt_get_timer_heap(mod_tsx_layer.endpt);
+    delay.sec = 0;
+    delay.msec = PJSIP_TSX_RETRANS_SWEEP_INTERVAL;
+    pj_time_val_normalize(&delay);
+
+    status = pj_timer_heap_schedule_w_grp_lock(timer_heap,
+					       &mod_tsx_layer.retrans_sweep,
+					       &delay, RETRANSMIT_TIMER, NULL);
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(2,(THIS_FILE, status,
+		     "Failed to schedule retransmission sweep"));
+    }
+}
+
+/* Put transaction in the wheel. */
+static void retrans_schedule(pjsip_transaction *tsx,
+			     const pj_time_val *delay)
+{
+    pjsip_tsx_retrans_node *node = &tsx->retrans_node;
+    unsigned ticks, now;
+
+    ticks = (PJ_TIME_VAL_MSEC(*delay) + PJSIP_TSX_RETRANS_SWEEP_INTERVAL - 1)
+	    / PJSIP_TSX_RETRANS_SWEEP_INTERVAL;
+
+    pj_mutex_lock(mod_tsx_layer.retrans_mutex);
+
+    /* Only resync the wheel with the clock when it is idle. The sweep
+     * timer is also inactive while a sweep is dispatching its batches
+     * with the mutex released, and the slots it has yet to visit are
+     * behind the clock then.
+     */
+    now = retrans_get_tick();
+    if (mod_tsx_layer.retrans_count == 0 &&
+	!mod_tsx_layer.retrans_sweeping &&
+	mod_tsx_layer.retrans_sweep.id == TIMER_INACTIVE)
+    {
+	mod_tsx_layer.retrans_tick = now;
+    }
+
+    if (tsx->retransmit_timer.id != TIMER_INACTIVE) {
+	/* Already in the wheel, just move it */
+	pj_list_erase(node);
+    } else {
+	pj_grp_lock_add_ref(tsx->grp_lock);
+	tsx->retransmit_timer.id = RETRANSMIT_TIMER;
+	++mod_tsx_layer.retrans_count;
+    }
+
+    /* Don't put it in a slot which has just been swept, it would only be
+     * visited again after the wheel turns around.
+     */
+    node->due = now + ticks;
+    if ((int)(node->due - mod_tsx_layer.retrans_tick) < 0)
+	node->due = mod_tsx_layer.retrans_tick;
+    pj_list_push_back(&mod_tsx_layer.retrans_slot[node->due %
+						  PJSIP_TSX_RETRANS_WHEEL_SIZE],
+		      node);
+
+    /* A running sweep reschedules itself when it's done */
+    if (!mod_tsx_layer.retrans_sweeping &&
+	mod_tsx_layer.retrans_sweep.id == TIMER_INACTIVE)
+    {
+	retrans_start_sweep();
+    }
+
+    pj_mutex_unlock(mod_tsx_layer.retrans_mutex);
+}
+
+/* Remove transaction from the wheel. */
+static int retrans_cancel(pjsip_transaction *tsx)
+{
+    int count = 0;
+
+    pj_mutex_lock(mod_tsx_layer.retrans_mutex);
+    if (tsx->retransmit_timer.id != TIMER_INACTIVE) {
+	pj_list_erase(&tsx->retrans_node);
+	tsx->retransmit_timer.id = TIMER_INACTIVE;
+	--mod_tsx_layer.retrans_count;
+	count = 1;
+    }
+    pj_mutex_unlock(mod_tsx_layer.retrans_mutex);
+
+    /* Release the reference outside the wheel mutex as this may destroy
+     * the transaction.
+     */
+    if (count)
+	pj_grp_lock_dec_ref(tsx->grp_lock);
+
+    return count;
+}
+#endif	/* PJSIP_TSX_RETRANS_SWEEP_INTERVAL */
+
 /* Utility: schedule a timer */
 static pj_status_t tsx_schedule_timer(pjsip_transaction *tsx,
                                       pj_timer_entry *entry,
@@ -957,6 +1305,14 @@ static pj_status_t tsx_schedule_timer(pjsip_transaction *tsx,
     pj_status_t status;
 
     pj_assert(active_id != 0);
+
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    if (entry == &tsx->retransmit_timer) {
+	retrans_schedule(tsx, delay);
+	return PJ_SUCCESS;
+    }
+#endif
+
     status = pj_timer_heap_schedule_w_grp_lock(timer_heap, entry,
                                                delay, active_id,
                                                tsx->grp_lock);
@@ -969,9 +1325,43 @@ static int tsx_cancel_timer(pjsip_transaction *tsx,
                             pj_timer_entry *entry)
 {
     pj_timer_heap_t *timer_heap = pjsip_endpt_get_timer_heap(tsx->endpt);
+
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    if (entry == &tsx->retransmit_timer)
+	return retrans_cancel(tsx);
+#endif
+
     return pj_timer_heap_cancel_if_active(timer_heap, entry, TIMER_INACTIVE);
 }
 
+/* Utility: check if retransmission is scheduled */
+static pj_bool_t tsx_retransmit_scheduled(pjsip_transaction *tsx)
+{
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+    return tsx->retransmit_timer.id != TIMER_INACTIVE;
+#else
+    return pj_timer_entry_running(&tsx->retransmit_timer);
+#endif
+}
+
+/* Save the branch parameter of the transaction. The key of RFC 3261
+ * transactions ends with the branch, so share its storage if possible.
+ */
+static void tsx_set_branch(pjsip_transaction *tsx, const pj_str_t *branch)
+{
+    const pj_str_t *key = &tsx->transaction_key;
+
+    if (key->slen >= branch->slen &&
+	pj_memcmp(key->ptr + key->slen - branch->slen, branch->ptr,
+		  branch->slen) == 0)
+    {
+	tsx->branch.ptr = key->ptr + key->slen - branch->slen;
+	tsx->branch.slen = branch->slen;
+    } else {
+	pj_strdup(tsx->pool, &tsx->branch, branch);
+    }
+}
+
 /* Create and initialize basic transaction structure.
  * This function is called by both UAC and UAS creation.
  */
@@ -988,8 +1378,13 @@ static pj_status_t tsx_create( pjsip_module *tsx_user,
     if (!pool)
 	return PJ_ENOMEM;
 
-    tsx = PJ_POOL_ZALLOC_T(pool, pjsip_transaction);
+    tsx = (pjsip_transaction*) pj_objpool_zalloc(mod_tsx_layer.objpool);
+    if (!tsx) {
+	pjsip_endpt_release_pool(mod_tsx_layer.endpt, pool);
+	return PJ_ENOMEM;
+    }
     tsx->pool = pool;
+    tsx->objpool = mod_tsx_layer.objpool;
     tsx->tsx_user = tsx_user;
     tsx->endpt = mod_tsx_layer.endpt;
 
@@ -1004,6 +1399,7 @@ static pj_status_t tsx_create( pjsip_module *tsx_user,
     tsx->timeout_timer.id = TIMER_INACTIVE;
     tsx->timeout_timer.user_data = tsx;
     tsx->timeout_timer.cb = &tsx_timer_callback;
+    tsx->retrans_node.tsx = tsx;
     
     if (grp_lock) {
 	tsx->grp_lock = grp_lock;
@@ -1011,6 +1407,7 @@ static pj_status_t tsx_create( pjsip_module *tsx_user,
 	status = pj_grp_lock_create(pool, NULL, &tsx->grp_lock);
 	if (status != PJ_SUCCESS) {
 	    pjsip_endpt_release_pool(mod_tsx_layer.endpt, pool);
+	    pj_objpool_free(mod_tsx_layer.objpool, tsx);
 	    return status;
 	}
     }
@@ -1018,12 +1415,6 @@ static pj_status_t tsx_create( pjsip_module *tsx_user,
     pj_grp_lock_add_ref(tsx->grp_lock);
     pj_grp_lock_add_handler(tsx->grp_lock, tsx->pool, tsx, &tsx_on_destroy);
 
-    status = pj_mutex_create_simple(pool, tsx->obj_name, &tsx->mutex_b);
-    if (status != PJ_SUCCESS) {
-	tsx_shutdown(tsx);
-	return status;
-    }
-
     *p_tsx = tsx;
     return PJ_SUCCESS;
 }
@@ -1035,8 +1426,11 @@ static void tsx_on_destroy( void *arg )
 
     PJ_LOG(5,(tsx->obj_name, "Transaction destroyed!"));
 
-    pj_mutex_destroy(tsx->mutex_b);
+    /* The transaction layer may have been destroyed by now, in which case
+     * the object pool is destroyed when its last transaction is freed.
+     */
     pjsip_endpt_release_pool(tsx->endpt, tsx->pool);
+    pj_objpool_free(tsx->objpool, tsx);
 }
 
 /* Shutdown transaction. */
@@ -1085,6 +1479,28 @@ static pj_status_t tsx_shutdown( pjsip_transaction *tsx )
 }
 
 
+/*
+ * Dispatch timer event to the transaction.
+ */
+static void tsx_dispatch_timer(pjsip_transaction *tsx, pj_timer_entry *entry)
+{
+    pjsip_event event;
+
+    PJ_LOG(5,(tsx->obj_name, "%s timer event",
+	     (entry==&tsx->retransmit_timer ? "Retransmit":"Timeout")));
+    pj_log_push_indent();
+
+
+    PJSIP_EVENT_INIT_TIMER(event, entry);
+
+    /* Dispatch event to transaction. */
+    pj_grp_lock_acquire(tsx->grp_lock);
+    (*tsx->state_handler)(tsx, &event);
+    pj_grp_lock_release(tsx->grp_lock);
+
+    pj_log_pop_indent();
+}
+
 /*
  * Callback when timer expires. Transport error also piggybacks this event
  * to avoid deadlock (https://trac.pjsip.org/repos/ticket/1646).
@@ -1137,25 +1553,90 @@ static void tsx_timer_callback( pj_timer_heap_t *theap, pj_timer_entry *entry)
 	    }
 	}
     } else {
-	pjsip_event event;
-
 	entry->id = 0;
+	tsx_dispatch_timer(tsx, entry);
+    }
+}
 
-	PJ_LOG(5,(tsx->obj_name, "%s timer event",
-		 (entry==&tsx->retransmit_timer ? "Retransmit":"Timeout")));
-	pj_log_push_indent();
 
+#if PJSIP_TSX_RETRANS_SWEEP_INTERVAL
+/*
+ * Callback of the retransmission sweep timer. Takes all due transactions
+ * out of the wheel and retransmits them.
+ */
+static void tsx_retrans_sweep(pj_timer_heap_t *theap, pj_timer_entry *entry)
+{
+    pjsip_transaction *due[RETRANS_SWEEP_BATCH];
+    unsigned i, cnt, now;
+    pj_bool_t done;
 
-	PJSIP_EVENT_INIT_TIMER(event, entry);
+    PJ_UNUSED_ARG(theap);
 
-	/* Dispatch event to transaction. */
-	pj_grp_lock_acquire(tsx->grp_lock);
-	(*tsx->state_handler)(tsx, &event);
-	pj_grp_lock_release(tsx->grp_lock);
+    pj_mutex_lock(mod_tsx_layer.retrans_mutex);
+    entry->id = TIMER_INACTIVE;
+    mod_tsx_layer.retrans_sweeping = PJ_TRUE;
+    now = retrans_get_tick();
 
-	pj_log_pop_indent();
-    }
+    /* If we're late by more than a turn, every slot needs to be swept
+     * only once.
+     */
+    if ((int)(now - mod_tsx_layer.retrans_tick) >=
+	PJSIP_TSX_RETRANS_WHEEL_SIZE)
+    {
+	mod_tsx_layer.retrans_tick = now - PJSIP_TSX_RETRANS_WHEEL_SIZE + 1;
+    }
+
+    do {
+	cnt = 0;
+	while ((int)(now - mod_tsx_layer.retrans_tick) >= 0) {
+	    pjsip_tsx_retrans_node *slot, *node;
+
+	    slot = &mod_tsx_layer.retrans_slot[mod_tsx_layer.retrans_tick %
+					       PJSIP_TSX_RETRANS_WHEEL_SIZE];
+	    node = slot->next;
+	    while (node != slot && cnt < RETRANS_SWEEP_BATCH) {
+		pjsip_tsx_retrans_node *next = node->next;
+
+		/* Transactions due in a later turn stay in the slot */
+		if ((int)(node->due - now) <= 0) {
+		    pj_list_erase(node);
+		    node->tsx->retransmit_timer.id = TIMER_INACTIVE;
+		    --mod_tsx_layer.retrans_count;
+		    due[cnt++] = node->tsx;
+		}
+		node = next;
+	    }
+
+	    /* Batch is full, come back to this slot */
+	    if (node != slot)
+		break;
+
+	    ++mod_tsx_layer.retrans_tick;
+	}
+
+	done = ((int)(now - mod_tsx_layer.retrans_tick) < 0);
+	if (done) {
+	    mod_tsx_layer.retrans_sweeping = PJ_FALSE;
+	    if (mod_tsx_layer.retrans_count &&
+		mod_tsx_layer.retrans_sweep.id == TIMER_INACTIVE)
+	    {
+		retrans_start_sweep();
+	    }
+	}
+	pj_mutex_unlock(mod_tsx_layer.retrans_mutex);
+
+	/* Retransmit, and release the references held by the wheel */
+	for (i=0; i<cnt; ++i) {
+	    tsx_dispatch_timer(due[i], &due[i]->retransmit_timer);
+	    pj_grp_lock_dec_ref(due[i]->grp_lock);
+	}
+
+	if (!done)
+	    pj_mutex_lock(mod_tsx_layer.retrans_mutex);
+
+    } while (!done);
 }
+#endif
 
 
 /*
@@ -1331,27 +1812,23 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_uac2(pjsip_module *tsx_user,
     if (via->branch_param.slen == 0) {
 	pj_str_t tmp;
 	via->branch_param.ptr = (char*)
-				pj_pool_alloc(tsx->pool, PJSIP_MAX_BRANCH_LEN);
+				pj_pool_alloc(tdata->pool, PJSIP_MAX_BRANCH_LEN);
 	via->branch_param.slen = PJSIP_MAX_BRANCH_LEN;
 	pj_memcpy(via->branch_param.ptr, PJSIP_RFC3261_BRANCH_ID, 
 		  PJSIP_RFC3261_BRANCH_LEN);
 	tmp.ptr = via->branch_param.ptr + PJSIP_RFC3261_BRANCH_LEN + 2;
 	*(tmp.ptr-2) = 80; *(tmp.ptr-1) = 106;
 	pj_generate_unique_string( &tmp );
-
-        /* Save branch parameter. */
-        tsx->branch = via->branch_param;
-
-    } else {
-        /* Copy branch parameter. */
-        pj_strdup(tsx->pool, &tsx->branch, &via->branch_param);
     }
 
    /* Generate transaction key. */
-    create_tsx_key_3261( tsx->pool, &tsx->transaction_key,
-			 PJSIP_ROLE_UAC, &tsx->method, 
+    create_tsx_key_3261( tsx->pool, tsx->key_buf, sizeof(tsx->key_buf),
+			 &tsx->transaction_key, PJSIP_ROLE_UAC, &tsx->method,
 			 &via->branch_param);
 
+    /* Save branch parameter. */
+    tsx_set_branch(tsx, &via->branch_param);
+
     /* Calculate hashed key value. */
 #ifdef PRECALC_HASH
     tsx->hashed_key = pj_hash_calc_tolower(0, NULL, &tsx->transaction_key);
@@ -1483,8 +1960,9 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_uas2(pjsip_module *tsx_user,
     /* Get transaction key either from branch for RFC3261 message, or
      * create transaction key.
      */
-    status = pjsip_tsx_create_key(tsx->pool, &tsx->transaction_key, 
-                                  PJSIP_ROLE_UAS, &tsx->method, rdata);
+    status = create_tsx_key(tsx->pool, tsx->key_buf, sizeof(tsx->key_buf),
+			    &tsx->transaction_key, PJSIP_ROLE_UAS,
+			    &tsx->method, rdata);
     if (status != PJ_SUCCESS) {
 	pj_grp_lock_release(tsx->grp_lock);
 	tsx_shutdown(tsx);
@@ -1496,9 +1974,9 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_uas2(pjsip_module *tsx_user,
     tsx->hashed_key = pj_hash_calc_tolower(0, NULL, &tsx->transaction_key);
 #endif
 
-    /* Duplicate branch parameter for transaction. */
+    /* Save branch parameter for transaction. */
     branch = &rdata->msg_info.via->branch_param;
-    pj_strdup(tsx->pool, &tsx->branch, branch);
+    tsx_set_branch(tsx, branch);
 
     PJ_LOG(6, (tsx->obj_name, "tsx_key=%.*s", tsx->transaction_key.slen,
 	       tsx->transaction_key.ptr));
@@ -2235,7 +2713,7 @@ static pj_status_t tsx_retransmit( pjsip_transaction *tsx, int resched)
 {
     pj_status_t status;
 
-    if (resched && pj_timer_entry_running(&tsx->retransmit_timer)) {
+    if (resched && tsx_retransmit_scheduled(tsx)) {
 	/* We've been asked to reschedule but the timer is already rerunning.
 	 * This can only happen in a race condition where, between removing
 	 * this retransmit timer from the heap and actually scheduling it,
@@ -26,11 +26,13 @@
 #include <pjsip/sip_module.h>
 #include <pj/addr_resolv.h>
 #include <pj/except.h>
+#include <pj/ctype.h>
 #include <pj/os.h>
 #include <pj/log.h>
 #include <pj/ioqueue.h>
 #include <pj/hash.h>
 #include <pj/string.h>
+#include <pj/objpool.h>
 #include <pj/pool.h>
 #include <pj/assert.h>
 #include <pj/lock.h>
@@ -77,6 +79,14 @@ static pjsip_module mod_msg_print =
     NULL,				/* on_tsx_state()		    */
 };
 
+/* Buffer of a thread to build fast responses in. */
+typedef struct fast_resp_buf
+{
+    PJ_DECL_LIST_MEMBER(struct fast_resp_buf);
+    pjsip_tx_data   *tdata;			/* Reused to send response. */
+    char	     buf[PJSIP_MAX_PKT_LEN];	/* Response being built.    */
+} fast_resp_buf;
+
 /*
  * Transport manager.
  */
@@ -86,6 +96,7 @@ struct pjsip_tpmgr
     pj_lock_t	    *lock;
     pjsip_endpoint  *endpt;
     pjsip_tpfactory  factory_list;
+    pj_objpool_t    *tdata_objpool;
 #if defined(PJ_DEBUG) && PJ_DEBUG!=0
     pj_atomic_t	    *tdata_counter;
 #endif
@@ -93,10 +104,19 @@ struct pjsip_tpmgr
     pj_status_t	   (*on_tx_msg)(pjsip_endpoint*, pjsip_tx_data*);
     pjsip_tp_state_callback tp_state_cb;
 
+    /* Sizes of messages received and transmitted by all transports. */
+    pjsip_tp_size_stat rx_size_stat;
+    pjsip_tp_size_stat tx_size_stat;
+
     /* Transmit data list, for transmit data cleanup when transport manager
      * is destroyed.
      */
     pjsip_tx_data    tdata_list;
+
+    /* Fast response path. */
+    pjsip_tp_on_rx_fast_req on_rx_fast_req;
+    long	     fast_tls_id;
+    fast_resp_buf    fast_buf_list;
 };
 
 
@@ -381,6 +401,92 @@ PJ_DEF(void) pjsip_tpselector_dec_ref(pjsip_tpselector *sel)
 }
 
 
+/*****************************************************************************
+ *
+ * MESSAGE SIZE STATISTICS.
+ *
+ *****************************************************************************/
+
+enum
+{
+    /* Minimum number of messages before the statistics are used. */
+    SIZE_STAT_MIN_COUNT = 32,
+
+    /* The histograms are halved when they count this many messages. */
+    SIZE_STAT_MAX_COUNT = 4096,
+
+    /* Percentage of messages that should fit in the pool. */
+    SIZE_STAT_PERCENTILE = 95
+};
+
+/* Get the histogram bin for the size. */
+static unsigned size_stat_bin(pj_size_t size)
+{
+    pj_size_t bin = size / PJSIP_TP_SIZE_STAT_BIN_LEN;
+
+    return bin < PJSIP_TP_SIZE_STAT_BINS ? (unsigned)bin :
+					   PJSIP_TP_SIZE_STAT_BINS - 1;
+}
+
+/*
+ * Add a message to the size statistics.
+ */
+PJ_DEF(void) pjsip_tp_size_stat_add(pjsip_tp_size_stat *stat,
+				    pj_size_t msg_len,
+				    pj_size_t pool_used)
+{
+    if (stat->count >= SIZE_STAT_MAX_COUNT) {
+	unsigned i, count = 0;
+
+	/* Age the histograms, so that they follow the recent traffic. */
+	for (i=0; i<PJSIP_TP_SIZE_STAT_BINS; ++i) {
+	    stat->msg_len[i] >>= 1;
+	    stat->pool_used[i] >>= 1;
+	    count += stat->pool_used[i];
+	}
+	stat->count = count;
+    }
+
+    ++stat->msg_len[size_stat_bin(msg_len)];
+    ++stat->pool_used[size_stat_bin(pool_used)];
+    ++stat->count;
+}
+
+/*
+ * Get the initial pool size for most of the messages in the statistics.
+ */
+PJ_DEF(pj_size_t) pjsip_tp_size_stat_get_pool_size(
+					const pjsip_tp_size_stat *stat,
+					pj_size_t reserved,
+					pj_size_t def_size)
+{
+#if PJSIP_POOL_ADAPTIVE_SIZE
+    unsigned i, count, limit;
+
+    count = stat->count;
+    if (count < SIZE_STAT_MIN_COUNT)
+	return def_size;
+
+    /* Find the bin where the percentile falls in. */
+    limit = count * SIZE_STAT_PERCENTILE / 100;
+    count = 0;
+    for (i=0; i<PJSIP_TP_SIZE_STAT_BINS-1; ++i) {
+	count += stat->pool_used[i];
+	if (count >= limit)
+	    break;
+    }
+
+    /* The pool and the first block headers are in the initial block too. */
+    return (i+1) * PJSIP_TP_SIZE_STAT_BIN_LEN + reserved +
+	   sizeof(pj_pool_t) + sizeof(pj_pool_block) + PJ_POOL_ALIGNMENT;
+#else
+    PJ_UNUSED_ARG(stat);
+    PJ_UNUSED_ARG(reserved);
+    return def_size;
+#endif
+}
+
+
 /*****************************************************************************
  *
  * TRANSMIT DATA BUFFER MANIPULATION.
@@ -400,12 +506,18 @@ PJ_DEF(pj_status_t) pjsip_tx_data_create( pjsip_tpmgr *mgr,
     PJ_ASSERT_RETURN(mgr && p_tdata, PJ_EINVAL);
 
     pool = pjsip_endpt_create_pool( mgr->endpt, "tdta%p",
-				    PJSIP_POOL_LEN_TDATA,
+				    pjsip_tp_size_stat_get_pool_size(
+					&mgr->tx_size_stat, 0,
+					PJSIP_POOL_LEN_TDATA),
 				    PJSIP_POOL_INC_TDATA );
     if (!pool)
 	return PJ_ENOMEM;
 
-    tdata = PJ_POOL_ZALLOC_T(pool, pjsip_tx_data);
+    tdata = (pjsip_tx_data*) pj_objpool_zalloc(mgr->tdata_objpool);
+    if (!tdata) {
+	pjsip_endpt_release_pool( mgr->endpt, pool );
+	return PJ_ENOMEM;
+    }
     tdata->pool = pool;
     tdata->mgr = mgr;
     pj_memcpy(tdata->obj_name, pool->obj_name, PJ_MAX_OBJ_NAME);
@@ -413,6 +525,7 @@ PJ_DEF(pj_status_t) pjsip_tx_data_create( pjsip_tpmgr *mgr,
     status = pj_atomic_create(tdata->pool, 0, &tdata->ref_cnt);
     if (status != PJ_SUCCESS) {
 	pjsip_endpt_release_pool( mgr->endpt, tdata->pool );
+	pj_objpool_free( mgr->tdata_objpool, tdata );
 	return status;
     }
     
@@ -420,6 +533,7 @@ PJ_DEF(pj_status_t) pjsip_tx_data_create( pjsip_tpmgr *mgr,
     status = pj_lock_create_null_mutex(pool, "tdta%p", &tdata->lock);
     if (status != PJ_SUCCESS) {
 	pjsip_endpt_release_pool( mgr->endpt, tdata->pool );
+	pj_objpool_free( mgr->tdata_objpool, tdata );
 	return status;
     }
 
@@ -455,6 +569,13 @@ static void tx_data_destroy(pjsip_tx_data *tdata)
     PJ_LOG(5,(tdata->obj_name, "Destroying txdata %s",
 	      pjsip_tx_data_get_info(tdata)));
     pjsip_tpselector_dec_ref(&tdata->tp_sel);
+
+    /* Record the size of the message and the pool memory it used. */
+    if (tdata->buf.start) {
+	pjsip_tp_size_stat_add(&tdata->mgr->tx_size_stat,
+			       tdata->buf.cur - tdata->buf.start,
+			       pj_pool_get_used_size(tdata->pool));
+    }
 #if defined(PJ_DEBUG) && PJ_DEBUG!=0
     pj_atomic_dec( tdata->mgr->tdata_counter );
 #endif
@@ -469,6 +590,7 @@ static void tx_data_destroy(pjsip_tx_data *tdata)
     pj_atomic_destroy( tdata->ref_cnt );
     pj_lock_destroy( tdata->lock );
     pjsip_endpt_release_pool( tdata->mgr->endpt, tdata->pool );
+    pj_objpool_free( tdata->mgr->tdata_objpool, tdata );
 }
 
 /*
@@ -494,6 +616,21 @@ PJ_DEF(void) pjsip_tx_data_invalidate_msg( pjsip_tx_data *tdata )
 {
     tdata->buf.cur = tdata->buf.start;
     tdata->info = NULL;
+    tdata->print_cache.buf = NULL;
+}
+
+/*
+ * Invalidate the print buffer after a header has been modified, keeping
+ * the other headers for the next print.
+ */
+PJ_DEF(void) pjsip_tx_data_invalidate_hdr( pjsip_tx_data *tdata,
+					   const void *hdr )
+{
+    PJ_ASSERT_ON_FAIL(tdata && hdr, return);
+
+    tdata->buf.cur = tdata->buf.start;
+    tdata->info = NULL;
+    pjsip_msg_print_cache_invalidate_hdr(&tdata->print_cache, hdr);
 }
 
 /*
@@ -520,16 +657,78 @@ PJ_DEF(pj_status_t) pjsip_tx_data_encode(pjsip_tx_data *tdata)
 
     /* Do we need to reprint? */
     if (!pjsip_tx_data_is_valid(tdata)) {
+	pj_size_t buf_len = tdata->buf.end - tdata->buf.start;
+	char *buf = tdata->buf.start;
 	pj_ssize_t size;
 
-	size = pjsip_msg_print( tdata->msg, tdata->buf.start, 
-			        tdata->buf.end - tdata->buf.start);
+	/* If the buffer still holds the previous print, print to the second
+	 * buffer so that unchanged headers can be copied from the first.
+	 */
+	if (tdata->print_cache.buf == tdata->buf.start &&
+	    buf_len == PJSIP_MAX_PKT_LEN)
+	{
+	    if (tdata->print_buf == NULL) {
+		PJ_USE_EXCEPTION;
+
+		PJ_TRY {
+		    tdata->print_buf = (char*)
+				       pj_pool_alloc(tdata->pool,
+						     PJSIP_MAX_PKT_LEN);
+		}
+		PJ_CATCH_ANY {
+		    return PJ_ENOMEM;
+		}
+		PJ_END
+	    }
+	    buf = tdata->print_buf;
+	} else {
+	    tdata->print_cache.buf = NULL;
+	}
+
+	size = pjsip_msg_print2( tdata->msg, buf, buf_len, tdata->pool,
+				 &tdata->print_cache);
+
+	if (size >= 0 && buf != tdata->buf.start) {
+	    tdata->print_buf = tdata->buf.start;
+	    tdata->buf.start = buf;
+	    tdata->buf.end = buf + buf_len;
+	}
+
+	/* The message doesn't fit, normally because of a large body. Print
+	 * it once to a buffer of the largest size, datagram transports will
+	 * reject it when it's sent.
+	 */
+	if (size < 0 && tdata->msg->body &&
+	    PJSIP_MAX_STREAM_TX_LEN > PJSIP_MAX_PKT_LEN &&
+	    buf_len < PJSIP_MAX_STREAM_TX_LEN)
+	{
+	    PJ_USE_EXCEPTION;
+
+	    buf_len = PJSIP_MAX_STREAM_TX_LEN;
+	    PJ_TRY {
+		buf = (char*) pj_pool_alloc(tdata->pool, buf_len);
+	    }
+	    PJ_CATCH_ANY {
+		return PJ_ENOMEM;
+	    }
+	    PJ_END
+
+	    tdata->print_cache.buf = NULL;
+	    size = pjsip_msg_print2( tdata->msg, buf, buf_len, tdata->pool,
+				     &tdata->print_cache);
+	    if (size >= 0) {
+		tdata->buf.start = buf;
+		tdata->buf.end = buf + buf_len;
+	    }
+	}
+
 	if (size < 0) {
+	    tdata->print_cache.buf = NULL;
 	    return PJSIP_EMSGTOOLONG;
 	}
 	pj_assert(size != 0);
-	tdata->buf.cur[size] = '\0';
-	tdata->buf.cur += size;
+
+	tdata->buf.cur = tdata->buf.start + size;
     }
 
     return PJ_SUCCESS;
@@ -655,11 +854,22 @@ PJ_DEF(pj_status_t) pjsip_rx_data_clone( const pjsip_rx_data *src,
     dst->tp_info.pool = pool;
     dst->tp_info.transport = (pjsip_transport*)src->tp_info.transport;
 
-    /* pkt_info can be memcopied */
+    /* pkt_info can be memcopied, except the stream receive buffer */
     pj_memcpy(&dst->pkt_info, &src->pkt_info, sizeof(src->pkt_info));
+    if (src->pkt_info.ext_packet) {
+	dst->pkt_info.ext_packet = (char*)
+				   pj_pool_alloc(pool, src->pkt_info.len + 1);
+	pj_memcpy(dst->pkt_info.ext_packet, src->pkt_info.ext_packet,
+		  src->pkt_info.len);
+	dst->pkt_info.ext_packet[src->pkt_info.len] = '\0';
+	dst->msg_info.msg_buf = dst->pkt_info.ext_packet +
+				(src->msg_info.msg_buf -
+				 src->pkt_info.ext_packet);
+    } else {
+	dst->msg_info.msg_buf = dst->pkt_info.packet;
+    }
 
     /* msg_info needs deep clone */
-    dst->msg_info.msg_buf = dst->pkt_info.packet;
     dst->msg_info.len = src->msg_info.len;
     dst->msg_info.msg = pjsip_msg_clone(pool, src->msg_info.msg);
     pj_list_init(&dst->msg_info.parse_err);
@@ -732,7 +942,9 @@ static void transport_send_callback(pjsip_transport *transport,
 {
     pjsip_tx_data *tdata = (pjsip_tx_data*) token;
 
-    PJ_UNUSED_ARG(transport);
+    /* One less message queued on the transport */
+    if (transport && transport->pending_tx)
+	pj_atomic_dec(transport->pending_tx);
 
     /* Mark pending off so that app can resend/reuse txdata from inside
      * the callback.
@@ -778,6 +990,18 @@ PJ_DEF(pj_status_t) pjsip_transport_send(  pjsip_transport *tr,
 	return PJSIP_EPENDINGTX;
     }
 
+    /* Report back-pressure when too many messages are already queued on
+     * the transport, so that caller may try another connection or retry
+     * later rather than growing the queue indefinitely.
+     */
+    if (pjsip_cfg()->tp.max_pending_tx &&
+	pjsip_transport_get_pending_tx(tr) >= pjsip_cfg()->tp.max_pending_tx)
+    {
+	PJ_LOG(4,(THIS_FILE, "Unable to send %s: transport %s is busy",
+			     pjsip_tx_data_get_info(tdata), tr->obj_name));
+	return PJSIP_ETPBUSY;
+    }
+
     /* Add reference to prevent deletion, and to cancel idle timer if
      * it's running.
      */
@@ -817,10 +1041,15 @@ PJ_DEF(pj_status_t) pjsip_transport_send(  pjsip_transport *tr,
     tdata->is_pending = 1;
 
     /* Send to transport. */
+    if (tr->pending_tx)
+	pj_atomic_inc(tr->pending_tx);
+
     status = (*tr->send_msg)(tr, tdata,  addr, addr_len, (void*)tdata, 
 			     &transport_send_callback);
 
     if (status != PJ_EPENDING) {
+	if (tr->pending_tx)
+	    pj_atomic_dec(tr->pending_tx);
 	tdata->is_pending = 0;
 	pjsip_tx_data_dec_ref(tdata);
     }
@@ -855,26 +1084,20 @@ static void send_raw_callback(pjsip_transport *transport,
 }
 
 
-/* Send raw data */
-PJ_DEF(pj_status_t) pjsip_tpmgr_send_raw(pjsip_tpmgr *mgr,
-					 pjsip_transport_type_e tp_type,
-					 const pjsip_tpselector *sel,
-					 pjsip_tx_data *tdata,
-					 const void *raw_data,
-					 pj_size_t data_len,
-					 const pj_sockaddr_t *addr,
-					 int addr_len,
-					 void *token,
-					 pjsip_tp_send_callback cb)
+/* Send raw data with the transport that has been acquired by the caller.
+ * The reference of the transport (and of tdata, if specified) is released
+ * when the sending completes.
+ */
+static pj_status_t send_raw_with_tp(pjsip_transport *tr,
+				    pjsip_tx_data *tdata,
+				    const void *raw_data,
+				    pj_size_t data_len,
+				    const pj_sockaddr_t *addr,
+				    int addr_len,
+				    void *token,
+				    pjsip_tp_send_callback cb)
 {
-    pjsip_transport *tr;
     pj_status_t status;
- 
-    /* Acquire the transport */
-    status = pjsip_tpmgr_acquire_transport(mgr, tp_type, addr, addr_len,
-					   sel, &tr);
-    if (status != PJ_SUCCESS)
-	return status;
 
     /* Create transmit data buffer if one is not specified */
     if (tdata == NULL) {
@@ -925,6 +1148,31 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_send_raw(pjsip_tpmgr *mgr,
     return status;
 }
 
+/* Send raw data */
+PJ_DEF(pj_status_t) pjsip_tpmgr_send_raw(pjsip_tpmgr *mgr,
+					 pjsip_transport_type_e tp_type,
+					 const pjsip_tpselector *sel,
+					 pjsip_tx_data *tdata,
+					 const void *raw_data,
+					 pj_size_t data_len,
+					 const pj_sockaddr_t *addr,
+					 int addr_len,
+					 void *token,
+					 pjsip_tp_send_callback cb)
+{
+    pjsip_transport *tr;
+    pj_status_t status;
+ 
+    /* Acquire the transport */
+    status = pjsip_tpmgr_acquire_transport(mgr, tp_type, addr, addr_len,
+					   sel, &tr);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    return send_raw_with_tp(tr, tdata, raw_data, data_len, addr, addr_len,
+			    token, cb);
+}
+
 
 static void transport_idle_callback(pj_timer_heap_t *timer_heap,
 				    struct pj_timer_entry *entry)
@@ -1001,6 +1249,28 @@ PJ_DEF(pj_status_t) pjsip_transport_dec_ref( pjsip_transport *tp )
     return PJ_SUCCESS;
 }
 
+/*
+ * Get number of messages queued on the transport.
+ */
+PJ_DEF(unsigned) pjsip_transport_get_pending_tx( pjsip_transport *tp )
+{
+    PJ_ASSERT_RETURN(tp != NULL, 0);
+
+    return tp->pending_tx ? (unsigned) pj_atomic_get(tp->pending_tx) : 0;
+}
+
+/*
+ * Check if more than one connection may be opened to the same destination
+ * for this transport.
+ */
+static pj_bool_t is_pooled_transport(const pjsip_transport *tp)
+{
+    return pjsip_cfg()->tp.pool_size > 1 &&
+	   (tp->flag & PJSIP_TRANSPORT_RELIABLE) != 0 &&
+	   tp->key.type != PJSIP_TRANSPORT_LOOP &&
+	   tp->key.type != PJSIP_TRANSPORT_LOOP_DGRAM;
+}
+
 
 /**
  * Register a transport.
@@ -1017,6 +1287,15 @@ PJ_DEF(pj_status_t) pjsip_transport_register( pjsip_tpmgr *mgr,
     pj_bzero(&tp->idle_timer, sizeof(tp->idle_timer));
     tp->idle_timer.user_data = tp;
     tp->idle_timer.cb = &transport_idle_callback;
+    tp->pool_next = NULL;
+
+    if (tp->pending_tx == NULL) {
+	pj_status_t status;
+
+	status = pj_atomic_create(tp->pool, 0, &tp->pending_tx);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
 
     /* 
      * Register to hash table (see Trac ticket #42).
@@ -1024,13 +1303,21 @@ PJ_DEF(pj_status_t) pjsip_transport_register( pjsip_tpmgr *mgr,
     key_len = sizeof(tp->key.type) + tp->addr_len;
     pj_lock_acquire(mgr->lock);
 
-    /* If entry already occupied, unregister previous entry */
+    /* If entry already occupied, unregister previous entry. With
+     * connection pooling, the previous entry is kept in the list of
+     * connections to the destination instead.
+     */
     hval = 0;
     entry = pj_hash_get(mgr->table, &tp->key, key_len, &hval);
-    if (entry != NULL)
+    if (entry != NULL) {
 	pj_hash_set(NULL, mgr->table, &tp->key, key_len, hval, NULL);
+	if (is_pooled_transport(tp))
+	    tp->pool_next = (pjsip_transport*) entry;
+    }
 
-    /* Register new entry */
+    /* Register new entry. Note that the hash entry is allocated from, and
+     * refers to the key of, the first transport in the list.
+     */
     pj_hash_set(tp->pool, mgr->table, &tp->key, key_len, hval, tp);
 
     pj_lock_release(mgr->lock);
@@ -1074,9 +1361,25 @@ static pj_status_t destroy_transport( pjsip_tpmgr *mgr,
     key_len = sizeof(tp->key.type) + tp->addr_len;
     hval = 0;
     entry = pj_hash_get(mgr->table, &tp->key, key_len, &hval);
-    if (entry == (void*)tp)
+    if (entry == (void*)tp) {
 	pj_hash_set(NULL, mgr->table, &tp->key, key_len, hval, NULL);
 
+	/* Next connection to the destination takes over the entry */
+	if (tp->pool_next) {
+	    pjsip_transport *next = tp->pool_next;
+	    pj_hash_set(next->pool, mgr->table, &next->key, key_len, hval,
+			next);
+	}
+    } else {
+	pjsip_transport *prev = (pjsip_transport*) entry;
+
+	while (prev && prev->pool_next != tp)
+	    prev = prev->pool_next;
+	if (prev)
+	    prev->pool_next = tp->pool_next;
+    }
+    tp->pool_next = NULL;
+
     pj_lock_release(mgr->lock);
 
     /* Destroy. */
@@ -1258,6 +1561,8 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_create( pj_pool_t *pool,
     mgr->on_tx_msg = tx_cb;
     pj_list_init(&mgr->factory_list);
     pj_list_init(&mgr->tdata_list);
+    pj_list_init(&mgr->fast_buf_list);
+    mgr->fast_tls_id = -1;
 
     mgr->table = pj_hash_create(pool, PJSIP_TPMGR_HTABLE_SIZE);
     if (!mgr->table)
@@ -1267,9 +1572,21 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_create( pj_pool_t *pool,
     if (status != PJ_SUCCESS)
 	return status;
 
+    /* Transmit data instances are recycled with an object pool, their
+     * variable-size content still goes to the tdata's own memory pool.
+     */
+    status = pj_objpool_create(pool->factory, "tdtaobj%p",
+			       sizeof(pjsip_tx_data), 0,
+			       &mgr->tdata_objpool);
+    if (status != PJ_SUCCESS) {
+	pj_lock_destroy(mgr->lock);
+	return status;
+    }
+
 #if defined(PJ_DEBUG) && PJ_DEBUG!=0
     status = pj_atomic_create(pool, 0, &mgr->tdata_counter);
     if (status != PJ_SUCCESS) {
+	pj_objpool_destroy(mgr->tdata_objpool);
     	pj_lock_destroy(mgr->lock);
     	return status;
     }
@@ -1486,6 +1803,35 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_find_local_addr( pjsip_tpmgr *tpmgr,
     return PJ_SUCCESS;
 }
 
+/*
+ * Get the size statistics of all transports.
+ */
+PJ_DEF(pj_status_t) pjsip_tpmgr_get_size_stat(pjsip_tpmgr *mgr,
+					      pjsip_tp_size_stat *rx_stat,
+					      pjsip_tp_size_stat *tx_stat)
+{
+    PJ_ASSERT_RETURN(mgr, PJ_EINVAL);
+
+    if (rx_stat)
+	pj_memcpy(rx_stat, &mgr->rx_size_stat, sizeof(*rx_stat));
+    if (tx_stat)
+	pj_memcpy(tx_stat, &mgr->tx_size_stat, sizeof(*tx_stat));
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Get the initial size of a new rdata pool.
+ */
+PJ_DEF(pj_size_t) pjsip_tpmgr_get_rdata_pool_size(pjsip_tpmgr *mgr,
+						  pj_size_t reserved)
+{
+    PJ_ASSERT_RETURN(mgr, PJSIP_POOL_RDATA_LEN);
+
+    return pjsip_tp_size_stat_get_pool_size(&mgr->rx_size_stat, reserved,
+					    PJSIP_POOL_RDATA_LEN);
+}
+
 /*
  * Return number of transports currently registered to the transport
  * manager.
@@ -1500,7 +1846,10 @@ PJ_DEF(unsigned) pjsip_tpmgr_get_transport_count(pjsip_tpmgr *mgr)
     
     itr = pj_hash_first(mgr->table, &itr_val);
     while (itr) {
-	nr_of_transports++;
+	pjsip_transport *tp = (pjsip_transport*) pj_hash_this(mgr->table, itr);
+
+	for (; tp; tp = tp->pool_next)
+	    nr_of_transports++;
 	itr = pj_hash_next(mgr->table, itr);
     }
     
@@ -1537,6 +1886,12 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
 
 	next = pj_hash_next(mgr->table, itr);
 
+	/* Destroy other connections to the same destination first, so
+	 * that the hash entry is only removed with the last one.
+	 */
+	while (transport->pool_next)
+	    destroy_transport(mgr, transport->pool_next);
+
 	destroy_transport(mgr, transport);
 
 	itr = next;
@@ -1556,6 +1911,19 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
 
     pj_lock_release(mgr->lock);
 
+    /*
+     * Release the buffers of the fast response path.
+     */
+    while (!pj_list_empty(&mgr->fast_buf_list)) {
+	fast_resp_buf *fb = mgr->fast_buf_list.next;
+	pj_list_erase(fb);
+	pjsip_tx_data_dec_ref(fb->tdata);
+    }
+    if (mgr->fast_tls_id != -1) {
+	pj_thread_local_free(mgr->fast_tls_id);
+	mgr->fast_tls_id = -1;
+    }
+
 #if defined(PJ_DEBUG) && PJ_DEBUG!=0
     /* If you encounter assert error on this line, it means there are
      * leakings in transmit data (i.e. some transmit data have not been
@@ -1585,6 +1953,10 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
     pj_atomic_destroy(mgr->tdata_counter);
 #endif
 
+    /* Transmit buffers which are still referenced (e.g. by a dialog or
+     * a pending send) keep the object pool until they are destroyed.
+     */
+    pj_objpool_destroy(mgr->tdata_objpool);
     pj_lock_destroy(mgr->lock);
 
     /* Unregister mod_msg_print. */
@@ -1596,6 +1968,479 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
 }
 
 
+/*****************************************************************************
+ *
+ * FAST RESPONSE PATH.
+ *
+ *****************************************************************************/
+
+/* Maximum number of Via header lines in requests answered by the fast
+ * response path.
+ */
+#define FAST_MAX_VIA	8
+
+/* Headers of a request scanned by the fast response path. */
+typedef struct fast_req_hdrs
+{
+    pjsip_tp_fast_req	req;
+    pj_str_t		via[FAST_MAX_VIA];
+    unsigned		via_cnt;
+    pj_str_t		expires;
+} fast_req_hdrs;
+
+/* Response being built. */
+typedef struct fast_resp
+{
+    char	*p;
+    char	*end;
+    pj_bool_t	 overflow;
+} fast_resp;
+
+/* Get the line starting at p, without the line terminator. Returns the
+ * start of the next line, or NULL if the line is not terminated.
+ */
+static char *fast_get_line(char *p, char *end, pj_str_t *line)
+{
+    char *eol = p;
+
+    while (eol != end && *eol != '\n')
+	++eol;
+    if (eol == end)
+	return NULL;
+
+    line->ptr = p;
+    line->slen = eol - p;
+    if (line->slen && p[line->slen-1] == '\r')
+	--line->slen;
+
+    return eol + 1;
+}
+
+/* Check the header name, in full or compact form. */
+static pj_bool_t fast_hdr_is(const pj_str_t *name, const char *full,
+			     char compact)
+{
+    if (compact && name->slen == 1)
+	return pj_tolower(*name->ptr) == compact;
+    return pj_stricmp2(name, full) == 0;
+}
+
+/* Set the header value, fail if the header is repeated. */
+static pj_bool_t fast_set_hdr(pj_str_t *hdr, const pj_str_t *value)
+{
+    if (hdr->slen || value->slen == 0)
+	return PJ_FALSE;
+    *hdr = *value;
+    return PJ_TRUE;
+}
+
+/* Scan the headers of an OPTIONS or REGISTER request. */
+static pj_bool_t fast_scan_request(char *pkt, pj_size_t len,
+				   fast_req_hdrs *h)
+{
+    static const pj_str_t SIP_VERSION = { "SIP/2.0", 7 };
+    char *p, *end = pkt + len;
+    pj_str_t line, version;
+    unsigned skip;
+
+    pj_bzero(h, sizeof(*h));
+    h->req.expires = -1;
+
+    /* Request line */
+    p = fast_get_line(pkt, end, &line);
+    if (!p)
+	return PJ_FALSE;
+
+    if (line.slen > 8 && pj_memcmp(line.ptr, "OPTIONS ", 8) == 0) {
+	pjsip_method_set(&h->req.method, PJSIP_OPTIONS_METHOD);
+	skip = 8;
+    } else if (line.slen > 9 && pj_memcmp(line.ptr, "REGISTER ", 9) == 0) {
+	pjsip_method_set(&h->req.method, PJSIP_REGISTER_METHOD);
+	skip = 9;
+    } else {
+	return PJ_FALSE;
+    }
+
+    h->req.req_uri.ptr = line.ptr + skip;
+    h->req.req_uri.slen = line.slen - skip;
+    version.ptr = (char*) pj_memchr(h->req.req_uri.ptr, ' ',
+				    h->req.req_uri.slen);
+    if (!version.ptr)
+	return PJ_FALSE;
+    version.slen = h->req.req_uri.ptr + h->req.req_uri.slen - version.ptr;
+    h->req.req_uri.slen = version.ptr - h->req.req_uri.ptr;
+    pj_strtrim(&version);
+    if (pj_strcmp(&version, &SIP_VERSION) != 0)
+	return PJ_FALSE;
+
+    /* Headers */
+    for (;;) {
+	pj_str_t name, value;
+	char *next, *colon;
+
+	next = fast_get_line(p, end, &line);
+	if (!next)
+	    return PJ_FALSE;
+
+	/* End of headers */
+	if (line.slen == 0)
+	    break;
+
+	/* Folded header lines are not handled */
+	if (next != end && (*next == ' ' || *next == '\t'))
+	    return PJ_FALSE;
+
+	colon = (char*) pj_memchr(line.ptr, ':', line.slen);
+	if (!colon)
+	    return PJ_FALSE;
+
+	name.ptr = line.ptr;
+	name.slen = colon - line.ptr;
+	pj_strrtrim(&name);
+	value.ptr = colon + 1;
+	value.slen = line.ptr + line.slen - value.ptr;
+	pj_strtrim(&value);
+
+	if (fast_hdr_is(&name, "Via", 'v')) {
+	    if (h->via_cnt == FAST_MAX_VIA || value.slen == 0)
+		return PJ_FALSE;
+	    h->via[h->via_cnt++] = value;
+	} else if (fast_hdr_is(&name, "From", 'f')) {
+	    if (!fast_set_hdr(&h->req.from, &value))
+		return PJ_FALSE;
+	} else if (fast_hdr_is(&name, "To", 't')) {
+	    if (!fast_set_hdr(&h->req.to, &value))
+		return PJ_FALSE;
+	} else if (fast_hdr_is(&name, "Call-ID", 'i')) {
+	    if (!fast_set_hdr(&h->req.call_id, &value))
+		return PJ_FALSE;
+	} else if (fast_hdr_is(&name, "CSeq", 0)) {
+	    if (!fast_set_hdr(&h->req.cseq, &value))
+		return PJ_FALSE;
+	} else if (fast_hdr_is(&name, "Contact", 'm')) {
+	    if (!fast_set_hdr(&h->req.contact, &value))
+		return PJ_FALSE;
+	} else if (fast_hdr_is(&name, "Expires", 0)) {
+	    if (!fast_set_hdr(&h->expires, &value))
+		return PJ_FALSE;
+	    h->req.expires = (int) pj_strtoul(&value);
+	}
+
+	p = next;
+    }
+
+    return h->via_cnt && h->req.from.slen && h->req.to.slen &&
+	   h->req.call_id.slen && h->req.cseq.slen;
+}
+
+/* Find the parameter in the header parameters which start at p. Returns
+ * the end of the parameter name, or NULL if it's not found. The value,
+ * if any, is returned in pvalue.
+ */
+static char *fast_find_param(char *p, char *end, const char *pname,
+			     pj_str_t *pvalue)
+{
+    while ((p = (char*) pj_memchr(p, ';', end - p)) != NULL) {
+	pj_str_t name;
+	char *name_end;
+
+	name_end = ++p;
+	while (name_end != end && *name_end != ';' && *name_end != '=')
+	    ++name_end;
+
+	name.ptr = p;
+	name.slen = name_end - p;
+	pj_strtrim(&name);
+
+	if (pj_stricmp2(&name, pname) == 0) {
+	    pvalue->ptr = name_end;
+	    pvalue->slen = 0;
+	    if (name_end != end && *name_end == '=') {
+		pvalue->ptr = name_end + 1;
+		while (name_end != end && *name_end != ';')
+		    ++name_end;
+		pvalue->slen = name_end - pvalue->ptr;
+	    }
+	    return name.ptr + name.slen;
+	}
+
+	p = name_end;
+    }
+
+    return NULL;
+}
+
+/* Append string to the response. */
+static void fast_append(fast_resp *r, const char *s, pj_ssize_t len)
+{
+    if (len < 0 || r->end - r->p < len) {
+	r->overflow = PJ_TRUE;
+	return;
+    }
+    pj_memcpy(r->p, s, len);
+    r->p += len;
+}
+
+/* Append header to the response. */
+static void fast_append_hdr(fast_resp *r, const char *name,
+			    const pj_str_t *value)
+{
+    fast_append(r, name, pj_ansi_strlen(name));
+    fast_append(r, value->ptr, value->slen);
+    fast_append(r, "\r\n", 2);
+}
+
+/* Build the response to the scanned request. Returns the length of the
+ * response, or zero if the request can't be answered this way.
+ */
+static pj_size_t fast_build_response(pjsip_rx_data *rdata,
+				     const fast_req_hdrs *h,
+				     int code, char *buf, pj_size_t size)
+{
+    fast_resp r;
+    pj_str_t top, rest, pval, tag;
+    char *rport_end, *to_params;
+    char tmp[80];
+    int len;
+
+    r.p = buf;
+    r.end = buf + size;
+    r.overflow = PJ_FALSE;
+
+    /* The top Via ends at the first comma of the first Via line. */
+    top = h->via[0];
+    rest.ptr = (char*) pj_memchr(top.ptr, ',', top.slen);
+    rest.slen = 0;
+    if (rest.ptr) {
+	rest.slen = top.ptr + top.slen - rest.ptr;
+	top.slen = rest.ptr - top.ptr;
+    }
+
+    /* Leave Via headers which set the response address, or which
+     * already have the received parameter, to the full processing.
+     */
+    if (fast_find_param(top.ptr, top.ptr+top.slen, "received", &pval) ||
+	fast_find_param(top.ptr, top.ptr+top.slen, "maddr", &pval))
+    {
+	return 0;
+    }
+
+    rport_end = fast_find_param(top.ptr, top.ptr+top.slen, "rport", &pval);
+    if (rport_end && pval.slen)
+	return 0;
+
+    /* Without rport, datagram responses go to the port in the sent-by
+     * of the Via (RFC 3261 section 18.2.2).
+     */
+    if (!rport_end &&
+	(rdata->tp_info.transport->flag & PJSIP_TRANSPORT_DATAGRAM))
+    {
+	return 0;
+    }
+
+    /* Status line */
+    len = pj_ansi_snprintf(tmp, sizeof(tmp), "SIP/2.0 %d ", code);
+    fast_append(&r, tmp, len);
+    fast_append(&r, pjsip_get_status_text(code)->ptr,
+		pjsip_get_status_text(code)->slen);
+    fast_append(&r, "\r\n", 2);
+
+    /* Top Via, with rport and received parameters */
+    fast_append(&r, "Via: ", 5);
+    if (rport_end) {
+	fast_append(&r, top.ptr, rport_end - top.ptr);
+	len = pj_ansi_snprintf(tmp, sizeof(tmp), "=%d",
+			       rdata->pkt_info.src_port);
+	fast_append(&r, tmp, len);
+	fast_append(&r, rport_end, top.ptr + top.slen - rport_end);
+    } else {
+	fast_append(&r, top.ptr, top.slen);
+    }
+    fast_append(&r, ";received=", 10);
+    fast_append(&r, rdata->pkt_info.src_name,
+		pj_ansi_strlen(rdata->pkt_info.src_name));
+    fast_append(&r, rest.ptr, rest.slen);
+    fast_append(&r, "\r\n", 2);
+
+    /* Other Via headers */
+    for (len=1; len<(int)h->via_cnt; ++len)
+	fast_append_hdr(&r, "Via: ", &h->via[len]);
+
+    fast_append_hdr(&r, "From: ", &h->req.from);
+
+    /* Add To tag. It is derived from the Call-ID and the top Via, so that
+     * retransmissions of the request get the same tag.
+     */
+    fast_append(&r, "To: ", 4);
+    fast_append(&r, h->req.to.ptr, h->req.to.slen);
+    to_params = (char*) pj_memchr(h->req.to.ptr, '>', h->req.to.slen);
+    if (!to_params)
+	to_params = h->req.to.ptr;
+    if (!fast_find_param(to_params, h->req.to.ptr + h->req.to.slen, "tag",
+			 &tag))
+    {
+	pj_uint32_t hval;
+
+	hval = pj_hash_calc(0, h->req.call_id.ptr,
+			    (unsigned)h->req.call_id.slen);
+	hval = pj_hash_calc(hval, h->via[0].ptr, (unsigned)h->via[0].slen);
+	len = pj_ansi_snprintf(tmp, sizeof(tmp), ";tag=%08x", hval);
+	fast_append(&r, tmp, len);
+    }
+    fast_append(&r, "\r\n", 2);
+
+    fast_append_hdr(&r, "Call-ID: ", &h->req.call_id);
+    fast_append_hdr(&r, "CSeq: ", &h->req.cseq);
+
+    /* Successful REGISTER response contains the bindings */
+    if (h->req.method.id == PJSIP_REGISTER_METHOD && code/100 == 2) {
+	/* "Contact: *" removes all bindings and must not be echoed */
+	if (h->req.contact.slen &&
+	    !(h->req.contact.slen == 1 && *h->req.contact.ptr == '*'))
+	{
+	    fast_append_hdr(&r, "Contact: ", &h->req.contact);
+	}
+	if (h->expires.slen)
+	    fast_append_hdr(&r, "Expires: ", &h->expires);
+    }
+
+    fast_append(&r, "Content-Length: 0\r\n\r\n", 21);
+
+    return r.overflow ? 0 : (r.p - buf);
+}
+
+/* Get the fast response buffer of the calling thread. */
+static fast_resp_buf *fast_get_buf(pjsip_tpmgr *mgr)
+{
+    fast_resp_buf *fb;
+    pjsip_tx_data *tdata;
+
+    fb = (fast_resp_buf*) pj_thread_local_get(mgr->fast_tls_id);
+    if (fb)
+	return fb;
+
+    if (pjsip_tx_data_create(mgr, &tdata) != PJ_SUCCESS)
+	return NULL;
+    pjsip_tx_data_add_ref(tdata);
+    tdata->info = "fast response";
+
+    /* Allocate the transmit buffer now so that it is reused by
+     * pjsip_tpmgr_send_raw().
+     */
+    tdata->buf.start = (char*) pj_pool_alloc(tdata->pool,
+					     PJSIP_MAX_PKT_LEN + 1);
+    tdata->buf.cur = tdata->buf.start;
+    tdata->buf.end = tdata->buf.start + PJSIP_MAX_PKT_LEN + 1;
+
+    fb = PJ_POOL_ZALLOC_T(tdata->pool, fast_resp_buf);
+    fb->tdata = tdata;
+
+    pj_lock_acquire(mgr->lock);
+    pj_list_push_back(&mgr->fast_buf_list, fb);
+    pj_lock_release(mgr->lock);
+
+    pj_thread_local_set(mgr->fast_tls_id, fb);
+    return fb;
+}
+
+/* Answer the request in the packet if the fast response callback wants
+ * to. Returns PJ_TRUE if the request has been answered.
+ */
+static pj_bool_t fast_respond(pjsip_tpmgr *mgr, pjsip_rx_data *rdata,
+			      char *pkt, pj_size_t len)
+{
+    pjsip_transport *tp = rdata->tp_info.transport;
+    fast_req_hdrs h;
+    fast_resp_buf *fb;
+    pjsip_tx_data *tdata;
+    pjsip_tpselector sel;
+    pj_size_t resp_len;
+    int code;
+    pj_status_t status;
+
+    if (!fast_scan_request(pkt, len, &h))
+	return PJ_FALSE;
+
+    h.req.rdata = rdata;
+    code = (*mgr->on_rx_fast_req)(mgr, &h.req);
+    if (code < 200 || code >= 700)
+	return PJ_FALSE;
+
+    fb = fast_get_buf(mgr);
+    if (!fb)
+	return PJ_FALSE;
+
+    resp_len = fast_build_response(rdata, &h, code, fb->buf,
+				   sizeof(fb->buf));
+    if (resp_len == 0)
+	return PJ_FALSE;
+
+    PJ_LOG(5,(THIS_FILE, "Fast response %d to %.*s from %s:%d", code,
+	      (int)h.req.method.name.slen, h.req.method.name.ptr,
+	      rdata->pkt_info.src_name, rdata->pkt_info.src_port));
+
+    pj_bzero(&sel, sizeof(sel));
+    sel.type = PJSIP_TPSELECTOR_TRANSPORT;
+    sel.u.transport = tp;
+
+    status = pjsip_tpmgr_acquire_transport(mgr,
+					   (pjsip_transport_type_e)tp->key.type,
+					   &rdata->pkt_info.src_addr,
+					   rdata->pkt_info.src_addr_len,
+					   &sel, &tp);
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(3,(THIS_FILE, status, "Error sending fast response"));
+	return PJ_TRUE;
+    }
+
+    /* Reuse the transmit data unless the previous response is still
+     * being sent, send_raw_with_tp() creates one in that case.
+     */
+    tdata = NULL;
+    if (!fb->tdata->is_pending) {
+	tdata = fb->tdata;
+	pjsip_tx_data_add_ref(tdata);
+    }
+
+    status = send_raw_with_tp(tp, tdata, fb->buf, resp_len,
+			      &rdata->pkt_info.src_addr,
+			      rdata->pkt_info.src_addr_len, NULL, NULL);
+    if (status != PJ_EPENDING) {
+	/* The send callback won't be called to clear the pending flag */
+	if (tdata)
+	    tdata->is_pending = 0;
+	if (status != PJ_SUCCESS) {
+	    PJ_PERROR(3,(THIS_FILE, status, "Error sending fast response"));
+	}
+    }
+
+    return PJ_TRUE;
+}
+
+/*
+ * Set the callback of the fast response path.
+ */
+PJ_DEF(pj_status_t) pjsip_tpmgr_set_fast_req_cb(pjsip_tpmgr *mgr,
+						pjsip_tp_on_rx_fast_req cb)
+{
+    PJ_ASSERT_RETURN(mgr, PJ_EINVAL);
+
+    if (cb && mgr->fast_tls_id == -1) {
+	pj_status_t status;
+
+	status = pj_thread_local_alloc(&mgr->fast_tls_id);
+	if (status != PJ_SUCCESS) {
+	    mgr->fast_tls_id = -1;
+	    return status;
+	}
+    }
+
+    mgr->on_rx_fast_req = cb;
+
+    return PJ_SUCCESS;
+}
+
+
 /*
  * pjsip_tpmgr_receive_packet()
  *
@@ -1608,6 +2453,7 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 
     char *current_pkt;
     pj_size_t remaining_len;
+    pj_size_t max_len;
     pj_size_t total_processed = 0;
 
     /* Check size. */
@@ -1615,7 +2461,13 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
     if (rdata->pkt_info.len <= 0)
 	return -1;
 
-    current_pkt = rdata->pkt_info.packet;
+    if (rdata->pkt_info.ext_packet) {
+	current_pkt = rdata->pkt_info.ext_packet;
+	max_len = PJSIP_MAX_STREAM_RX_LEN;
+    } else {
+	current_pkt = rdata->pkt_info.packet;
+	max_len = PJSIP_MAX_PKT_LEN;
+    }
     remaining_len = rdata->pkt_info.len;
 
     tr->last_recv_len = rdata->pkt_info.len;
@@ -1633,6 +2485,7 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	char *p, *end;
 	char saved;
 	pj_size_t msg_fragment_size;
+	pj_size_t pool_used;
 
 	/* Skip leading newlines as pjsip_find_msg() currently can't
 	 * handle leading newlines.
@@ -1668,7 +2521,7 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	    msg_status = pjsip_find_msg(current_pkt, remaining_len, PJ_FALSE, 
                                         &msg_fragment_size);
 	    if (msg_status != PJ_SUCCESS) {
-		if (remaining_len == PJSIP_MAX_PKT_LEN) {
+		if (remaining_len >= max_len) {
 		    mgr->on_rx_msg(mgr->endpt, PJSIP_ERXOVERFLOW, rdata);
 		    /* Exhaust all data. */
 		    return rdata->pkt_info.len;
@@ -1686,6 +2539,19 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	saved = current_pkt[msg_fragment_size];
 	current_pkt[msg_fragment_size] = '\0';
 
+	/* Answer keep-alive requests without parsing them, if application
+	 * wants to.
+	 */
+	if (mgr->on_rx_fast_req &&
+	    fast_respond(mgr, rdata, current_pkt, msg_fragment_size))
+	{
+	    current_pkt[msg_fragment_size] = saved;
+	    goto finish_process_fragment;
+	}
+
+	/* Pool memory used before the message is parsed. */
+	pool_used = pj_pool_get_used_size(rdata->tp_info.pool);
+
 	/* Parse the message. */
 	rdata->msg_info.msg = msg = 
 	    pjsip_parse_rdata( current_pkt, msg_fragment_size, rdata);
@@ -1795,6 +2661,15 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	 */
 	mgr->on_rx_msg(mgr->endpt, PJ_SUCCESS, rdata);
 
+	/* Record the size of the message and the pool memory used to
+	 * process it.
+	 */
+	pool_used = pj_pool_get_used_size(rdata->tp_info.pool) - pool_used;
+	pjsip_tp_size_stat_add(&tr->rx_size_stat, msg_fragment_size,
+			       pool_used);
+	pjsip_tp_size_stat_add(&mgr->rx_size_stat, msg_fragment_size,
+			       pool_used);
+
 
 finish_process_fragment:
 	total_processed += msg_fragment_size;
@@ -1825,6 +2700,38 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_acquire_transport(pjsip_tpmgr *mgr,
 					  NULL, tp);
 }
 
+/*
+ * Select the least loaded connection among the connections to the same
+ * destination, starting from the head of the list. Set open_new if another
+ * connection should be opened instead. Must be called with mgr->lock held.
+ */
+static pjsip_transport *select_pooled_transport(pjsip_transport *head,
+						pj_bool_t *open_new)
+{
+    pjsip_transport *best = NULL;
+    unsigned best_pending = 0;
+    unsigned count = 0;
+    pjsip_transport *t;
+
+    for (t = head; t; t = t->pool_next) {
+	unsigned pending;
+
+	++count;
+	if (t->is_shutdown || t->is_destroying)
+	    continue;
+
+	pending = pjsip_transport_get_pending_tx(t);
+	if (best == NULL || pending < best_pending) {
+	    best = t;
+	    best_pending = pending;
+	}
+    }
+
+    *open_new = (best == NULL) ||
+		(best_pending > 0 && count < pjsip_cfg()->tp.pool_size);
+    return best;
+}
+
 /*
  * pjsip_tpmgr_acquire_transport2()
  *
@@ -1840,6 +2747,7 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_acquire_transport2(pjsip_tpmgr *mgr,
 						   pjsip_transport **tp)
 {
     pjsip_tpfactory *factory;
+    pjsip_transport *fallback = NULL;
     pj_status_t status;
 
     TRACE_((THIS_FILE,"Acquiring transport type=%s, remote=%s:%d",
@@ -1949,6 +2857,19 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_acquire_transport2(pjsip_tpmgr *mgr,
 	    }
 	}
 
+	/* With connection pooling, pick the least loaded connection to
+	 * the destination, or open another one when all are busy.
+	 */
+	if (transport!=NULL && is_pooled_transport(transport)) {
+	    pj_bool_t open_new;
+
+	    transport = select_pooled_transport(transport, &open_new);
+	    if (open_new) {
+		fallback = transport;
+		transport = NULL;
+	    }
+	}
+
 	if (transport!=NULL && !transport->is_shutdown) {
 	    /*
 	     * Transport found!
@@ -1996,6 +2917,13 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_acquire_transport2(pjsip_tpmgr *mgr,
 	PJ_ASSERT_ON_FAIL(tp!=NULL, 
 	    {pj_lock_release(mgr->lock); return PJ_EBUG;});
 	pjsip_transport_add_ref(*tp);
+    } else if (fallback) {
+	/* Couldn't open another connection, use the busy one */
+	pjsip_transport_add_ref(fallback);
+	*tp = fallback;
+	status = PJ_SUCCESS;
+
+	TRACE_((THIS_FILE, "Transport %s acquired", fallback->obj_name));
     }
     pj_lock_release(mgr->lock);
     return status;
@@ -2018,6 +2946,13 @@ PJ_DEF(void) pjsip_tpmgr_dump_transports(pjsip_tpmgr *mgr)
 	      pj_atomic_get(mgr->tdata_counter)));
 #endif
 
+    PJ_LOG(3,(THIS_FILE, " Pool sizes: rdata=%u tdata=%u (%u/%u messages)",
+	      (unsigned)pjsip_tpmgr_get_rdata_pool_size(mgr, 0),
+	      (unsigned)pjsip_tp_size_stat_get_pool_size(&mgr->tx_size_stat,
+							 0,
+							 PJSIP_POOL_LEN_TDATA),
+	      mgr->rx_size_stat.count, mgr->tx_size_stat.count));
+
     PJ_LOG(3, (THIS_FILE, " Dumping listeners:"));
     factory = mgr->factory_list.next;
     while (factory != &mgr->factory_list) {
@@ -2038,11 +2973,14 @@ PJ_DEF(void) pjsip_tpmgr_dump_transports(pjsip_tpmgr *mgr)
 	    pjsip_transport *t = (pjsip_transport*) 
 	    			 pj_hash_this(mgr->table, itr);
 
-	    PJ_LOG(3, (THIS_FILE, "  %s %s (refcnt=%d%s)", 
-		       t->obj_name,
-		       t->info,
-		       pj_atomic_get(t->ref_cnt),
-		       (t->idle_timer.id ? " [idle]" : "")));
+	    for (; t; t = t->pool_next) {
+		PJ_LOG(3, (THIS_FILE, "  %s %s (refcnt=%d pending=%u%s)", 
+			   t->obj_name,
+			   t->info,
+			   pj_atomic_get(t->ref_cnt),
+			   pjsip_transport_get_pending_tx(t),
+			   (t->idle_timer.id ? " [idle]" : "")));
+	    }
 
 	    itr = pj_hash_next(mgr->table, itr);
 	} while (itr);
@@ -74,7 +74,9 @@ static struct recv_list *create_incoming_packet( struct loop_transport *loop,
     struct recv_list *pkt;
 
     pool = pjsip_endpt_create_pool(loop->base.endpt, "rdata", 
-				   PJSIP_POOL_RDATA_LEN, 
+				   pjsip_tpmgr_get_rdata_pool_size(
+					loop->base.tpmgr,
+					sizeof(struct recv_list)),
 				   PJSIP_POOL_RDATA_INC+5);
     if (!pool)
 	return NULL;
@@ -161,6 +163,9 @@ static pj_status_t loop_send_msg( pjsip_transport *tp,
     PJ_UNUSED_ARG(rem_addr);
     PJ_UNUSED_ARG(addr_len);
 
+    /* The "packet" must fit in rdata's packet buffer. */
+    if (tdata->buf.cur - tdata->buf.start > PJSIP_MAX_PKT_LEN)
+	return PJSIP_EMSGTOOLONG;
 
     /* Need to send failure? */
     if (loop->fail_mode) {
@@ -248,6 +253,8 @@ static pj_status_t loop_destroy(pjsip_transport *tp)
     /* Self destruct.. heheh.. */
     pj_lock_destroy(loop->base.lock);
     pj_atomic_destroy(loop->base.ref_cnt);
+    if (loop->base.pending_tx)
+	pj_atomic_destroy(loop->base.pending_tx);
     pjsip_endpt_release_pool(loop->base.endpt, loop->base.pool);
 
     return PJ_SUCCESS;
@@ -114,6 +114,19 @@ struct tcp_transport
 
     /* Pending transmission list. */
     struct delayed_tdata     delayed_list;
+
+    /* Send batching. Messages sent while a write is in progress are
+     * queued in batch_list, and written together from batch_buf once the
+     * write completes. Messages in the current batch write are kept in
+     * batch_sent until the write completes.
+     */
+    unsigned		     tx_inflight;
+    char		    *batch_buf;
+    pj_size_t		     batch_buf_size;
+    pjsip_tx_data_op_key     batch_op_key;
+    struct delayed_tdata     batch_list;
+    struct delayed_tdata     batch_sent;
+    pj_timer_entry	     batch_timer;
 };
 
 
@@ -549,6 +562,11 @@ static pj_bool_t on_data_sent(pj_activesock_t *asock,
 			      pj_ioqueue_op_key_t *send_key,
 			      pj_ssize_t sent);
 
+/* Callback when pending write completes */
+static pj_bool_t on_write_complete(pj_activesock_t *asock,
+				   pj_ioqueue_op_key_t *send_key,
+				   pj_ssize_t sent);
+
 /* Callback when connect completes */
 static pj_bool_t on_connect_complete(pj_activesock_t *asock,
 				     pj_status_t status);
@@ -556,6 +574,12 @@ static pj_bool_t on_connect_complete(pj_activesock_t *asock,
 /* TCP keep-alive timer callback */
 static void tcp_keep_alive_timer(pj_timer_heap_t *th, pj_timer_entry *e);
 
+/* Send batching timer callback */
+static void tcp_batch_timer(pj_timer_heap_t *th, pj_timer_entry *e);
+
+/* Write messages queued for send batching */
+static void tcp_flush_batch(struct tcp_transport *tcp, pj_bool_t force);
+
 /*
  * Common function to create TCP transport, called when pending accept() and
  * pending connect() complete.
@@ -593,6 +617,8 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     tcp->sock = sock;
     /*tcp->listener = listener;*/
     pj_list_init(&tcp->delayed_list);
+    pj_list_init(&tcp->batch_list);
+    pj_list_init(&tcp->batch_sent);
     tcp->base.pool = pool;
 
     pj_ansi_snprintf(tcp->base.obj_name, PJ_MAX_OBJ_NAME, 
@@ -639,7 +665,7 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
 
     pj_bzero(&tcp_callback, sizeof(tcp_callback));
     tcp_callback.on_data_read = &on_data_read;
-    tcp_callback.on_data_sent = &on_data_sent;
+    tcp_callback.on_data_sent = &on_write_complete;
     tcp_callback.on_connect_complete = &on_connect_complete;
 
     ioqueue = pjsip_endpt_get_ioqueue(listener->endpt);
@@ -663,6 +689,16 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     pj_ioqueue_op_key_init(&tcp->ka_op_key.key, sizeof(pj_ioqueue_op_key_t));
     pj_strdup(tcp->base.pool, &tcp->ka_pkt, &ka_pkt);
 
+    /* Initialize send batching */
+    if (pjsip_cfg()->tp.tx_batch_size) {
+	tcp->batch_buf_size = pjsip_cfg()->tp.tx_batch_size;
+	tcp->batch_buf = (char*) pj_pool_alloc(pool, tcp->batch_buf_size);
+	pj_ioqueue_op_key_init(&tcp->batch_op_key.key,
+			       sizeof(pj_ioqueue_op_key_t));
+	tcp->batch_timer.user_data = (void*)tcp;
+	tcp->batch_timer.cb = &tcp_batch_timer;
+    }
+
     /* Done setting up basic transport. */
     *p_tcp = tcp;
 
@@ -703,6 +739,12 @@ static void tcp_flush_pending_tx(struct tcp_transport *tcp)
             continue;
         }
 
+	/* With send batching, coalesce the delayed messages */
+	if (tcp->batch_buf) {
+	    pj_list_push_back(&tcp->batch_list, pending_tx);
+	    continue;
+	}
+
 	/* send! */
 	size = tdata->buf.cur - tdata->buf.start;
 	status = pj_activesock_send(tcp->asock, op_key, tdata->buf.start, 
@@ -715,6 +757,142 @@ static void tcp_flush_pending_tx(struct tcp_transport *tcp)
 
     }
     pj_lock_release(tcp->base.lock);
+
+    if (tcp->batch_buf)
+	tcp_flush_batch(tcp, PJ_FALSE);
+}
+
+
+/* Queue the message to be written with the next batch. Called with
+ * transport lock held.
+ */
+static void tcp_batch_queue(struct tcp_transport *tcp, pjsip_tx_data *tdata)
+{
+    struct delayed_tdata *batch_tdata;
+
+    batch_tdata = PJ_POOL_ZALLOC_T(tdata->pool, struct delayed_tdata);
+    batch_tdata->tdata_op_key = &tdata->op_key;
+    pj_list_push_back(&tcp->batch_list, batch_tdata);
+
+    /* Limit the time the message may wait for the pending write */
+    if (pjsip_cfg()->tp.tx_batch_delay && !tcp->batch_timer.id) {
+	pj_time_val delay;
+
+	delay.sec = 0;
+	delay.msec = pjsip_cfg()->tp.tx_batch_delay;
+	pj_time_val_normalize(&delay);
+
+	tcp->batch_timer.id = PJ_TRUE;
+	pjsip_endpt_schedule_timer(tcp->base.endpt, &tcp->batch_timer,
+				   &delay);
+    }
+}
+
+
+/* Notify the messages of the completed batch write. */
+static void tcp_batch_complete(struct tcp_transport *tcp,
+			       pj_ssize_t bytes_sent)
+{
+    struct delayed_tdata done;
+
+    pj_list_init(&done);
+
+    pj_lock_acquire(tcp->base.lock);
+    pj_list_merge_last(&done, &tcp->batch_sent);
+    pj_lock_release(tcp->base.lock);
+
+    while (!pj_list_empty(&done)) {
+	struct delayed_tdata *batch_tdata;
+	pjsip_tx_data *tdata;
+	pj_ssize_t size;
+
+	batch_tdata = done.next;
+	pj_list_erase(batch_tdata);
+
+	tdata = batch_tdata->tdata_op_key->tdata;
+	size = (bytes_sent > 0) ? tdata->buf.cur - tdata->buf.start :
+				  bytes_sent;
+
+	on_data_sent(tcp->asock, (pj_ioqueue_op_key_t*)
+				 batch_tdata->tdata_op_key, size);
+    }
+}
+
+
+/* Write the queued messages, coalescing as many of them as fit in the
+ * batch buffer into one write. Unless force is set, nothing is written
+ * while another write is still in progress.
+ */
+static void tcp_flush_batch(struct tcp_transport *tcp, pj_bool_t force)
+{
+    pj_lock_acquire(tcp->base.lock);
+
+    while (!pj_list_empty(&tcp->batch_list) && !tcp->is_closing &&
+	   (tcp->tx_inflight == 0 || force))
+    {
+	struct delayed_tdata *batch_tdata = tcp->batch_list.next;
+	pjsip_tx_data *tdata = batch_tdata->tdata_op_key->tdata;
+	pj_ioqueue_op_key_t *op_key;
+	char *data;
+	pj_ssize_t size;
+	pj_status_t status;
+
+	size = tdata->buf.cur - tdata->buf.start;
+
+	if (batch_tdata->next != &tcp->batch_list &&
+	    pj_list_empty(&tcp->batch_sent) &&
+	    size <= (pj_ssize_t)tcp->batch_buf_size)
+	{
+	    /* Coalesce messages into the batch buffer */
+	    size = 0;
+	    while (!pj_list_empty(&tcp->batch_list)) {
+		pj_ssize_t len;
+
+		batch_tdata = tcp->batch_list.next;
+		tdata = batch_tdata->tdata_op_key->tdata;
+		len = tdata->buf.cur - tdata->buf.start;
+		if (size + len > (pj_ssize_t)tcp->batch_buf_size)
+		    break;
+
+		pj_memcpy(tcp->batch_buf + size, tdata->buf.start, len);
+		size += len;
+
+		pj_list_erase(batch_tdata);
+		pj_list_push_back(&tcp->batch_sent, batch_tdata);
+	    }
+	    data = tcp->batch_buf;
+	    op_key = &tcp->batch_op_key.key;
+
+	} else {
+	    /* Single message, or it doesn't fit in the batch buffer */
+	    pj_list_erase(batch_tdata);
+	    data = tdata->buf.start;
+	    op_key = (pj_ioqueue_op_key_t*)batch_tdata->tdata_op_key;
+	}
+
+	status = pj_activesock_send(tcp->asock, op_key, data, &size, 0);
+	if (status == PJ_EPENDING) {
+	    ++tcp->tx_inflight;
+	    continue;
+	}
+
+	if (status != PJ_SUCCESS)
+	    size = -status;
+
+	pj_lock_release(tcp->base.lock);
+	if (op_key == &tcp->batch_op_key.key)
+	    tcp_batch_complete(tcp, size);
+	else
+	    on_data_sent(tcp->asock, op_key, size);
+	pj_lock_acquire(tcp->base.lock);
+    }
+
+    if (pj_list_empty(&tcp->batch_list) && tcp->batch_timer.id) {
+	pjsip_endpt_cancel_timer(tcp->base.endpt, &tcp->batch_timer);
+	tcp->batch_timer.id = PJ_FALSE;
+    }
+
+    pj_lock_release(tcp->base.lock);
 }
 
 
@@ -773,6 +951,17 @@ static pj_status_t tcp_destroy(pjsip_transport *transport,
 	on_data_sent(tcp->asock, op_key, -reason);
     }
 
+    /* Cancel all batched transmits */
+    if (tcp->batch_timer.id) {
+	pjsip_endpt_cancel_timer(tcp->base.endpt, &tcp->batch_timer);
+	tcp->batch_timer.id = PJ_FALSE;
+    }
+
+    if (!pj_list_empty(&tcp->batch_list) || !pj_list_empty(&tcp->batch_sent)) {
+	pj_list_merge_last(&tcp->batch_sent, &tcp->batch_list);
+	tcp_batch_complete(tcp, -reason);
+    }
+
     if (tcp->rdata.tp_info.pool) {
 	pj_pool_release(tcp->rdata.tp_info.pool);
 	tcp->rdata.tp_info.pool = NULL;
@@ -797,6 +986,11 @@ static pj_status_t tcp_destroy(pjsip_transport *transport,
 	tcp->base.ref_cnt = NULL;
     }
 
+    if (tcp->base.pending_tx) {
+	pj_atomic_destroy(tcp->base.pending_tx);
+	tcp->base.pending_tx = NULL;
+    }
+
     if (tcp->base.pool) {
 	pj_pool_t *pool;
 
@@ -840,7 +1034,8 @@ static pj_status_t tcp_start_read(struct tcp_transport *tcp)
     /* Init rdata */
     pool = pjsip_endpt_create_pool(tcp->base.endpt,
 				   "rtd%p",
-				   PJSIP_POOL_RDATA_LEN,
+				   pjsip_tpmgr_get_rdata_pool_size(
+					tcp->base.tpmgr, 0),
 				   PJSIP_POOL_RDATA_INC);
     if (!pool) {
 	tcp_perror(tcp->base.obj_name, "Unable to create pool", PJ_ENOMEM);
@@ -862,8 +1057,16 @@ static pj_status_t tcp_start_read(struct tcp_transport *tcp)
                       sizeof(tcp->rdata.pkt_info.src_name), 0);
     tcp->rdata.pkt_info.src_port = pj_sockaddr_get_port(rem_addr);
 
-    size = sizeof(tcp->rdata.pkt_info.packet);
-    readbuf[0] = tcp->rdata.pkt_info.packet;
+    /* Receive into a buffer large enough for the largest message, with
+     * room for the zero termination added by the transport manager.
+     */
+    if (tcp->rdata.pkt_info.ext_packet == NULL) {
+	tcp->rdata.pkt_info.ext_packet = (char*)
+		pj_pool_alloc(tcp->base.pool, PJSIP_MAX_STREAM_RX_LEN + 1);
+    }
+
+    size = PJSIP_MAX_STREAM_RX_LEN;
+    readbuf[0] = tcp->rdata.pkt_info.ext_packet;
     status = pj_activesock_start_read2(tcp->asock, tcp->base.pool, size,
 				       readbuf, 0);
     if (status != PJ_SUCCESS && status != PJ_EPENDING) {
@@ -1130,6 +1333,59 @@ static pj_bool_t on_data_sent(pj_activesock_t *asock,
 }
 
 
+/* 
+ * Callback from ioqueue when pending write completes. With send batching,
+ * this also writes the messages that were queued in the meantime.
+ */
+static pj_bool_t on_write_complete(pj_activesock_t *asock,
+				   pj_ioqueue_op_key_t *op_key,
+				   pj_ssize_t bytes_sent)
+{
+    struct tcp_transport *tcp = (struct tcp_transport*) 
+    				pj_activesock_get_user_data(asock);
+    pj_bool_t ret;
+
+    if (tcp->batch_buf == NULL)
+	return on_data_sent(asock, op_key, bytes_sent);
+
+    /* Keep-alive is not accounted as it is written independently */
+    if (op_key != &tcp->ka_op_key.key) {
+	pj_lock_acquire(tcp->base.lock);
+	pj_assert(tcp->tx_inflight > 0);
+	if (tcp->tx_inflight)
+	    --tcp->tx_inflight;
+	pj_lock_release(tcp->base.lock);
+    }
+
+    if (op_key == &tcp->batch_op_key.key) {
+	tcp_batch_complete(tcp, bytes_sent);
+	ret = (bytes_sent > 0);
+    } else {
+	ret = on_data_sent(asock, op_key, bytes_sent);
+    }
+
+    if (ret)
+	tcp_flush_batch(tcp, PJ_FALSE);
+
+    return ret;
+}
+
+
+/* Send batching timer callback, messages have waited long enough */
+static void tcp_batch_timer(pj_timer_heap_t *th, pj_timer_entry *e)
+{
+    struct tcp_transport *tcp = (struct tcp_transport*) e->user_data;
+
+    PJ_UNUSED_ARG(th);
+
+    pj_lock_acquire(tcp->base.lock);
+    tcp->batch_timer.id = PJ_FALSE;
+    pj_lock_release(tcp->base.lock);
+
+    tcp_flush_batch(tcp, PJ_TRUE);
+}
+
+
 /* 
  * This callback is called by transport manager to send SIP message 
  */
@@ -1203,6 +1459,23 @@ static pj_status_t tcp_send_msg(pjsip_transport *transport,
 	pj_lock_release(tcp->base.lock);
     } 
     
+    if (!delayed && tcp->batch_buf) {
+	/*
+	 * With send batching, queue the message if a write is still in
+	 * progress. It will be written together with other queued messages
+	 * once the write completes. Otherwise the lock is held until the
+	 * write below is accounted.
+	 */
+	pj_lock_acquire(tcp->base.lock);
+
+	if (tcp->tx_inflight || !pj_list_empty(&tcp->batch_list)) {
+	    tcp_batch_queue(tcp, tdata);
+	    status = PJ_EPENDING;
+	    delayed = PJ_TRUE;
+	    pj_lock_release(tcp->base.lock);
+	}
+    }
+
     if (!delayed) {
 	/*
 	 * Transport is ready to go. Send the packet to ioqueue to be
@@ -1213,6 +1486,12 @@ static pj_status_t tcp_send_msg(pjsip_transport *transport,
 				    (pj_ioqueue_op_key_t*)&tdata->op_key,
 				    tdata->buf.start, &size, 0);
 
+	if (tcp->batch_buf) {
+	    if (status == PJ_EPENDING)
+		++tcp->tx_inflight;
+	    pj_lock_release(tcp->base.lock);
+	}
+
 	if (status != PJ_EPENDING) {
 	    /* Not pending (could be immediate success or error) */
 	    tdata->op_key.tdata = NULL;
@@ -1285,7 +1564,7 @@ static pj_bool_t on_data_read(pj_activesock_t *asock,
 	/* Mark this as an activity */
 	pj_gettimeofday(&tcp->last_activity);
 
-	pj_assert((void*)rdata->pkt_info.packet == data);
+	pj_assert((void*)rdata->pkt_info.ext_packet == data);
 
 	/* Init pkt_info part. */
 	rdata->pkt_info.len = size;
@@ -1305,8 +1584,8 @@ static pj_bool_t on_data_read(pj_activesock_t *asock,
 	/* Move unprocessed data to the front of the buffer */
 	*remainder = size - size_eaten;
 	if (*remainder > 0 && *remainder != size) {
-	    pj_memmove(rdata->pkt_info.packet,
-		       rdata->pkt_info.packet + size_eaten,
+	    pj_memmove(rdata->pkt_info.ext_packet,
+		       rdata->pkt_info.ext_packet + size_eaten,
 		       *remainder);
 	}
 
@@ -27,6 +27,7 @@
 #include <pj/hash.h>
 #include <pj/lock.h>
 #include <pj/log.h>
+#include <pj/math.h>
 #include <pj/os.h>
 #include <pj/pool.h>
 #include <pj/string.h>
@@ -41,6 +42,9 @@
 #define POOL_TP_INIT	512
 #define POOL_TP_INC	512
 
+/* SSL send buffer must hold the largest message plus TLS record overhead */
+#define TLS_SEND_BUF_LEN    (PJSIP_MAX_STREAM_TX_LEN + 1024)
+
 struct tls_listener;
 struct tls_transport;
 
@@ -106,6 +110,19 @@ struct tls_transport
 
     /* Pending transmission list. */
     struct delayed_tdata     delayed_list;
+
+    /* Send batching. Messages sent while a write is in progress are
+     * queued in batch_list, and written together from batch_buf once the
+     * write completes. Messages in the current batch write are kept in
+     * batch_sent until the write completes.
+     */
+    unsigned		     tx_inflight;
+    char		    *batch_buf;
+    pj_size_t		     batch_buf_size;
+    pjsip_tx_data_op_key     batch_op_key;
+    struct delayed_tdata     batch_list;
+    struct delayed_tdata     batch_sent;
+    pj_timer_entry	     batch_timer;
 };
 
 
@@ -131,6 +148,11 @@ static pj_bool_t on_data_sent(pj_ssl_sock_t *ssock,
 			      pj_ioqueue_op_key_t *send_key,
 			      pj_ssize_t sent);
 
+/* Callback when pending write completes */
+static pj_bool_t on_write_complete(pj_ssl_sock_t *ssock,
+				   pj_ioqueue_op_key_t *send_key,
+				   pj_ssize_t sent);
+
 /* This callback is called by transport manager to destroy listener */
 static pj_status_t lis_destroy(pjsip_tpfactory *factory);
 
@@ -329,7 +351,7 @@ PJ_DEF(pj_status_t) pjsip_tls_transport_start2( pjsip_endpoint *endpt,
     ssock_param.sock_af = af;
     ssock_param.cb.on_accept_complete = &on_accept_complete;
     ssock_param.cb.on_data_read = &on_data_read;
-    ssock_param.cb.on_data_sent = &on_data_sent;
+    ssock_param.cb.on_data_sent = &on_write_complete;
     ssock_param.async_cnt = async_cnt;
     ssock_param.ioqueue = pjsip_endpt_get_ioqueue(endpt);
     ssock_param.require_client_cert = listener->tls_setting.require_client_cert;
@@ -337,8 +359,8 @@ PJ_DEF(pj_status_t) pjsip_tls_transport_start2( pjsip_endpoint *endpt,
     ssock_param.user_data = listener;
     ssock_param.verify_peer = PJ_FALSE; /* avoid SSL socket closing the socket
 					 * due to verification error */
-    if (ssock_param.send_buffer_size < PJSIP_MAX_PKT_LEN)
-	ssock_param.send_buffer_size = PJSIP_MAX_PKT_LEN;
+    if (ssock_param.send_buffer_size < TLS_SEND_BUF_LEN)
+	ssock_param.send_buffer_size = TLS_SEND_BUF_LEN;
     if (ssock_param.read_buffer_size < PJSIP_MAX_PKT_LEN)
 	ssock_param.read_buffer_size = PJSIP_MAX_PKT_LEN;
     ssock_param.ciphers_num = listener->tls_setting.ciphers_num;
@@ -568,6 +590,12 @@ static pj_bool_t on_connect_complete(pj_ssl_sock_t *ssock,
 /* TLS keep-alive timer callback */
 static void tls_keep_alive_timer(pj_timer_heap_t *th, pj_timer_entry *e);
 
+/* Send batching timer callback */
+static void tls_batch_timer(pj_timer_heap_t *th, pj_timer_entry *e);
+
+/* Write messages queued for send batching */
+static void tls_flush_batch(struct tls_transport *tls, pj_bool_t force);
+
 /*
  * Common function to create TLS transport, called when pending accept() and
  * pending connect() complete.
@@ -603,6 +631,8 @@ static pj_status_t tls_create( struct tls_listener *listener,
     tls->is_server = is_server;
     tls->verify_server = listener->tls_setting.verify_server;
     pj_list_init(&tls->delayed_list);
+    pj_list_init(&tls->batch_list);
+    pj_list_init(&tls->batch_sent);
     tls->base.pool = pool;
 
     pj_ansi_snprintf(tls->base.obj_name, PJ_MAX_OBJ_NAME, 
@@ -675,6 +705,19 @@ static pj_status_t tls_create( struct tls_listener *listener,
     tls->ka_timer.cb = &tls_keep_alive_timer;
     pj_ioqueue_op_key_init(&tls->ka_op_key.key, sizeof(pj_ioqueue_op_key_t));
     pj_strdup(tls->base.pool, &tls->ka_pkt, &ka_pkt);
+
+    /* Initialize send batching. Each batch is written as one TLS record,
+     * so keep it within the secure socket send buffer.
+     */
+    if (pjsip_cfg()->tp.tx_batch_size) {
+	tls->batch_buf_size = PJ_MIN(pjsip_cfg()->tp.tx_batch_size,
+				     PJSIP_MAX_STREAM_TX_LEN);
+	tls->batch_buf = (char*) pj_pool_alloc(pool, tls->batch_buf_size);
+	pj_ioqueue_op_key_init(&tls->batch_op_key.key,
+			       sizeof(pj_ioqueue_op_key_t));
+	tls->batch_timer.user_data = (void*)tls;
+	tls->batch_timer.cb = &tls_batch_timer;
+    }
     
     /* Done setting up basic transport. */
     *p_tls = tls;
@@ -716,6 +759,12 @@ static void tls_flush_pending_tx(struct tls_transport *tls)
             continue;
         }
 
+	/* With send batching, coalesce the delayed messages */
+	if (tls->batch_buf) {
+	    pj_list_push_back(&tls->batch_list, pending_tx);
+	    continue;
+	}
+
 	/* send! */
 	size = tdata->buf.cur - tdata->buf.start;
 	status = pj_ssl_sock_send(tls->ssock, op_key, tdata->buf.start, 
@@ -728,6 +777,142 @@ static void tls_flush_pending_tx(struct tls_transport *tls)
 	}
     }
     pj_lock_release(tls->base.lock);
+
+    if (tls->batch_buf)
+	tls_flush_batch(tls, PJ_FALSE);
+}
+
+
+/* Queue the message to be written with the next batch. Called with
+ * transport lock held.
+ */
+static void tls_batch_queue(struct tls_transport *tls, pjsip_tx_data *tdata)
+{
+    struct delayed_tdata *batch_tdata;
+
+    batch_tdata = PJ_POOL_ZALLOC_T(tdata->pool, struct delayed_tdata);
+    batch_tdata->tdata_op_key = &tdata->op_key;
+    pj_list_push_back(&tls->batch_list, batch_tdata);
+
+    /* Limit the time the message may wait for the pending write */
+    if (pjsip_cfg()->tp.tx_batch_delay && !tls->batch_timer.id) {
+	pj_time_val delay;
+
+	delay.sec = 0;
+	delay.msec = pjsip_cfg()->tp.tx_batch_delay;
+	pj_time_val_normalize(&delay);
+
+	tls->batch_timer.id = PJ_TRUE;
+	pjsip_endpt_schedule_timer(tls->base.endpt, &tls->batch_timer,
+				   &delay);
+    }
+}
+
+
+/* Notify the messages of the completed batch write. */
+static void tls_batch_complete(struct tls_transport *tls,
+			       pj_ssize_t bytes_sent)
+{
+    struct delayed_tdata done;
+
+    pj_list_init(&done);
+
+    pj_lock_acquire(tls->base.lock);
+    pj_list_merge_last(&done, &tls->batch_sent);
+    pj_lock_release(tls->base.lock);
+
+    while (!pj_list_empty(&done)) {
+	struct delayed_tdata *batch_tdata;
+	pjsip_tx_data *tdata;
+	pj_ssize_t size;
+
+	batch_tdata = done.next;
+	pj_list_erase(batch_tdata);
+
+	tdata = batch_tdata->tdata_op_key->tdata;
+	size = (bytes_sent > 0) ? tdata->buf.cur - tdata->buf.start :
+				  bytes_sent;
+
+	on_data_sent(tls->ssock, (pj_ioqueue_op_key_t*)
+				 batch_tdata->tdata_op_key, size);
+    }
+}
+
+
+/* Write the queued messages, coalescing as many of them as fit in the
+ * batch buffer into one write. Unless force is set, nothing is written
+ * while another write is still in progress.
+ */
+static void tls_flush_batch(struct tls_transport *tls, pj_bool_t force)
+{
+    pj_lock_acquire(tls->base.lock);
+
+    while (!pj_list_empty(&tls->batch_list) && !tls->is_closing &&
+	   (tls->tx_inflight == 0 || force))
+    {
+	struct delayed_tdata *batch_tdata = tls->batch_list.next;
+	pjsip_tx_data *tdata = batch_tdata->tdata_op_key->tdata;
+	pj_ioqueue_op_key_t *op_key;
+	char *data;
+	pj_ssize_t size;
+	pj_status_t status;
+
+	size = tdata->buf.cur - tdata->buf.start;
+
+	if (batch_tdata->next != &tls->batch_list &&
+	    pj_list_empty(&tls->batch_sent) &&
+	    size <= (pj_ssize_t)tls->batch_buf_size)
+	{
+	    /* Coalesce messages into the batch buffer */
+	    size = 0;
+	    while (!pj_list_empty(&tls->batch_list)) {
+		pj_ssize_t len;
+
+		batch_tdata = tls->batch_list.next;
+		tdata = batch_tdata->tdata_op_key->tdata;
+		len = tdata->buf.cur - tdata->buf.start;
+		if (size + len > (pj_ssize_t)tls->batch_buf_size)
+		    break;
+
+		pj_memcpy(tls->batch_buf + size, tdata->buf.start, len);
+		size += len;
+
+		pj_list_erase(batch_tdata);
+		pj_list_push_back(&tls->batch_sent, batch_tdata);
+	    }
+	    data = tls->batch_buf;
+	    op_key = &tls->batch_op_key.key;
+
+	} else {
+	    /* Single message, or it doesn't fit in the batch buffer */
+	    pj_list_erase(batch_tdata);
+	    data = tdata->buf.start;
+	    op_key = (pj_ioqueue_op_key_t*)batch_tdata->tdata_op_key;
+	}
+
+	status = pj_ssl_sock_send(tls->ssock, op_key, data, &size, 0);
+	if (status == PJ_EPENDING) {
+	    ++tls->tx_inflight;
+	    continue;
+	}
+
+	if (status != PJ_SUCCESS)
+	    size = -status;
+
+	pj_lock_release(tls->base.lock);
+	if (op_key == &tls->batch_op_key.key)
+	    tls_batch_complete(tls, size);
+	else
+	    on_data_sent(tls->ssock, op_key, size);
+	pj_lock_acquire(tls->base.lock);
+    }
+
+    if (pj_list_empty(&tls->batch_list) && tls->batch_timer.id) {
+	pjsip_endpt_cancel_timer(tls->base.endpt, &tls->batch_timer);
+	tls->batch_timer.id = PJ_FALSE;
+    }
+
+    pj_lock_release(tls->base.lock);
 }
 
 
@@ -786,6 +971,17 @@ static pj_status_t tls_destroy(pjsip_transport *transport,
 	on_data_sent(tls->ssock, op_key, -reason);
     }
 
+    /* Cancel all batched transmits */
+    if (tls->batch_timer.id) {
+	pjsip_endpt_cancel_timer(tls->base.endpt, &tls->batch_timer);
+	tls->batch_timer.id = PJ_FALSE;
+    }
+
+    if (!pj_list_empty(&tls->batch_list) || !pj_list_empty(&tls->batch_sent)) {
+	pj_list_merge_last(&tls->batch_sent, &tls->batch_list);
+	tls_batch_complete(tls, -reason);
+    }
+
     if (tls->rdata.tp_info.pool) {
 	pj_pool_release(tls->rdata.tp_info.pool);
 	tls->rdata.tp_info.pool = NULL;
@@ -805,6 +1001,11 @@ static pj_status_t tls_destroy(pjsip_transport *transport,
 	tls->base.ref_cnt = NULL;
     }
 
+    if (tls->base.pending_tx) {
+	pj_atomic_destroy(tls->base.pending_tx);
+	tls->base.pending_tx = NULL;
+    }
+
     if (tls->base.pool) {
 	pj_pool_t *pool;
 
@@ -848,7 +1049,8 @@ static pj_status_t tls_start_read(struct tls_transport *tls)
     /* Init rdata */
     pool = pjsip_endpt_create_pool(tls->base.endpt,
 				   "rtd%p",
-				   PJSIP_POOL_RDATA_LEN,
+				   pjsip_tpmgr_get_rdata_pool_size(
+					tls->base.tpmgr, 0),
 				   PJSIP_POOL_RDATA_INC);
     if (!pool) {
 	tls_perror(tls->base.obj_name, "Unable to create pool", PJ_ENOMEM);
@@ -870,8 +1072,16 @@ static pj_status_t tls_start_read(struct tls_transport *tls)
                           sizeof(tls->rdata.pkt_info.src_name), 0);
     tls->rdata.pkt_info.src_port = pj_sockaddr_get_port(rem_addr);
 
-    size = sizeof(tls->rdata.pkt_info.packet);
-    readbuf[0] = tls->rdata.pkt_info.packet;
+    /* Receive into a buffer large enough for the largest message, with
+     * room for the zero termination added by the transport manager.
+     */
+    if (tls->rdata.pkt_info.ext_packet == NULL) {
+	tls->rdata.pkt_info.ext_packet = (char*)
+		pj_pool_alloc(tls->base.pool, PJSIP_MAX_STREAM_RX_LEN + 1);
+    }
+
+    size = PJSIP_MAX_STREAM_RX_LEN;
+    readbuf[0] = tls->rdata.pkt_info.ext_packet;
     status = pj_ssl_sock_start_read2(tls->ssock, tls->base.pool, size,
 				     readbuf, 0);
     if (status != PJ_SUCCESS && status != PJ_EPENDING) {
@@ -934,7 +1144,7 @@ static pj_status_t lis_create_transport(pjsip_tpfactory *factory,
 			    pj_AF_INET6() : pj_AF_INET();
     ssock_param.cb.on_connect_complete = &on_connect_complete;
     ssock_param.cb.on_data_read = &on_data_read;
-    ssock_param.cb.on_data_sent = &on_data_sent;
+    ssock_param.cb.on_data_sent = &on_write_complete;
     ssock_param.async_cnt = 1;
     ssock_param.ioqueue = pjsip_endpt_get_ioqueue(listener->endpt);
     ssock_param.server_name = remote_name;
@@ -942,8 +1152,8 @@ static pj_status_t lis_create_transport(pjsip_tpfactory *factory,
     ssock_param.user_data = NULL; /* pending, must be set later */
     ssock_param.verify_peer = PJ_FALSE; /* avoid SSL socket closing the socket
 					 * due to verification error */
-    if (ssock_param.send_buffer_size < PJSIP_MAX_PKT_LEN)
-	ssock_param.send_buffer_size = PJSIP_MAX_PKT_LEN;
+    if (ssock_param.send_buffer_size < TLS_SEND_BUF_LEN)
+	ssock_param.send_buffer_size = TLS_SEND_BUF_LEN;
     if (ssock_param.read_buffer_size < PJSIP_MAX_PKT_LEN)
 	ssock_param.read_buffer_size = PJSIP_MAX_PKT_LEN;
     ssock_param.ciphers_num = listener->tls_setting.ciphers_num;
@@ -1236,6 +1446,59 @@ static pj_bool_t on_data_sent(pj_ssl_sock_t *ssock,
 }
 
 
+/* 
+ * Callback from ioqueue when pending write completes. With send batching,
+ * this also writes the messages that were queued in the meantime.
+ */
+static pj_bool_t on_write_complete(pj_ssl_sock_t *ssock,
+				   pj_ioqueue_op_key_t *op_key,
+				   pj_ssize_t bytes_sent)
+{
+    struct tls_transport *tls = (struct tls_transport*) 
+    				pj_ssl_sock_get_user_data(ssock);
+    pj_bool_t ret;
+
+    if (tls->batch_buf == NULL)
+	return on_data_sent(ssock, op_key, bytes_sent);
+
+    /* Keep-alive is not accounted as it is written independently */
+    if (op_key != &tls->ka_op_key.key) {
+	pj_lock_acquire(tls->base.lock);
+	pj_assert(tls->tx_inflight > 0);
+	if (tls->tx_inflight)
+	    --tls->tx_inflight;
+	pj_lock_release(tls->base.lock);
+    }
+
+    if (op_key == &tls->batch_op_key.key) {
+	tls_batch_complete(tls, bytes_sent);
+	ret = (bytes_sent > 0);
+    } else {
+	ret = on_data_sent(ssock, op_key, bytes_sent);
+    }
+
+    if (ret)
+	tls_flush_batch(tls, PJ_FALSE);
+
+    return ret;
+}
+
+
+/* Send batching timer callback, messages have waited long enough */
+static void tls_batch_timer(pj_timer_heap_t *th, pj_timer_entry *e)
+{
+    struct tls_transport *tls = (struct tls_transport*) e->user_data;
+
+    PJ_UNUSED_ARG(th);
+
+    pj_lock_acquire(tls->base.lock);
+    tls->batch_timer.id = PJ_FALSE;
+    pj_lock_release(tls->base.lock);
+
+    tls_flush_batch(tls, PJ_TRUE);
+}
+
+
 /* 
  * This callback is called by transport manager to send SIP message 
  */
@@ -1309,6 +1572,23 @@ static pj_status_t tls_send_msg(pjsip_transport *transport,
 	pj_lock_release(tls->base.lock);
     } 
     
+    if (!delayed && tls->batch_buf) {
+	/*
+	 * With send batching, queue the message if a write is still in
+	 * progress. It will be written together with other queued messages
+	 * once the write completes. Otherwise the lock is held until the
+	 * write below is accounted.
+	 */
+	pj_lock_acquire(tls->base.lock);
+
+	if (tls->tx_inflight || !pj_list_empty(&tls->batch_list)) {
+	    tls_batch_queue(tls, tdata);
+	    status = PJ_EPENDING;
+	    delayed = PJ_TRUE;
+	    pj_lock_release(tls->base.lock);
+	}
+    }
+
     if (!delayed) {
 	/*
 	 * Transport is ready to go. Send the packet to ioqueue to be
@@ -1319,6 +1599,12 @@ static pj_status_t tls_send_msg(pjsip_transport *transport,
 				    (pj_ioqueue_op_key_t*)&tdata->op_key,
 				    tdata->buf.start, &size, 0);
 
+	if (tls->batch_buf) {
+	    if (status == PJ_EPENDING)
+		++tls->tx_inflight;
+	    pj_lock_release(tls->base.lock);
+	}
+
 	if (status != PJ_EPENDING) {
 	    /* Not pending (could be immediate success or error) */
 	    tdata->op_key.tdata = NULL;
@@ -1391,7 +1677,7 @@ static pj_bool_t on_data_read(pj_ssl_sock_t *ssock,
 	/* Mark this as an activity */
 	pj_gettimeofday(&tls->last_activity);
 
-	pj_assert((void*)rdata->pkt_info.packet == data);
+	pj_assert((void*)rdata->pkt_info.ext_packet == data);
 
 	/* Init pkt_info part. */
 	rdata->pkt_info.len = size;
@@ -1411,8 +1697,8 @@ static pj_bool_t on_data_read(pj_ssl_sock_t *ssock,
 	/* Move unprocessed data to the front of the buffer */
 	*remainder = size - size_eaten;
 	if (*remainder > 0 && *remainder != size) {
-	    pj_memmove(rdata->pkt_info.packet,
-		       rdata->pkt_info.packet + size_eaten,
+	    pj_memmove(rdata->pkt_info.ext_packet,
+		       rdata->pkt_info.ext_packet + size_eaten,
 		       *remainder);
 	}
 
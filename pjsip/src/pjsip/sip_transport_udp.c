@@ -33,6 +33,15 @@
 
 #define THIS_FILE   "sip_transport_udp.c"
 
+/* Maximum number of datagrams to be processed before the read operation
+ * is forced to complete asynchronously, to allow other sockets to get
+ * their data. See https://trac.pjsip.org/repos/ticket/1197
+ */
+#define MAX_IMMEDIATE_PACKET	50
+
+/* Datagrams up to this size are too small to be SIP messages. */
+#define MIN_PACKET_SIZE		32
+
 /**
  * These are the target values for socket send and receive buffer sizes,
  * respectively. They will be applied to UDP socket with setsockopt().
@@ -66,6 +75,13 @@
 #endif
 
 
+/* Additional socket bound to the transport address with SO_REUSEPORT */
+struct udp_rp_sock
+{
+    pj_sock_t		sock;
+    pj_ioqueue_key_t   *key;
+};
+
 /* Struct udp_transport "inherits" struct pjsip_transport */
 struct udp_transport
 {
@@ -76,9 +92,66 @@ struct udp_transport
     pjsip_rx_data     **rdata;
     int			is_closing;
     pj_bool_t		is_paused;
+
+    /* Number of read operations per socket. Each read operation uses
+     * rx_batch consecutive rdata and the op_key of the first of them.
+     * The first async_cnt*rx_batch rdata belong to the main socket, the
+     * next async_cnt*rx_batch to rp[0], and so on.
+     */
+    unsigned		async_cnt;
+
+    /* Batched receive. When rx_mmsg is false, because the ioqueue doesn't
+     * support it, each rdata has its own read operation instead.
+     */
+    unsigned		rx_batch;
+    pj_bool_t		rx_mmsg;
+    pj_sock_msg	       *rx_msg;	    /* Descriptor of each rdata.    */
+
+    /* Additional SO_REUSEPORT sockets. These are only used for receiving,
+     * all outgoing messages are sent with the main socket.
+     */
+    unsigned		rp_cnt;
+    struct udp_rp_sock *rp;
 };
 
 
+/*
+ * Get the ioqueue key of the socket which the rdata is reading from.
+ * May return NULL if the socket has been closed.
+ */
+static pj_ioqueue_key_t *get_rdata_key(struct udp_transport *tp,
+				       unsigned rdata_index)
+{
+    unsigned sock_index = rdata_index / (tp->async_cnt * tp->rx_batch);
+
+    if (sock_index == 0)
+	return tp->key;
+
+    pj_assert(sock_index <= tp->rp_cnt);
+    return tp->rp[sock_index-1].key;
+}
+
+
+/*
+ * Unregister and close all additional SO_REUSEPORT sockets.
+ */
+static void close_rp_sockets(struct udp_transport *tp)
+{
+    unsigned i;
+
+    for (i=0; i<tp->rp_cnt; ++i) {
+	if (tp->rp[i].key) {
+	    /* This implicitly closes the socket */
+	    pj_ioqueue_unregister(tp->rp[i].key);
+	    tp->rp[i].key = NULL;
+	} else if (tp->rp[i].sock != PJ_INVALID_SOCKET) {
+	    pj_sock_close(tp->rp[i].sock);
+	}
+	tp->rp[i].sock = PJ_INVALID_SOCKET;
+    }
+}
+
+
 /*
  * Initialize transport's receive buffer from the specified pool.
  */
@@ -108,18 +181,246 @@ static void init_rdata(struct udp_transport *tp, unsigned rdata_index,
 }
 
 
+/*
+ * Replace the pool of a receive buffer when its initial block doesn't
+ * match the memory used by the messages received on the transport,
+ * either because most messages would need another block, or because
+ * much of the block is never used. The pool must have been reset.
+ */
+static pj_pool_t *adapt_rdata_pool(struct udp_transport *tp, pj_pool_t *pool)
+{
+#if PJSIP_POOL_ADAPTIVE_SIZE
+    pj_size_t size, capacity;
+    pj_pool_t *new_pool;
+
+    size = pjsip_tp_size_stat_get_pool_size(&tp->base.rx_size_stat,
+					    sizeof(pjsip_rx_data),
+					    PJSIP_POOL_RDATA_LEN);
+    capacity = pj_pool_get_capacity(pool);
+
+    /* The pool factory rounds sizes up to its size classes, so only
+     * shrink when the pool is at least twice as large as needed.
+     */
+    if (size <= capacity && size > capacity / 2)
+	return pool;
+
+    new_pool = pjsip_endpt_create_pool(tp->base.endpt, "rtd%p", size,
+				       PJSIP_POOL_RDATA_INC);
+    if (!new_pool)
+	return pool;
+
+    pjsip_endpt_release_pool(tp->base.endpt, pool);
+    return new_pool;
+#else
+    PJ_UNUSED_ARG(tp);
+    return pool;
+#endif
+}
+
+
+/*
+ * Report a received datagram to the transport manager. The source address
+ * must have been set in the rdata.
+ */
+static void udp_report_packet(pjsip_rx_data *rdata, pj_ssize_t bytes_read)
+{
+    pj_size_t size_eaten;
+    const pj_sockaddr *src_addr = &rdata->pkt_info.src_addr;
+
+    /* Init pkt_info part. */
+    rdata->pkt_info.len = bytes_read;
+    rdata->pkt_info.zero = 0;
+    pj_gettimeofday(&rdata->pkt_info.timestamp);
+    if (src_addr->addr.sa_family == pj_AF_INET()) {
+	pj_ansi_strcpy(rdata->pkt_info.src_name,
+		       pj_inet_ntoa(src_addr->ipv4.sin_addr));
+	rdata->pkt_info.src_port = pj_ntohs(src_addr->ipv4.sin_port);
+    } else {
+	pj_inet_ntop(pj_AF_INET6(), 
+		     pj_sockaddr_get_addr(&rdata->pkt_info.src_addr),
+		     rdata->pkt_info.src_name,
+		     sizeof(rdata->pkt_info.src_name));
+	rdata->pkt_info.src_port = pj_ntohs(src_addr->ipv6.sin6_port);
+    }
+
+    size_eaten = 
+	pjsip_tpmgr_receive_packet(rdata->tp_info.transport->tpmgr, 
+				   rdata);
+
+    if (size_eaten < 0) {
+	pj_assert(!"It shouldn't happen!");
+	size_eaten = rdata->pkt_info.len;
+    }
+
+    /* Since this is UDP, the whole buffer is the message. */
+    rdata->pkt_info.len = 0;
+}
+
+
+/*
+ * Reset the pool of the rdata to receive the next packet. Returns the new
+ * rdata, as the old one is invalid after the pool has been reset.
+ */
+static pjsip_rx_data *reset_rdata(pjsip_rx_data *rdata)
+{
+    /* Need to copy rdata fields to temp variable because they will
+     * be invalid after pj_pool_reset().
+     */
+    pj_pool_t *rdata_pool = rdata->tp_info.pool;
+    struct udp_transport *rdata_tp ;
+    unsigned rdata_index;
+
+    rdata_tp = (struct udp_transport*)rdata->tp_info.transport;
+    rdata_index = (unsigned)(unsigned long)(pj_ssize_t)
+		  rdata->tp_info.tp_data;
+
+    pj_pool_reset(rdata_pool);
+    rdata_pool = adapt_rdata_pool(rdata_tp, rdata_pool);
+    init_rdata(rdata_tp, rdata_index, rdata_pool, &rdata);
+
+    return rdata;
+}
+
+
+/* Check if a read error is worth reporting. */
+static pj_bool_t is_read_error(pj_status_t status)
+{
+    return status != PJ_STATUS_FROM_OS(OSERR_EWOULDBLOCK) &&
+	   status != PJ_STATUS_FROM_OS(OSERR_EINPROGRESS) && 
+	   status != PJ_STATUS_FROM_OS(OSERR_ECONNRESET);
+}
+
+
+/*
+ * Prepare the descriptors of the batch starting at the rdata index for
+ * the next read operation.
+ */
+static void init_rx_msg(struct udp_transport *tp, unsigned first)
+{
+    unsigned i;
+
+    for (i=first; i<first+tp->rx_batch; ++i) {
+	pj_sock_msg *msg = &tp->rx_msg[i];
+
+	msg->buf = tp->rdata[i]->pkt_info.packet;
+	msg->len = sizeof(tp->rdata[i]->pkt_info.packet);
+	msg->addr_len = sizeof(msg->addr);
+    }
+}
+
+
+/*
+ * udp_on_read_batch_complete()
+ *
+ * Process the datagrams received by a batched read operation, and start
+ * the next one. Like udp_on_read_complete(), immediate data is processed
+ * in a loop as long as less than MAX_IMMEDIATE_PACKET datagrams have
+ * been processed.
+ */
+static void udp_on_read_batch_complete(struct udp_transport *tp,
+				       pj_ioqueue_key_t *key,
+				       unsigned first,
+				       pj_ssize_t cnt)
+{
+    unsigned i;
+    pj_status_t status;
+
+    for (i=0;;) {
+	pj_uint32_t flags;
+	unsigned j, n;
+
+	if (cnt > 0) {
+	    for (j=first; j<first+(unsigned)cnt; ++j) {
+		pj_sock_msg *msg = &tp->rx_msg[j];
+		pjsip_rx_data *rdata = tp->rdata[j];
+
+		/* Only report packet which is relatively big enough for
+		 * a SIP packet.
+		 */
+		if (msg->len > MIN_PACKET_SIZE) {
+		    pj_memcpy(&rdata->pkt_info.src_addr, &msg->addr,
+			      msg->addr_len);
+		    rdata->pkt_info.src_addr_len = msg->addr_len;
+		    udp_report_packet(rdata, msg->len);
+		}
+
+		reset_rdata(rdata);
+	    }
+	    i += (unsigned)cnt;
+
+	} else {
+	    if (cnt < 0 && is_read_error((pj_status_t)-cnt)) {
+		/* Report error to endpoint. */
+		PJSIP_ENDPT_LOG_ERROR((tp->base.endpt, tp->base.obj_name,
+				       (pj_status_t)-cnt, 
+				       "Warning: pj_ioqueue_recvmmsg()"
+				       " callback error"));
+	    }
+	    ++i;
+	}
+
+	/* Only read next packets if transport is not being paused. */
+	if (tp->is_paused)
+	    return;
+
+	if (i >= MAX_IMMEDIATE_PACKET) {
+	    /* Force pj_ioqueue_recvmmsg() to return PJ_EPENDING */
+	    flags = PJ_IOQUEUE_ALWAYS_ASYNC;
+	} else {
+	    flags = 0;
+	}
+
+	/* Read next packets. */
+	init_rx_msg(tp, first);
+	n = tp->rx_batch;
+	status = pj_ioqueue_recvmmsg(key,
+				     &tp->rdata[first]->tp_info.op_key.op_key,
+				     &tp->rx_msg[first], &n, flags);
+
+	if (status == PJ_SUCCESS) {
+	    /* Continue loop. */
+	    pj_assert(i < MAX_IMMEDIATE_PACKET);
+	    cnt = n;
+
+	} else if (status == PJ_EPENDING) {
+	    break;
+
+	} else if (i < MAX_IMMEDIATE_PACKET) {
+
+	    /* Report error to endpoint if this is not EWOULDBLOCK error.*/
+	    if (is_read_error(status)) {
+		PJSIP_ENDPT_LOG_ERROR((tp->base.endpt, tp->base.obj_name,
+				       status, 
+				       "Warning: pj_ioqueue_recvmmsg"));
+	    }
+
+	    /* Continue loop. */
+	    cnt = 0;
+
+	} else {
+	    /* This is fatal error.
+	     * Ioqueue operation will stop for this transport!
+	     */
+	    PJSIP_ENDPT_LOG_ERROR((tp->base.endpt, tp->base.obj_name,
+				   status, 
+				   "FATAL: pj_ioqueue_recvmmsg() error, "
+				   "UDP transport stopping! Error"));
+	    break;
+	}
+    }
+}
+
+
 /*
  * udp_on_read_complete()
  *
  * This is callback notification from ioqueue that a pending recvfrom()
- * operation has completed.
+ * or batched receive operation has completed.
  */
 static void udp_on_read_complete( pj_ioqueue_key_t *key, 
 				  pj_ioqueue_op_key_t *op_key, 
 				  pj_ssize_t bytes_read)
 {
-    /* See https://trac.pjsip.org/repos/ticket/1197 */
-    enum { MAX_IMMEDIATE_PACKET = 50 };
     pjsip_rx_data_op_key *rdata_op_key = (pjsip_rx_data_op_key*) op_key;
     pjsip_rx_data *rdata = rdata_op_key->rdata;
     struct udp_transport *tp = (struct udp_transport*)rdata->tp_info.transport;
@@ -136,6 +437,15 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
     if (tp->is_paused)
 	return;
 
+    /* For batched receive, bytes_read is the number of datagrams */
+    if (tp->rx_mmsg) {
+	udp_on_read_batch_complete(tp, key,
+				   (unsigned)(unsigned long)(pj_ssize_t)
+				   rdata->tp_info.tp_data,
+				   bytes_read);
+	return;
+    }
+
     /*
      * The idea of the loop is to process immediate data received by
      * pj_ioqueue_recvfrom(), as long as i < MAX_IMMEDIATE_PACKET. When
@@ -143,52 +453,19 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
      * complete asynchronously, to allow other sockets to get their data.
      */
     for (i=0;; ++i) {
-    	enum { MIN_SIZE = 32 };
 	pj_uint32_t flags;
 
 	/* Report the packet to transport manager. Only do so if packet size
 	 * is relatively big enough for a SIP packet.
 	 */
-	if (bytes_read > MIN_SIZE) {
-	    pj_size_t size_eaten;
-	    const pj_sockaddr *src_addr = &rdata->pkt_info.src_addr;
-
-	    /* Init pkt_info part. */
-	    rdata->pkt_info.len = bytes_read;
-	    rdata->pkt_info.zero = 0;
-	    pj_gettimeofday(&rdata->pkt_info.timestamp);
-	    if (src_addr->addr.sa_family == pj_AF_INET()) {
-		pj_ansi_strcpy(rdata->pkt_info.src_name,
-			       pj_inet_ntoa(src_addr->ipv4.sin_addr));
-		rdata->pkt_info.src_port = pj_ntohs(src_addr->ipv4.sin_port);
-	    } else {
-		pj_inet_ntop(pj_AF_INET6(), 
-			     pj_sockaddr_get_addr(&rdata->pkt_info.src_addr),
-			     rdata->pkt_info.src_name,
-			     sizeof(rdata->pkt_info.src_name));
-		rdata->pkt_info.src_port = pj_ntohs(src_addr->ipv6.sin6_port);
-	    }
+	if (bytes_read > MIN_PACKET_SIZE) {
+	    udp_report_packet(rdata, bytes_read);
 
-	    size_eaten = 
-		pjsip_tpmgr_receive_packet(rdata->tp_info.transport->tpmgr, 
-					   rdata);
-
-	    if (size_eaten < 0) {
-		pj_assert(!"It shouldn't happen!");
-		size_eaten = rdata->pkt_info.len;
-	    }
-
-	    /* Since this is UDP, the whole buffer is the message. */
-	    rdata->pkt_info.len = 0;
-
-	} else if (bytes_read <= MIN_SIZE) {
+	} else if (bytes_read <= MIN_PACKET_SIZE) {
 
 	    /* TODO: */
 
-	} else if (-bytes_read != PJ_STATUS_FROM_OS(OSERR_EWOULDBLOCK) &&
-		   -bytes_read != PJ_STATUS_FROM_OS(OSERR_EINPROGRESS) && 
-		   -bytes_read != PJ_STATUS_FROM_OS(OSERR_ECONNRESET)) 
-	{
+	} else if (is_read_error((pj_status_t)-bytes_read)) {
 
 	    /* Report error to endpoint. */
 	    PJSIP_ENDPT_LOG_ERROR((rdata->tp_info.transport->endpt,
@@ -205,27 +482,9 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
 	    flags = 0;
 	}
 
-	/* Reset pool. 
-	 * Need to copy rdata fields to temp variable because they will
-	 * be invalid after pj_pool_reset().
-	 */
-	{
-	    pj_pool_t *rdata_pool = rdata->tp_info.pool;
-	    struct udp_transport *rdata_tp ;
-	    unsigned rdata_index;
-
-	    rdata_tp = (struct udp_transport*)rdata->tp_info.transport;
-	    rdata_index = (unsigned)(unsigned long)(pj_ssize_t)
-			  rdata->tp_info.tp_data;
-
-	    pj_pool_reset(rdata_pool);
-	    init_rdata(rdata_tp, rdata_index, rdata_pool, &rdata);
-
-	    /* Change some vars to point to new location after
-	     * pool reset.
-	     */
-	    op_key = &rdata->tp_info.op_key.op_key;
-	}
+	/* Reset pool, and change some vars to point to new location. */
+	rdata = reset_rdata(rdata);
+	op_key = &rdata->tp_info.op_key.op_key;
 
 	/* Only read next packet if transport is not being paused. This
 	 * check handles the case where transport is paused while endpoint
@@ -255,10 +514,7 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
 	    if (i < MAX_IMMEDIATE_PACKET) {
 
 		/* Report error to endpoint if this is not EWOULDBLOCK error.*/
-		if (status != PJ_STATUS_FROM_OS(OSERR_EWOULDBLOCK) &&
-		    status != PJ_STATUS_FROM_OS(OSERR_EINPROGRESS) && 
-		    status != PJ_STATUS_FROM_OS(OSERR_ECONNRESET)) 
-		{
+		if (is_read_error(status)) {
 
 		    PJSIP_ENDPT_LOG_ERROR((rdata->tp_info.transport->endpt,
 					   rdata->tp_info.transport->obj_name,
@@ -328,13 +584,17 @@ static pj_status_t udp_send_msg( pjsip_transport *transport,
     if (tp->is_paused)
 	return PJSIP_ETPNOTAVAIL;
 
+    /* Messages larger than PJSIP_MAX_PKT_LEN are for stream transports */
+    size = tdata->buf.cur - tdata->buf.start;
+    if (size > PJSIP_MAX_PKT_LEN)
+	return PJSIP_EMSGTOOLONG;
+
     /* Init op key. */
     tdata->op_key.tdata = tdata;
     tdata->op_key.token = token;
     tdata->op_key.callback = callback;
 
     /* Send to ioqueue! */
-    size = tdata->buf.cur - tdata->buf.start;
     status = pj_ioqueue_sendto(tp->key, (pj_ioqueue_op_key_t*)&tdata->op_key,
 			       tdata->buf.start, &size, 0,
 			       rem_addr, addr_len);
@@ -353,7 +613,7 @@ static pj_status_t udp_send_msg( pjsip_transport *transport,
 static pj_status_t udp_destroy( pjsip_transport *transport )
 {
     struct udp_transport *tp = (struct udp_transport*)transport;
-    int i;
+    int i, read_op_cnt;
 
     /* Mark this transport as closing. */
     tp->is_closing = 1;
@@ -372,6 +632,7 @@ static pj_status_t udp_destroy( pjsip_transport *transport )
     */
 
     /* Unregister from ioqueue. */
+    close_rp_sockets(tp);
     if (tp->key) {
 	pj_ioqueue_unregister(tp->key);
 	tp->key = NULL;
@@ -387,7 +648,9 @@ static pj_status_t udp_destroy( pjsip_transport *transport )
      * is closed. We poll the ioqueue until all pending callbacks 
      * have been called.
      */
-    for (i=0; i<50 && tp->is_closing < 1+tp->rdata_cnt; ++i) {
+    read_op_cnt = tp->rx_mmsg ? tp->rdata_cnt / (int)tp->rx_batch :
+				tp->rdata_cnt;
+    for (i=0; i<50 && tp->is_closing < 1+read_op_cnt; ++i) {
 	int cnt;
 	pj_time_val timeout = {0, 1};
 
@@ -406,6 +669,10 @@ static pj_status_t udp_destroy( pjsip_transport *transport )
     if (tp->base.ref_cnt)
 	pj_atomic_destroy(tp->base.ref_cnt);
 
+    /* Destroy pending messages counter. */
+    if (tp->base.pending_tx)
+	pj_atomic_destroy(tp->base.pending_tx);
+
     /* Destroy lock */
     if (tp->base.lock)
 	pj_lock_destroy(tp->base.lock);
@@ -430,7 +697,8 @@ static pj_status_t udp_shutdown(pjsip_transport *transport)
 
 /* Create socket */
 static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
-				 int addr_len, pj_sock_t *p_sock)
+				 int addr_len, pj_bool_t reuse_port,
+				 pj_sock_t *p_sock)
 {
     pj_sock_t sock;
     pj_sockaddr_in tmp_addr;
@@ -454,6 +722,16 @@ static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
 	}
     }
 
+    if (reuse_port) {
+	int enabled = 1;
+	status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), pj_SO_REUSEPORT(),
+				    &enabled, sizeof(enabled));
+	if (status != PJ_SUCCESS) {
+	    pj_sock_close(sock);
+	    return status;
+	}
+    }
+
     status = pj_sock_bind(sock, local_a, addr_len);
     if (status != PJ_SUCCESS) {
 	pj_sock_close(sock);
@@ -465,6 +743,39 @@ static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
 }
 
 
+/* Create the additional SO_REUSEPORT sockets, bound to the same address
+ * as the main socket. The main socket must have been created with
+ * SO_REUSEPORT too.
+ */
+static pj_status_t create_rp_sockets(pj_sock_t sock, unsigned cnt,
+				     pj_sock_t rp_sock[])
+{
+    pj_sockaddr bound_addr;
+    int addr_len;
+    unsigned i;
+    pj_status_t status;
+
+    addr_len = sizeof(bound_addr);
+    status = pj_sock_getsockname(sock, &bound_addr, &addr_len);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    for (i=0; i<cnt; ++i) {
+	status = create_socket(bound_addr.addr.sa_family, &bound_addr,
+			       addr_len, PJ_TRUE, &rp_sock[i]);
+	if (status != PJ_SUCCESS) {
+	    while (i > 0) {
+		pj_sock_close(rp_sock[--i]);
+		rp_sock[i] = PJ_INVALID_SOCKET;
+	    }
+	    return status;
+	}
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 /* Generate transport's published address */
 static pj_status_t get_published_name(pj_sock_t sock,
 				      char hostbuf[],
@@ -554,10 +865,8 @@ static void udp_set_pub_name(struct udp_transport *tp,
 	tp->base.local_name.port);
 }
 
-/* Set the socket handle of the transport */
-static void udp_set_socket(struct udp_transport *tp,
-			   pj_sock_t sock,
-			   const pjsip_host_port *a_name)
+/* Adjust the socket buffer sizes */
+static void udp_set_sock_buf(pj_sock_t sock)
 {
 #if PJSIP_UDP_SO_RCVBUF_SIZE || PJSIP_UDP_SO_SNDBUF_SIZE
     long sobuf_size;
@@ -589,6 +898,16 @@ static void udp_set_socket(struct udp_transport *tp,
 		  status));
     }
 #endif
+    PJ_UNUSED_ARG(sock);
+}
+
+/* Set the socket handle of the transport */
+static void udp_set_socket(struct udp_transport *tp,
+			   pj_sock_t sock,
+			   const pjsip_host_port *a_name)
+{
+    /* Adjust the socket buffer sizes */
+    udp_set_sock_buf(sock);
 
     /* Set the socket. */
     tp->sock = sock;
@@ -597,24 +916,68 @@ static void udp_set_socket(struct udp_transport *tp,
     udp_set_pub_name(tp, a_name);
 }
 
-/* Register socket to ioqueue */
+/* Register sockets to ioqueue */
 static pj_status_t register_to_ioqueue(struct udp_transport *tp)
 {
     pj_ioqueue_t *ioqueue;
     pj_ioqueue_callback ioqueue_cb;
+    unsigned i;
+    pj_status_t status;
 
-    /* Ignore if already registered */
-    if (tp->key != NULL)
-    	return PJ_SUCCESS;
-    
-    /* Register to ioqueue. */
     ioqueue = pjsip_endpt_get_ioqueue(tp->base.endpt);
     pj_memset(&ioqueue_cb, 0, sizeof(ioqueue_cb));
     ioqueue_cb.on_read_complete = &udp_on_read_complete;
     ioqueue_cb.on_write_complete = &udp_on_write_complete;
 
-    return pj_ioqueue_register_sock(tp->base.pool, ioqueue, tp->sock, tp,
-				    &ioqueue_cb, &tp->key);
+    /* Register the main socket, unless it's already registered */
+    if (tp->key == NULL) {
+	status = pj_ioqueue_register_sock(tp->base.pool, ioqueue, tp->sock,
+					  tp, &ioqueue_cb, &tp->key);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    /* Register the additional SO_REUSEPORT sockets, each with its own key */
+    for (i=0; i<tp->rp_cnt; ++i) {
+	if (tp->rp[i].key != NULL || tp->rp[i].sock == PJ_INVALID_SOCKET)
+	    continue;
+
+	udp_set_sock_buf(tp->rp[i].sock);
+	status = pj_ioqueue_register_sock(tp->base.pool, ioqueue,
+					  tp->rp[i].sock, tp, &ioqueue_cb,
+					  &tp->rp[i].key);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Release the rdata which are only used by batched read operations, when
+ * falling back to one datagram per read operation. The first rdata of
+ * each batch is kept, so each socket keeps async_cnt rdata. No read
+ * operation must be pending.
+ */
+static void shrink_rdata(struct udp_transport *tp)
+{
+    int i, cnt = 0;
+
+    for (i=0; i<tp->rdata_cnt; ++i) {
+	pjsip_rx_data *rdata = tp->rdata[i];
+
+	if ((i % tp->rx_batch) == 0) {
+	    rdata->tp_info.tp_data = (void*)(pj_ssize_t)cnt;
+	    tp->rdata[cnt++] = rdata;
+	} else {
+	    pj_pool_release(rdata->tp_info.pool);
+	    tp->rdata[i] = NULL;
+	}
+    }
+
+    tp->rdata_cnt = cnt;
+    tp->rx_batch = 1;
+    tp->rx_mmsg = PJ_FALSE;
 }
 
 /* Start ioqueue asynchronous reading to all rdata */
@@ -625,11 +988,46 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 
     /* Start reading the ioqueue. */
     for (i=0; i<tp->rdata_cnt; ++i) {
+	pj_ioqueue_key_t *key = get_rdata_key(tp, i);
 	pj_ssize_t size;
 
+	/* Skip rdata of sockets that have been closed */
+	if (key == NULL)
+	    continue;
+
+	/* Start a batched read with the first rdata of each batch */
+	if (tp->rx_mmsg && (i % tp->rx_batch) == 0) {
+	    unsigned cnt = tp->rx_batch;
+
+	    init_rx_msg(tp, i);
+	    status = pj_ioqueue_recvmmsg(key,
+					 &tp->rdata[i]->tp_info.op_key.op_key,
+					 &tp->rx_msg[i], &cnt,
+					 PJ_IOQUEUE_ALWAYS_ASYNC);
+	    if (status == PJ_EPENDING) {
+		i += tp->rx_batch - 1;
+		continue;
+	    } else if (status == PJ_SUCCESS) {
+		pj_assert(!"Shouldn't happen because PJ_IOQUEUE_ALWAYS_ASYNC!");
+		udp_on_read_complete(key, &tp->rdata[i]->tp_info.op_key.op_key,
+				     cnt);
+		i += tp->rx_batch - 1;
+		continue;
+	    } else if (status != PJ_ENOTSUP) {
+		/* Error! */
+		return status;
+	    }
+
+	    /* The ioqueue doesn't support batched receive, only the first
+	     * batch can get here. Read each rdata separately from now on.
+	     */
+	    pj_assert(i == 0);
+	    shrink_rdata(tp);
+	}
+
 	size = sizeof(tp->rdata[i]->pkt_info.packet);
 	tp->rdata[i]->pkt_info.src_addr_len = sizeof(tp->rdata[i]->pkt_info.src_addr);
-	status = pj_ioqueue_recvfrom(tp->key, 
+	status = pj_ioqueue_recvfrom(key, 
 				     &tp->rdata[i]->tp_info.op_key.op_key,
 				     tp->rdata[i]->pkt_info.packet,
 				     &size, PJ_IOQUEUE_ALWAYS_ASYNC,
@@ -637,7 +1035,7 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 				     &tp->rdata[i]->pkt_info.src_addr_len);
 	if (status == PJ_SUCCESS) {
 	    pj_assert(!"Shouldn't happen because PJ_IOQUEUE_ALWAYS_ASYNC!");
-	    udp_on_read_complete(tp->key, &tp->rdata[i]->tp_info.op_key.op_key,
+	    udp_on_read_complete(key, &tp->rdata[i]->tp_info.op_key.op_key,
 				 size);
 	} else if (status != PJ_EPENDING) {
 	    /* Error! */
@@ -657,6 +1055,8 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 static pj_status_t transport_attach( pjsip_endpoint *endpt,
 				     pjsip_transport_type_e type,
 				     pj_sock_t sock,
+				     const pj_sock_t rp_sock[],
+				     unsigned rp_cnt,
 				     const pjsip_host_port *a_name,
 				     unsigned async_cnt,
 				     pjsip_transport **p_transport)
@@ -692,6 +1092,22 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
     /* Save pool. */
     tp->base.pool = pool;
 
+    /* Save the additional sockets, so that they're closed on error. */
+    tp->async_cnt = async_cnt;
+    tp->rx_batch = PJSIP_UDP_RECV_BATCH;
+    if (tp->rx_batch > PJ_SOCK_MAX_MMSG)
+	tp->rx_batch = PJ_SOCK_MAX_MMSG;
+    else if (tp->rx_batch == 0)
+	tp->rx_batch = 1;
+    tp->rx_mmsg = (tp->rx_batch > 1);
+    if (rp_cnt) {
+	tp->rp = (struct udp_rp_sock*)
+		 pj_pool_calloc(pool, rp_cnt, sizeof(struct udp_rp_sock));
+	for (i=0; i<rp_cnt; ++i)
+	    tp->rp[i].sock = rp_sock[i];
+	tp->rp_cnt = rp_cnt;
+    }
+
     pj_memcpy(tp->base.obj_name, pool->obj_name, PJ_MAX_OBJ_NAME);
 
     /* Init reference counter. */
@@ -769,15 +1185,26 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
 	goto on_error;
 
 
-    /* Create rdata and put it in the array. */
+    /* Create rdata and put it in the array. Each socket gets its own
+     * set of async_cnt*rx_batch rdata.
+     */
     tp->rdata_cnt = 0;
     tp->rdata = (pjsip_rx_data**)
-    		pj_pool_calloc(tp->base.pool, async_cnt, 
+    		pj_pool_calloc(tp->base.pool,
+			       async_cnt * tp->rx_batch * (rp_cnt+1), 
 			       sizeof(pjsip_rx_data*));
-    for (i=0; i<async_cnt; ++i) {
+    if (tp->rx_mmsg) {
+	tp->rx_msg = (pj_sock_msg*)
+		     pj_pool_calloc(tp->base.pool,
+				    async_cnt * tp->rx_batch * (rp_cnt+1),
+				    sizeof(pj_sock_msg));
+    }
+    for (i=0; i<async_cnt * tp->rx_batch * (rp_cnt+1); ++i) {
 	pj_pool_t *rdata_pool = pjsip_endpt_create_pool(endpt, "rtd%p", 
-							PJSIP_POOL_RDATA_LEN,
-							PJSIP_POOL_RDATA_INC);
+					pjsip_tpmgr_get_rdata_pool_size(
+					    tp->base.tpmgr,
+					    sizeof(pjsip_rx_data)),
+					PJSIP_POOL_RDATA_INC);
 	if (!rdata_pool) {
 	    pj_atomic_set(tp->base.ref_cnt, 0);
 	    pjsip_transport_destroy(&tp->base);
@@ -800,13 +1227,15 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
 	*p_transport = &tp->base;
     
     PJ_LOG(4,(tp->base.obj_name, 
-	      "SIP %s started, published address is %s%.*s%s:%d",
+	      "SIP %s started, published address is %s%.*s%s:%d, "
+	      "%d socket(s)",
 	      pjsip_transport_get_type_desc((pjsip_transport_type_e)tp->base.key.type),
 	      ipv6_quoteb,
 	      (int)tp->base.local_name.host.slen,
 	      tp->base.local_name.host.ptr,
 	      ipv6_quotee,
-	      tp->base.local_name.port));
+	      tp->base.local_name.port,
+	      rp_cnt+1));
 
     return PJ_SUCCESS;
 
@@ -822,8 +1251,8 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_attach( pjsip_endpoint *endpt,
 						unsigned async_cnt,
 						pjsip_transport **p_transport)
 {
-    return transport_attach(endpt, PJSIP_TRANSPORT_UDP, sock, a_name,
-			    async_cnt, p_transport);
+    return transport_attach(endpt, PJSIP_TRANSPORT_UDP, sock, NULL, 0,
+			    a_name, async_cnt, p_transport);
 }
 
 PJ_DEF(pj_status_t) pjsip_udp_transport_attach2( pjsip_endpoint *endpt,
@@ -833,7 +1262,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_attach2( pjsip_endpoint *endpt,
 						 unsigned async_cnt,
 						 pjsip_transport **p_transport)
 {
-    return transport_attach(endpt, type, sock, a_name,
+    return transport_attach(endpt, type, sock, NULL, 0, a_name,
 			    async_cnt, p_transport);
 }
 
@@ -856,7 +1285,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start( pjsip_endpoint *endpt,
     PJ_ASSERT_RETURN(endpt && async_cnt, PJ_EINVAL);
 
     status = create_socket(pj_AF_INET(), local_a, sizeof(pj_sockaddr_in), 
-			   &sock);
+			   PJ_FALSE, &sock);
     if (status != PJ_SUCCESS)
 	return status;
 
@@ -898,7 +1327,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start6(pjsip_endpoint *endpt,
     PJ_ASSERT_RETURN(endpt && async_cnt, PJ_EINVAL);
 
     status = create_socket(pj_AF_INET6(), local_a, sizeof(pj_sockaddr_in6), 
-			   &sock);
+			   PJ_FALSE, &sock);
     if (status != PJ_SUCCESS)
 	return status;
 
@@ -920,6 +1349,107 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start6(pjsip_endpoint *endpt,
 				       sock, a_name, async_cnt, p_transport);
 }
 
+/*
+ * Initialize pjsip_udp_transport_cfg with default values.
+ */
+PJ_DEF(void) pjsip_udp_transport_cfg_default(pjsip_udp_transport_cfg *cfg,
+					     int af)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->af = af;
+    pj_sockaddr_init(cfg->af, &cfg->bind_addr, NULL, 0);
+    cfg->async_cnt = 1;
+    cfg->sock_cnt = PJSIP_UDP_TRANSPORT_SOCK_CNT;
+}
+
+
+/*
+ * pjsip_udp_transport_start2()
+ *
+ * Create one or more UDP sockets in the specified address and start
+ * a transport.
+ */
+PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
+					pjsip_endpoint *endpt,
+					const pjsip_udp_transport_cfg *cfg,
+					pjsip_transport **p_transport)
+{
+    pj_pool_t *pool = NULL;
+    pj_sock_t sock;
+    pj_sock_t *rp_sock = NULL;
+    unsigned sock_cnt;
+    const pjsip_host_port *a_name;
+    char addr_buf[PJ_INET6_ADDRSTRLEN];
+    pjsip_host_port bound_name;
+    pjsip_transport_type_e type;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(endpt && cfg && cfg->async_cnt, PJ_EINVAL);
+    PJ_ASSERT_RETURN(cfg->af==pj_AF_INET() || cfg->af==pj_AF_INET6(),
+		     PJ_EINVAL);
+
+    sock_cnt = cfg->sock_cnt ? cfg->sock_cnt : 1;
+    if (sock_cnt > 1 && pj_SO_REUSEPORT() == 0xFFFF) {
+	PJ_LOG(3,(THIS_FILE, "SO_REUSEPORT is not supported, UDP transport "
+		  "will only use one socket"));
+	sock_cnt = 1;
+    }
+
+    type = (cfg->af == pj_AF_INET6()) ? PJSIP_TRANSPORT_UDP6 :
+					PJSIP_TRANSPORT_UDP;
+
+    status = create_socket(cfg->af, &cfg->bind_addr,
+			   pj_sockaddr_get_len(&cfg->bind_addr),
+			   (sock_cnt > 1), &sock);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (cfg->addr_name.host.slen == 0) {
+	/* Address name is not specified. 
+	 * Build a name based on bound address.
+	 */
+	status = get_published_name(sock, addr_buf, sizeof(addr_buf), 
+				    &bound_name);
+	if (status != PJ_SUCCESS) {
+	    pj_sock_close(sock);
+	    return status;
+	}
+
+	a_name = &bound_name;
+    } else {
+	a_name = &cfg->addr_name;
+    }
+
+    /* Create the additional sockets on the address that the main socket
+     * has actually been bound to (the port may have been chosen by the OS).
+     */
+    if (sock_cnt > 1) {
+	pool = pjsip_endpt_create_pool(endpt, "udprp%p", 128, 128);
+	if (!pool) {
+	    pj_sock_close(sock);
+	    return PJ_ENOMEM;
+	}
+
+	rp_sock = (pj_sock_t*) pj_pool_calloc(pool, sock_cnt-1,
+					      sizeof(pj_sock_t));
+	status = create_rp_sockets(sock, sock_cnt-1, rp_sock);
+	if (status != PJ_SUCCESS) {
+	    pj_sock_close(sock);
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return status;
+	}
+    }
+
+    status = transport_attach(endpt, type, sock, rp_sock, sock_cnt-1, a_name,
+			      cfg->async_cnt, p_transport);
+
+    if (pool)
+	pjsip_endpt_release_pool(endpt, pool);
+
+    return status;
+}
+
+
 /*
  * Retrieve the internal socket handle used by the UDP transport.
  */
@@ -962,12 +1492,22 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_pause(pjsip_transport *transport,
 
     /* Cancel the ioqueue operation. */
     for (i=0; i<(unsigned)tp->rdata_cnt; ++i) {
-	pj_ioqueue_post_completion(tp->key, 
-				   &tp->rdata[i]->tp_info.op_key.op_key, -1);
+	pj_ioqueue_key_t *key = get_rdata_key(tp, i);
+
+	/* A batched read only uses the op_key of its first rdata */
+	if (tp->rx_mmsg && (i % tp->rx_batch) != 0)
+	    continue;
+
+	if (key) {
+	    pj_ioqueue_post_completion(key, 
+				       &tp->rdata[i]->tp_info.op_key.op_key,
+				       -1);
+	}
     }
 
     /* Destroy the socket? */
     if (option & PJSIP_UDP_TRANSPORT_DESTROY_SOCKET) {
+	close_rp_sockets(tp);
 	if (tp->key) {
 	    /* This implicitly closes the socket */
 	    pj_ioqueue_unregister(tp->key);
@@ -1005,6 +1545,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart(pjsip_transport *transport,
 						const pjsip_host_port *a_name)
 {
     struct udp_transport *tp;
+    unsigned i;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(transport != NULL, PJ_EINVAL);
@@ -1020,6 +1561,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart(pjsip_transport *transport,
 	/* Request to recreate transport */
 
 	/* Destroy existing socket, if any. */
+	close_rp_sockets(tp);
 	if (tp->key) {
 	    /* This implicitly closes the socket */
 	    pj_ioqueue_unregister(tp->key);
@@ -1033,12 +1575,26 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart(pjsip_transport *transport,
 	}
 	tp->sock = PJ_INVALID_SOCKET;
 
-	/* Create the socket if it's not specified */
+	/* Create the socket if it's not specified. If the transport was
+	 * started with multiple SO_REUSEPORT sockets, recreate all of them.
+	 * When the socket is given by application, only that socket will
+	 * be used.
+	 */
 	if (sock == PJ_INVALID_SOCKET) {
 	    status = create_socket(pj_AF_INET(), local, 
-				   sizeof(pj_sockaddr_in), &sock);
+				   sizeof(pj_sockaddr_in), (tp->rp_cnt > 0),
+				   &sock);
 	    if (status != PJ_SUCCESS)
 		return status;
+
+	    for (i=0; i<tp->rp_cnt && status==PJ_SUCCESS; ++i) {
+		status = create_rp_sockets(sock, 1, &tp->rp[i].sock);
+	    }
+	    if (status != PJ_SUCCESS) {
+		close_rp_sockets(tp);
+		pj_sock_close(sock);
+		return status;
+	    }
 	}
 
 	/* If transport published name is not specified, calculate it
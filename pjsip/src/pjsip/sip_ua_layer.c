@@ -69,6 +69,15 @@ struct dlg_set
     struct dlg_set_head  dlg_list;
 };
 
+/* Lock stripe of the dialog set table. */
+typedef struct dlg_stripe
+{
+    pj_pool_t		*pool;
+    pj_mutex_t		*mutex;
+    pj_hash_table_t	*dlg_table;
+    struct dlg_set	 free_dlgset_nodes;
+} dlg_stripe;
+
 
 /*
  * Module interface.
@@ -76,12 +85,9 @@ struct dlg_set
 static struct user_agent
 {
     pjsip_module	 mod;
-    pj_pool_t		*pool;
     pjsip_endpoint	*endpt;
-    pj_mutex_t		*mutex;
-    pj_hash_table_t	*dlg_table;
     pjsip_ua_init_param  param;
-    struct dlg_set	 free_dlgset_nodes;
+    dlg_stripe		 stripe[PJSIP_DLG_TABLE_STRIPE_COUNT];
 
 } mod_ua = 
 {
@@ -102,6 +108,42 @@ static struct user_agent
   }
 };
 
+/*
+ * Get the stripe of the dialog set table for the hash value of the
+ * local tag.
+ */
+static dlg_stripe *get_stripe(pj_uint32_t hval)
+{
+    /* The hash tables use the low bits of the hash value to select the
+     * bucket, so use the high bits here.
+     */
+    return &mod_ua.stripe[(hval >> 16) % PJSIP_DLG_TABLE_STRIPE_COUNT];
+}
+
+/*
+ * Destroy the mutexes and release the pools of the dialog set table
+ * stripes.
+ */
+static void destroy_stripes(void)
+{
+    unsigned i;
+
+    for (i=0; i<PJSIP_DLG_TABLE_STRIPE_COUNT; ++i) {
+	dlg_stripe *stripe = &mod_ua.stripe[i];
+
+	if (stripe->mutex) {
+	    pj_mutex_destroy(stripe->mutex);
+	    stripe->mutex = NULL;
+	}
+	stripe->dlg_table = NULL;
+
+	if (stripe->pool) {
+	    pjsip_endpt_release_pool(mod_ua.endpt, stripe->pool);
+	    stripe->pool = NULL;
+	}
+    }
+}
+
 /* 
  * mod_ua_load()
  *
@@ -109,24 +151,46 @@ static struct user_agent
  */
 static pj_status_t mod_ua_load(pjsip_endpoint *endpt)
 {
+    unsigned i;
     pj_status_t status;
 
     /* Initialize the user agent. */
     mod_ua.endpt = endpt;
-    mod_ua.pool = pjsip_endpt_create_pool( endpt, "ua%p", PJSIP_POOL_LEN_UA,
-					   PJSIP_POOL_INC_UA);
-    if (mod_ua.pool == NULL)
-	return PJ_ENOMEM;
 
-    status = pj_mutex_create_recursive(mod_ua.pool, " ua%p", &mod_ua.mutex);
-    if (status != PJ_SUCCESS)
-	return status;
+    /* Create the pool, hash table and mutex of each stripe. Each stripe
+     * has its own pool, since the pool is used (e.g. when the hash table
+     * grows) while holding the stripe mutex only.
+     */
+    for (i=0; i<PJSIP_DLG_TABLE_STRIPE_COUNT; ++i) {
+	dlg_stripe *stripe = &mod_ua.stripe[i];
+
+	stripe->pool = pjsip_endpt_create_pool( endpt, "ua%p",
+						PJSIP_POOL_LEN_UA,
+						PJSIP_POOL_INC_UA);
+	if (stripe->pool == NULL) {
+	    destroy_stripes();
+	    return PJ_ENOMEM;
+	}
+
+	stripe->dlg_table = pj_hash_create2(stripe->pool,
+				PJSIP_MAX_DIALOG_COUNT /
+				    PJSIP_DLG_TABLE_STRIPE_COUNT,
+				(PJSIP_HASH_OPEN_ADDRESSING ?
+				 PJ_HASH_OPEN_ADDRESSING : 0));
+	if (stripe->dlg_table == NULL) {
+	    destroy_stripes();
+	    return PJ_ENOMEM;
+	}
 
-    mod_ua.dlg_table = pj_hash_create(mod_ua.pool, PJSIP_MAX_DIALOG_COUNT);
-    if (mod_ua.dlg_table == NULL)
-	return PJ_ENOMEM;
+	status = pj_mutex_create_recursive(stripe->pool, " ua%p",
+					   &stripe->mutex);
+	if (status != PJ_SUCCESS) {
+	    destroy_stripes();
+	    return status;
+	}
 
-    pj_list_init(&mod_ua.free_dlgset_nodes);
+	pj_list_init(&stripe->free_dlgset_nodes);
+    }
 
     /* Initialize dialog lock. */
     status = pj_thread_local_alloc(&pjsip_dlg_lock_tls_id);
@@ -147,12 +211,8 @@ static pj_status_t mod_ua_load(pjsip_endpoint *endpt)
 static pj_status_t mod_ua_unload(void)
 {
     pj_thread_local_free(pjsip_dlg_lock_tls_id);
-    pj_mutex_destroy(mod_ua.mutex);
+    destroy_stripes();
 
-    /* Release pool */
-    if (mod_ua.pool) {
-	pjsip_endpt_release_pool( mod_ua.endpt, mod_ua.pool );
-    }
     return PJ_SUCCESS;
 }
 
@@ -259,18 +319,18 @@ PJ_DEF(void) pjsip_ua_create_dlg_set_key( pj_pool_t *pool,
 /*
  * Acquire one dlg_set node to be put in the hash table.
  * This will first look in the free nodes list, then allocate
- * a new one from UA's pool when one is not available.
+ * a new one from the stripe's pool when one is not available.
  */
-static struct dlg_set *alloc_dlgset_node(void)
+static struct dlg_set *alloc_dlgset_node(dlg_stripe *stripe)
 {
     struct dlg_set *set;
 
-    if (!pj_list_empty(&mod_ua.free_dlgset_nodes)) {
-	set = mod_ua.free_dlgset_nodes.next;
+    if (!pj_list_empty(&stripe->free_dlgset_nodes)) {
+	set = stripe->free_dlgset_nodes.next;
 	pj_list_erase(set);
 	return set;
     } else {
-	set = PJ_POOL_ALLOC_T(mod_ua.pool, struct dlg_set);
+	set = PJ_POOL_ALLOC_T(stripe->pool, struct dlg_set);
 	return set;
     }
 }
@@ -282,6 +342,8 @@ static struct dlg_set *alloc_dlgset_node(void)
 PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 					   pjsip_dialog *dlg )
 {
+    dlg_stripe *stripe;
+
     /* Sanity check. */
     PJ_ASSERT_RETURN(ua && dlg, PJ_EINVAL);
 
@@ -294,15 +356,16 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
     //		     (dlg->role==PJSIP_ROLE_UAS && dlg->remote.info->tag.slen
     //		      && dlg->remote.tag_hval != 0), PJ_EBUG);
 
-    /* Lock the user agent. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the stripe of the dialog set table. */
+    stripe = get_stripe(dlg->local.tag_hval);
+    pj_mutex_lock(stripe->mutex);
 
     /* For UAC, check if there is existing dialog in the same set. */
     if (dlg->role == PJSIP_ROLE_UAC) {
 	struct dlg_set *dlg_set;
 
 	dlg_set = (struct dlg_set*)
-		  pj_hash_get_lower( mod_ua.dlg_table,
+		  pj_hash_get_lower( stripe->dlg_table,
                                      dlg->local.info->tag.ptr, 
 			             (unsigned)dlg->local.info->tag.slen,
 			             &dlg->local.tag_hval);
@@ -320,14 +383,14 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 	    /* This is the first dialog in the dialog set. 
 	     * Create the dialog set and add this dialog to it.
 	     */
-	    dlg_set = alloc_dlgset_node();
+	    dlg_set = alloc_dlgset_node(stripe);
 	    pj_list_init(&dlg_set->dlg_list);
 	    pj_list_push_back(&dlg_set->dlg_list, dlg);
 
 	    dlg->dlg_set = dlg_set;
 
 	    /* Register the dialog set in the hash table. */
-	    pj_hash_set_np_lower(mod_ua.dlg_table, 
+	    pj_hash_set_np_lower(stripe->dlg_table, 
 			         dlg->local.info->tag.ptr,
                                  (unsigned)dlg->local.info->tag.slen,
 			         dlg->local.tag_hval, dlg_set->ht_entry,
@@ -338,20 +401,20 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 	/* For UAS, create the dialog set with a single dialog as member. */
 	struct dlg_set *dlg_set;
 
-	dlg_set = alloc_dlgset_node();
+	dlg_set = alloc_dlgset_node(stripe);
 	pj_list_init(&dlg_set->dlg_list);
 	pj_list_push_back(&dlg_set->dlg_list, dlg);
 
 	dlg->dlg_set = dlg_set;
 
-	pj_hash_set_np_lower(mod_ua.dlg_table, 
+	pj_hash_set_np_lower(stripe->dlg_table, 
 		             dlg->local.info->tag.ptr,
                              (unsigned)dlg->local.info->tag.slen,
 		             dlg->local.tag_hval, dlg_set->ht_entry, dlg_set);
     }
 
-    /* Unlock user agent. */
-    pj_mutex_unlock(mod_ua.mutex);
+    /* Unlock the stripe. */
+    pj_mutex_unlock(stripe->mutex);
 
     /* Done. */
     return PJ_SUCCESS;
@@ -361,6 +424,7 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
 					     pjsip_dialog *dlg )
 {
+    dlg_stripe *stripe;
     struct dlg_set *dlg_set;
     pjsip_dialog *d;
 
@@ -370,8 +434,9 @@ PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
     /* Check that dialog has been registered. */
     PJ_ASSERT_RETURN(dlg->dlg_set, PJ_EINVALIDOP);
 
-    /* Lock user agent. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the stripe of the dialog set table. */
+    stripe = get_stripe(dlg->local.tag_hval);
+    pj_mutex_lock(stripe->mutex);
 
     /* Find this dialog from the dialog set. */
     dlg_set = (struct dlg_set*) dlg->dlg_set;
@@ -382,7 +447,7 @@ PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
 
     if (d != dlg) {
 	pj_assert(!"Dialog is not registered!");
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(stripe->mutex);
 	return PJ_EINVALIDOP;
     }
 
@@ -391,16 +456,16 @@ PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
 
     /* If dialog list is empty, remove the dialog set from the hash table. */
     if (pj_list_empty(&dlg_set->dlg_list)) {
-	pj_hash_set_lower(NULL, mod_ua.dlg_table, dlg->local.info->tag.ptr,
+	pj_hash_set_lower(NULL, stripe->dlg_table, dlg->local.info->tag.ptr,
 		          (unsigned)dlg->local.info->tag.slen, 
 			  dlg->local.tag_hval, NULL);
 
 	/* Return dlg_set to free nodes. */
-	pj_list_push_back(&mod_ua.free_dlgset_nodes, dlg_set);
+	pj_list_push_back(&stripe->free_dlgset_nodes, dlg_set);
     }
 
-    /* Unlock user agent. */
-    pj_mutex_unlock(mod_ua.mutex);
+    /* Unlock the stripe. */
+    pj_mutex_unlock(stripe->mutex);
 
     /* Done. */
     return PJ_SUCCESS;
@@ -424,13 +489,17 @@ PJ_DEF(pjsip_dialog*) pjsip_tsx_get_dlg( pjsip_transaction *tsx )
  */
 PJ_DEF(unsigned) pjsip_ua_get_dlg_set_count(void)
 {
-    unsigned count;
+    unsigned i, count = 0;
 
     PJ_ASSERT_RETURN(mod_ua.endpt, 0);
 
-    pj_mutex_lock(mod_ua.mutex);
-    count = pj_hash_count(mod_ua.dlg_table);
-    pj_mutex_unlock(mod_ua.mutex);
+    for (i=0; i<PJSIP_DLG_TABLE_STRIPE_COUNT; ++i) {
+	dlg_stripe *stripe = &mod_ua.stripe[i];
+
+	pj_mutex_lock(stripe->mutex);
+	count += pj_hash_count(stripe->dlg_table);
+	pj_mutex_unlock(stripe->mutex);
+    }
 
     return count;
 }
@@ -444,21 +513,25 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 					   const pj_str_t *remote_tag,
 					   pj_bool_t lock_dialog)
 {
+    dlg_stripe *stripe;
     struct dlg_set *dlg_set;
     pjsip_dialog *dlg;
+    pj_uint32_t hval;
 
     PJ_ASSERT_RETURN(call_id && local_tag && remote_tag, NULL);
 
-    /* Lock user agent. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the stripe of the dialog set table. */
+    hval = pj_hash_calc_tolower(0, NULL, local_tag);
+    stripe = get_stripe(hval);
+    pj_mutex_lock(stripe->mutex);
 
     /* Lookup the dialog set. */
     dlg_set = (struct dlg_set*)
-    	      pj_hash_get_lower(mod_ua.dlg_table, local_tag->ptr,
-                                (unsigned)local_tag->slen, NULL);
+    	      pj_hash_get_lower(stripe->dlg_table, local_tag->ptr,
+                                (unsigned)local_tag->slen, &hval);
     if (dlg_set == NULL) {
 	/* Not found */
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(stripe->mutex);
 	return NULL;
     }
 
@@ -474,38 +547,38 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 
     if (dlg == (pjsip_dialog*)&dlg_set->dlg_list) {
 	/* Not found */
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(stripe->mutex);
 	return NULL;
     }
 
     /* Dialog has been found. It SHOULD have the right Call-ID!! */
     PJ_ASSERT_ON_FAIL(pj_strcmp(&dlg->call_id->id, call_id)==0, 
-			{pj_mutex_unlock(mod_ua.mutex); return NULL;});
+			{pj_mutex_unlock(stripe->mutex); return NULL;});
 
     if (lock_dialog) {
 	if (pjsip_dlg_try_inc_lock(dlg) != PJ_SUCCESS) {
 
 	    /*
-	     * Unable to acquire dialog's lock while holding the user
-	     * agent's mutex. Release the UA mutex before retrying once
+	     * Unable to acquire dialog's lock while holding the dialog
+	     * set table's mutex. Release the mutex before retrying once
 	     * more.
 	     *
 	     * THIS MAY CAUSE RACE CONDITION!
 	     */
 
-	    /* Unlock user agent. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    /* Unlock the stripe. */
+	    pj_mutex_unlock(stripe->mutex);
 	    /* Lock dialog */
 	    pjsip_dlg_inc_lock(dlg);
 
 	} else {
-	    /* Unlock user agent. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    /* Unlock the stripe. */
+	    pj_mutex_unlock(stripe->mutex);
 	}
 
     } else {
-	/* Unlock user agent. */
-	pj_mutex_unlock(mod_ua.mutex);
+	/* Unlock the stripe. */
+	pj_mutex_unlock(stripe->mutex);
     }
 
     return dlg;
@@ -514,8 +587,11 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 
 /*
  * Find the first dialog in dialog set in hash table for an incoming message.
+ * When the dialog set is found, the stripe where it is registered is
+ * returned locked in p_stripe.
  */
-static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
+static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata,
+					     dlg_stripe **p_stripe )
 {
     /* CANCEL message doesn't have To tag, so we must lookup the dialog
      * by finding the INVITE UAS transaction being cancelled.
@@ -544,13 +620,23 @@ static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
 
 	/* We should find the dialog attached to the INVITE transaction */
 	if (tsx) {
-	    dlg = (pjsip_dialog*) tsx->mod_data[mod_ua.mod.id];
-	    pj_grp_lock_release(tsx->grp_lock);
+	    struct dlg_set *dlg_set = NULL;
 
 	    /* Dlg may be NULL on some extreme condition
 	     * (e.g. during debugging where initially there is a dialog)
 	     */
-	    return dlg ? (struct dlg_set*) dlg->dlg_set : NULL;
+	    dlg = (pjsip_dialog*) tsx->mod_data[mod_ua.mod.id];
+	    if (dlg) {
+		/* Lock the stripe while the transaction still holds the
+		 * dialog.
+		 */
+		*p_stripe = get_stripe(dlg->local.tag_hval);
+		pj_mutex_lock((*p_stripe)->mutex);
+		dlg_set = (struct dlg_set*) dlg->dlg_set;
+	    }
+	    pj_grp_lock_release(tsx->grp_lock);
+
+	    return dlg_set;
 
 	} else {
 	    return NULL;
@@ -560,16 +646,29 @@ static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
     } else {
 	pj_str_t *tag;
 	struct dlg_set *dlg_set;
+	dlg_stripe *stripe;
+	pj_uint32_t hval;
 
 	if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG)
 	    tag = &rdata->msg_info.to->tag;
 	else
 	    tag = &rdata->msg_info.from->tag;
 
+	/* Lock the stripe where the dialog set would be registered. */
+	hval = pj_hash_calc_tolower(0, NULL, tag);
+	stripe = get_stripe(hval);
+	pj_mutex_lock(stripe->mutex);
+
 	/* Lookup the dialog set. */
 	dlg_set = (struct dlg_set*)
-		  pj_hash_get_lower(mod_ua.dlg_table, tag->ptr, 
-				    (unsigned)tag->slen, NULL);
+		  pj_hash_get_lower(stripe->dlg_table, tag->ptr, 
+				    (unsigned)tag->slen, &hval);
+	if (dlg_set == NULL) {
+	    pj_mutex_unlock(stripe->mutex);
+	    return NULL;
+	}
+
+	*p_stripe = stripe;
 	return dlg_set;
     }
 }
@@ -577,6 +676,7 @@ static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
 /* On received requests. */
 static pj_bool_t mod_ua_on_rx_request(pjsip_rx_data *rdata)
 {
+    dlg_stripe *stripe = NULL;
     struct dlg_set *dlg_set;
     pj_str_t *from_tag;
     pjsip_dialog *dlg;
@@ -597,19 +697,16 @@ static pj_bool_t mod_ua_on_rx_request(pjsip_rx_data *rdata)
 
 retry_on_deadlock:
 
-    /* Lock user agent before looking up the dialog hash table. */
-    pj_mutex_lock(mod_ua.mutex);
-
-    /* Lookup the dialog set, based on the To tag header. */
-    dlg_set = find_dlg_set_for_msg(rdata);
+    /* Lookup the dialog set, based on the To tag header. This locks the
+     * stripe of the dialog set table when the dialog set is found.
+     */
+    dlg_set = find_dlg_set_for_msg(rdata, &stripe);
 
     /* If dialog is not found, respond with 481 (Call/Transaction
      * Does Not Exist).
      */
     if (dlg_set == NULL) {
 	/* Unable to find dialog. */
-	pj_mutex_unlock(mod_ua.mutex);
-
 	if (rdata->msg_info.msg->line.req.method.id != PJSIP_ACK_METHOD) {
 	    PJ_LOG(5,(THIS_FILE, 
 		      "Unable to find dialogset for %s, answering with 481",
@@ -649,7 +746,7 @@ retry_on_deadlock:
 
 	if (first_dlg->remote.info->tag.slen != 0) {
 	    /* Not found. Mulfunction UAC? */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    pj_mutex_unlock(stripe->mutex);
 
 	    if (rdata->msg_info.msg->line.req.method.id != PJSIP_ACK_METHOD) {
 		PJ_LOG(5,(THIS_FILE, 
@@ -678,16 +775,16 @@ retry_on_deadlock:
     status = pjsip_dlg_try_inc_lock(dlg);
     if (status != PJ_SUCCESS) {
 	/* Failed to acquire dialog mutex immediately, this could be 
-	 * because of deadlock. Release UA mutex, yield, and retry 
-	 * the whole thing once again.
+	 * because of deadlock. Release the stripe's mutex, yield, and
+	 * retry the whole thing once again.
 	 */
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(stripe->mutex);
 	pj_thread_sleep(0);
 	goto retry_on_deadlock;
     }
 
     /* Done with processing in UA layer, release lock */
-    pj_mutex_unlock(mod_ua.mutex);
+    pj_mutex_unlock(stripe->mutex);
 
     /* Pass to dialog. */
     pjsip_dlg_on_rx_request(dlg, rdata);
@@ -705,6 +802,7 @@ retry_on_deadlock:
 static pj_bool_t mod_ua_on_rx_response(pjsip_rx_data *rdata)
 {
     pjsip_transaction *tsx;
+    dlg_stripe *stripe;
     struct dlg_set *dlg_set;
     pjsip_dialog *dlg;
     pj_status_t status;
@@ -723,19 +821,17 @@ retry_on_deadlock:
 
     dlg = NULL;
 
-    /* Lock user agent dlg table before we're doing anything. */
-    pj_mutex_lock(mod_ua.mutex);
-
     /* Check if transaction is present. */
     tsx = pjsip_rdata_get_tsx(rdata);
     if (tsx) {
 	/* Check if dialog is present in the transaction. */
 	dlg = pjsip_tsx_get_dlg(tsx);
-	if (!dlg) {
-	    /* Unlock dialog hash table. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	if (!dlg)
 	    return PJ_FALSE;
-	}
+
+	/* Lock the stripe of the dialog set table. */
+	stripe = get_stripe(dlg->local.tag_hval);
+	pj_mutex_lock(stripe->mutex);
 
 	/* Get the dialog set. */
 	dlg_set = (struct dlg_set*) dlg->dlg_set;
@@ -751,6 +847,7 @@ retry_on_deadlock:
 	 * dialog.
 	 */
 	pjsip_cseq_hdr *cseq_hdr = rdata->msg_info.cseq;
+	pj_uint32_t hval;
 
 	if (cseq_hdr->method.id != PJSIP_INVITE_METHOD ||
 	    rdata->msg_info.msg->line.status.code / 100 != 2)
@@ -759,22 +856,24 @@ retry_on_deadlock:
 	     * This must be some stateless response sent by other modules,
 	     * or a very late response.
 	     */
-	    /* Unlock dialog hash table. */
-	    pj_mutex_unlock(mod_ua.mutex);
 	    return PJ_FALSE;
 	}
 
+	/* Lock the stripe of the dialog set table. */
+	hval = pj_hash_calc_tolower(0, NULL, &rdata->msg_info.from->tag);
+	stripe = get_stripe(hval);
+	pj_mutex_lock(stripe->mutex);
 
 	/* Get the dialog set. */
 	dlg_set = (struct dlg_set*)
-		  pj_hash_get_lower(mod_ua.dlg_table, 
+		  pj_hash_get_lower(stripe->dlg_table, 
 			            rdata->msg_info.from->tag.ptr,
 			            (unsigned)rdata->msg_info.from->tag.slen,
-			            NULL);
+			            &hval);
 
 	if (!dlg_set) {
 	    /* Unlock dialog hash table. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    pj_mutex_unlock(stripe->mutex);
 
 	    /* Strayed 2xx response!! */
 	    PJ_LOG(4,(THIS_FILE, 
@@ -844,7 +943,7 @@ retry_on_deadlock:
 		dlg = (*mod_ua.param.on_dlg_forked)(dlg_set->dlg_list.next, 
 						    rdata);
 		if (dlg == NULL) {
-		    pj_mutex_unlock(mod_ua.mutex);
+		    pj_mutex_unlock(stripe->mutex);
 		    return PJ_TRUE;
 		}
 	    } else {
@@ -888,15 +987,16 @@ retry_on_deadlock:
     if (status != PJ_SUCCESS) {
 	/* Failed to acquire dialog mutex. This could indicate a deadlock
 	 * situation, and for safety, try to avoid deadlock by releasing
-	 * UA mutex, yield, and retry the whole processing once again.
+	 * the stripe's mutex, yield, and retry the whole processing once
+	 * again.
 	 */
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(stripe->mutex);
 	pj_thread_sleep(0);
 	goto retry_on_deadlock;
     }
 
     /* We're done with processing in the UA layer, we can release the mutex */
-    pj_mutex_unlock(mod_ua.mutex);
+    pj_mutex_unlock(stripe->mutex);
 
     /* Pass the response to the dialog. */
     pjsip_dlg_on_rx_response(dlg, rdata);
@@ -942,21 +1042,29 @@ PJ_DEF(void) pjsip_ua_dump(pj_bool_t detail)
 #if PJ_LOG_MAX_LEVEL >= 3
     pj_hash_iterator_t itbuf, *it;
     char dlginfo[128];
+    unsigned i, count;
+
+    count = pjsip_ua_get_dlg_set_count();
+
+    PJ_LOG(3, (THIS_FILE, "Number of dialog sets: %u", count));
+
+    if (!detail || count == 0)
+	return;
+
+    PJ_LOG(3, (THIS_FILE, "Dumping dialog sets:"));
 
-    pj_mutex_lock(mod_ua.mutex);
+    for (i=0; i<PJSIP_DLG_TABLE_STRIPE_COUNT; ++i) {
+	dlg_stripe *stripe = &mod_ua.stripe[i];
 
-    PJ_LOG(3, (THIS_FILE, "Number of dialog sets: %u", 
-			  pj_hash_count(mod_ua.dlg_table)));
+	pj_mutex_lock(stripe->mutex);
 
-    if (detail && pj_hash_count(mod_ua.dlg_table)) {
-	PJ_LOG(3, (THIS_FILE, "Dumping dialog sets:"));
-	it = pj_hash_first(mod_ua.dlg_table, &itbuf);
-	for (; it != NULL; it = pj_hash_next(mod_ua.dlg_table, it))  {
+	it = pj_hash_first(stripe->dlg_table, &itbuf);
+	for (; it != NULL; it = pj_hash_next(stripe->dlg_table, it))  {
 	    struct dlg_set *dlg_set;
 	    pjsip_dialog *dlg;
 	    const char *title;
 
-	    dlg_set = (struct dlg_set*) pj_hash_this(mod_ua.dlg_table, it);
+	    dlg_set = (struct dlg_set*) pj_hash_this(stripe->dlg_table, it);
 	    if (!dlg_set || pj_list_empty(&dlg_set->dlg_list)) continue;
 
 	    /* First dialog in dialog set. */
@@ -976,9 +1084,9 @@ PJ_DEF(void) pjsip_ua_dump(pj_bool_t detail)
 		dlg = dlg->next;
 	    }
 	}
-    }
 
-    pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(stripe->mutex);
+    }
 #endif
 }
 
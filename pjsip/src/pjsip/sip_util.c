@@ -1237,7 +1237,8 @@ static void stateless_send_transport_cb( void *token,
 	    }
 	}
 
-	pjsip_tx_data_invalidate_msg(tdata);
+	/* Only the Via header needs to be re-printed. */
+	pjsip_tx_data_invalidate_hdr(tdata, via);
 
 	/* Send message using this transport. */
 	status = pjsip_transport_send( stateless_data->cur_transport,
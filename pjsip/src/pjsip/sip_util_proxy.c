@@ -67,6 +67,197 @@ PJ_DEF(pj_status_t) pjsip_endpt_clone_msg( pjsip_endpoint *endpt,
 */
 
 
+/*
+ * Create the Via header to be added by the proxy to the forwarded request.
+ */
+static pjsip_via_hdr *create_fwd_via(pjsip_tx_data *tdata,
+				     pjsip_rx_data *rdata,
+				     const pj_str_t *branch)
+{
+    pjsip_via_hdr *hvia;
+
+    hvia = pjsip_via_hdr_create(tdata->pool);
+    if (branch)
+	pj_strdup(tdata->pool, &hvia->branch_param, branch);
+    else {
+	pj_str_t new_branch = pjsip_calculate_branch_id(rdata);
+	pj_strdup(tdata->pool, &hvia->branch_param, &new_branch);
+    }
+    return hvia;
+}
+
+
+/*
+ * Build the headers and body of the message to be forwarded from the
+ * packet in rdata (see PJSIP_FWD_SPLICE). For requests, new_via is
+ * inserted before the top-most Via and Max-Forwards is decremented. For
+ * responses (new_via is NULL), the top-most Via is removed.
+ */
+static pj_status_t splice_msg(pjsip_tx_data *tdata,
+			      const pjsip_rx_data *rdata,
+			      pjsip_via_hdr *new_via)
+{
+    const pjsip_msg *src = rdata->msg_info.msg;
+    pjsip_msg *dst = tdata->msg;
+    char *buf, *end, *line;
+    pj_bool_t via_found = PJ_FALSE, max_fwd_found = PJ_FALSE;
+
+    if (rdata->msg_info.msg_buf == NULL || rdata->msg_info.len <= 0)
+	return PJ_ENOTSUP;
+
+    /* Copy the packet once. The headers which are not changed and the
+     * body will refer to this copy.
+     */
+    buf = (char*) pj_pool_alloc(tdata->pool, rdata->msg_info.len);
+    pj_memcpy(buf, rdata->msg_info.msg_buf, rdata->msg_info.len);
+    end = buf + rdata->msg_info.len;
+
+    /* Skip the start line */
+    line = (char*) pj_memchr(buf, '\n', end - buf);
+    if (line) {
+	char *cr = (char*) pj_memchr(buf, '\r', line - buf);
+	if (cr && cr != line-1)
+	    return PJ_ENOTSUP;
+    }
+
+    while (line) {
+	char *eol, *p;
+	pj_str_t hname, hvalue;
+	pjsip_lazy_hdr *hdr;
+
+	++line;
+	if (line == end)
+	    return PJ_ENOTSUP;
+
+	/* Empty line ends the header area */
+	if ((*line == '\r' && line+1 < end && line[1] == '\n') ||
+	    *line == '\n')
+	{
+	    break;
+	}
+
+	eol = (char*) pj_memchr(line, '\n', end - line);
+	if (eol == NULL)
+	    return PJ_ENOTSUP;
+
+	/* Don't splice folded header lines, or lines which end with CR
+	 * only.
+	 */
+	if (eol+1 < end && (eol[1] == ' ' || eol[1] == '\t'))
+	    return PJ_ENOTSUP;
+	p = (char*) pj_memchr(line, '\r', eol - line);
+	if (p && p != eol-1)
+	    return PJ_ENOTSUP;
+
+	/* Header name */
+	p = (char*) pj_memchr(line, ':', eol - line);
+	if (p == NULL)
+	    return PJ_ENOTSUP;
+	hname.ptr = line;
+	hname.slen = p - line;
+	while (hname.slen && pj_isblank(hname.ptr[hname.slen-1]))
+	    --hname.slen;
+
+	/* Header value */
+	for (++p; p < eol && pj_isblank(*p); ++p)
+	    ;
+	hvalue.ptr = p;
+	hvalue.slen = eol - p;
+	while (hvalue.slen && pj_isspace(hvalue.ptr[hvalue.slen-1]))
+	    --hvalue.slen;
+
+	hdr = pjsip_lazy_hdr_create2(tdata->pool, &hname, &hvalue);
+
+	if (hdr->htype == PJSIP_H_VIA && !via_found) {
+	    via_found = PJ_TRUE;
+
+	    if (new_via) {
+		pjsip_msg_add_hdr(dst, (pjsip_hdr*)new_via);
+	    } else {
+		/* Remove the first value from the header line */
+		pj_bool_t quoted = PJ_FALSE;
+
+		for (p=hvalue.ptr; p < hvalue.ptr+hvalue.slen; ++p) {
+		    if (*p == '"')
+			quoted = !quoted;
+		    else if (*p == ',' && !quoted)
+			break;
+		}
+		if (p == hvalue.ptr+hvalue.slen) {
+		    line = eol;
+		    continue;
+		}
+		for (++p; p < hvalue.ptr+hvalue.slen && pj_isspace(*p); ++p)
+		    ;
+		hdr->hvalue.slen -= (p - hvalue.ptr);
+		hdr->hvalue.ptr = p;
+	    }
+
+	} else if (hdr->htype == PJSIP_H_MAX_FORWARDS && new_via &&
+		   !max_fwd_found && rdata->msg_info.max_fwd)
+	{
+	    pjsip_max_fwd_hdr *hmaxfwd;
+
+	    max_fwd_found = PJ_TRUE;
+	    hmaxfwd = pjsip_max_fwd_hdr_create(tdata->pool,
+					       rdata->msg_info.max_fwd->ivalue);
+	    --hmaxfwd->ivalue;
+	    pjsip_msg_add_hdr(dst, (pjsip_hdr*)hmaxfwd);
+	    line = eol;
+	    continue;
+
+	} else if (hdr->htype == PJSIP_H_CONTENT_LENGTH ||
+		   hdr->htype == PJSIP_H_CONTENT_TYPE)
+	{
+	    /* These will be generated when the message is printed. */
+	    line = eol;
+	    continue;
+	}
+
+	pjsip_msg_add_hdr(dst, (pjsip_hdr*)hdr);
+	line = eol;
+    }
+
+    if (line == NULL || !via_found)
+	return PJ_ENOTSUP;
+
+    /* 16.6.3:
+     * If the copy does not contain a Max-Forwards header field, the
+     * proxy MUST add one with a field value, which SHOULD be 70.
+     */
+    if (new_via && !max_fwd_found) {
+	pjsip_max_fwd_hdr *hmaxfwd = 
+	    pjsip_max_fwd_hdr_create(tdata->pool, 70);
+	pjsip_msg_add_hdr(dst, (pjsip_hdr*)hmaxfwd);
+    }
+
+    /* The body refers to the copy too */
+    if (src->body) {
+	pj_ssize_t offset = (char*)src->body->data - rdata->msg_info.msg_buf;
+
+	if (src->body->print_body == &pjsip_print_text_body &&
+	    offset >= 0 && offset + src->body->len <=
+			   (pj_size_t)rdata->msg_info.len)
+	{
+	    pjsip_msg_body *body = PJ_POOL_ZALLOC_T(tdata->pool,
+						    pjsip_msg_body);
+
+	    pjsip_media_type_cp(tdata->pool, &body->content_type,
+				&src->body->content_type);
+	    body->data = buf + offset;
+	    body->len = src->body->len;
+	    body->print_body = &pjsip_print_text_body;
+	    body->clone_data = &pjsip_clone_text_data;
+	    dst->body = body;
+	} else {
+	    dst->body = pjsip_msg_body_clone(tdata->pool, src->body);
+	}
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Create new request message to be forwarded upstream to new destination URI 
  * in uri. 
@@ -87,8 +278,6 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_request_fwd(pjsip_endpoint *endpt,
     PJ_ASSERT_RETURN(rdata->msg_info.msg->type == PJSIP_REQUEST_MSG, 
 		     PJSIP_ENOTREQUESTMSG);
 
-    PJ_UNUSED_ARG(options);
-
 
     /* Request forwarding rule in RFC 3261 section 16.6:
      *
@@ -122,6 +311,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_request_fwd(pjsip_endpoint *endpt,
 	pjsip_msg *dst;
 	const pjsip_msg *src = rdata->msg_info.msg;
 	const pjsip_hdr *hsrc;
+	pj_bool_t spliced = PJ_FALSE;
 
 	/* Create the request */
 	tdata->msg = dst = pjsip_msg_create(tdata->pool, PJSIP_REQUEST_MSG);
@@ -139,8 +329,19 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_request_fwd(pjsip_endpoint *endpt,
 	    		       pjsip_uri_clone(tdata->pool, src->line.req.uri);
 	}
 
-	/* Clone ALL headers */
-	hsrc = src->hdr.next;
+	/* Splice the headers from the packet if requested */
+	if (options & PJSIP_FWD_SPLICE) {
+	    spliced = (splice_msg(tdata, rdata,
+				  create_fwd_via(tdata, rdata, branch))
+		       == PJ_SUCCESS);
+	    if (!spliced) {
+		pj_list_init(&dst->hdr);
+		dst->body = NULL;
+	    }
+	}
+
+	/* Otherwise clone ALL headers */
+	hsrc = spliced ? &src->hdr : src->hdr.next;
 	while (hsrc != &src->hdr) {
 
 	    pjsip_hdr *hdst;
@@ -150,13 +351,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_request_fwd(pjsip_endpoint *endpt,
 	     */
 	    if (hsrc == (pjsip_hdr*)rdata->msg_info.via) {
 		pjsip_via_hdr *hvia;
-		hvia = pjsip_via_hdr_create(tdata->pool);
-		if (branch)
-		    pj_strdup(tdata->pool, &hvia->branch_param, branch);
-		else {
-		    pj_str_t new_branch = pjsip_calculate_branch_id(rdata);
-		    pj_strdup(tdata->pool, &hvia->branch_param, &new_branch);
-		}
+		hvia = create_fwd_via(tdata, rdata, branch);
 		pjsip_msg_add_hdr(dst, (pjsip_hdr*)hvia);
 
 	    }
@@ -217,14 +412,14 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_request_fwd(pjsip_endpoint *endpt,
 	 * If the copy does not contain a Max-Forwards header field, the
          * proxy MUST add one with a field value, which SHOULD be 70.
 	 */
-	if (rdata->msg_info.max_fwd == NULL) {
+	if (!spliced && rdata->msg_info.max_fwd == NULL) {
 	    pjsip_max_fwd_hdr *hmaxfwd = 
 		pjsip_max_fwd_hdr_create(tdata->pool, 70);
 	    pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr*)hmaxfwd);
 	}
 
 	/* Clone request body */
-	if (src->body) {
+	if (!spliced && src->body) {
 	    dst->body = pjsip_msg_body_clone(tdata->pool, src->body);
 	}
 
@@ -255,8 +450,6 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_response_fwd( pjsip_endpoint *endpt,
     pj_status_t status;
     PJ_USE_EXCEPTION;
 
-    PJ_UNUSED_ARG(options);
-
     status = pjsip_endpt_create_tdata(endpt, &tdata);
     if (status != PJ_SUCCESS)
 	return status;
@@ -267,6 +460,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_response_fwd( pjsip_endpoint *endpt,
 	pjsip_msg *dst;
 	const pjsip_msg *src = rdata->msg_info.msg;
 	const pjsip_hdr *hsrc;
+	pj_bool_t spliced = PJ_FALSE;
 
 	/* Create the request */
 	tdata->msg = dst = pjsip_msg_create(tdata->pool, PJSIP_RESPONSE_MSG);
@@ -276,8 +470,17 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_response_fwd( pjsip_endpoint *endpt,
 	pj_strdup(tdata->pool, &dst->line.status.reason, 
 		  &src->line.status.reason);
 
-	/* Duplicate all headers */
-	hsrc = src->hdr.next;
+	/* Splice the headers from the packet if requested */
+	if (options & PJSIP_FWD_SPLICE) {
+	    spliced = (splice_msg(tdata, rdata, NULL) == PJ_SUCCESS);
+	    if (!spliced) {
+		pj_list_init(&dst->hdr);
+		dst->body = NULL;
+	    }
+	}
+
+	/* Otherwise duplicate all headers */
+	hsrc = spliced ? &src->hdr : src->hdr.next;
 	while (hsrc != &src->hdr) {
 	    
 	    /* Skip Content-Type and Content-Length as these would be 
@@ -304,7 +507,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_create_response_fwd( pjsip_endpoint *endpt,
 	}
 
 	/* Clone message body */
-	if (src->body)
+	if (!spliced && src->body)
 	    dst->body = pjsip_msg_body_clone(tdata->pool, src->body);
 
 
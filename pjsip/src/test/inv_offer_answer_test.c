@@ -137,6 +137,7 @@ typedef struct inv_test_param_t
     pj_bool_t	need_established;
     unsigned	count;
     oa_t	oa[4];
+    pj_bool_t	lazy_parse;
 } inv_test_param_t;
 
 typedef struct inv_test_t
@@ -152,6 +153,9 @@ typedef struct inv_test_t
     unsigned		oa_index;
     unsigned		uac_update_cnt,
 			uas_update_cnt;
+
+    unsigned		prack_cnt;
+    pj_bool_t		has_route_set;
 } inv_test_t;
 
 
@@ -312,6 +316,9 @@ static pj_bool_t on_rx_request(pjsip_rx_data *rdata)
 				      &uri, &dlg);
 	pj_assert(status == PJ_SUCCESS);
 
+	/* Route set is taken from the Record-Route of the request */
+	inv_test.has_route_set = !pj_list_empty(&dlg->route_set);
+
 	if (inv_test.param.oa[0] == OFFERER_UAC)
 	    sdp = create_sdp(rdata->tp_info.pool, oa_sdp[0].answer);
 	else if (inv_test.param.oa[0] == OFFERER_UAS)
@@ -400,6 +407,8 @@ static int perform_test(inv_test_param_t *param)
     pjsip_dialog *dlg;
     pjmedia_sdp_session *sdp;
     pjsip_tx_data *tdata;
+    pj_bool_t saved_lazy = pjsip_cfg()->endpt.lazy_parse;
+    int rc = 0;
     pj_status_t status;
 
     PJ_LOG(3,(THIS_FILE, "  %s", param->title));
@@ -433,6 +442,23 @@ static int perform_test(inv_test_param_t *param)
     status = pjsip_inv_invite(inv_test.uac, &tdata);
     PJ_ASSERT_RETURN(status==PJ_SUCCESS, -30);
 
+    /* With lazy parsing, check that the dialog still gets its route set
+     * from Record-Route, and 100rel still works.
+     */
+    if (param->lazy_parse) {
+	pj_str_t hname = pj_str("Record-Route");
+	pj_str_t hvalue;
+	pjsip_hdr *rr;
+
+	pj_strdup2_with_null(tdata->pool, &hvalue, "<" CONTACT ";lr>");
+	rr = (pjsip_hdr*) pjsip_parse_hdr(tdata->pool, &hname, hvalue.ptr,
+					  hvalue.slen, NULL);
+	PJ_ASSERT_RETURN(rr != NULL, -25);
+	pjsip_msg_add_hdr(tdata->msg, rr);
+
+	pjsip_cfg()->endpt.lazy_parse = PJ_TRUE;
+    }
+
     status = pjsip_inv_send_msg(inv_test.uac, tdata);
     PJ_ASSERT_RETURN(status==PJ_SUCCESS, -30);
 
@@ -469,7 +495,21 @@ static int perform_test(inv_test_param_t *param)
 
     flush_events(500);
 
-    return 0;
+    if (param->lazy_parse) {
+	pjsip_cfg()->endpt.lazy_parse = saved_lazy;
+
+	if (!inv_test.has_route_set) {
+	    PJ_LOG(3,(THIS_FILE, "    error: dialog has no route set"));
+	    rc = -40;
+	} else if ((param->inv_option & PJSIP_INV_REQUIRE_100REL) &&
+		   inv_test.prack_cnt == 0)
+	{
+	    PJ_LOG(3,(THIS_FILE, "    error: no PRACK was sent"));
+	    rc = -50;
+	}
+    }
+
+    return rc;
 }
 
 
@@ -478,6 +518,12 @@ static pj_bool_t log_on_rx_msg(pjsip_rx_data *rdata)
     pjsip_msg *msg = rdata->msg_info.msg;
     char info[80];
 
+    if (msg->type == PJSIP_REQUEST_MSG &&
+	pj_stricmp2(&msg->line.req.method.name, "PRACK") == 0)
+    {
+	++inv_test.prack_cnt;
+    }
+
     if (msg->type == PJSIP_REQUEST_MSG)
 	pj_ansi_snprintf(info, sizeof(info), "%.*s", 
 	    (int)msg->line.req.method.name.slen,
@@ -562,6 +608,15 @@ static inv_test_param_t test_params[] =
 	1,
 	{ OFFERER_UAS }
     },
+
+    {
+	"INVITE with no offer, with 100rel and Record-Route, lazy parsing",
+	PJSIP_INV_REQUIRE_100REL,
+	PJ_TRUE,
+	1,
+	{ OFFERER_UAS },
+	PJ_TRUE
+    },
 #endif
 
 /* Subsequent UAC offer with UPDATE:
@@ -820,6 +820,12 @@ static pjsip_msg *create_msg1(pj_pool_t *pool)
 static pj_status_t simple_test(void)
 {
     char stbuf[] = "SIP/2.0 180 Ringing like it never rings before";
+    /* Stream message with Content-Length too large for int */
+    char clen_overflow[] =
+	"BYE sip:user@foo SIP/2.0\r\n"
+	"Content-Length: 21474836480\r\n"
+	"\r\n";
+    pj_size_t msg_size;
     unsigned i;
     pjsip_status_line st_line;
     pj_status_t status;
@@ -830,6 +836,14 @@ static pj_status_t simple_test(void)
     if (status != PJ_SUCCESS)
 	return status;
 
+    status = pjsip_find_msg(clen_overflow, pj_ansi_strlen(clen_overflow),
+			    PJ_FALSE, &msg_size);
+    if (status != PJSIP_EMISSINGHDR) {
+	PJ_LOG(3,(THIS_FILE, "   error: overflowing Content-Length is not "
+			     "rejected"));
+	return -7;
+    }
+
     for (i=0; i<PJ_ARRAY_SIZE(test_array); ++i) {
 	pj_pool_t *pool;
 	pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE, POOL_SIZE);
@@ -1985,6 +1999,322 @@ static int hdr_test(void)
 }
 
 
+/*****************************************************************************/
+/*
+ * Lazy parsing: the message parsed with lazy parsing must yield the same
+ * headers as the normal parsing once the headers have been looked up.
+ */
+static int lazy_parse_test(void)
+{
+    struct test_msg *entry = &test_array[0];
+    pj_bool_t saved_lazy = pjsip_cfg()->endpt.lazy_parse;
+    pj_pool_t *pool;
+    pjsip_rx_data *rdata;
+    pjsip_msg *ref_msg, *lazy_msg;
+    pjsip_hdr *hdr1, *hdr2;
+    char *buf, str1[512], str2[512];
+    pj_size_t len;
+    unsigned count;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  lazy parsing test.."));
+
+    pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE, POOL_SIZE);
+
+    len = pj_ansi_strlen(entry->msg);
+    buf = (char*) pj_pool_alloc(pool, len+1);
+    pj_memcpy(buf, entry->msg, len+1);
+
+    rdata = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
+    rdata->tp_info.pool = pool;
+    pj_list_init(&rdata->msg_info.parse_err);
+
+    pjsip_cfg()->endpt.lazy_parse = PJ_TRUE;
+    lazy_msg = pjsip_parse_rdata(buf, len, rdata);
+    pjsip_cfg()->endpt.lazy_parse = saved_lazy;
+
+    if (!lazy_msg || !pj_list_empty(&rdata->msg_info.parse_err)) {
+	rc = -1000;
+	goto on_return;
+    }
+
+    /* The headers needed by the core must have been parsed. */
+    if (!rdata->msg_info.via || !rdata->msg_info.from || !rdata->msg_info.to ||
+	!rdata->msg_info.cid || !rdata->msg_info.cseq ||
+	!rdata->msg_info.max_fwd || !rdata->msg_info.ctype ||
+	!rdata->msg_info.clen)
+    {
+	rc = -1010;
+	goto on_return;
+    }
+
+    /* Routing headers are parsed too, since the core uses them through
+     * msg_info.
+     */
+    if (!rdata->msg_info.route || !rdata->msg_info.record_route) {
+	rc = -1020;
+	goto on_return;
+    }
+
+    /* The first Contact header line contains two contacts */
+    hdr1 = (pjsip_hdr*) pjsip_msg_find_hdr(lazy_msg, PJSIP_H_CONTACT, NULL);
+    for (count=0; hdr1; ++count) {
+	hdr1 = (pjsip_hdr*) pjsip_msg_find_hdr(lazy_msg, PJSIP_H_CONTACT,
+					       hdr1->next);
+    }
+    if (count != 3) {
+	rc = -1030;
+	goto on_return;
+    }
+
+    /* Parse the rest of the headers */
+    pjsip_msg_find_hdr(lazy_msg, PJSIP_H_UNSUPPORTED, NULL);
+
+    /* Compare with normal parsing */
+    ref_msg = pjsip_parse_msg(pool, entry->msg, len, NULL);
+    if (!ref_msg) {
+	rc = -1040;
+	goto on_return;
+    }
+
+    hdr1 = lazy_msg->hdr.next;
+    hdr2 = ref_msg->hdr.next;
+    while (hdr1 != &lazy_msg->hdr && hdr2 != &ref_msg->hdr) {
+	int len1, len2;
+
+	len1 = pjsip_hdr_print_on(hdr1, str1, sizeof(str1)-1);
+	len2 = pjsip_hdr_print_on(hdr2, str2, sizeof(str2)-1);
+	if (hdr1->type != hdr2->type || len1 < 0 || len1 != len2 ||
+	    pj_memcmp(str1, str2, len1) != 0)
+	{
+	    PJ_LOG(3,(THIS_FILE, "   error: header mismatch:\n"
+				 "   h1='%.*s'\n"
+				 "   h2='%.*s'\n",
+				 len1, str1, len2, str2));
+	    rc = -1050;
+	    goto on_return;
+	}
+
+	hdr1 = hdr1->next;
+	hdr2 = hdr2->next;
+    }
+
+    if (hdr1 != &lazy_msg->hdr || hdr2 != &ref_msg->hdr) {
+	rc = -1060;
+	goto on_return;
+    }
+
+on_return:
+    pjsip_endpt_release_pool(endpt, pool);
+    return rc;
+}
+
+
+/*****************************************************************************/
+/*
+ * Compare messages forwarded with PJSIP_FWD_SPLICE against the messages
+ * forwarded by cloning.
+ */
+static char fwd_req[] =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKnashds8\r\n"
+    "Max-Forwards: 70\r\n"
+    "Route: <sip:proxy.example.com;lr>\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "f: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+    "X-Header: some value\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 5\r\n"
+    "\r\n"
+    "v=0\r\n";
+
+static char fwd_res[] =
+    "SIP/2.0 200 OK\r\n"
+    "v: SIP/2.0/UDP proxy.example.com;branch=z9hG4bK776, "
+	"SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKnashds8\r\n"
+    "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:bob@192.0.2.4>\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 5\r\n"
+    "\r\n"
+    "v=0\r\n";
+
+static pjsip_tx_data *create_fwd(pjsip_rx_data *rdata, unsigned options)
+{
+    pjsip_tx_data *tdata;
+    pj_status_t status;
+
+    if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG) {
+	pj_str_t branch = pj_str("z9hG4bKfwdtest");
+	pjsip_via_hdr *via;
+
+	status = pjsip_endpt_create_request_fwd(endpt, rdata, NULL, &branch,
+						options, &tdata);
+	if (status != PJ_SUCCESS)
+	    return NULL;
+
+	/* Fill in the new Via, as the transport would do */
+	via = (pjsip_via_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, 
+						  NULL);
+	via->transport = pj_str("UDP");
+	via->sent_by.host = pj_str("proxy.example.com");
+    } else {
+	status = pjsip_endpt_create_response_fwd(endpt, rdata, options,
+						 &tdata);
+	if (status != PJ_SUCCESS)
+	    return NULL;
+    }
+
+    return tdata;
+}
+
+static int fwd_splice_test_msg(pj_pool_t *pool, char *msg)
+{
+    pjsip_rx_data *rdata;
+    pjsip_tx_data *tdata1, *tdata2;
+    pjsip_msg *msg1, *msg2;
+    pjsip_hdr *hdr1, *hdr2;
+    pj_size_t len = pj_ansi_strlen(msg);
+    char *buf1, *buf2, str1[512], str2[512];
+    pj_ssize_t len1, len2;
+    int rc = 0;
+
+    rdata = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
+    rdata->tp_info.pool = pool;
+    pj_list_init(&rdata->msg_info.parse_err);
+    rdata->msg_info.msg_buf = msg;
+    rdata->msg_info.len = (int)len;
+
+    if (!pjsip_parse_rdata(msg, len, rdata))
+	return -1100;
+
+    tdata1 = create_fwd(rdata, 0);
+    if (!tdata1)
+	return -1110;
+    tdata2 = create_fwd(rdata, PJSIP_FWD_SPLICE);
+    if (!tdata2) {
+	pjsip_tx_data_dec_ref(tdata1);
+	return -1120;
+    }
+
+    /* Print and parse both messages, then compare them */
+    buf1 = (char*) pj_pool_alloc(pool, PJSIP_MAX_PKT_LEN);
+    buf2 = (char*) pj_pool_alloc(pool, PJSIP_MAX_PKT_LEN);
+    len1 = pjsip_msg_print(tdata1->msg, buf1, PJSIP_MAX_PKT_LEN);
+    len2 = pjsip_msg_print(tdata2->msg, buf2, PJSIP_MAX_PKT_LEN);
+    if (len1 <= 0 || len2 <= 0) {
+	rc = -1130;
+	goto on_return;
+    }
+    buf1[len1] = buf2[len2] = '\0';
+
+    msg1 = pjsip_parse_msg(pool, buf1, len1, NULL);
+    msg2 = pjsip_parse_msg(pool, buf2, len2, NULL);
+    if (!msg1 || !msg2) {
+	rc = -1140;
+	goto on_return;
+    }
+
+    hdr1 = msg1->hdr.next;
+    hdr2 = msg2->hdr.next;
+    while (hdr1 != &msg1->hdr && hdr2 != &msg2->hdr) {
+	int hlen1, hlen2;
+
+	hlen1 = pjsip_hdr_print_on(hdr1, str1, sizeof(str1)-1);
+	hlen2 = pjsip_hdr_print_on(hdr2, str2, sizeof(str2)-1);
+	if (hdr1->type != hdr2->type || hlen1 < 0 || hlen1 != hlen2 ||
+	    pj_memcmp(str1, str2, hlen1) != 0)
+	{
+	    PJ_LOG(3,(THIS_FILE, "   error: header mismatch:\n"
+				 "   h1='%.*s'\n"
+				 "   h2='%.*s'\n",
+				 hlen1, str1, hlen2, str2));
+	    rc = -1150;
+	    goto on_return;
+	}
+
+	hdr1 = hdr1->next;
+	hdr2 = hdr2->next;
+    }
+
+    if (hdr1 != &msg1->hdr || hdr2 != &msg2->hdr) {
+	rc = -1160;
+	goto on_return;
+    }
+
+    if (!msg1->body || !msg2->body || msg1->body->len != msg2->body->len ||
+	pj_memcmp(msg1->body->data, msg2->body->data, msg1->body->len) != 0)
+    {
+	rc = -1170;
+	goto on_return;
+    }
+
+on_return:
+    pjsip_tx_data_dec_ref(tdata1);
+    pjsip_tx_data_dec_ref(tdata2);
+    return rc;
+}
+
+static int fwd_splice_test(void)
+{
+    pj_pool_t *pool;
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "  forwarding splice test.."));
+
+    pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE, POOL_SIZE);
+
+    rc = fwd_splice_test_msg(pool, fwd_req);
+    if (rc == 0)
+	rc = fwd_splice_test_msg(pool, fwd_res);
+
+#if INCLUDE_BENCHMARKS
+    if (rc == 0) {
+	unsigned options[2] = { 0, PJSIP_FWD_SPLICE };
+	pjsip_rx_data *rdata;
+	char *buf;
+	unsigned i, j;
+
+	rdata = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
+	rdata->tp_info.pool = pool;
+	pj_list_init(&rdata->msg_info.parse_err);
+	rdata->msg_info.msg_buf = fwd_req;
+	rdata->msg_info.len = (int)pj_ansi_strlen(fwd_req);
+	pjsip_parse_rdata(fwd_req, rdata->msg_info.len, rdata);
+
+	buf = (char*) pj_pool_alloc(pool, PJSIP_MAX_PKT_LEN);
+
+	for (j=0; j<PJ_ARRAY_SIZE(options); ++j) {
+	    pj_timestamp t1, t2;
+	    unsigned msec;
+
+	    pj_get_timestamp(&t1);
+	    for (i=0; i<LOOP; ++i) {
+		pjsip_tx_data *tdata = create_fwd(rdata, options[j]);
+		pjsip_msg_print(tdata->msg, buf, PJSIP_MAX_PKT_LEN);
+		pjsip_tx_data_dec_ref(tdata);
+	    }
+	    pj_get_timestamp(&t2);
+
+	    msec = pj_elapsed_msec(&t1, &t2);
+	    if (msec == 0) msec = 1;
+	    PJ_LOG(3,(THIS_FILE, "    %s: %u requests forwarded/sec", 
+		      (options[j] ? "splice" : "clone"), LOOP*1000/msec));
+	}
+    }
+#endif
+
+    pjsip_endpt_release_pool(endpt, pool);
+    return rc;
+}
+
+
 /*****************************************************************************/
 
 int msg_test(void)
@@ -2007,6 +2337,14 @@ int msg_test(void)
     if (status != PJ_SUCCESS)
 	return status;
 
+    status = lazy_parse_test();
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = fwd_splice_test();
+    if (status != PJ_SUCCESS)
+	return status;
+
 #if INCLUDE_BENCHMARKS
     for (i=0; i<COUNT; ++i) {
 	PJ_LOG(3,(THIS_FILE, "  benchmarking (%d of %d)..", i+1, COUNT));
@@ -2035,6 +2373,14 @@ int msg_test(void)
 			  "%d bytes)", (int)PJ_ARRAY_SIZE(test_array), avg_len);
     report_ival("msg-detect-per-sec", max, "msg/sec", desc);
 
+    /* Msg detection bandwidth */
+    PJ_LOG(3,("", "  Maximum message detection bandwidth=%u MB/sec",
+	      avg_len*max/1000000));
+    report_ival("msg-detect-bandwidth-mb", avg_len*max/1000000, "MB/sec",
+	        "Message detection bandwidth in megabytes (number of "
+		"megabytes worth of SIP messages that can be pre-parsed per "
+		"second). The value is derived from msg-detect-per-sec above.");
+
     /* Print maximum parse/sec */
     for (i=0, max=0; i<COUNT; ++i)
 	if (run[i].parse > max) max = run[i].parse;
@@ -2049,6 +2395,8 @@ int msg_test(void)
     report_ival("msg-parse-per-sec", max, "msg/sec", desc);
 
     /* Msg parsing bandwidth */
+    PJ_LOG(3,("", "  Maximum message parsing bandwidth=%u MB/sec",
+	      avg_len*max/1000000));
     report_ival("msg-parse-bandwidth-mb", avg_len*max/1000000, "MB/sec",
 	        "Message parsing bandwidth in megabytes (number of megabytes"
 		" worth of SIP messages that can be parsed per second). "
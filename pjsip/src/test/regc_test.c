@@ -148,12 +148,16 @@ static pj_bool_t regs_rx_request(pjsip_rx_data *rdata)
 	{
 	    pjsip_hdr *hsrc;
 
-	    for (hsrc=msg->hdr.next; hsrc!=&msg->hdr; hsrc=hsrc->next) {
+	    /* Use pjsip_msg_find_hdr() so that unparsed Contact headers
+	     * are also found when lazy parsing is enabled.
+	     */
+	    for (hsrc=(pjsip_hdr*)pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, NULL);
+		 hsrc;
+		 hsrc=(pjsip_hdr*)pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT,
+						     hsrc->next))
+	    {
 		pjsip_contact_hdr *hdst;
 
-		if (hsrc->type != PJSIP_H_CONTACT)
-		    continue;
-
 		hdst = (pjsip_contact_hdr*)
 		       pjsip_hdr_clone(rdata->tp_info.pool, hsrc);
 
@@ -702,6 +706,38 @@ on_return:
 };
 
 
+/* Registration with lazy parsing, the Contact headers of the response
+ * are only parsed when regc looks them up.
+ */
+static int lazy_parse_test(const pj_str_t *registrar_uri)
+{
+    struct registrar_cfg server_cfg = 
+	/* respond	code	auth	  contact  exp_prm expires more_contacts */
+	{ PJ_TRUE,	200,	PJ_FALSE, EXACT,   75,	    65,	    
+	  {"<sip:a@a>;expires=70, <sip:b@b>;expires=70", 0}};
+    struct client client_cfg = 
+	/* error	code	have_reg    expiration	contact_cnt auth?    destroy*/
+	{ PJ_FALSE,	200,	PJ_TRUE,    75,		3,	    PJ_FALSE, PJ_FALSE};
+    pj_str_t contact = pj_str("<sip:user@127.0.0.1:5060;transport=udp>");
+    pj_bool_t saved_lazy = pjsip_cfg()->endpt.lazy_parse;
+    pj_bool_t saved_check = pjsip_cfg()->regc.check_contact;
+    int ret;
+
+    server_cfg.more_contacts.slen = strlen(server_cfg.more_contacts.ptr);
+
+    pjsip_cfg()->endpt.lazy_parse = PJ_TRUE;
+    pjsip_cfg()->regc.check_contact = PJ_TRUE;
+
+    ret = do_test("lazy parsing", &server_cfg, &client_cfg, registrar_uri,
+		  1, &contact, 600, PJ_FALSE, NULL);
+
+    pjsip_cfg()->endpt.lazy_parse = saved_lazy;
+    pjsip_cfg()->regc.check_contact = saved_check;
+
+    return ret;
+}
+
+
 /* send error on authentication */
 static int auth_send_error(const pj_str_t *registrar_uri,
 			   pj_bool_t destroy_on_cb)
@@ -734,6 +770,409 @@ static int auth_send_error(const pj_str_t *registrar_uri,
 
 
 
+/************************************************************************/
+/* Server authentication with asynchronous lookup and digest cache */
+static struct
+{
+    pjsip_cred_info	  cred;
+    pj_bool_t		  complete_now;
+    unsigned		  lookup_cnt;
+    pjsip_auth_lookup_op *op;
+    unsigned		  cb_cnt;
+    pj_status_t		  cb_status;
+    int			  cb_code;
+} auth_srv_test_data;
+
+static void auth_test_init_cred(void)
+{
+    auth_srv_test_data.cred.realm = pj_str("test");
+    auth_srv_test_data.cred.scheme = pj_str("digest");
+    auth_srv_test_data.cred.username = pj_str("alice");
+    auth_srv_test_data.cred.data_type = PJSIP_CRED_DATA_PLAIN_PASSWD;
+    auth_srv_test_data.cred.data = pj_str("secret");
+}
+
+static pj_status_t auth_srv_lookup_async(
+				const pjsip_auth_lookup_cred_param *param,
+				pjsip_auth_lookup_op *op)
+{
+    PJ_UNUSED_ARG(param);
+
+    ++auth_srv_test_data.lookup_cnt;
+    if (auth_srv_test_data.complete_now)
+	return pjsip_auth_srv_lookup_complete(op, PJ_SUCCESS,
+					      &auth_srv_test_data.cred);
+
+    auth_srv_test_data.op = op;
+    return PJ_SUCCESS;
+}
+
+static void auth_srv_on_verify(pjsip_auth_srv *auth_srv,
+			       pjsip_rx_data *rdata,
+			       void *token,
+			       pj_status_t status,
+			       int status_code)
+{
+    PJ_UNUSED_ARG(auth_srv);
+    PJ_UNUSED_ARG(rdata);
+    PJ_UNUSED_ARG(token);
+
+    ++auth_srv_test_data.cb_cnt;
+    auth_srv_test_data.cb_status = status;
+    auth_srv_test_data.cb_code = status_code;
+}
+
+/* Build a REGISTER request with the specified password */
+static int auth_srv_create_request(pj_pool_t *pool,
+				   pjsip_transport *tp,
+				   const char *passwd,
+				   pjsip_rx_data *rdata)
+{
+    const pj_str_t nonce = pj_str("abcdef");
+    const pj_str_t uri = pj_str("sip:test");
+    const pj_str_t method = pj_str("REGISTER");
+    pjsip_cred_info cred = auth_srv_test_data.cred;
+    char digest_buf[PJSIP_MD5STRLEN];
+    pj_str_t digest;
+    char *msg;
+    int len;
+
+    digest.ptr = digest_buf;
+    digest.slen = PJSIP_MD5STRLEN;
+    cred.data = pj_str((char*)passwd);
+    pjsip_auth_create_digest(&digest, &nonce, NULL, NULL, NULL, &uri,
+			     &cred.realm, &cred, &method);
+
+    msg = (char*) pj_pool_alloc(pool, 600);
+    len = pj_ansi_snprintf(msg, 600,
+	    "REGISTER sip:test SIP/2.0\r\n"
+	    "Via: SIP/2.0/UDP 127.0.0.1:5060;branch=z9hG4bKauthsrv\r\n"
+	    "From: <sip:alice@test>;tag=1234\r\n"
+	    "To: <sip:alice@test>\r\n"
+	    "Call-ID: auth-srv-test\r\n"
+	    "CSeq: 1 REGISTER\r\n"
+	    "Authorization: Digest username=\"alice\", realm=\"test\", "
+	    "nonce=\"abcdef\", uri=\"sip:test\", response=\"%.*s\"\r\n"
+	    "Content-Length: 0\r\n"
+	    "\r\n",
+	    (int)digest.slen, digest.ptr);
+
+    pj_bzero(rdata, sizeof(*rdata));
+    rdata->tp_info.pool = pool;
+    rdata->tp_info.transport = tp;
+    rdata->msg_info.msg = pjsip_parse_msg(pool, msg, len, NULL);
+
+    return rdata->msg_info.msg ? 0 : -1;
+}
+
+static int auth_srv_test(void)
+{
+    pjsip_auth_srv_init_param param;
+    pjsip_auth_srv auth_srv;
+    pjsip_rx_data good, bad;
+    pjsip_transport *tp;
+    pj_sockaddr_in addr;
+    pj_pool_t *pool;
+    pj_str_t realm = pj_str("test");
+    pj_str_t acc_name = pj_str("alice");
+    int code, ret = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  server authentication with async lookup"));
+
+    pj_bzero(&auth_srv, sizeof(auth_srv));
+
+    pj_bzero(&auth_srv_test_data, sizeof(auth_srv_test_data));
+    auth_test_init_cred();
+
+    pj_sockaddr_in_init(&addr, 0, 0);
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_UDP, &addr,
+					   sizeof(addr), NULL, &tp);
+    if (status != PJ_SUCCESS)
+	return -700;
+
+    pool = pjsip_endpt_create_pool(endpt, "authsrv", 4000, 4000);
+
+    pj_bzero(&param, sizeof(param));
+    param.realm = &realm;
+    param.lookup_async = &auth_srv_lookup_async;
+    param.cache_size = 16;
+    status = pjsip_auth_srv_init2(pool, &auth_srv, &param);
+    if (status != PJ_SUCCESS) {
+	ret = -705;
+	goto on_return;
+    }
+
+    if (auth_srv_create_request(pool, tp, "secret", &good) != 0 ||
+	auth_srv_create_request(pool, tp, "wrong", &bad) != 0)
+    {
+	ret = -710;
+	goto on_return;
+    }
+
+    /* First request waits for the lookup */
+    status = pjsip_auth_srv_verify_async(&auth_srv, &good, &code, NULL,
+					 &auth_srv_on_verify);
+    if (status != PJ_EPENDING || auth_srv_test_data.lookup_cnt != 1 ||
+	auth_srv_test_data.op == NULL)
+    {
+	ret = -720;
+	goto on_return;
+    }
+
+    pjsip_auth_srv_lookup_complete(auth_srv_test_data.op, PJ_SUCCESS,
+				   &auth_srv_test_data.cred);
+    auth_srv_test_data.op = NULL;
+    if (auth_srv_test_data.cb_cnt != 1 ||
+	auth_srv_test_data.cb_status != PJ_SUCCESS ||
+	auth_srv_test_data.cb_code != 200)
+    {
+	ret = -730;
+	goto on_return;
+    }
+
+    /* Next one is verified from the cache */
+    status = pjsip_auth_srv_verify_async(&auth_srv, &good, &code, NULL,
+					 &auth_srv_on_verify);
+    if (status != PJ_SUCCESS || code != 200 ||
+	auth_srv_test_data.lookup_cnt != 1)
+    {
+	ret = -740;
+	goto on_return;
+    }
+
+    /* Wrong password must not pass on the cached digest, and the lookup
+     * completing immediately gives the result synchronously.
+     */
+    auth_srv_test_data.complete_now = PJ_TRUE;
+    status = pjsip_auth_srv_verify_async(&auth_srv, &bad, &code, NULL,
+					 &auth_srv_on_verify);
+    if (status != PJSIP_EAUTHINVALIDDIGEST || code != 403 ||
+	auth_srv_test_data.lookup_cnt != 2 || auth_srv_test_data.cb_cnt != 1)
+    {
+	ret = -750;
+	goto on_return;
+    }
+
+    /* The cache has been refilled by the lookup */
+    status = pjsip_auth_srv_verify_async(&auth_srv, &good, &code, NULL,
+					 &auth_srv_on_verify);
+    if (status != PJ_SUCCESS || auth_srv_test_data.lookup_cnt != 3) {
+	ret = -760;
+	goto on_return;
+    }
+    status = pjsip_auth_srv_verify(&auth_srv, &good, &code);
+    if (status != PJ_SUCCESS || auth_srv_test_data.lookup_cnt != 3) {
+	ret = -770;
+	goto on_return;
+    }
+
+    /* Removed account fails the lookup */
+    auth_srv_test_data.complete_now = PJ_FALSE;
+    pjsip_auth_srv_cache_remove(&auth_srv, &acc_name);
+    status = pjsip_auth_srv_verify_async(&auth_srv, &good, &code, NULL,
+					 &auth_srv_on_verify);
+    if (status != PJ_EPENDING || auth_srv_test_data.op == NULL) {
+	ret = -780;
+	goto on_return;
+    }
+    pjsip_auth_srv_lookup_complete(auth_srv_test_data.op,
+				   PJSIP_EAUTHACCNOTFOUND, NULL);
+    auth_srv_test_data.op = NULL;
+    if (auth_srv_test_data.cb_cnt != 2 ||
+	auth_srv_test_data.cb_status != PJSIP_EAUTHACCNOTFOUND ||
+	auth_srv_test_data.cb_code != 403)
+    {
+	ret = -790;
+	goto on_return;
+    }
+
+on_return:
+    if (auth_srv_test_data.op)
+	pjsip_auth_srv_lookup_complete(auth_srv_test_data.op,
+				       PJSIP_EAUTHACCNOTFOUND, NULL);
+    pjsip_auth_srv_deinit(&auth_srv);
+    pj_pool_release(pool);
+    pjsip_transport_dec_ref(tp);
+    return ret;
+}
+
+
+/************************************************************************/
+/* Client authentication sending the next request proactively */
+static pj_status_t auth_clt_lookup(pj_pool_t *pool,
+				   const pjsip_auth_lookup_cred_param *param,
+				   pjsip_cred_info *cred_info)
+{
+    PJ_UNUSED_ARG(pool);
+    PJ_UNUSED_ARG(param);
+
+    *cred_info = auth_srv_test_data.cred;
+    return PJ_SUCCESS;
+}
+
+/* Check the nonce-count of the Authorization header in the request, and
+ * have the server verify it.
+ */
+static int auth_clt_verify(pjsip_auth_srv *auth_srv,
+			   pjsip_tx_data *tdata,
+			   const char *nc)
+{
+    pjsip_authorization_hdr *h;
+    pjsip_via_hdr *via;
+    pjsip_rx_data rdata;
+    char *buf;
+    pj_size_t len;
+    int code;
+
+    h = (pjsip_authorization_hdr*)
+	pjsip_msg_find_hdr(tdata->msg, PJSIP_H_AUTHORIZATION, NULL);
+    if (!h || pj_strcmp2(&h->credential.digest.nc, nc) != 0)
+	return -1;
+
+    /* Fill in the Via, the request is not sent */
+    via = (pjsip_via_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL);
+    via->transport = pj_str("UDP");
+    via->sent_by.host = pj_str("127.0.0.1");
+    pjsip_tx_data_invalidate_msg(tdata);
+
+    if (pjsip_tx_data_encode(tdata) != PJ_SUCCESS)
+	return -2;
+
+    len = tdata->buf.cur - tdata->buf.start;
+    buf = (char*) pj_pool_alloc(tdata->pool, len + 1);
+    pj_memcpy(buf, tdata->buf.start, len);
+    buf[len] = '\0';
+
+    pj_bzero(&rdata, sizeof(rdata));
+    rdata.tp_info.pool = tdata->pool;
+    rdata.msg_info.msg = pjsip_parse_msg(tdata->pool, buf, len, NULL);
+    if (!rdata.msg_info.msg)
+	return -3;
+
+    if (pjsip_auth_srv_verify(auth_srv, &rdata, &code) != PJ_SUCCESS)
+	return -4;
+
+    return 0;
+}
+
+static int auth_clt_test(void)
+{
+    char response[] =
+	"SIP/2.0 401 Unauthorized\r\n"
+	"Via: SIP/2.0/UDP 127.0.0.1:5060;branch=z9hG4bKauthclt\r\n"
+	"From: <sip:alice@test>;tag=1234\r\n"
+	"To: <sip:alice@test>;tag=5678\r\n"
+	"Call-ID: auth-clt-test\r\n"
+	"CSeq: 1 REGISTER\r\n"
+	"WWW-Authenticate: Digest realm=\"test\", nonce=\"abcdef\", "
+	"qop=\"auth\"\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n";
+    pj_str_t realm = pj_str("test");
+    pj_str_t target = pj_str("sip:test");
+    pj_str_t aor = pj_str("<sip:alice@test>");
+    pjsip_auth_srv_init_param param;
+    pjsip_auth_srv auth_srv;
+    pjsip_auth_clt_sess sess;
+    pjsip_auth_clt_pref pref;
+    pjsip_tx_data *tdata = NULL, *retry = NULL, *next = NULL;
+    pjsip_rx_data rdata;
+    pj_pool_t *pool;
+    int ret = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  client authentication sending next request"));
+
+    pj_bzero(&auth_srv_test_data, sizeof(auth_srv_test_data));
+    auth_test_init_cred();
+
+    pool = pjsip_endpt_create_pool(endpt, "authclt", 4000, 4000);
+
+    pj_bzero(&param, sizeof(param));
+    param.realm = &realm;
+    param.lookup2 = &auth_clt_lookup;
+    pj_bzero(&auth_srv, sizeof(auth_srv));
+    if (pjsip_auth_srv_init2(pool, &auth_srv, &param) != PJ_SUCCESS) {
+	ret = -800;
+	goto on_return;
+    }
+
+    /* The digest cache is not enabled by default */
+    if (auth_srv.cache || auth_srv.mutex) {
+	ret = -805;
+	goto on_return;
+    }
+
+    pjsip_auth_clt_init(&sess, endpt, pool, 0);
+    pjsip_auth_clt_set_credentials(&sess, 1, &auth_srv_test_data.cred);
+    pj_bzero(&pref, sizeof(pref));
+    pref.auto_send_next = PJ_TRUE;
+    pjsip_auth_clt_set_prefs(&sess, &pref);
+
+    /* Nothing to send before the first challenge */
+    status = pjsip_endpt_create_request(endpt, &pjsip_register_method,
+					&target, &aor, &aor, &aor, NULL, -1,
+					NULL, &tdata);
+    if (status != PJ_SUCCESS ||
+	pjsip_auth_clt_init_req(&sess, tdata) != PJ_SUCCESS ||
+	pjsip_msg_find_hdr(tdata->msg, PJSIP_H_AUTHORIZATION, NULL))
+    {
+	ret = -810;
+	goto on_return;
+    }
+
+    /* Respond to the challenge */
+    pj_bzero(&rdata, sizeof(rdata));
+    rdata.tp_info.pool = pool;
+    rdata.msg_info.msg = pjsip_parse_msg(pool, response,
+					 pj_ansi_strlen(response), NULL);
+    if (!rdata.msg_info.msg ||
+	pjsip_auth_clt_reinit_req(&sess, &rdata, tdata, &retry) != PJ_SUCCESS)
+    {
+	ret = -820;
+	goto on_return;
+    }
+    if (auth_clt_verify(&auth_srv, retry, "00000001") != 0) {
+	ret = -830;
+	goto on_return;
+    }
+
+    /* The next request is authorized without waiting for a challenge,
+     * with the HA1 computed only once.
+     */
+    status = pjsip_endpt_create_request(endpt, &pjsip_register_method,
+					&target, &aor, &aor, &aor, NULL, -1,
+					NULL, &next);
+    if (status != PJ_SUCCESS ||
+	pjsip_auth_clt_init_req(&sess, next) != PJ_SUCCESS)
+    {
+	ret = -840;
+	goto on_return;
+    }
+    if (auth_clt_verify(&auth_srv, next, "00000002") != 0) {
+	ret = -850;
+	goto on_return;
+    }
+    if (sess.cached_auth.next->ha1_cred != &sess.cred_info[0]) {
+	ret = -860;
+	goto on_return;
+    }
+
+on_return:
+    if (next)
+	pjsip_tx_data_dec_ref(next);
+    if (retry)
+	pjsip_tx_data_dec_ref(retry);
+    if (tdata)
+	pjsip_tx_data_dec_ref(tdata);
+    pjsip_auth_srv_deinit(&auth_srv);
+    pj_pool_release(pool);
+    return ret;
+}
+
+
+
 
 /************************************************************************/
 enum
@@ -1031,6 +1470,16 @@ int regc_test(void)
 	port = pj_sockaddr_get_port(&udp->local_addr);
     }
 
+    /* Server authentication */
+    rc = auth_srv_test();
+    if (rc != 0)
+	goto on_return;
+
+    /* Client authentication */
+    rc = auth_clt_test();
+    if (rc != 0)
+	goto on_return;
+
     /* Register registrar module */
     rc = pjsip_endpt_register_module(endpt, &registrar.mod);
     if (rc != PJ_SUCCESS) {
@@ -1138,6 +1587,11 @@ int regc_test(void)
     if (rc != 0)
 	goto on_return;
 
+    /* Contact headers parsed on demand */
+    rc = lazy_parse_test(&registrar_uri);
+    if (rc != 0)
+	goto on_return;
+
     /* Send error during auth, don't destroy on callback */
     rc = auth_send_error(&registrar_uri, PJ_FALSE);
     if (rc != 0)
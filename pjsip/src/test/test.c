@@ -325,6 +325,10 @@ int test_main(void)
     DO_TEST(transport_tcp_test());
 #endif
 
+#if INCLUDE_TLS_TEST
+    DO_TEST(transport_tls_test());
+#endif
+
 #if INCLUDE_RESOLVE_TEST
     DO_TEST(resolve_test());
 #endif
@@ -370,12 +374,16 @@ int test_main(void)
 #endif
 
     /*
-     * Better be last because it recreates the endpt
+     * Better be last because these recreate the endpt
      */
 #if INCLUDE_TSX_DESTROY_TEST
     DO_TEST(tsx_destroy_test());
 #endif
 
+#if INCLUDE_RX_WORKER_TEST
+    DO_TEST(rx_worker_test());
+#endif
+
 on_return:
     flush_events(500);
 
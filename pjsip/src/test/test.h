@@ -62,7 +62,9 @@ extern pj_caching_pool caching_pool;
 #define INCLUDE_TSX_BENCH	INCLUDE_MESSAGING_GROUP
 #define INCLUDE_UDP_TEST	INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_LOOP_TEST	INCLUDE_TRANSPORT_GROUP
+#define INCLUDE_RX_WORKER_TEST	INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_TCP_TEST	INCLUDE_TRANSPORT_GROUP
+#define INCLUDE_TLS_TEST	(INCLUDE_TRANSPORT_GROUP && PJSIP_HAS_TLS_TRANSPORT)
 #define INCLUDE_RESOLVE_TEST	INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_TSX_TEST	INCLUDE_TSX_GROUP
 #define INCLUDE_TSX_DESTROY_TEST INCLUDE_TSX_GROUP
@@ -80,7 +82,9 @@ int tsx_bench(void);
 int tsx_destroy_test(void);
 int transport_udp_test(void);
 int transport_loop_test(void);
+int rx_worker_test(void);
 int transport_tcp_test(void);
+int transport_tls_test(void);
 int resolve_test(void);
 int regc_test(void);
 
@@ -105,7 +109,9 @@ int transport_rt_test( pjsip_transport_type_e tp_type,
 		       pjsip_transport *ref_tp,
 		       char *target_url,
 		       int *pkt_lost);
+int transport_fast_response_test(char *target_url);
 int transport_load_test(char *target_url);
+int transport_large_msg_test(char *target_url);
 
 /* Invite session */
 int inv_offer_answer_test(void);
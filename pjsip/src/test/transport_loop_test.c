@@ -115,6 +115,161 @@ static int datagram_loop_test()
     return 0;
 }
 
+/*
+ * Receive worker test. Requests of several calls are received by an
+ * endpoint with receive workers, and each call's requests must be
+ * processed in order, outside the thread that received them.
+ */
+#define RXW_CALLS	8
+#define RXW_REQUESTS	50
+
+static struct rxw_state
+{
+    pj_thread_t	*rx_thread;
+    pj_atomic_t	*count;
+    int		 last_cseq[RXW_CALLS];
+    pj_bool_t	 err;
+} rxw;
+
+static pj_bool_t rxw_on_rx_request(pjsip_rx_data *rdata)
+{
+    pj_str_t num;
+    unsigned call;
+
+    if (pj_strncmp2(&rdata->msg_info.cid->id, "rxw-", 4) != 0)
+	return PJ_FALSE;
+
+    num.ptr = rdata->msg_info.cid->id.ptr + 4;
+    num.slen = rdata->msg_info.cid->id.slen - 4;
+    call = pj_strtoul(&num) % RXW_CALLS;
+
+    if (rdata->msg_info.cseq->cseq != rxw.last_cseq[call] + 1) {
+	PJ_LOG(3,(THIS_FILE, "   error: call %u got CSeq %d after %d",
+		  call, rdata->msg_info.cseq->cseq, rxw.last_cseq[call]));
+	rxw.err = PJ_TRUE;
+    }
+    rxw.last_cseq[call] = rdata->msg_info.cseq->cseq;
+
+    if (pj_thread_this() == rxw.rx_thread)
+	rxw.err = PJ_TRUE;
+
+    pj_atomic_inc(rxw.count);
+    return PJ_TRUE;
+}
+
+static pjsip_module rxw_mod = 
+{
+    NULL, NULL,				/* prev and next	*/
+    { "mod-rxw-test", 12},		/* Name.		*/
+    -1,					/* Id			*/
+    PJSIP_MOD_PRIORITY_APPLICATION-1,	/* Priority		*/
+    NULL,				/* load()		*/
+    NULL,				/* start()		*/
+    NULL,				/* stop()		*/
+    NULL,				/* unload()		*/
+    &rxw_on_rx_request,			/* on_rx_request()	*/
+    NULL,				/* on_rx_response()	*/
+    NULL,				/* tsx_handler()	*/
+};
+
+/*
+ * This recreates the endpoint with receive workers enabled, so it must be
+ * run after the other tests.
+ */
+int rx_worker_test(void)
+{
+    unsigned saved_worker_cnt = pjsip_cfg()->endpt.rx_worker_cnt;
+    pj_pool_t *pool;
+    pj_str_t target, from;
+    unsigned i, j;
+    int rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  receive worker test..."));
+
+    pj_bzero(&rxw, sizeof(rxw));
+    rxw.rx_thread = pj_thread_this();
+
+    pjsip_endpt_destroy(endpt);
+
+    pjsip_cfg()->endpt.rx_worker_cnt = 4;
+    status = pjsip_endpt_create(&caching_pool.factory, "endpt", &endpt);
+    pjsip_cfg()->endpt.rx_worker_cnt = saved_worker_cnt;
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create endpoint", status);
+	return -200;
+    }
+
+    pool = pjsip_endpt_create_pool(endpt, "rxw", 512, 512);
+    status = pj_atomic_create(pool, 0, &rxw.count);
+    if (status != PJ_SUCCESS) {
+	rc = -210;
+	goto on_return;
+    }
+
+    status = pjsip_loop_start(endpt, NULL);
+    if (status == PJ_SUCCESS)
+	status = pjsip_endpt_register_module(endpt, &rxw_mod);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to init endpoint", status);
+	rc = -220;
+	goto on_return;
+    }
+
+    target = pj_str("sip:bob@130.0.0.1;transport=loop-dgram");
+    from = pj_str("<sip:alice@130.0.0.1>");
+
+    /* Interleave the requests of the calls */
+    for (i=0; i<RXW_REQUESTS; ++i) {
+	for (j=0; j<RXW_CALLS; ++j) {
+	    char call_id_buf[16];
+	    pj_str_t call_id;
+	    pjsip_tx_data *tdata;
+
+	    pj_ansi_snprintf(call_id_buf, sizeof(call_id_buf), "rxw-%u", j);
+	    call_id = pj_str(call_id_buf);
+
+	    status = pjsip_endpt_create_request(endpt, &pjsip_options_method,
+						&target, &from, &target,
+						NULL, &call_id, i+1, NULL,
+						&tdata);
+	    if (status == PJ_SUCCESS)
+		status = pjsip_endpt_send_request_stateless(endpt, tdata,
+							    NULL, NULL);
+	    if (status != PJ_SUCCESS) {
+		app_perror("   error: unable to send request", status);
+		rc = -230;
+		goto on_return;
+	    }
+	}
+    }
+
+    /* Wait until all requests are processed */
+    for (i=0; i<500; ++i) {
+	if (pj_atomic_get(rxw.count) == RXW_CALLS * RXW_REQUESTS)
+	    break;
+	pj_thread_sleep(10);
+    }
+
+    if (pj_atomic_get(rxw.count) != RXW_CALLS * RXW_REQUESTS) {
+	PJ_LOG(3,(THIS_FILE, "   error: only %d of %d requests processed",
+		  pj_atomic_get(rxw.count), RXW_CALLS * RXW_REQUESTS));
+	rc = -240;
+    } else if (rxw.err) {
+	rc = -250;
+    }
+
+on_return:
+    if (rxw_mod.id != -1)
+	pjsip_endpt_unregister_module(endpt, &rxw_mod);
+    if (rxw.count) {
+	pj_atomic_destroy(rxw.count);
+	rxw.count = NULL;
+    }
+    pjsip_endpt_release_pool(endpt, pool);
+    return rc;
+}
+
 int transport_loop_test(void)
 {
     int status;
@@ -29,6 +29,159 @@
  * TCP transport test.
  */
 #if PJ_HAS_TCP
+
+/*
+ * Connection pool and back-pressure test. The load of a connection is
+ * simulated by manipulating its pending transmit counter.
+ */
+static int tcp_pool_test(pjsip_transport *tcp, const pj_sockaddr_in *rem_addr,
+			 const char *url)
+{
+    unsigned saved_pool_size = pjsip_cfg()->tp.pool_size;
+    unsigned saved_max_pending = pjsip_cfg()->tp.max_pending_tx;
+    pjsip_transport *tp2 = NULL, *tp;
+    pjsip_tx_data *tdata;
+    pj_str_t target, from;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   TCP connection pool test.."));
+
+    pjsip_cfg()->tp.pool_size = 2;
+
+    /* Idle connection must be reused */
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_TCP,
+					   rem_addr, sizeof(*rem_addr),
+					   NULL, &tp);
+    if (status != PJ_SUCCESS) {
+	rc = -300;
+	goto on_return;
+    }
+    pjsip_transport_dec_ref(tp);
+    if (tp != tcp) {
+	rc = -310;
+	goto on_return;
+    }
+
+    /* Busy connection causes another connection to be opened */
+    pj_atomic_inc(tcp->pending_tx);
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_TCP,
+					   rem_addr, sizeof(*rem_addr),
+					   NULL, &tp2);
+    if (status != PJ_SUCCESS) {
+	tp2 = NULL;
+	rc = -320;
+	goto on_return_dec;
+    }
+    if (tp2 == tcp) {
+	rc = -330;
+	goto on_return_dec;
+    }
+
+    /* When the pool is full, the least loaded connection is selected */
+    pj_atomic_inc(tp2->pending_tx);
+    pj_atomic_inc(tp2->pending_tx);
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_TCP,
+					   rem_addr, sizeof(*rem_addr),
+					   NULL, &tp);
+    pj_atomic_dec(tp2->pending_tx);
+    pj_atomic_dec(tp2->pending_tx);
+    if (status != PJ_SUCCESS) {
+	rc = -340;
+	goto on_return_dec;
+    }
+    pjsip_transport_dec_ref(tp);
+    if (tp != tcp) {
+	rc = -350;
+	goto on_return_dec;
+    }
+
+    /* Sending must be refused when too many messages are pending */
+    pjsip_cfg()->tp.max_pending_tx = 1;
+
+    target = pj_str((char*)url);
+    from = pj_str("<sip:tcp_pool_test@127.0.0.1>");
+    status = pjsip_endpt_create_request(endpt, &pjsip_options_method,
+					&target, &from, &target, NULL, NULL,
+					-1, NULL, &tdata);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create request", status);
+	rc = -360;
+	goto on_return_dec;
+    }
+    status = pjsip_transport_send(tcp, tdata, rem_addr, sizeof(*rem_addr),
+				  NULL, NULL);
+    pjsip_tx_data_dec_ref(tdata);
+    if (status != PJSIP_ETPBUSY) {
+	app_perror("   error: expecting PJSIP_ETPBUSY", status);
+	rc = -370;
+	goto on_return_dec;
+    }
+
+on_return_dec:
+    pj_atomic_dec(tcp->pending_tx);
+
+on_return:
+    pjsip_cfg()->tp.pool_size = saved_pool_size;
+    pjsip_cfg()->tp.max_pending_tx = saved_max_pending;
+
+    if (tp2) {
+	pjsip_transport_dec_ref(tp2);
+	pjsip_transport_destroy(tp2);
+    }
+
+    if (pjsip_transport_get_pending_tx(tcp) != 0 && rc == 0)
+	rc = -380;
+
+    return rc;
+}
+
+/*
+ * Send batching test. The load test is repeated on a new connection with
+ * send batching enabled. The messages are queued while the connection is
+ * being established and then coalesced, and they must still arrive
+ * complete and in order.
+ */
+static int tcp_batch_test(const pj_sockaddr_in *rem_addr, char *url)
+{
+    unsigned saved_batch_size = pjsip_cfg()->tp.tx_batch_size;
+    unsigned saved_batch_delay = pjsip_cfg()->tp.tx_batch_delay;
+    pjsip_transport *tcp;
+    pj_status_t status;
+    int rtt, rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   TCP send batching test.."));
+
+    pjsip_cfg()->tp.tx_batch_size = PJSIP_MAX_STREAM_TX_LEN;
+    pjsip_cfg()->tp.tx_batch_delay = 20;
+
+    if (transport_load_test(url) != 0) {
+	rc = -400;
+	goto on_return;
+    }
+
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_TCP,
+					   rem_addr, sizeof(*rem_addr),
+					   NULL, &tcp);
+    if (status != PJ_SUCCESS) {
+	app_perror("   Error: unable to acquire TCP transport", status);
+	rc = -410;
+	goto on_return;
+    }
+
+    status = transport_send_recv_test(PJSIP_TRANSPORT_TCP, tcp, url, &rtt);
+    if (status != 0)
+	rc = -420;
+
+    pjsip_transport_dec_ref(tcp);
+    pjsip_transport_destroy(tcp);
+
+on_return:
+    pjsip_cfg()->tp.tx_batch_size = saved_batch_size;
+    pjsip_cfg()->tp.tx_batch_delay = saved_batch_delay;
+    return rc;
+}
+
 int transport_tcp_test(void)
 {
     enum { SEND_RECV_LOOP = 8 };
@@ -112,6 +265,13 @@ int transport_tcp_test(void)
 		"TCP socket has been established by previous test)");
 
 
+    /* Message larger than PJSIP_MAX_PKT_LEN */
+    status = transport_large_msg_test(url);
+    if (status != 0) {
+	pjsip_transport_dec_ref(tcp);
+	return status;
+    }
+
     /* Multi-threaded round-trip test. */
     status = transport_rt_test(PJSIP_TRANSPORT_TCP, tcp, url, &pkt_lost);
     if (status != 0) {
@@ -126,6 +286,13 @@ int transport_tcp_test(void)
     if (pj_atomic_get(tcp->ref_cnt) != 1)
 	return -80;
 
+    /* Connection pool test */
+    status = tcp_pool_test(tcp, &rem_addr, url);
+    if (status != 0) {
+	pjsip_transport_dec_ref(tcp);
+	return status;
+    }
+
     /* Destroy this transport. */
     pjsip_transport_dec_ref(tcp);
 
@@ -134,6 +301,11 @@ int transport_tcp_test(void)
     if (status != PJ_SUCCESS)
 	return -90;
 
+    /* Send batching test */
+    status = tcp_batch_test(&rem_addr, url);
+    if (status != 0)
+	return status;
+
     /* Unregister factory */
     status = pjsip_tpmgr_unregister_tpfactory(pjsip_endpt_get_tpmgr(endpt), 
 					      tpfactory);
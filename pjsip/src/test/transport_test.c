@@ -111,10 +111,28 @@ static pjsip_module my_module =
 };
 
 
+/* Fast response test (see transport_fast_response_test()). */
+#define FAST_CALL_ID_HDR    "FastResp-Test"
+static int fast_cb_status = NO_STATUS;
+static int fast_resp_code;
+static pj_bool_t fast_resp_has_contact;
+
+/* Large message test (see transport_large_msg_test()). */
+#define LARGE_CALL_ID_HDR   "LargeMsg-Test"
+static unsigned large_body_len;
+
 static pj_bool_t my_on_rx_request(pjsip_rx_data *rdata)
 {
+    /* Requests answered by the fast response path must not get here. */
+    if (pj_strcmp2(&rdata->msg_info.cid->id, FAST_CALL_ID_HDR) == 0) {
+	recv_status = PJ_EBUG;
+	return PJ_TRUE;
+    }
+
     /* Check that this is our request. */
-    if (pj_strcmp2(&rdata->msg_info.cid->id, CALL_ID_HDR) == 0) {
+    if (pj_strcmp2(&rdata->msg_info.cid->id, CALL_ID_HDR) == 0 ||
+	pj_strcmp2(&rdata->msg_info.cid->id, LARGE_CALL_ID_HDR) == 0)
+    {
 	/* It is! */
 	/* Send response. */
 	pjsip_tx_data *tdata;
@@ -126,6 +144,18 @@ static pj_bool_t my_on_rx_request(pjsip_rx_data *rdata)
 	    recv_status = status;
 	    return PJ_TRUE;
 	}
+
+	/* Large message test: check the body and send it back. */
+	if (pj_strcmp2(&rdata->msg_info.cid->id, LARGE_CALL_ID_HDR) == 0) {
+	    const pjsip_msg_body *body = rdata->msg_info.msg->body;
+
+	    if (body == NULL || body->len != large_body_len) {
+		recv_status = PJ_EBUG;
+		pjsip_tx_data_dec_ref(tdata);
+		return PJ_TRUE;
+	    }
+	    tdata->msg->body = pjsip_msg_body_clone(tdata->pool, body);
+	}
 	status = pjsip_get_response_addr( tdata->pool, rdata, &res_addr);
 	if (status != PJ_SUCCESS) {
 	    recv_status = status;
@@ -147,6 +177,23 @@ static pj_bool_t my_on_rx_request(pjsip_rx_data *rdata)
 
 static pj_bool_t my_on_rx_response(pjsip_rx_data *rdata)
 {
+    if (pj_strcmp2(&rdata->msg_info.cid->id, FAST_CALL_ID_HDR) == 0) {
+	fast_resp_code = rdata->msg_info.msg->line.status.code;
+	fast_resp_has_contact =
+	    pjsip_msg_find_hdr(rdata->msg_info.msg, PJSIP_H_CONTACT,
+			       NULL) != NULL;
+	recv_status = PJ_SUCCESS;
+	return PJ_TRUE;
+    }
+    if (pj_strcmp2(&rdata->msg_info.cid->id, LARGE_CALL_ID_HDR) == 0) {
+	const pjsip_msg_body *body = rdata->msg_info.msg->body;
+
+	if (body && body->len == large_body_len)
+	    recv_status = PJ_SUCCESS;
+	else
+	    recv_status = PJ_EBUG;
+	return PJ_TRUE;
+    }
     if (pj_strcmp2(&rdata->msg_info.cid->id, CALL_ID_HDR) == 0) {
 	pj_get_timestamp(&my_recv_time);
 	recv_status = PJ_SUCCESS;
@@ -293,6 +340,295 @@ on_return:
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+/*
+ * Fast response test.
+ *
+ * This test sends OPTIONS and REGISTER requests to loopback address with
+ * fast response callback installed. The requests must be answered by the
+ * transport manager without reaching the modules.
+ */
+static int on_rx_fast_req(pjsip_tpmgr *mgr, const pjsip_tp_fast_req *req)
+{
+    PJ_UNUSED_ARG(mgr);
+
+    if (pj_strcmp2(&req->call_id, FAST_CALL_ID_HDR) != 0)
+	return 0;
+
+    if ((req->method.id != PJSIP_OPTIONS_METHOD &&
+	 req->method.id != PJSIP_REGISTER_METHOD) || req->rdata == NULL)
+    {
+	fast_cb_status = PJ_EBUG;
+    }
+    else
+	fast_cb_status = PJ_SUCCESS;
+
+    return 200;
+}
+
+/* Send a request to be answered by the fast response path, and wait for
+ * the 200 response.
+ */
+static int fast_send_request(char *target_url,
+			     pjsip_method_e method_id,
+			     char *contact_hdr)
+{
+    pj_status_t status;
+    pj_str_t target, from, to, contact, call_id;
+    pjsip_method method;
+    pjsip_tx_data *tdata;
+    pj_time_val timeout;
+
+    /* Create a request message. */
+    target = pj_str(target_url);
+    from = pj_str(FROM_HDR);
+    to = pj_str(target_url);
+    contact = pj_str(contact_hdr);
+    call_id = pj_str(FAST_CALL_ID_HDR);
+
+    pjsip_method_set(&method, method_id);
+    status = pjsip_endpt_create_request( endpt, &method, &target, &from, &to,
+					 &contact, &call_id, CSEQ_VALUE, 
+					 NULL, &tdata );
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create request", status);
+	return -610;
+    }
+
+    /* Reset statuses */
+    send_status = recv_status = fast_cb_status = NO_STATUS;
+    fast_resp_code = 0;
+    fast_resp_has_contact = PJ_FALSE;
+
+    /* Send the message (statelessly). */
+    status = pjsip_endpt_send_request_stateless( endpt, tdata, NULL,
+					         &send_msg_callback);
+    if (status != PJ_SUCCESS) {
+	/* Immediate error! */
+	pjsip_tx_data_dec_ref(tdata);
+	send_status = status;
+    }
+
+    /* Set the timeout (2 seconds from now) */
+    pj_gettimeofday(&timeout);
+    timeout.sec += 2;
+
+    /* Loop handling events until we get the response */
+    do {
+	pj_time_val now;
+	pj_time_val poll_interval = { 0, 10 };
+
+	pj_gettimeofday(&now);
+	if (PJ_TIME_VAL_GTE(now, timeout)) {
+	    PJ_LOG(3,(THIS_FILE, "   error: timeout in fast response test"));
+	    return -620;
+	}
+
+	if (send_status!=NO_STATUS && send_status!=PJ_SUCCESS) {
+	    app_perror("   error sending message", send_status);
+	    return -630;
+	}
+
+	if (recv_status!=NO_STATUS && recv_status!=PJ_SUCCESS) {
+	    PJ_LOG(3,(THIS_FILE, "   error: request was not answered by "
+				 "the fast response path"));
+	    return -640;
+	}
+
+	if (send_status!=NO_STATUS && recv_status!=NO_STATUS)
+	    break;
+
+	pjsip_endpt_handle_events(endpt, &poll_interval);
+
+    } while (1);
+
+    if (fast_cb_status != PJ_SUCCESS) {
+	PJ_LOG(3,(THIS_FILE, "   error: fast response callback was not "
+			     "called properly"));
+	return -650;
+    }
+
+    if (fast_resp_code != 200) {
+	PJ_LOG(3,(THIS_FILE, "   error: expecting 200 response, got %d",
+		  fast_resp_code));
+	return -660;
+    }
+
+    return 0;
+}
+
+int transport_fast_response_test(char *target_url)
+{
+    pjsip_tpmgr *tpmgr = pjsip_endpt_get_tpmgr(endpt);
+    pj_bool_t msg_log_enabled;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  fast response test..."));
+
+    /* Register out test module to receive the message (if necessary). */
+    if (my_module.id == -1) {
+	status = pjsip_endpt_register_module( endpt, &my_module );
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error: unable to register module", status);
+	    return -600;
+	}
+    }
+
+    status = pjsip_tpmgr_set_fast_req_cb(tpmgr, &on_rx_fast_req);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to set fast response callback", status);
+	return -605;
+    }
+
+    /* Disable message logging. */
+    msg_log_enabled = msg_logger_set_enabled(0);
+
+    status = fast_send_request(target_url, PJSIP_OPTIONS_METHOD,
+			       CONTACT_HDR);
+    if (status != 0)
+	goto on_return;
+
+    /* Removing all bindings: "Contact: *" must not be echoed */
+    status = fast_send_request(target_url, PJSIP_REGISTER_METHOD, "*");
+    if (status != 0)
+	goto on_return;
+
+    if (fast_resp_has_contact) {
+	PJ_LOG(3,(THIS_FILE, "   error: \"Contact: *\" is echoed in "
+			     "REGISTER response"));
+	status = -670;
+	goto on_return;
+    }
+
+on_return:
+    /* Restore message logging. */
+    msg_logger_set_enabled(msg_log_enabled);
+    pjsip_tpmgr_set_fast_req_cb(tpmgr, NULL);
+    return status;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/*
+ * Large message test.
+ *
+ * This test sends a request with a body larger than PJSIP_MAX_PKT_LEN over
+ * a stream transport, and the request must be received completely and
+ * answered with a response carrying the same body.
+ */
+int transport_large_msg_test(char *target_url)
+{
+    pj_bool_t msg_log_enabled;
+    pj_status_t status;
+    pj_str_t target, from, to, contact, call_id, body;
+    pj_str_t type = pj_str("text");
+    pj_str_t subtype = pj_str("plain");
+    pjsip_method method;
+    pjsip_tx_data *tdata;
+    pj_time_val timeout;
+
+    large_body_len = PJSIP_MAX_PKT_LEN * 2;
+    if (large_body_len + 1000 > PJSIP_MAX_STREAM_TX_LEN ||
+	large_body_len + 1000 > PJSIP_MAX_STREAM_RX_LEN)
+    {
+	/* Large messages are disabled. */
+	return 0;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  large message round-trip test..."));
+
+    /* Register out test module to receive the message (if necessary). */
+    if (my_module.id == -1) {
+	status = pjsip_endpt_register_module( endpt, &my_module );
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error: unable to register module", status);
+	    return -700;
+	}
+    }
+
+    /* Disable message logging. */
+    msg_log_enabled = msg_logger_set_enabled(0);
+
+    /* Create a request message. */
+    target = pj_str(target_url);
+    from = pj_str(FROM_HDR);
+    to = pj_str(target_url);
+    contact = pj_str(CONTACT_HDR);
+    call_id = pj_str(LARGE_CALL_ID_HDR);
+
+    pjsip_method_set(&method, PJSIP_OPTIONS_METHOD);
+    status = pjsip_endpt_create_request( endpt, &method, &target, &from, &to,
+					 &contact, &call_id, CSEQ_VALUE, 
+					 NULL, &tdata );
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create request", status);
+	status = -710;
+	goto on_return;
+    }
+
+    body.slen = large_body_len;
+    body.ptr = (char*) pj_pool_alloc(tdata->pool, body.slen);
+    pj_memset(body.ptr, 'x', body.slen);
+    tdata->msg->body = pjsip_msg_body_create(tdata->pool, &type, &subtype,
+					     &body);
+
+    /* Reset statuses */
+    send_status = recv_status = NO_STATUS;
+
+    /* Send the message (statelessly). */
+    status = pjsip_endpt_send_request_stateless( endpt, tdata, NULL,
+					         &send_msg_callback);
+    if (status != PJ_SUCCESS) {
+	/* Immediate error! */
+	pjsip_tx_data_dec_ref(tdata);
+	send_status = status;
+    }
+
+    /* Set the timeout (2 seconds from now) */
+    pj_gettimeofday(&timeout);
+    timeout.sec += 2;
+
+    /* Loop handling events until we get the response */
+    do {
+	pj_time_val now;
+	pj_time_val poll_interval = { 0, 10 };
+
+	pj_gettimeofday(&now);
+	if (PJ_TIME_VAL_GTE(now, timeout)) {
+	    PJ_LOG(3,(THIS_FILE, "   error: timeout in large message test"));
+	    status = -720;
+	    goto on_return;
+	}
+
+	if (send_status!=NO_STATUS && send_status!=PJ_SUCCESS) {
+	    app_perror("   error sending message", send_status);
+	    status = -730;
+	    goto on_return;
+	}
+
+	if (recv_status!=NO_STATUS && recv_status!=PJ_SUCCESS) {
+	    PJ_LOG(3,(THIS_FILE, "   error: large message body was not "
+				 "received completely"));
+	    status = -740;
+	    goto on_return;
+	}
+
+	if (send_status!=NO_STATUS && recv_status!=NO_STATUS)
+	    break;
+
+	pjsip_endpt_handle_events(endpt, &poll_interval);
+
+    } while (1);
+
+    status = PJ_SUCCESS;
+
+on_return:
+    /* Restore message logging. */
+    msg_logger_set_enabled(msg_log_enabled);
+    return status;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 /* 
  * Multithreaded round-trip test
@@ -0,0 +1,170 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "test.h"
+#include <pjsip.h>
+#include <pjlib.h>
+
+#define THIS_FILE   "transport_tls_test.c"
+
+
+/*
+ * TLS transport test.
+ */
+#if PJSIP_HAS_TLS_TRANSPORT
+
+/* Certificate of the listener, relative to the test's working directory */
+#define CERT_DIR		"../../pjlib/build/"
+#define CERT_FILE		CERT_DIR "cacert.pem"
+#define CERT_PRIVKEY_FILE	CERT_DIR "privkey.pem"
+
+/*
+ * Send batching test. Like the TCP one, the load test is repeated on a
+ * new connection with send batching enabled. The messages are queued
+ * while the connection and the TLS session are being established and
+ * then written with one pj_ssl_sock_send(), and they must still arrive
+ * complete and in order.
+ */
+static int tls_batch_test(const pj_sockaddr_in *rem_addr, char *url)
+{
+    unsigned saved_batch_size = pjsip_cfg()->tp.tx_batch_size;
+    unsigned saved_batch_delay = pjsip_cfg()->tp.tx_batch_delay;
+    pjsip_transport *tls;
+    pj_status_t status;
+    int rtt, rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   TLS send batching test.."));
+
+    pjsip_cfg()->tp.tx_batch_size = PJSIP_MAX_STREAM_TX_LEN;
+    pjsip_cfg()->tp.tx_batch_delay = 20;
+
+    if (transport_load_test(url) != 0) {
+	rc = -400;
+	goto on_return;
+    }
+
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_TLS,
+					   rem_addr, sizeof(*rem_addr),
+					   NULL, &tls);
+    if (status != PJ_SUCCESS) {
+	app_perror("   Error: unable to acquire TLS transport", status);
+	rc = -410;
+	goto on_return;
+    }
+
+    status = transport_send_recv_test(PJSIP_TRANSPORT_TLS, tls, url, &rtt);
+    if (status != 0)
+	rc = -420;
+
+    pjsip_transport_dec_ref(tls);
+    pjsip_transport_destroy(tls);
+
+on_return:
+    pjsip_cfg()->tp.tx_batch_size = saved_batch_size;
+    pjsip_cfg()->tp.tx_batch_delay = saved_batch_delay;
+    return rc;
+}
+
+int transport_tls_test(void)
+{
+    pjsip_tls_setting tls_opt;
+    pjsip_tpfactory *tpfactory;
+    pjsip_transport *tls;
+    pj_sockaddr_in local_addr, rem_addr;
+    pj_str_t s;
+    pj_status_t status;
+    char url[PJSIP_MAX_URL_SIZE];
+    int rtt;
+
+    /* Start TLS listener on arbitrary loopback port. */
+    pjsip_tls_setting_default(&tls_opt);
+    tls_opt.cert_file = pj_str(CERT_FILE);
+    tls_opt.privkey_file = pj_str(CERT_PRIVKEY_FILE);
+
+    pj_sockaddr_in_init(&local_addr, pj_cstr(&s, "127.0.0.1"), 0);
+    status = pjsip_tls_transport_start(endpt, &tls_opt, &local_addr, NULL,
+				       1, &tpfactory);
+    if (status != PJ_SUCCESS) {
+	app_perror("   Error: unable to start TLS transport", status);
+	return -10;
+    }
+
+    /* Get the listener address */
+    status = pj_sockaddr_in_init(&rem_addr, &tpfactory->addr_name.host,
+				 (pj_uint16_t)tpfactory->addr_name.port);
+    if (status != PJ_SUCCESS) {
+	app_perror("   Error: possibly invalid TLS address name", status);
+	return -14;
+    }
+
+    pj_ansi_sprintf(url, "sip:alice@%s:%d;transport=tls",
+		    pj_inet_ntoa(rem_addr.sin_addr),
+		    pj_ntohs(rem_addr.sin_port));
+
+
+    /* Acquire one TLS transport. */
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_TLS,
+					   &rem_addr, sizeof(rem_addr),
+					   NULL, &tls);
+    if (status != PJ_SUCCESS || tls == NULL) {
+	app_perror("   Error: unable to acquire TLS transport", status);
+	return -17;
+    }
+
+    /* Basic transport's send/receive loopback test. */
+    status = transport_send_recv_test(PJSIP_TRANSPORT_TLS, tls, url, &rtt);
+    if (status != 0) {
+	pjsip_transport_dec_ref(tls);
+	flush_events(500);
+	return -72;
+    }
+
+    /* Destroy this transport. */
+    pjsip_transport_dec_ref(tls);
+
+    /* Force destroy this transport. */
+    status = pjsip_transport_destroy(tls);
+    if (status != PJ_SUCCESS)
+	return -90;
+
+    /* Send batching test */
+    status = tls_batch_test(&rem_addr, url);
+    if (status != 0)
+	return status;
+
+    /* Unregister factory */
+    status = pjsip_tpmgr_unregister_tpfactory(pjsip_endpt_get_tpmgr(endpt),
+					      tpfactory);
+    if (status != PJ_SUCCESS)
+	return -95;
+
+    /* Flush events. */
+    PJ_LOG(3,(THIS_FILE, "   Flushing events, 1 second..."));
+    flush_events(1000);
+
+    /* Done */
+    return 0;
+}
+#else	/* PJSIP_HAS_TLS_TRANSPORT */
+int transport_tls_test(void)
+{
+    return 0;
+}
+#endif	/* PJSIP_HAS_TLS_TRANSPORT */
@@ -25,6 +25,345 @@
 #define THIS_FILE   "transport_udp_test.c"
 
 
+/* Requests sent by the tests in this file from their own sockets. */
+#define MULTI_CALL_ID	"UdpMultiSock-Test"
+#define POOL_CALL_ID	"UdpPool-Test"
+static unsigned multi_rdata_per_sock;
+static unsigned multi_rx_cnt, multi_rx_other_cnt;
+static unsigned pool_rx_cnt;
+static pj_size_t pool_rx_capacity;
+
+static pj_bool_t udp_test_on_rx_request(pjsip_rx_data *rdata)
+{
+    if (pj_strcmp2(&rdata->msg_info.cid->id, MULTI_CALL_ID) == 0) {
+	unsigned rdata_index;
+
+	/* The UDP transport keeps the index of the rdata in tp_data, and
+	 * the rdata of the main socket come first.
+	 */
+	rdata_index = (unsigned)(pj_ssize_t)rdata->tp_info.tp_data;
+	if (rdata_index >= multi_rdata_per_sock)
+	    ++multi_rx_other_cnt;
+	++multi_rx_cnt;
+	return PJ_TRUE;
+    }
+
+    if (pj_strcmp2(&rdata->msg_info.cid->id, POOL_CALL_ID) == 0) {
+	pool_rx_capacity = pj_pool_get_capacity(rdata->tp_info.pool);
+	++pool_rx_cnt;
+	return PJ_TRUE;
+    }
+
+    return PJ_FALSE;
+}
+
+static pjsip_module udp_test_module = 
+{
+    NULL, NULL,				/* prev and next	*/
+    { "UDP-Test", 8},			/* Name.		*/
+    -1,					/* Id			*/
+    PJSIP_MOD_PRIORITY_TSX_LAYER-1,	/* Priority		*/
+    NULL,				/* load()		*/
+    NULL,				/* start()		*/
+    NULL,				/* stop()		*/
+    NULL,				/* unload()		*/
+    &udp_test_on_rx_request,		/* on_rx_request()	*/
+    NULL,				/* on_rx_response()	*/
+    NULL,				/* on_tsx_state()	*/
+};
+
+/* Send an OPTIONS request to the UDP test port from the socket. */
+static pj_status_t send_request(pj_sock_t sock, const char *call_id,
+				unsigned cseq)
+{
+    pj_sockaddr_in dst_addr;
+    pj_str_t s;
+    char msg[512];
+    pj_ssize_t len;
+
+    pj_sockaddr_in_init(&dst_addr, pj_cstr(&s, "127.0.0.1"), TEST_UDP_PORT);
+
+    len = pj_ansi_snprintf(msg, sizeof(msg),
+			   "OPTIONS sip:alice@127.0.0.1:%d SIP/2.0\r\n"
+			   "Via: SIP/2.0/UDP 127.0.0.1;rport;"
+			   "branch=z9hG4bKudp%u\r\n"
+			   "Max-Forwards: 70\r\n"
+			   "From: <sip:bob@127.0.0.1>;tag=udp\r\n"
+			   "To: <sip:alice@127.0.0.1>\r\n"
+			   "Call-ID: %s\r\n"
+			   "CSeq: %u OPTIONS\r\n"
+			   "Content-Length: 0\r\n\r\n",
+			   TEST_UDP_PORT, cseq, call_id, cseq);
+    return pj_sock_sendto(sock, msg, &len, 0, &dst_addr, sizeof(dst_addr));
+}
+
+/* Handle events until the counter reaches the value, for two seconds at
+ * most.
+ */
+static void wait_rx_cnt(const unsigned *cnt, unsigned value)
+{
+    pj_time_val timeout, now;
+
+    pj_gettimeofday(&timeout);
+    timeout.sec += 2;
+    do {
+	pj_time_val poll_interval = { 0, 10 };
+
+	pjsip_endpt_handle_events(endpt, &poll_interval);
+	pj_gettimeofday(&now);
+    } while (*cnt < value && PJ_TIME_VAL_LT(now, timeout));
+}
+
+/*
+ * Send a request from each of several sockets with distinct source ports,
+ * so that the kernel spreads them over the SO_REUSEPORT sockets, and check
+ * that not all of them are received by the main socket.
+ */
+static int udp_multi_src_test(void)
+{
+    enum { SRC_SOCK_CNT = 16 };
+    pj_sock_t sock[SRC_SOCK_CNT];
+    unsigned i;
+    int rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "   receiving from %d source ports",
+	      SRC_SOCK_CNT));
+
+    for (i=0; i<SRC_SOCK_CNT; ++i)
+	sock[i] = PJ_INVALID_SOCKET;
+
+    status = pjsip_endpt_register_module(endpt, &udp_test_module);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to register module", status);
+	return -140;
+    }
+
+    multi_rx_cnt = multi_rx_other_cnt = 0;
+
+    for (i=0; i<SRC_SOCK_CNT; ++i) {
+	status = pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &sock[i]);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error: unable to create socket", status);
+	    rc = -150;
+	    goto on_return;
+	}
+
+	status = send_request(sock[i], MULTI_CALL_ID, i+1);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error: unable to send request", status);
+	    rc = -160;
+	    goto on_return;
+	}
+    }
+
+    wait_rx_cnt(&multi_rx_cnt, SRC_SOCK_CNT);
+
+    if (multi_rx_cnt != SRC_SOCK_CNT) {
+	PJ_LOG(3,(THIS_FILE, "   error: only %d of %d requests received",
+		  multi_rx_cnt, SRC_SOCK_CNT));
+	rc = -170;
+	goto on_return;
+    }
+
+    if (multi_rx_other_cnt == 0) {
+	PJ_LOG(3,(THIS_FILE, "   error: all requests were received by the "
+			     "main socket"));
+	rc = -180;
+	goto on_return;
+    }
+
+on_return:
+    for (i=0; i<SRC_SOCK_CNT; ++i) {
+	if (sock[i] != PJ_INVALID_SOCKET)
+	    pj_sock_close(sock[i]);
+    }
+    pjsip_endpt_unregister_module(endpt, &udp_test_module);
+    return rc;
+}
+
+/*
+ * Test UDP transport with multiple SO_REUSEPORT sockets.
+ */
+static int udp_multi_sock_test(void)
+{
+    enum { SEND_RECV_LOOP = 8 };
+    pjsip_udp_transport_cfg cfg;
+    pjsip_transport *udp_tp;
+    pj_status_t status;
+    int i, rtt;
+
+    PJ_LOG(3,(THIS_FILE, "   multiple sockets test"));
+
+    pjsip_udp_transport_cfg_default(&cfg, pj_AF_INET());
+    pj_sockaddr_set_port(&cfg.bind_addr, TEST_UDP_PORT);
+    cfg.sock_cnt = 4;
+
+    status = pjsip_udp_transport_start2(endpt, &cfg, &udp_tp);
+    if (status != PJ_SUCCESS) {
+	app_perror("   Error: unable to start UDP transport", status);
+	return -110;
+    }
+
+    /* The sockets must still be seen as one transport */
+    if (pj_atomic_get(udp_tp->ref_cnt) != 1)
+	return -120;
+
+    for (i=0; i<SEND_RECV_LOOP; ++i) {
+	status = transport_send_recv_test(PJSIP_TRANSPORT_UDP, udp_tp, 
+					  "sip:alice@127.0.0.1:"TEST_UDP_PORT_STR,
+					  &rtt);
+	if (status != 0)
+	    return status;
+    }
+
+    /* Requests from other source ports must reach the other sockets */
+    if (pj_SO_REUSEPORT() != 0xFFFF) {
+	multi_rdata_per_sock = cfg.async_cnt * PJSIP_UDP_RECV_BATCH;
+	if (PJSIP_UDP_RECV_BATCH > PJ_SOCK_MAX_MMSG)
+	    multi_rdata_per_sock = cfg.async_cnt * PJ_SOCK_MAX_MMSG;
+
+	status = udp_multi_src_test();
+	if (status != 0)
+	    return status;
+    }
+
+    pjsip_transport_dec_ref(udp_tp);
+    status = pjsip_transport_destroy(udp_tp);
+    if (status != PJ_SUCCESS)
+	return -130;
+
+    flush_events(500);
+    return 0;
+}
+
+
+/*
+ * Test the message size statistics and the pool size chosen from them.
+ */
+static int size_stat_test(pjsip_transport *udp_tp)
+{
+    pjsip_tp_size_stat stat, rx_stat, tx_stat;
+    pj_size_t size;
+    unsigned i;
+
+    PJ_LOG(3,(THIS_FILE, "   message size statistics test"));
+
+    /* Too few messages, the default size is used */
+    pj_bzero(&stat, sizeof(stat));
+    for (i=0; i<10; ++i)
+	pjsip_tp_size_stat_add(&stat, 600, 1000);
+    if (pjsip_tp_size_stat_get_pool_size(&stat, 100, 4000) != 4000)
+	return -140;
+
+    /* The pool must fit most messages, but not the few large ones */
+    for (i=0; i<90; ++i)
+	pjsip_tp_size_stat_add(&stat, 600, 1000);
+    for (i=0; i<3; ++i)
+	pjsip_tp_size_stat_add(&stat, 6000, 10000);
+    size = pjsip_tp_size_stat_get_pool_size(&stat, 100, 4000);
+#if PJSIP_POOL_ADAPTIVE_SIZE
+    if (size < 1000 + 100 || size >= 1000 + 100 + 2*PJSIP_TP_SIZE_STAT_BIN_LEN)
+	return -150;
+#else
+    if (size != 4000)
+	return -150;
+#endif
+
+    /* The messages of the previous tests must have been counted */
+    pjsip_tpmgr_get_size_stat(pjsip_endpt_get_tpmgr(endpt), &rx_stat,
+			      &tx_stat);
+    if (udp_tp->rx_size_stat.count == 0 || rx_stat.count == 0 ||
+	tx_stat.count == 0)
+    {
+	return -160;
+    }
+
+    return 0;
+}
+
+/*
+ * Test that the pools of the receive buffers are replaced once the size
+ * statistics of the transport say that the messages need more memory.
+ */
+static int rdata_pool_test(pjsip_transport *udp_tp)
+{
+#if PJSIP_POOL_ADAPTIVE_SIZE
+    pj_sock_t sock;
+    pj_size_t capacity, size;
+    unsigned i;
+    int rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "   receive buffer pool test"));
+
+    status = pjsip_endpt_register_module(endpt, &udp_test_module);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to register module", status);
+	return -200;
+    }
+
+    status = pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &sock);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create socket", status);
+	pjsip_endpt_unregister_module(endpt, &udp_test_module);
+	return -210;
+    }
+
+    /* Get the pool capacity of the receive buffer */
+    pool_rx_cnt = 0;
+    send_request(sock, POOL_CALL_ID, 1);
+    wait_rx_cnt(&pool_rx_cnt, 1);
+    if (pool_rx_cnt != 1) {
+	rc = -220;
+	goto on_return;
+    }
+    capacity = pool_rx_capacity;
+
+    /* Make the messages look like they need much larger pools */
+    pj_bzero(&udp_tp->rx_size_stat, sizeof(udp_tp->rx_size_stat));
+    for (i=0; i<100; ++i) {
+	pjsip_tp_size_stat_add(&udp_tp->rx_size_stat, 600,
+			       capacity + 4*PJSIP_TP_SIZE_STAT_BIN_LEN);
+    }
+    size = pjsip_tp_size_stat_get_pool_size(&udp_tp->rx_size_stat,
+					    sizeof(pjsip_rx_data),
+					    PJSIP_POOL_RDATA_LEN);
+    if (size <= capacity) {
+	rc = -230;
+	goto on_return;
+    }
+
+    /* The pool is replaced after the next message has been processed,
+     * so the message after that must be received with the larger pool.
+     */
+    send_request(sock, POOL_CALL_ID, 2);
+    wait_rx_cnt(&pool_rx_cnt, 2);
+    send_request(sock, POOL_CALL_ID, 3);
+    wait_rx_cnt(&pool_rx_cnt, 3);
+    if (pool_rx_cnt != 3) {
+	rc = -240;
+	goto on_return;
+    }
+
+    if (pool_rx_capacity < size) {
+	PJ_LOG(3,(THIS_FILE, "   error: rdata pool is %d bytes, expecting "
+			     "at least %d",
+		  (int)pool_rx_capacity, (int)size));
+	rc = -250;
+	goto on_return;
+    }
+
+on_return:
+    pj_sock_close(sock);
+    pjsip_endpt_unregister_module(endpt, &udp_test_module);
+    return rc;
+#else
+    PJ_UNUSED_ARG(udp_tp);
+    return 0;
+#endif
+}
+
 /*
  * UDP transport test.
  */
@@ -97,6 +436,12 @@ int transport_udp_test(void)
 		"Tests were performed on local machine only)");
 
 
+    /* Stateless fast response test. */
+    status = transport_fast_response_test(
+				"sip:alice@127.0.0.1:"TEST_UDP_PORT_STR);
+    if (status != 0)
+	return status;
+
     /* Multi-threaded round-trip test. */
     status = transport_rt_test(PJSIP_TRANSPORT_UDP, tp, 
 			       "sip:alice@127.0.0.1:"TEST_UDP_PORT_STR, 
@@ -107,6 +452,16 @@ int transport_udp_test(void)
     if (pkt_lost != 0)
 	PJ_LOG(3,(THIS_FILE, "   note: %d packet(s) was lost", pkt_lost));
 
+    /* Message size statistics test. */
+    status = size_stat_test(udp_tp);
+    if (status != 0)
+	return status;
+
+    /* Receive buffer pool replacement test. */
+    status = rdata_pool_test(udp_tp);
+    if (status != 0)
+	return status;
+
     /* Check again that reference counter is 1. */
     if (pj_atomic_get(udp_tp->ref_cnt) != 1)
 	return -80;
@@ -123,6 +478,11 @@ int transport_udp_test(void)
     PJ_LOG(3,(THIS_FILE, "   Flushing events, 1 second..."));
     flush_events(1000);
 
+    /* Same thing with multiple sockets */
+    status = udp_multi_sock_test();
+    if (status != 0)
+	return status;
+
     /* Done */
     return 0;
 }
@@ -26,12 +26,20 @@
 
 static pjsip_module mod_tsx_user;
 
-static int uac_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
+/* Get the number of bytes held by the pools which are in use. */
+static pj_size_t get_used_mem(void)
+{
+    return caching_pool.used_size - caching_pool.capacity;
+}
+
+static int uac_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed,
+			 unsigned *p_mem)
 {
     unsigned i;
     pjsip_tx_data *request;
     pjsip_transaction **tsx;
     pj_timestamp t1, t2, elapsed;
+    pj_size_t mem;
     pjsip_via_hdr *via;
     pj_status_t status;
 
@@ -60,6 +68,7 @@ static int uac_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
     mod_tsx_user.id = -1;
 
     /* Benchmark */
+    mem = get_used_mem();
     elapsed.u64 = 0;
     pj_get_timestamp(&t1);
     for (i=0; i<working_set; ++i) {
@@ -74,6 +83,7 @@ static int uac_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
     pj_add_timestamp(&elapsed, &t2);
 
     p_elapsed->u64 = elapsed.u64;
+    *p_mem = (unsigned)((get_used_mem() - mem) / working_set);
     status = PJ_SUCCESS;
     
 on_error:
@@ -95,7 +105,8 @@ on_error:
 
 
 
-static int uas_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
+static int uas_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed,
+			 unsigned *p_mem)
 {
     unsigned i;
     pjsip_tx_data *request;
@@ -104,6 +115,7 @@ static int uas_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
     pj_sockaddr_in remote;
     pjsip_transaction **tsx;
     pj_timestamp t1, t2, elapsed;
+    pj_size_t mem;
     char branch_buf[80] = PJSIP_RFC3261_BRANCH_ID "0000000000";
     pj_status_t status;
 
@@ -160,6 +172,7 @@ static int uas_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
 
 
     /* Benchmark */
+    mem = get_used_mem();
     elapsed.u64 = 0;
     pj_get_timestamp(&t1);
     for (i=0; i<working_set; ++i) {
@@ -177,6 +190,7 @@ static int uas_tsx_bench(unsigned working_set, pj_timestamp *p_elapsed)
     pj_add_timestamp(&elapsed, &t2);
 
     p_elapsed->u64 = elapsed.u64;
+    *p_mem = (unsigned)((get_used_mem() - mem) / working_set);
     status = PJ_SUCCESS;
     
 on_error:
@@ -202,7 +216,7 @@ on_error:
 int tsx_bench(void)
 {
     enum { WORKING_SET=10000, REPEAT = 4 };
-    unsigned i, speed;
+    unsigned i, speed, mem;
     pj_timestamp usec[REPEAT], min, freq;
     char desc[250];
     int status;
@@ -221,7 +235,7 @@ int tsx_bench(void)
 		  i+1, REPEAT));
 	PJ_LOG(3,(THIS_FILE, "    number of current tsx: %d",
 		  pjsip_tsx_layer_get_tsx_count()));
-	status = uac_tsx_bench(WORKING_SET, &usec[i]);
+	status = uac_tsx_bench(WORKING_SET, &usec[i], &mem);
 	if (status != PJ_SUCCESS)
 	    return status;
     }
@@ -250,6 +264,15 @@ int tsx_bench(void)
     report_ival("create-uac-tsx-per-sec", 
 		speed, "tsx/sec", desc);
 
+    /* Write memory usage */
+    PJ_LOG(3,(THIS_FILE, "    UAC uses %d bytes/tsx", mem));
+
+    pj_ansi_sprintf(desc, "Pool memory used by each of %d simultaneous UAC "
+			  "transactions, excluding the request.",
+			  WORKING_SET);
+
+    report_ival("create-uac-tsx-mem", mem, "bytes", desc);
+
 
 
     /*
@@ -261,7 +284,7 @@ int tsx_bench(void)
 		  i+1, REPEAT));
 	PJ_LOG(3,(THIS_FILE, "    number of current tsx: %d",
 		  pjsip_tsx_layer_get_tsx_count()));
-	status = uas_tsx_bench(WORKING_SET, &usec[i]);
+	status = uas_tsx_bench(WORKING_SET, &usec[i], &mem);
 	if (status != PJ_SUCCESS)
 	    return status;
     }
@@ -290,6 +313,15 @@ int tsx_bench(void)
     report_ival("create-uas-tsx-per-sec", 
 		speed, "tsx/sec", desc);
 
+    /* Write memory usage */
+    PJ_LOG(3,(THIS_FILE, "    UAS uses %d bytes/tsx", mem));
+
+    pj_ansi_sprintf(desc, "Pool memory used by each of %d simultaneous UAS "
+			  "transactions, excluding the request.",
+			  WORKING_SET);
+
+    report_ival("create-uas-tsx-mem", mem, "bytes", desc);
+
     return PJ_SUCCESS;
 }
 
@@ -74,6 +74,12 @@
  ** TEST9_BRANCH_ID
  **	Test failed INVITE transaction with provisional response.
  **
+ ** TEST10_BRANCH_ID
+ **	Test many transactions with retransmissions due at the same time.
+ **	Message receiver will verify that every transaction retransmits in
+ **	time, including those which don't fit in one batch of the
+ **	retransmission sweep.
+ **
  **	
  *****************************************************************************
  */
@@ -87,10 +93,12 @@ static char *TEST6_BRANCH_ID = PJSIP_RFC3261_BRANCH_ID "-UAC-Test6";
 static char *TEST7_BRANCH_ID = PJSIP_RFC3261_BRANCH_ID "-UAC-Test7";
 static char *TEST8_BRANCH_ID = PJSIP_RFC3261_BRANCH_ID "-UAC-Test8";
 static char *TEST9_BRANCH_ID = PJSIP_RFC3261_BRANCH_ID "-UAC-Test9";
+static char *TEST10_BRANCH_ID = PJSIP_RFC3261_BRANCH_ID "-UAC-Test10";
 
 #define      TEST1_ALLOWED_DIFF	    (150)
 #define      TEST4_RETRANSMIT_CNT   3
 #define	     TEST5_RETRANSMIT_CNT   3
+#define	     TEST10_TSX_CNT	    100
 
 static char TARGET_URI[128];
 static char FROM_URI[128];
@@ -141,6 +149,11 @@ static int recv_count;
 static pj_time_val recv_last;
 static pj_bool_t test_complete;
 
+/* Per transaction receive state of TEST10_BRANCH_ID. */
+static unsigned test10_recv_cnt[TEST10_TSX_CNT];
+static pj_time_val test10_recv_first[TEST10_TSX_CNT];
+static unsigned test10_retrans_cnt;
+
 /* Loop transport instance. */
 static pjsip_transport *loop;
 
@@ -935,6 +948,54 @@ static pj_bool_t msg_receiver_on_rx_request(pjsip_rx_data *rdata)
 
 	return PJ_TRUE;
 
+    } else
+    if (pj_strnicmp2(&rdata->msg_info.via->branch_param, TEST10_BRANCH_ID,
+		     pj_ansi_strlen(TEST10_BRANCH_ID)) == 0)
+    {
+	/*
+	 * The TEST10_BRANCH_ID test verifies that the first retransmission
+	 * of each transaction is received in time. The branch param is
+	 * suffixed with the transaction index.
+	 */
+	pj_str_t idx_str;
+	unsigned idx;
+
+	idx_str = rdata->msg_info.via->branch_param;
+	idx_str.ptr += pj_ansi_strlen(TEST10_BRANCH_ID) + 1;
+	idx_str.slen -= pj_ansi_strlen(TEST10_BRANCH_ID) + 1;
+	idx = (unsigned) pj_strtoul(&idx_str);
+	if (idx >= TEST10_TSX_CNT) {
+	    PJ_LOG(3,(THIS_FILE, "    error: invalid transaction index %d",
+		      idx));
+	    test_complete = -1300;
+	    return PJ_TRUE;
+	}
+
+	if (test10_recv_cnt[idx] == 0) {
+	    test10_recv_first[idx] = rdata->pkt_info.timestamp;
+	} else if (test10_recv_cnt[idx] == 1) {
+	    pj_time_val now;
+	    unsigned msec_elapsed;
+
+	    now = rdata->pkt_info.timestamp;
+	    PJ_TIME_VAL_SUB(now, test10_recv_first[idx]);
+	    msec_elapsed = now.sec*1000 + now.msec;
+
+	    if (DIFF(pjsip_cfg()->tsx.t1, msec_elapsed) > TEST1_ALLOWED_DIFF) {
+		PJ_LOG(3,(THIS_FILE,
+			  "    error: expecting retransmission of tsx %d in "
+			  "%d ms, received in %d ms",
+			  idx, pjsip_cfg()->tsx.t1, msec_elapsed));
+		test_complete = -1310;
+	    } else if (++test10_retrans_cnt == TEST10_TSX_CNT &&
+		       test_complete == 0)
+	    {
+		test_complete = 1;
+	    }
+	}
+	++test10_recv_cnt[idx];
+
+	return PJ_TRUE;
     }
 
     return PJ_FALSE;
@@ -1337,6 +1398,132 @@ static int perform_generic_test( const char *title,
 }
 
 
+/*****************************************************************************
+ **
+ ** TEST10_BRANCH_ID: Many concurrent retransmissions
+ **
+ ** Start more transactions at once than the retransmission sweep takes in
+ ** one batch. Remote will not answer them, and all of them must still
+ ** retransmit in time, even when the sweep runs late because the endpoint
+ ** has been busy.
+ **
+ *****************************************************************************
+ */
+static int tsx_concurrent_retransmit_test(void)
+{
+    pj_pool_t *pool;
+    pj_str_t target, from, *tsx_key;
+    pj_time_val timeout;
+    int i, enabled, status = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  test10: %d concurrent retransmissions test",
+	      TEST10_TSX_CNT));
+
+    /* Message printing makes incorrect timing */
+    enabled = msg_logger_set_enabled(0);
+
+    pool = pjsip_endpt_create_pool(endpt, "test10", 4000, 4000);
+    tsx_key = (pj_str_t*) pj_pool_calloc(pool, TEST10_TSX_CNT,
+					 sizeof(pj_str_t));
+
+    /* Reset test. */
+    pj_bzero(test10_recv_cnt, sizeof(test10_recv_cnt));
+    test10_retrans_cnt = 0;
+    test_complete = 0;
+
+    target = pj_str(TARGET_URI);
+    from = pj_str(FROM_URI);
+
+    /* Start all transactions. */
+    for (i=0; i<TEST10_TSX_CNT; ++i) {
+	pjsip_tx_data *tdata;
+	pjsip_transaction *tsx;
+	pjsip_via_hdr *via;
+	char branch[64];
+
+	status = pjsip_endpt_create_request(endpt, &pjsip_options_method,
+					    &target, &from, &target, NULL,
+					    NULL, -1, NULL, &tdata);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   Error: unable to create request", status);
+	    status = -1320;
+	    goto on_return;
+	}
+
+	pj_ansi_snprintf(branch, sizeof(branch), "%s-%d",
+			 TEST10_BRANCH_ID, i);
+	via = (pjsip_via_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA,
+						  NULL);
+	pj_strdup2(tdata->pool, &via->branch_param, branch);
+
+	status = pjsip_tsx_create_uac(&tsx_user, tdata, &tsx);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   Error: unable to create UAC transaction", status);
+	    pjsip_tx_data_dec_ref(tdata);
+	    status = -1330;
+	    goto on_return;
+	}
+
+	pj_strdup(pool, &tsx_key[i], &tsx->transaction_key);
+
+	status = pjsip_tsx_send_msg(tsx, NULL);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   Error: unable to send request", status);
+	    pjsip_tx_data_dec_ref(tdata);
+	    status = -1340;
+	    goto on_return;
+	}
+    }
+
+    /* Keep the endpoint busy until the retransmissions are overdue, so
+     * that they are swept in several batches from a late slot.
+     */
+    pj_thread_sleep(pjsip_cfg()->tsx.t1 + TEST1_ALLOWED_DIFF/2);
+
+    /* Wait until all transactions have retransmitted. */
+    pj_gettimeofday(&timeout);
+    timeout.sec += pjsip_cfg()->tsx.t1 / 1000 + 5;
+
+    while (!test_complete) {
+	pj_time_val now, poll_delay = {0, 10};
+
+	pjsip_endpt_handle_events(endpt, &poll_delay);
+
+	pj_gettimeofday(&now);
+	if (PJ_TIME_VAL_GT(now, timeout)) {
+	    PJ_LOG(3,(THIS_FILE, "   Error: only %d of %d transactions have "
+		      "retransmitted", test10_retrans_cnt, TEST10_TSX_CNT));
+	    test_complete = -1350;
+	}
+    }
+
+    status = (test_complete < 0) ? test_complete : 0;
+
+on_return:
+    /* Terminate the transactions. */
+    for (i=0; i<TEST10_TSX_CNT; ++i) {
+	pjsip_transaction *tsx;
+
+	if (tsx_key[i].slen == 0)
+	    continue;
+
+	tsx = pjsip_tsx_layer_find_tsx(&tsx_key[i], PJ_TRUE);
+	if (tsx) {
+	    pjsip_tsx_terminate(tsx, PJSIP_SC_REQUEST_TERMINATED);
+	    pj_grp_lock_release(tsx->grp_lock);
+	}
+    }
+    flush_events(500);
+
+    pj_pool_release(pool);
+
+    /* Restore msg logger. */
+    msg_logger_set_enabled(enabled);
+
+    return status;
+}
+
+
 /*****************************************************************************
  **
  ** UAC Transaction Test.
@@ -1439,6 +1626,15 @@ int tsx_uac_test(struct tsx_test_param *param)
     if (status != 0)
 	return status;
 
+    /* TEST10_BRANCH_ID: Many concurrent retransmissions.
+     *			 Only applies to loop transport.
+     */
+    if (test_param->type == PJSIP_TRANSPORT_LOOP_DGRAM) {
+	status = tsx_concurrent_retransmit_test();
+	if (status != 0)
+	    return status;
+    }
+
     pjsip_transport_dec_ref(loop);
     flush_events(500);
 
@@ -625,6 +625,252 @@ static int txdata_test_uri_params(void)
 }
 
 
+/*
+ * This tests re-encoding of the message after some of its headers have
+ * been invalidated with pjsip_tx_data_invalidate_hdr().
+ */
+static int check_encoded(pjsip_tx_data *tdata, const char *title)
+{
+    char msgbuf[PJSIP_MAX_PKT_LEN];
+    pj_ssize_t len;
+    pj_status_t status;
+
+    status = pjsip_tx_data_encode(tdata);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to encode message", status);
+	return -500;
+    }
+
+    len = pjsip_msg_print(tdata->msg, msgbuf, sizeof(msgbuf));
+    if (len < 1) {
+	PJ_LOG(3,(THIS_FILE, "   error: printing message"));
+	return -510;
+    }
+
+    if (tdata->buf.cur - tdata->buf.start != len ||
+	pj_memcmp(tdata->buf.start, msgbuf, len) != 0)
+    {
+	PJ_LOG(3,(THIS_FILE, "   error: %s: re-encoded message differs:\n"
+		  "%.*s\nexpecting:\n%.*s", title,
+		  (int)(tdata->buf.cur - tdata->buf.start), tdata->buf.start,
+		  (int)len, msgbuf));
+	return -520;
+    }
+
+    return 0;
+}
+
+static int txdata_test_reencode(void)
+{
+    enum { RR_CNT = 8 };
+    pj_str_t target = pj_str("sip:bob@example.com");
+    pj_str_t from = pj_str("\"Alice\" <sip:alice@example.com>");
+    pj_str_t to = pj_str("\"Bob\" <sip:bob@example.com>");
+    pj_str_t contact = pj_str("<sip:alice@192.168.0.1:5060>");
+    pj_str_t body = pj_str(
+	"v=0\r\n"
+	"o=alice 2890844526 2890844526 IN IP4 host.example.com\r\n"
+	"s=-\r\n"
+	"c=IN IP4 192.168.0.1\r\n"
+	"t=0 0\r\n"
+	"m=audio 49170 RTP/AVP 0 8 97\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:97 iLBC/8000\r\n"
+	"m=video 51372 RTP/AVP 31 32\r\n"
+	"a=rtpmap:31 H261/90000\r\n"
+	"a=rtpmap:32 MPV/90000\r\n");
+    pj_str_t rr = pj_str("<sip:proxy.example.com;lr>");
+    pj_str_t hname = pj_str("Record-Route");
+    pj_str_t subject_name = pj_str("Subject");
+    pj_str_t subject = pj_str("Re-encoding test");
+    pjsip_tx_data *tdata;
+    pjsip_via_hdr *via;
+    pjsip_cseq_hdr *cseq;
+    pjsip_hdr *hdr;
+    pj_timestamp t1, t2, full, incr;
+    unsigned i;
+    int rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "   re-encoding message after header change"));
+
+    status = pjsip_endpt_create_request(endpt, &pjsip_invite_method, &target,
+					&from, &to, &contact, NULL, 10, &body,
+					&tdata);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create request", status);
+	return -400;
+    }
+
+    for (i=0; i<RR_CNT; ++i) {
+	hdr = (pjsip_hdr*) pjsip_parse_hdr(tdata->pool, &hname, rr.ptr,
+					   rr.slen, NULL);
+	if (!hdr) {
+	    rc = -405;
+	    goto on_return;
+	}
+	pjsip_msg_add_hdr(tdata->msg, hdr);
+    }
+
+    via = HFIND(tdata->msg, via, VIA);
+    via->transport = pj_str("UDP");
+    via->sent_by.host = pj_str("192.168.0.1");
+    via->branch_param = pj_str("z9hG4bK-first");
+    cseq = HFIND(tdata->msg, cseq, CSEQ);
+
+    rc = check_encoded(tdata, "initial print");
+    if (rc != 0)
+	goto on_return;
+
+    /* New Via branch and CSeq */
+    via->branch_param = pj_str("z9hG4bK-second-and-longer");
+    pjsip_tx_data_invalidate_hdr(tdata, via);
+    cseq->cseq = 11;
+    pjsip_tx_data_invalidate_hdr(tdata, cseq);
+    if (pjsip_tx_data_is_valid(tdata)) {
+	PJ_LOG(3,(THIS_FILE, "   error: buffer must be invalid"));
+	rc = -410;
+	goto on_return;
+    }
+    rc = check_encoded(tdata, "Via and CSeq change");
+    if (rc != 0)
+	goto on_return;
+
+    /* Add and remove headers, and change the request URI */
+    hdr = (pjsip_hdr*)
+	  pjsip_generic_string_hdr_create(tdata->pool, &subject_name,
+					  &subject);
+    pjsip_msg_insert_first_hdr(tdata->msg, hdr);
+    pj_list_erase(pjsip_msg_find_hdr(tdata->msg, PJSIP_H_RECORD_ROUTE, NULL));
+    tdata->msg->line.req.uri = (pjsip_uri*)
+	pjsip_parse_uri(tdata->pool, contact.ptr, contact.slen, 0);
+    via->branch_param = pj_str("z9hG4bK-x");
+    pjsip_tx_data_invalidate_hdr(tdata, via);
+    rc = check_encoded(tdata, "header list change");
+    if (rc != 0)
+	goto on_return;
+
+    /* New body */
+    body = pj_str("Hello world!");
+    tdata->msg->body = pjsip_msg_body_create(tdata->pool,
+					     &tdata->msg->body->content_type.type,
+					     &tdata->msg->body->content_type.subtype,
+					     &body);
+    pjsip_tx_data_invalidate_hdr(tdata, via);
+    rc = check_encoded(tdata, "body change");
+    if (rc != 0)
+	goto on_return;
+
+    /* Compare the cost of full and incremental re-encoding */
+    full.u64 = incr.u64 = 0;
+    for (i=0; i<LOOP; ++i) {
+	pj_get_timestamp(&t1);
+	pjsip_tx_data_invalidate_msg(tdata);
+	pjsip_tx_data_encode(tdata);
+	pj_get_timestamp(&t2);
+	pj_add_timestamp(&full, &t2);
+	pj_sub_timestamp(&full, &t1);
+
+	pj_get_timestamp(&t1);
+	pjsip_tx_data_invalidate_hdr(tdata, via);
+	pjsip_tx_data_encode(tdata);
+	pj_get_timestamp(&t2);
+	pj_add_timestamp(&incr, &t2);
+	pj_sub_timestamp(&incr, &t1);
+    }
+
+    rc = check_encoded(tdata, "after benchmark");
+    if (rc != 0)
+	goto on_return;
+
+    t1.u64 = 0;
+    PJ_LOG(3,(THIS_FILE, "    %d re-encodings: full print %u usec, "
+	      "Via only %u usec", LOOP, pj_elapsed_usec(&t1, &full),
+	      pj_elapsed_usec(&t1, &incr)));
+
+on_return:
+    pjsip_tx_data_dec_ref(tdata);
+    return rc;
+}
+
+
+/*
+ * This tests encoding of messages larger than PJSIP_MAX_PKT_LEN.
+ */
+static int txdata_test_large_body(void)
+{
+    pj_str_t target = pj_str("sip:bob@example.com");
+    pj_str_t from = pj_str("<sip:alice@example.com>");
+    pj_str_t type = pj_str("text");
+    pj_str_t subtype = pj_str("plain");
+    pj_str_t body;
+    pjsip_tx_data *tdata;
+    pj_ssize_t len;
+    int rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "   encoding message with large body"));
+
+    status = pjsip_endpt_create_request(endpt, &pjsip_options_method,
+					&target, &from, &target, NULL, NULL,
+					-1, NULL, &tdata);
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to create request", status);
+	return -600;
+    }
+
+    /* Body that is larger than PJSIP_MAX_PKT_LEN but still fits
+     * PJSIP_MAX_STREAM_TX_LEN.
+     */
+    body.slen = PJ_MIN(PJSIP_MAX_PKT_LEN * 2, PJSIP_MAX_STREAM_TX_LEN - 1000);
+    body.ptr = (char*) pj_pool_alloc(tdata->pool, body.slen);
+    pj_memset(body.ptr, 'x', body.slen);
+    tdata->msg->body = pjsip_msg_body_create(tdata->pool, &type, &subtype,
+					     &body);
+
+    status = pjsip_tx_data_encode(tdata);
+    len = tdata->buf.cur - tdata->buf.start;
+    if (PJSIP_MAX_STREAM_TX_LEN <= PJSIP_MAX_PKT_LEN) {
+	if (status != PJSIP_EMSGTOOLONG) {
+	    PJ_LOG(3,(THIS_FILE, "   error: expecting PJSIP_EMSGTOOLONG"));
+	    rc = -610;
+	}
+	goto on_return;
+    }
+    if (status != PJ_SUCCESS) {
+	app_perror("   error: unable to encode large message", status);
+	rc = -620;
+	goto on_return;
+    }
+    if (len <= body.slen ||
+	pj_memcmp(tdata->buf.cur - body.slen, body.ptr, body.slen) != 0)
+    {
+	PJ_LOG(3,(THIS_FILE, "   error: incorrect large message"));
+	rc = -630;
+	goto on_return;
+    }
+
+    /* Body larger than PJSIP_MAX_STREAM_TX_LEN must be rejected */
+    body.slen = PJSIP_MAX_STREAM_TX_LEN;
+    body.ptr = (char*) pj_pool_alloc(tdata->pool, body.slen);
+    pj_memset(body.ptr, 'x', body.slen);
+    tdata->msg->body = pjsip_msg_body_create(tdata->pool, &type, &subtype,
+					     &body);
+    pjsip_tx_data_invalidate_msg(tdata);
+    status = pjsip_tx_data_encode(tdata);
+    if (status != PJSIP_EMSGTOOLONG) {
+	PJ_LOG(3,(THIS_FILE, "   error: expecting PJSIP_EMSGTOOLONG"));
+	rc = -640;
+	goto on_return;
+    }
+
+on_return:
+    pjsip_tx_data_dec_ref(tdata);
+    return rc;
+}
+
+
 /*
  * create request benchmark
  */
@@ -796,6 +1042,14 @@ int txdata_test(void)
     if (status != 0)
 	return status;
 
+    status = txdata_test_reencode();
+    if (status != 0)
+	return status;
+
+    status = txdata_test_large_body();
+    if (status != 0)
+	return status;
+
 
     /*
      * Benchmark create_request()